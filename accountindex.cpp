@@ -0,0 +1,201 @@
+#include "accountindex.h"
+
+#include <limits>
+
+namespace {
+
+const qint64 kMSecsPerDay = 24 * 3600 * 1000;
+
+qint64 dayOf(qint64 timestamp)
+{
+    // Floor division so pre-1970 timestamps land in the right bucket
+    return timestamp >= 0 ? timestamp / kMSecsPerDay : -((-timestamp - 1) / kMSecsPerDay) - 1;
+}
+
+} // namespace
+
+bool AccountIndex::PostingKey::operator<(const PostingKey& other) const
+{
+    if (timestamp != other.timestamp) {
+        return timestamp < other.timestamp;
+    }
+    if (sequence != other.sequence) {
+        return sequence < other.sequence;
+    }
+    return side < other.side;
+}
+
+// ==================== DayTree ====================
+
+AccountIndex::DayTree::DayTree()
+    : m_firstDay(0)
+{
+}
+
+void AccountIndex::DayTree::add(qint64 day, double amount)
+{
+    for (qint64 i = day - m_firstDay + 1; i <= qint64(m_tree.size()); i += i & -i) {
+        m_tree[size_t(i - 1)] += amount;
+    }
+}
+
+double AccountIndex::DayTree::sumBefore(qint64 day) const
+{
+    qint64 i = qBound<qint64>(0, day - m_firstDay, qint64(m_tree.size()));
+    double sum = 0.0;
+    for (; i > 0; i -= i & -i) {
+        sum += m_tree[size_t(i - 1)];
+    }
+    return sum;
+}
+
+bool AccountIndex::DayTree::covers(qint64 day) const
+{
+    return day >= m_firstDay && day < m_firstDay + qint64(m_tree.size());
+}
+
+void AccountIndex::DayTree::reset(qint64 firstDay, qint64 dayCount)
+{
+    m_firstDay = firstDay;
+    m_tree.assign(size_t(dayCount), 0.0);
+}
+
+qint64 AccountIndex::DayTree::bytesUsed() const
+{
+    return qint64(m_tree.capacity() * sizeof(double));
+}
+
+// ==================== AccountIndex ====================
+
+void AccountIndex::addTransaction(quint32 sequence, const Transaction& transaction)
+{
+    qint64 timestamp = transaction.getTimestampMSecs();
+    if (timestamp == Transaction::InvalidTimestamp) {
+        return;
+    }
+    post(transaction.getFromAccount(), {timestamp, sequence, 0}, -transaction.getAmount());
+    post(transaction.getToAccount(), {timestamp, sequence, 1}, transaction.getAmount());
+}
+
+void AccountIndex::removeTransaction(quint32 sequence, const Transaction& transaction)
+{
+    qint64 timestamp = transaction.getTimestampMSecs();
+    if (timestamp == Transaction::InvalidTimestamp) {
+        return;
+    }
+    unpost(transaction.getFromAccount(), {timestamp, sequence, 0}, -transaction.getAmount());
+    unpost(transaction.getToAccount(), {timestamp, sequence, 1}, transaction.getAmount());
+}
+
+void AccountIndex::clear()
+{
+    m_accounts.clear();
+}
+
+qint64 AccountIndex::bytesUsed() const
+{
+    // std::map nodes carry a colour and three links ahead of the value
+    const qint64 postingNode = 4 * qint64(sizeof(void*)) + qint64(sizeof(PostingKey) + sizeof(double));
+    qint64 bytes = m_accounts.capacity() * qint64(sizeof(QString) + sizeof(Account) + 1);
+    for (auto it = m_accounts.cbegin(); it != m_accounts.cend(); ++it) {
+        bytes += qint64(it.value().postings.size()) * postingNode;
+    }
+    return bytes;
+}
+
+qint64 AccountIndex::rollupBytes() const
+{
+    qint64 bytes = 0;
+    for (auto it = m_accounts.cbegin(); it != m_accounts.cend(); ++it) {
+        bytes += it.value().days.bytesUsed();
+    }
+    return bytes;
+}
+
+QStringList AccountIndex::accounts() const
+{
+    QStringList names = m_accounts.keys();
+    names.sort();
+    return names;
+}
+
+double AccountIndex::balanceAt(const QString& account, qint64 timestamp) const
+{
+    auto it = m_accounts.constFind(account);
+    return it == m_accounts.constEnd() ? 0.0 : balanceAt(it.value(), timestamp);
+}
+
+QList<AccountPosting> AccountIndex::statement(const QString& account, qint64 start, qint64 end) const
+{
+    QList<AccountPosting> lines;
+    auto it = m_accounts.constFind(account);
+    if (it == m_accounts.constEnd() || start > end) {
+        return lines;
+    }
+
+    const Account& entry = it.value();
+    double balance = start == std::numeric_limits<qint64>::min() ? 0.0 : balanceAt(entry, start - 1);
+
+    auto first = entry.postings.lower_bound({start, 0, 0});
+    for (auto posting = first; posting != entry.postings.end() && posting->first.timestamp <= end; ++posting) {
+        balance += posting->second;
+        lines.append(AccountPosting{posting->first.sequence, posting->first.timestamp, posting->second, balance});
+    }
+    return lines;
+}
+
+void AccountIndex::post(const QString& account, const PostingKey& key, double amount)
+{
+    Account& entry = m_accounts[account];
+    entry.postings.emplace(key, amount);
+
+    qint64 day = dayOf(key.timestamp);
+    if (!entry.days.covers(day)) {
+        rebuildDays(entry, day);
+    } else {
+        entry.days.add(day, amount);
+    }
+}
+
+void AccountIndex::unpost(const QString& account, const PostingKey& key, double amount)
+{
+    auto it = m_accounts.find(account);
+    if (it == m_accounts.end() || it.value().postings.erase(key) == 0) {
+        return;
+    }
+
+    Account& entry = it.value();
+    if (entry.postings.empty()) {
+        m_accounts.erase(it);
+        return;
+    }
+    entry.days.add(dayOf(key.timestamp), -amount);
+}
+
+// Re-creates the day tree with room to spare on both sides of the range
+// now in use, so that growth is amortized over many inserts
+void AccountIndex::rebuildDays(Account& account, qint64 day)
+{
+    qint64 firstDay = qMin(day, dayOf(account.postings.begin()->first.timestamp));
+    qint64 lastDay = qMax(day, dayOf(account.postings.rbegin()->first.timestamp));
+    qint64 span = lastDay - firstDay + 1;
+    qint64 slack = qMax<qint64>(span, 32);
+
+    account.days.reset(firstDay - slack, span + 2 * slack);
+    for (const auto& posting : account.postings) {
+        account.days.add(dayOf(posting.first.timestamp), posting.second);
+    }
+}
+
+double AccountIndex::balanceAt(const Account& account, qint64 timestamp)
+{
+    qint64 day = dayOf(timestamp);
+    double balance = account.days.sumBefore(day);
+
+    // Whole days come from the tree, the partial day from the postings
+    auto it = account.postings.lower_bound({day * kMSecsPerDay, 0, 0});
+    for (; it != account.postings.end() && it->first.timestamp <= timestamp; ++it) {
+        balance += it->second;
+    }
+    return balance;
+}
@@ -0,0 +1,79 @@
+#ifndef ACCOUNTINDEX_H
+#define ACCOUNTINDEX_H
+
+#include "transaction.h"
+#include <QHash>
+#include <QList>
+#include <QStringList>
+
+#include <map>
+#include <vector>
+
+struct AccountPosting {
+    quint32 sequence;   // row in TransactionManager's store
+    qint64 timestamp;
+    double amount;      // signed: positive into the account, negative out of it
+    double balance;     // running balance after this posting
+};
+
+// Secondary index from account name to its postings in time order.
+//
+// Every dated transaction posts -amount to its from-account and +amount to
+// its to-account. Each account keeps its postings in an ordered map plus a
+// Fenwick tree of per-day sums, so balance-at-time is O(log n) and a
+// statement for a date range is a single ordered range read.
+class AccountIndex
+{
+public:
+    void addTransaction(quint32 sequence, const Transaction& transaction);
+    void removeTransaction(quint32 sequence, const Transaction& transaction);
+    void clear();
+
+    QStringList accounts() const;
+    double balanceAt(const QString& account, qint64 timestamp) const;
+    QList<AccountPosting> statement(const QString& account, qint64 start, qint64 end) const;
+
+    // Estimated heap bytes: postings and account table, and the per-day
+    // rollup trees
+    qint64 bytesUsed() const;
+    qint64 rollupBytes() const;
+
+private:
+    struct PostingKey {
+        qint64 timestamp;
+        quint32 sequence;
+        quint8 side;   // 0 = from, 1 = to (an account may be both)
+
+        bool operator<(const PostingKey& other) const;
+    };
+
+    // Prefix sums over whole days, grown on demand
+    class DayTree
+    {
+    public:
+        DayTree();
+        void add(qint64 day, double amount);
+        double sumBefore(qint64 day) const;
+        bool covers(qint64 day) const;
+        void reset(qint64 firstDay, qint64 dayCount);
+        qint64 bytesUsed() const;
+
+    private:
+        qint64 m_firstDay;
+        std::vector<double> m_tree;
+    };
+
+    struct Account {
+        std::map<PostingKey, double> postings;
+        DayTree days;
+    };
+
+    void post(const QString& account, const PostingKey& key, double amount);
+    void unpost(const QString& account, const PostingKey& key, double amount);
+    static void rebuildDays(Account& account, qint64 day);
+    static double balanceAt(const Account& account, qint64 timestamp);
+
+    QHash<QString, Account> m_accounts;
+};
+
+#endif // ACCOUNTINDEX_H
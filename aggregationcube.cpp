@@ -0,0 +1,384 @@
+#include "aggregationcube.h"
+#include <QDateTime>
+
+#include <limits>
+
+namespace {
+
+// Above this many cells only the non-empty ones are stored
+const quint64 kMaxDenseCells = quint64(1) << 22;
+
+bool isTime(AggregationCube::Dimension dimension)
+{
+    return dimension == AggregationCube::Day || dimension == AggregationCube::Month
+            || dimension == AggregationCube::Year;
+}
+
+// Labels are prefixes of one another: "yyyy-MM-dd" -> "yyyy-MM" -> "yyyy"
+int labelLength(AggregationCube::Dimension dimension)
+{
+    switch (dimension) {
+    case AggregationCube::Day:   return 10;
+    case AggregationCube::Month: return 7;
+    default:                     return 4;
+    }
+}
+
+QString timeFormat(AggregationCube::Dimension dimension)
+{
+    switch (dimension) {
+    case AggregationCube::Day:   return QStringLiteral("yyyy-MM-dd");
+    case AggregationCube::Month: return QStringLiteral("yyyy-MM");
+    default:                     return QStringLiteral("yyyy");
+    }
+}
+
+QString stringField(AggregationCube::Dimension dimension, const Transaction& transaction)
+{
+    switch (dimension) {
+    case AggregationCube::Category:    return transaction.getCategory();
+    case AggregationCube::Method:      return transaction.getMethod();
+    case AggregationCube::FromAccount: return transaction.getFromAccount();
+    default:                           return transaction.getToAccount();
+    }
+}
+
+// Per-axis lookup caches for the build pass
+struct AxisEncoder {
+    // Pooled strings share one payload, so most rows resolve by pointer. The
+    // input list keeps every payload alive for the whole pass, so a pointer
+    // cannot be reused for different text.
+    QHash<const void*, int> byPayload;
+    int typeMembers[2] = {-1, -1};
+    qint64 dayStart = 1;
+    qint64 dayEnd = 0;
+    int dayMember = -1;
+};
+
+} // namespace
+
+void CubeCell::merge(const CubeCell& other)
+{
+    income += other.income;
+    expense += other.expense;
+    count += other.count;
+}
+
+int AggregationCube::Axis::memberFor(const QString& label)
+{
+    auto it = index.constFind(label);
+    if (it != index.constEnd()) {
+        return it.value();
+    }
+    const int member = int(labels.size());
+    labels.append(label);
+    index.insert(label, member);
+    return member;
+}
+
+template <typename Function>
+void AggregationCube::forEachCell(Function function) const
+{
+    if (m_dense) {
+        for (quint64 linear = 0; linear < m_denseCells.size(); ++linear) {
+            if (m_denseCells[linear].count > 0) {
+                function(linear, m_denseCells[linear]);
+            }
+        }
+    } else {
+        for (auto it = m_sparseCells.cbegin(); it != m_sparseCells.cend(); ++it) {
+            function(it.key(), it.value());
+        }
+    }
+}
+
+AggregationCube::AggregationCube()
+    : m_cellCount(0)
+    , m_valid(false)
+    , m_dense(true)
+{
+}
+
+AggregationCube::AggregationCube(const QList<Transaction>& transactions, const QList<Dimension>& dimensions)
+    : m_cellCount(0)
+    , m_valid(true)
+    , m_dense(true)
+{
+    for (Dimension dimension : dimensions) {
+        m_axes.append(Axis{dimension, QStringList(), QHash<QString, int>()});
+    }
+
+    // Encode every row's coordinates first: the member counts, and with them
+    // the cell layout, are only known once all rows are seen
+    const int axisCount = int(m_axes.size());
+    std::vector<AxisEncoder> encoders(axisCount);
+    std::vector<int> coordinates(size_t(transactions.size()) * axisCount);
+
+    for (qsizetype row = 0; row < transactions.size(); ++row) {
+        const Transaction& transaction = transactions.at(row);
+        int* members = coordinates.data() + row * axisCount;
+
+        for (int axis = 0; axis < axisCount; ++axis) {
+            Axis& target = m_axes[axis];
+            AxisEncoder& encoder = encoders[axis];
+
+            if (target.dimension == Type) {
+                const int type = transaction.getType() == TransactionType::INCOME ? 0 : 1;
+                if (encoder.typeMembers[type] < 0) {
+                    encoder.typeMembers[type] = target.memberFor(transaction.getTypeString());
+                }
+                members[axis] = encoder.typeMembers[type];
+            } else if (isTime(target.dimension)) {
+                const qint64 timestamp = transaction.getTimestampMSecs();
+                if (timestamp == Transaction::InvalidTimestamp) {
+                    members[axis] = target.memberFor(QString());
+                    continue;
+                }
+                // Rows of the same local day reuse the last lookup
+                if (timestamp < encoder.dayStart || timestamp >= encoder.dayEnd) {
+                    const QDate date = QDateTime::fromMSecsSinceEpoch(timestamp).date();
+                    encoder.dayStart = QDateTime(date, QTime(0, 0)).toMSecsSinceEpoch();
+                    encoder.dayEnd = QDateTime(date.addDays(1), QTime(0, 0)).toMSecsSinceEpoch();
+                    encoder.dayMember = target.memberFor(date.toString(timeFormat(target.dimension)));
+                }
+                members[axis] = encoder.dayMember;
+            } else {
+                const QString value = stringField(target.dimension, transaction);
+                const void* payload = value.isEmpty() ? nullptr : value.constData();
+                auto it = encoder.byPayload.constFind(payload);
+                if (it != encoder.byPayload.constEnd()) {
+                    members[axis] = it.value();
+                } else {
+                    members[axis] = target.memberFor(value);
+                    encoder.byPayload.insert(payload, members[axis]);
+                }
+            }
+        }
+    }
+
+    allocate();
+    if (!m_valid) {
+        return;
+    }
+
+    for (qsizetype row = 0; row < transactions.size(); ++row) {
+        const Transaction& transaction = transactions.at(row);
+        CubeCell& cell = cellAt(linearIndex(coordinates.data() + row * axisCount));
+        if (transaction.getType() == TransactionType::INCOME) {
+            cell.income += transaction.getAmount();
+        } else {
+            cell.expense += transaction.getAmount();
+        }
+        ++cell.count;
+    }
+}
+
+bool AggregationCube::isValid() const
+{
+    return m_valid;
+}
+
+QList<AggregationCube::Dimension> AggregationCube::dimensions() const
+{
+    QList<Dimension> result;
+    for (const Axis& axis : m_axes) {
+        result.append(axis.dimension);
+    }
+    return result;
+}
+
+int AggregationCube::axisOf(Dimension dimension) const
+{
+    for (int axis = 0; axis < m_axes.size(); ++axis) {
+        if (m_axes.at(axis).dimension == dimension) {
+            return axis;
+        }
+    }
+    return -1;
+}
+
+QStringList AggregationCube::members(Dimension dimension) const
+{
+    const int axis = axisOf(dimension);
+    return axis < 0 ? QStringList() : m_axes.at(axis).labels;
+}
+
+CubeCell AggregationCube::total() const
+{
+    CubeCell result;
+    forEachCell([&result](quint64, const CubeCell& cell) {
+        result.merge(cell);
+    });
+    return result;
+}
+
+CubeCell AggregationCube::cell(const QStringList& labels) const
+{
+    if (!m_valid || labels.size() != m_axes.size()) {
+        return CubeCell();
+    }
+
+    std::vector<int> members(m_axes.size());
+    for (int axis = 0; axis < m_axes.size(); ++axis) {
+        members[axis] = m_axes.at(axis).index.value(labels.at(axis), -1);
+        if (members[axis] < 0) {
+            return CubeCell();
+        }
+    }
+
+    const quint64 linear = linearIndex(members.data());
+    if (m_dense) {
+        return m_denseCells[linear];
+    }
+    return m_sparseCells.value(linear);
+}
+
+AggregationCube AggregationCube::slice(Dimension dimension, const QString& label) const
+{
+    const int fixedAxis = axisOf(dimension);
+    if (!m_valid || fixedAxis < 0) {
+        return AggregationCube();
+    }
+
+    AggregationCube result;
+    result.m_valid = true;
+    std::vector<int> sourceAxes;
+    std::vector<std::vector<int>> memberMaps(m_axes.size());
+    for (int axis = 0; axis < m_axes.size(); ++axis) {
+        if (axis != fixedAxis) {
+            sourceAxes.push_back(axis);
+            result.m_axes.append(m_axes.at(axis));
+            memberMaps[axis].resize(m_axes.at(axis).labels.size());
+            for (int member = 0; member < int(memberMaps[axis].size()); ++member) {
+                memberMaps[axis][member] = member;
+            }
+        }
+    }
+
+    const int fixedMember = m_axes.at(fixedAxis).index.value(label, -1);
+    result.allocate();
+    if (fixedMember >= 0 && result.m_valid) {
+        projectInto(&result, sourceAxes, memberMaps, fixedAxis, fixedMember);
+    }
+    return result;
+}
+
+AggregationCube AggregationCube::rollUp(const QList<Dimension>& keep) const
+{
+    if (!m_valid) {
+        return AggregationCube();
+    }
+
+    AggregationCube result;
+    result.m_valid = true;
+    std::vector<int> sourceAxes;
+    std::vector<std::vector<int>> memberMaps(m_axes.size());
+
+    for (Dimension dimension : keep) {
+        // The dimension itself, or a finer time dimension to coarsen
+        int source = axisOf(dimension);
+        if (source < 0 && dimension == Month) {
+            source = axisOf(Day);
+        } else if (source < 0 && dimension == Year) {
+            source = axisOf(Month) >= 0 ? axisOf(Month) : axisOf(Day);
+        }
+        if (source < 0 || !memberMaps[source].empty()) {
+            return AggregationCube();
+        }
+
+        Axis target{dimension, QStringList(), QHash<QString, int>()};
+        const Axis& from = m_axes.at(source);
+        memberMaps[source].resize(from.labels.size());
+        for (int member = 0; member < from.labels.size(); ++member) {
+            const QString& label = from.labels.at(member);
+            memberMaps[source][member] = target.memberFor(
+                    isTime(dimension) ? label.left(labelLength(dimension)) : label);
+        }
+        sourceAxes.push_back(source);
+        result.m_axes.append(target);
+    }
+
+    result.allocate();
+    if (result.m_valid) {
+        projectInto(&result, sourceAxes, memberMaps, -1, -1);
+    }
+    return result;
+}
+
+QMap<QString, CubeCell> AggregationCube::breakdown(Dimension dimension) const
+{
+    QMap<QString, CubeCell> result;
+    const AggregationCube single = rollUp({dimension});
+    if (!single.isValid()) {
+        return result;
+    }
+
+    const QStringList& labels = single.m_axes.first().labels;
+    single.forEachCell([&](quint64 linear, const CubeCell& cell) {
+        result.insert(labels.at(int(linear)), cell);
+    });
+    return result;
+}
+
+void AggregationCube::allocate()
+{
+    // Row-major: the last axis varies fastest
+    m_strides.assign(m_axes.size(), 1);
+    quint64 cells = 1;
+    for (int axis = int(m_axes.size()) - 1; axis >= 0; --axis) {
+        m_strides[axis] = cells;
+        const quint64 count = quint64(m_axes.at(axis).labels.size());
+        if (count > 0 && cells > std::numeric_limits<quint64>::max() / count) {
+            m_valid = false;
+            return;
+        }
+        cells *= count;
+    }
+
+    m_cellCount = cells;
+    m_dense = cells <= kMaxDenseCells;
+    m_denseCells.clear();
+    m_sparseCells.clear();
+    if (m_dense) {
+        m_denseCells.resize(size_t(cells));
+    }
+}
+
+quint64 AggregationCube::linearIndex(const int* members) const
+{
+    quint64 linear = 0;
+    for (int axis = 0; axis < m_axes.size(); ++axis) {
+        linear += quint64(members[axis]) * m_strides[axis];
+    }
+    return linear;
+}
+
+CubeCell& AggregationCube::cellAt(quint64 linear)
+{
+    if (m_dense) {
+        return m_denseCells[linear];
+    }
+    return m_sparseCells[linear];
+}
+
+void AggregationCube::projectInto(AggregationCube* target, const std::vector<int>& sourceAxes,
+                                  const std::vector<std::vector<int>>& memberMaps, int fixedAxis,
+                                  int fixedMember) const
+{
+    std::vector<int> members(m_axes.size());
+    std::vector<int> targetMembers(sourceAxes.size());
+
+    forEachCell([&](quint64 linear, const CubeCell& cell) {
+        for (int axis = 0; axis < m_axes.size(); ++axis) {
+            members[axis] = int((linear / m_strides[axis]) % quint64(m_axes.at(axis).labels.size()));
+        }
+        if (fixedAxis >= 0 && members[fixedAxis] != fixedMember) {
+            return;
+        }
+        for (size_t i = 0; i < sourceAxes.size(); ++i) {
+            const int axis = sourceAxes[i];
+            targetMembers[i] = memberMaps[axis][members[axis]];
+        }
+        target->cellAt(target->linearIndex(targetMembers.data())).merge(cell);
+    });
+}
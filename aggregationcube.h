@@ -0,0 +1,97 @@
+#ifndef AGGREGATIONCUBE_H
+#define AGGREGATIONCUBE_H
+
+#include "transaction.h"
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QStringList>
+
+#include <vector>
+
+struct CubeCell {
+    double income = 0.0;
+    double expense = 0.0;
+    int count = 0;
+
+    double net() const { return income - expense; }
+    void merge(const CubeCell& other);
+};
+
+// Group-by over any subset of transaction attributes, computed in one pass.
+//
+// Each dimension is dictionary-encoded while the rows are scanned; the cells
+// then form a dense row-major array over the member dictionaries (a hash of
+// the non-empty cells when the array would be too large). slice() fixes a
+// dimension to one member and rollUp() sums dimensions away, both from the
+// cells alone. Day rolls up to Month and Year, Month to Year, so one cube
+// by day answers monthly and yearly questions too.
+//
+// Members are labelled: the type as getTypeString(), days "yyyy-MM-dd",
+// months "yyyy-MM", years "yyyy". Rows without a valid timestamp fall under
+// the empty label of a time dimension.
+class AggregationCube
+{
+public:
+    enum Dimension {
+        Type,
+        Category,
+        Method,
+        FromAccount,
+        ToAccount,
+        Day,
+        Month,
+        Year
+    };
+
+    AggregationCube(); // invalid
+    AggregationCube(const QList<Transaction>& transactions, const QList<Dimension>& dimensions);
+
+    // False for a default cube, a rollUp() to a dimension the cube cannot
+    // produce, or a cube whose cell count would not fit in 64 bits
+    bool isValid() const;
+
+    QList<Dimension> dimensions() const;
+    int axisOf(Dimension dimension) const; // -1 if absent
+    QStringList members(Dimension dimension) const;
+
+    CubeCell total() const;
+    CubeCell cell(const QStringList& labels) const; // one label per dimension, in order
+
+    AggregationCube slice(Dimension dimension, const QString& label) const;
+    AggregationCube rollUp(const QList<Dimension>& keep) const;
+
+    // One dimension against its cells, sorted by label
+    QMap<QString, CubeCell> breakdown(Dimension dimension) const;
+
+private:
+    struct Axis {
+        Dimension dimension;
+        QStringList labels;
+        QHash<QString, int> index;
+
+        int memberFor(const QString& label);
+    };
+
+    void allocate();
+    quint64 linearIndex(const int* members) const;
+    CubeCell& cellAt(quint64 linear);
+    template <typename Function>
+    void forEachCell(Function function) const;
+
+    // Maps every non-empty cell through memberMaps[axis] into target, which
+    // keeps sourceAxes[i] as its axis i; cells whose fixedAxis coordinate is
+    // not fixedMember are dropped
+    void projectInto(AggregationCube* target, const std::vector<int>& sourceAxes,
+                     const std::vector<std::vector<int>>& memberMaps, int fixedAxis, int fixedMember) const;
+
+    QList<Axis> m_axes;
+    std::vector<quint64> m_strides;
+    quint64 m_cellCount;
+    bool m_valid;
+    bool m_dense;
+    std::vector<CubeCell> m_denseCells;
+    QHash<quint64, CubeCell> m_sparseCells;
+};
+
+#endif // AGGREGATIONCUBE_H
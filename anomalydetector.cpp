@@ -0,0 +1,223 @@
+#include "anomalydetector.h"
+#include <QStringList>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Weight left after dt of decay with the burst half-life
+double decayFactor(qint64 dt)
+{
+    return std::exp2(-double(dt) / AnomalyDetector::BurstHalfLifeMSecs);
+}
+
+} // namespace
+
+void AnomalyDetector::Baseline::add(double amount, qint64 timestamp)
+{
+    ++count;
+    const double delta = amount - mean;
+    mean += delta / count;
+    m2 += delta * (amount - mean);
+
+    if (timestamp == NoTimestamp) {
+        return;
+    }
+    // The decayed count stays a sum of 2^(-age / half-life) over the charges,
+    // aged from the latest one, so rows may arrive out of time order
+    if (lastTimestamp == NoTimestamp || timestamp >= lastTimestamp) {
+        decayed = (lastTimestamp == NoTimestamp ? 0.0 : decayed * decayFactor(timestamp - lastTimestamp)) + 1.0;
+        lastTimestamp = timestamp;
+    } else {
+        decayed += decayFactor(lastTimestamp - timestamp);
+    }
+    recent[nextRecent] = Charge{timestamp, toCents(amount)};
+    nextRecent = (nextRecent + 1) % RecentCharges;
+}
+
+void AnomalyDetector::Baseline::remove(double amount, qint64 timestamp)
+{
+    if (count <= 1) {
+        *this = Baseline();
+        return;
+    }
+    const double previousMean = (mean * count - amount) / (count - 1);
+    m2 = qMax(0.0, m2 - (amount - previousMean) * (amount - mean));
+    mean = previousMean;
+    --count;
+
+    if (timestamp == NoTimestamp || lastTimestamp == NoTimestamp) {
+        return;
+    }
+    decayed = qMax(0.0, decayed - decayFactor(qAbs(lastTimestamp - timestamp)));
+    const qint64 cents = toCents(amount);
+    for (auto& charge : recent) {
+        if (charge.timestamp == timestamp && charge.cents == cents) {
+            charge.cents = -1;
+            break;
+        }
+    }
+}
+
+double AnomalyDetector::Baseline::standardDeviation() const
+{
+    return count > 1 ? std::sqrt(m2 / (count - 1)) : 0.0;
+}
+
+double AnomalyDetector::Baseline::decayedAt(qint64 timestamp) const
+{
+    if (lastTimestamp == NoTimestamp || timestamp < lastTimestamp) {
+        return decayed;
+    }
+    return decayed * decayFactor(timestamp - lastTimestamp);
+}
+
+bool AnomalyDetector::Baseline::chargedRecently(qint64 cents, qint64 timestamp) const
+{
+    for (const auto& charge : recent) {
+        if (charge.cents == cents && charge.timestamp != NoTimestamp
+            && qAbs(charge.timestamp - timestamp) <= DuplicateWindowMSecs) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AnomalyDetector::addTransaction(quint32 sequence, const Transaction& transaction)
+{
+    if (!isScored(transaction)) {
+        return;
+    }
+
+    const Anomaly anomaly = score(transaction);
+    if (anomaly.isFlagged()) {
+        m_flagged.insert(sequence, anomaly);
+    }
+
+    const qint64 timestamp = transaction.getTimestampMSecs();
+    const qint64 at = timestamp == Transaction::InvalidTimestamp ? NoTimestamp : timestamp;
+    m_categories[transaction.getCategory()].add(transaction.getAmount(), at);
+    m_pairs[PairKey(transaction.getCategory(), transaction.getToAccount())].add(transaction.getAmount(), at);
+}
+
+void AnomalyDetector::removeTransaction(quint32 sequence, const Transaction& transaction)
+{
+    if (!isScored(transaction)) {
+        return;
+    }
+    m_flagged.remove(sequence);
+
+    const qint64 timestamp = transaction.getTimestampMSecs();
+    const qint64 at = timestamp == Transaction::InvalidTimestamp ? NoTimestamp : timestamp;
+    auto removeFrom = [&transaction, at](auto& baselines, const auto& key) {
+        auto it = baselines.find(key);
+        if (it != baselines.end()) {
+            it->remove(transaction.getAmount(), at);
+            if (it->count == 0) {
+                baselines.erase(it);
+            }
+        }
+    };
+    removeFrom(m_categories, transaction.getCategory());
+    removeFrom(m_pairs, PairKey(transaction.getCategory(), transaction.getToAccount()));
+}
+
+void AnomalyDetector::clear()
+{
+    m_categories.clear();
+    m_pairs.clear();
+    m_flagged.clear();
+}
+
+AnomalyDetector::Anomaly AnomalyDetector::anomaly(quint32 sequence) const
+{
+    return m_flagged.value(sequence);
+}
+
+int AnomalyDetector::flaggedCount() const
+{
+    return int(m_flagged.size());
+}
+
+QList<quint32> AnomalyDetector::flaggedRows() const
+{
+    QList<quint32> rows = m_flagged.keys();
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+QString AnomalyDetector::describe(const Anomaly& anomaly, const Transaction& transaction)
+{
+    QStringList reasons;
+    if (anomaly.flags.testFlag(Outlier) && anomaly.typicalAmount > 0.0) {
+        reasons.append(QString("金额约为平时的 %1 倍（通常 ¥ %2）")
+                           .arg(transaction.getAmount() / anomaly.typicalAmount, 0, 'f', 1)
+                           .arg(anomaly.typicalAmount, 0, 'f', 2));
+    }
+    if (anomaly.flags.testFlag(Duplicate)) {
+        reasons.append(QString("%1 分钟内向“%2”支付过相同金额")
+                           .arg(DuplicateWindowMSecs / 60000)
+                           .arg(transaction.getToAccount()));
+    }
+    if (anomaly.flags.testFlag(Burst)) {
+        reasons.append(QString("短时间内向“%1”多次付款").arg(transaction.getToAccount()));
+    }
+    return reasons.join("；");
+}
+
+qint64 AnomalyDetector::bytesUsed() const
+{
+    return m_categories.capacity() * qint64(sizeof(QString) + sizeof(Baseline))
+           + m_pairs.capacity() * qint64(sizeof(PairKey) + sizeof(Baseline))
+           + m_flagged.capacity() * qint64(sizeof(quint32) + sizeof(Anomaly));
+}
+
+bool AnomalyDetector::isScored(const Transaction& transaction)
+{
+    return transaction.getType() == TransactionType::EXPENSE;
+}
+
+qint64 AnomalyDetector::toCents(double amount)
+{
+    return qRound64(amount * 100.0);
+}
+
+AnomalyDetector::Anomaly AnomalyDetector::score(const Transaction& transaction) const
+{
+    Anomaly anomaly;
+    const double amount = transaction.getAmount();
+    const Baseline* pair = nullptr;
+    auto pairIt = m_pairs.constFind(PairKey(transaction.getCategory(), transaction.getToAccount()));
+    if (pairIt != m_pairs.constEnd()) {
+        pair = &pairIt.value();
+    }
+
+    const Baseline* baseline = pair && pair->count >= MinHistory ? pair : nullptr;
+    if (!baseline) {
+        auto categoryIt = m_categories.constFind(transaction.getCategory());
+        if (categoryIt != m_categories.constEnd() && categoryIt->count >= MinHistory) {
+            baseline = &categoryIt.value();
+        }
+    }
+    if (baseline && baseline->mean > 0.0 && amount >= OutlierRatio * baseline->mean
+        && amount - baseline->mean >= OutlierSigmas * baseline->standardDeviation()) {
+        anomaly.flags |= Outlier;
+        anomaly.typicalAmount = baseline->mean;
+    }
+
+    const qint64 timestamp = transaction.getTimestampMSecs();
+    if (pair && timestamp != Transaction::InvalidTimestamp) {
+        if (pair->chargedRecently(toCents(amount), timestamp)) {
+            anomaly.flags |= Duplicate;
+        }
+        // The decayed count says nothing about how busy a much earlier
+        // moment was
+        const bool current = pair->lastTimestamp == NoTimestamp
+                             || timestamp >= pair->lastTimestamp - BurstHalfLifeMSecs;
+        if (current && pair->decayedAt(timestamp) >= BurstCount) {
+            anomaly.flags |= Burst;
+        }
+    }
+    return anomaly;
+}
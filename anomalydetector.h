@@ -0,0 +1,110 @@
+#ifndef ANOMALYDETECTOR_H
+#define ANOMALYDETECTOR_H
+
+#include "transaction.h"
+#include <QHash>
+#include <QList>
+#include <QPair>
+
+#include <limits>
+
+// Flags unusual expenses as rows enter the ledger.
+//
+// Every category and every (category, counterparty) pair has a baseline:
+// the running mean and variance of its expense amounts, kept with Welford's
+// update (which can be reversed exactly when a row leaves), and an
+// exponentially decayed count of its recent charges. A row is scored against
+// the baselines as they stood before it arrived, then added to them, so both
+// steps are O(1) whatever the size of the history:
+//   - Outlier: the amount is at least OutlierRatio times the mean and
+//     OutlierSigmas standard deviations above it. The counterparty's own
+//     baseline is used once it has MinHistory rows, the category's before.
+//   - Duplicate: the counterparty was charged the same amount within
+//     DuplicateWindowMSecs, among its last RecentCharges charges.
+//   - Burst: the counterparty's decayed charge count, halving every
+//     BurstHalfLifeMSecs, had already reached BurstCount. The count is kept
+//     as of the counterparty's latest charge only, so a row dated more than
+//     one half-life before that (an old statement imported late, a row
+//     scored again after undo or retagging) is not checked for bursts.
+// The counterparty of an expense is its to account. Income rows are neither
+// scored nor counted. A row removed and re-added (undo, redo, retagging) is
+// scored again against the baselines of that moment.
+class AnomalyDetector
+{
+public:
+    enum Flag {
+        None = 0x0,
+        Outlier = 0x1,
+        Duplicate = 0x2,
+        Burst = 0x4
+    };
+    Q_DECLARE_FLAGS(Flags, Flag)
+
+    struct Anomaly {
+        Flags flags;
+        double typicalAmount = 0.0; // the baseline mean the row was compared with
+
+        bool isFlagged() const { return flags != Flags(); }
+    };
+
+    static constexpr int MinHistory = 8;
+    static constexpr double OutlierRatio = 5.0;
+    static constexpr double OutlierSigmas = 3.0;
+    static constexpr int RecentCharges = 4;
+    static constexpr qint64 DuplicateWindowMSecs = 30 * 60 * 1000;
+    static constexpr qint64 BurstHalfLifeMSecs = 60 * 60 * 1000;
+    static constexpr double BurstCount = 4.0;
+
+    AnomalyDetector() = default;
+
+    void addTransaction(quint32 sequence, const Transaction& transaction);
+    void removeTransaction(quint32 sequence, const Transaction& transaction);
+    void clear();
+
+    Anomaly anomaly(quint32 sequence) const; // no flags when the row was not flagged
+    int flaggedCount() const;
+    QList<quint32> flaggedRows() const;      // ascending
+
+    // "金额约为平时的 10.0 倍；30 分钟内有相同金额" and the like
+    static QString describe(const Anomaly& anomaly, const Transaction& transaction);
+
+    qint64 bytesUsed() const; // estimated heap bytes
+
+private:
+    static constexpr qint64 NoTimestamp = std::numeric_limits<qint64>::min();
+
+    struct Charge {
+        qint64 timestamp = NoTimestamp;
+        qint64 cents = -1; // -1 once the row has left
+    };
+
+    struct Baseline {
+        qint64 count = 0;
+        double mean = 0.0;
+        double m2 = 0.0; // sum of squared deviations from the mean
+        double decayed = 0.0;
+        qint64 lastTimestamp = NoTimestamp;
+        Charge recent[RecentCharges];
+        int nextRecent = 0;
+
+        void add(double amount, qint64 timestamp);
+        void remove(double amount, qint64 timestamp);
+        double standardDeviation() const;
+        double decayedAt(qint64 timestamp) const;
+        bool chargedRecently(qint64 cents, qint64 timestamp) const;
+    };
+
+    using PairKey = QPair<QString, QString>; // category, counterparty
+
+    static bool isScored(const Transaction& transaction);
+    static qint64 toCents(double amount);
+    Anomaly score(const Transaction& transaction) const;
+
+    QHash<QString, Baseline> m_categories;
+    QHash<PairKey, Baseline> m_pairs;
+    QHash<quint32, Anomaly> m_flagged;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(AnomalyDetector::Flags)
+
+#endif // ANOMALYDETECTOR_H
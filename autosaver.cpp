@@ -0,0 +1,180 @@
+#include "autosaver.h"
+#include "transactionmanager.h"
+#include "ledgerexporter.h"
+#include "ledgersummary.h"
+#include <QDir>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QSaveFile>
+
+namespace {
+
+const int kDefaultDebounceMSecs = 2000;
+const int kDefaultMaxDelayMSecs = 30000;
+
+} // namespace
+
+void AutoSaveWorker::save(const LedgerSnapshot& snapshot, const RoaringBitmap& pairedTransfers,
+                          const QString& filename, quint64 version)
+{
+    QDir().mkpath(QFileInfo(filename).absolutePath());
+
+    QSaveFile file(filename);
+    bool ok = file.open(QIODevice::WriteOnly);
+    if (ok) {
+        LedgerExporter exporter(&file, filename.endsWith(".json", Qt::CaseInsensitive)
+                                           ? LedgerExporter::Json : LedgerExporter::Archive);
+        ok = exporter.begin();
+        snapshot.forEach([&ok, &exporter](const Transaction& transaction) {
+            ok = ok && exporter.write(transaction);
+        });
+        ok = ok && exporter.finish();
+    }
+
+    ok = ok && file.commit();
+
+    // Best effort: a sidecar that is missing or older than the ledger is
+    // ignored at startup and the figures are recomputed from the rows
+    if (ok) {
+        LedgerSummary::compute(snapshot, &pairedTransfers).save(filename);
+    }
+    emit finished(version, ok, ok ? QString() : file.errorString());
+}
+
+AutoSaver::AutoSaver(TransactionManager* manager, const QString& filename, QObject* parent)
+    : QObject(parent)
+    , m_manager(manager)
+    , m_filename(filename)
+    , m_worker(new AutoSaveWorker())
+    , m_maxDelay(kDefaultMaxDelayMSecs)
+    , m_saving(false)
+    , m_saveQueued(false)
+{
+    m_thread.setObjectName("MoneyTracker autosave");
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    connect(m_worker, &AutoSaveWorker::finished, this, &AutoSaver::onWorkerFinished);
+    m_thread.start(QThread::LowPriority);
+
+    m_debounce.setSingleShot(true);
+    m_debounce.setInterval(kDefaultDebounceMSecs);
+    connect(&m_debounce, &QTimer::timeout, this, &AutoSaver::saveNow);
+
+    connect(m_manager, &TransactionManager::transactionsChanged, this, &AutoSaver::onLedgerChanged);
+}
+
+// A save still in flight runs to completion; call flush() first to also
+// write edits made after it started
+AutoSaver::~AutoSaver()
+{
+    m_thread.quit();
+    m_thread.wait();
+}
+
+QString AutoSaver::filename() const
+{
+    return m_filename;
+}
+
+void AutoSaver::setDebounceInterval(int msecs)
+{
+    m_debounce.setInterval(msecs);
+}
+
+void AutoSaver::setMaxDelay(int msecs)
+{
+    m_maxDelay = msecs;
+}
+
+bool AutoSaver::isSaving() const
+{
+    return m_saving;
+}
+
+void AutoSaver::saveNow()
+{
+    m_debounce.stop();
+
+    if (!m_manager->isDirty()) {
+        return;
+    }
+
+    // Snapshots hold only the resident rows; the dirty months are rewritten
+    // in place instead
+    if (m_manager->isPartitioned()) {
+        m_pendingSince.invalidate();
+        emit saveStarted();
+        const bool ok = m_manager->savePartitionedLedger(m_filename);
+        emit saveFinished(ok, ok ? QString() : QString("无法写入账本目录 %1").arg(m_filename));
+        return;
+    }
+
+    // One save at a time; later edits are picked up when it finishes
+    if (m_saving) {
+        m_saveQueued = true;
+        return;
+    }
+
+    m_saving = true;
+    m_saveQueued = false;
+    m_pendingSince.invalidate();
+
+    LedgerSnapshot snapshot = m_manager->snapshot();
+    RoaringBitmap pairedTransfers = m_manager->transferMatcher().pairedRows(); // shares its containers
+    quint64 version = m_manager->changeVersion();
+    QString filename = m_filename;
+    AutoSaveWorker* worker = m_worker;
+    QMetaObject::invokeMethod(m_worker, [worker, snapshot, pairedTransfers, filename, version]() {
+        worker->save(snapshot, pairedTransfers, filename, version);
+    }, Qt::QueuedConnection);
+
+    emit saveStarted();
+}
+
+void AutoSaver::flush()
+{
+    saveNow();
+    if (!m_saving) {
+        return;
+    }
+
+    // Shutdown path: wait for the in-flight save and any coalesced follow-up
+    QEventLoop loop;
+    connect(this, &AutoSaver::saveFinished, &loop, [this, &loop]() {
+        if (!m_saving) {
+            loop.quit();
+        }
+    });
+    loop.exec(QEventLoop::ExcludeUserInputEvents);
+}
+
+void AutoSaver::onLedgerChanged()
+{
+    if (!m_manager->isDirty()) {
+        return; // a load, not an edit
+    }
+
+    if (!m_pendingSince.isValid()) {
+        m_pendingSince.start();
+    }
+
+    // A steady stream of edits still gets saved every maxDelay
+    if (m_pendingSince.elapsed() >= m_maxDelay) {
+        saveNow();
+    } else {
+        m_debounce.start();
+    }
+}
+
+void AutoSaver::onWorkerFinished(quint64 version, bool ok, const QString& errorString)
+{
+    m_saving = false;
+    if (ok) {
+        m_manager->markSaved(version);
+    }
+
+    if (m_saveQueued) {
+        saveNow();
+    }
+    emit saveFinished(ok, errorString);
+}
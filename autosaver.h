@@ -0,0 +1,79 @@
+#ifndef AUTOSAVER_H
+#define AUTOSAVER_H
+
+#include "ledgersnapshot.h"
+#include "roaringbitmap.h"
+#include <QObject>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QTimer>
+
+class TransactionManager;
+
+// Writes one snapshot to disk on the I/O thread. Files ending in ".json" get
+// the JSON format of TransactionManager::saveToFile(); anything else is
+// written as a LedgerArchive. Output goes through QSaveFile, so the previous
+// file is replaced by an atomic rename only once the new one is complete.
+// A LedgerSummary sidecar for the dashboard is written after it.
+class AutoSaveWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+    void save(const LedgerSnapshot& snapshot, const RoaringBitmap& pairedTransfers, const QString& filename,
+              quint64 version);
+
+signals:
+    void finished(quint64 version, bool ok, const QString& errorString);
+};
+
+// Automatic persistence of the ledger to filename.
+//
+// Edits restart a debounce timer; when it fires (or when edits have kept
+// coming for maxDelay), a whole-file ledger hands an O(1) snapshot to a
+// dedicated I/O thread. Edits made while a save is running are coalesced
+// into one follow-up save, and flush() waits for the I/O thread at shutdown.
+// A partitioned ledger (filename is then its directory) is saved through
+// savePartitionedLedger() on the calling thread instead: only the months
+// edited since the last save are rewritten, so each save is bounded by the
+// size of those months rather than of the ledger.
+class AutoSaver : public QObject
+{
+    Q_OBJECT
+
+public:
+    AutoSaver(TransactionManager* manager, const QString& filename, QObject* parent = nullptr);
+    ~AutoSaver() override;
+
+    QString filename() const;
+    void setDebounceInterval(int msecs);
+    void setMaxDelay(int msecs);
+    bool isSaving() const;
+
+public slots:
+    void saveNow();
+    void flush();
+
+signals:
+    void saveStarted();
+    void saveFinished(bool ok, const QString& errorString);
+
+private slots:
+    void onLedgerChanged();
+    void onWorkerFinished(quint64 version, bool ok, const QString& errorString);
+
+private:
+    TransactionManager* m_manager;
+    QString m_filename;
+    QThread m_thread;
+    AutoSaveWorker* m_worker;
+    QTimer m_debounce;
+    QElapsedTimer m_pendingSince;
+    int m_maxDelay;
+    bool m_saving;
+    bool m_saveQueued;
+};
+
+#endif // AUTOSAVER_H
@@ -0,0 +1,500 @@
+// Command-line benchmark for the ledger core.
+//
+// Usage: MoneyTrackerBench [rows]
+//
+// Generates a synthetic ledger, saves it as JSON, as a LedgerArchive and as
+// CSV and loads all three back, printing file sizes, the dashboard summary
+// sidecar's save and load times, CSV import throughput, a federated report
+// over sharded copies of the ledger, transfer pairing,
+// the resident bytes per row and the number of malloc calls per row,
+// TransactionManager's own estimate of where those bytes go (anomaly
+// scoring runs inside the build and load figures), tag queries
+// against the bitmap indexes, and the latency and throughput of the local
+// query service under many concurrent clients.
+// Heap figures are only available on glibc, where this executable interposes
+// malloc/free to count them.
+
+#include "ledgergenerator.h"
+#include "transactionmanager.h"
+#include "csvimporter.h"
+#include "ledgerfederation.h"
+#include "statisticscalculator.h"
+#include "progressivestatistics.h"
+#include "ledgerqueryserver.h"
+#include "ledgersummary.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+}
+
+namespace {
+std::atomic<quint64> g_mallocCalls{0};
+std::atomic<qint64> g_liveBytes{0};
+} // namespace
+
+extern "C" void* malloc(size_t size) noexcept
+{
+    void* ptr = __libc_malloc(size);
+    if (ptr) {
+        g_mallocCalls.fetch_add(1, std::memory_order_relaxed);
+        g_liveBytes.fetch_add(qint64(malloc_usable_size(ptr)), std::memory_order_relaxed);
+    }
+    return ptr;
+}
+
+extern "C" void* calloc(size_t count, size_t size) noexcept
+{
+    void* ptr = __libc_calloc(count, size);
+    if (ptr) {
+        g_mallocCalls.fetch_add(1, std::memory_order_relaxed);
+        g_liveBytes.fetch_add(qint64(malloc_usable_size(ptr)), std::memory_order_relaxed);
+    }
+    return ptr;
+}
+
+extern "C" void* realloc(void* old, size_t size) noexcept
+{
+    qint64 oldBytes = old ? qint64(malloc_usable_size(old)) : 0;
+    void* ptr = __libc_realloc(old, size);
+    if (ptr) {
+        g_mallocCalls.fetch_add(1, std::memory_order_relaxed);
+        g_liveBytes.fetch_add(qint64(malloc_usable_size(ptr)) - oldBytes, std::memory_order_relaxed);
+    } else if (size == 0) {
+        g_liveBytes.fetch_sub(oldBytes, std::memory_order_relaxed);
+    }
+    return ptr;
+}
+
+extern "C" void free(void* ptr) noexcept
+{
+    if (ptr) {
+        g_liveBytes.fetch_sub(qint64(malloc_usable_size(ptr)), std::memory_order_relaxed);
+    }
+    __libc_free(ptr);
+}
+
+#define MONEYTRACKER_HEAP_COUNTERS 1
+#endif
+
+namespace {
+
+struct HeapSample {
+    quint64 mallocCalls = 0;
+    qint64 liveBytes = 0;
+};
+
+HeapSample sampleHeap()
+{
+    HeapSample sample;
+#ifdef MONEYTRACKER_HEAP_COUNTERS
+    sample.mallocCalls = g_mallocCalls.load();
+    sample.liveBytes = g_liveBytes.load();
+#endif
+    return sample;
+}
+
+// A deterministic share of the rows carries tags: every third is
+// reimbursable, every tenth on a trip and every twentieth refunded
+QStringList benchTags(int row)
+{
+    QStringList tags;
+    if (row % 3 == 0) {
+        tags.append("reimbursable");
+    }
+    if (row % 10 == 0) {
+        tags.append("trip");
+    }
+    if (row % 20 == 0) {
+        tags.append("refunded");
+    }
+    return tags;
+}
+
+void report(QTextStream& out, const QString& phase, int rows, qint64 elapsedMs,
+            const HeapSample& before, const HeapSample& after)
+{
+    out << phase << ": " << rows << " rows in " << elapsedMs << " ms";
+#ifdef MONEYTRACKER_HEAP_COUNTERS
+    double bytesPerRow = double(after.liveBytes - before.liveBytes) / rows;
+    double mallocsPerRow = double(after.mallocCalls - before.mallocCalls) / rows;
+    out << ", " << QString::number(bytesPerRow, 'f', 1) << " bytes/row"
+        << ", " << QString::number(mallocsPerRow, 'f', 2) << " mallocs/row";
+#else
+    Q_UNUSED(before);
+    Q_UNUSED(after);
+#endif
+    out << Qt::endl;
+}
+
+void reportThroughput(QTextStream& out, const QString& phase, int rows, qint64 elapsedMs)
+{
+    out << phase << ": " << rows << " rows in " << elapsedMs << " ms, "
+        << qRound64(rows * 1000.0 / qMax<qint64>(1, elapsedMs)) << " rows/s" << Qt::endl;
+}
+
+// Starts one thread per client against server, each sending query requests
+// times with up to depth of them in flight, and reports the throughput and
+// the round-trip latency percentiles. The server answers on this thread.
+void runQueryClients(QTextStream& out, const QString& phase, const QString& server, const LedgerQuery& query,
+                     int clients, int requests, int depth)
+{
+    std::vector<std::vector<qint64>> latencies(clients); // nanoseconds
+    std::atomic<int> failures{0};
+    QEventLoop loop;
+    int running = clients;
+    QList<QThread*> threads;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int c = 0; c < clients; ++c) {
+        QThread* thread = QThread::create([&, c]() {
+            LedgerQueryClient client;
+            if (!client.connectToServer(server)) {
+                failures.fetch_add(1);
+                return;
+            }
+            std::vector<qint64>& samples = latencies[c];
+            samples.reserve(requests);
+            QList<qint64> sent; // send times of the requests in flight
+            QElapsedTimer clock;
+            clock.start();
+            LedgerQueryResult result;
+            int issued = 0;
+            while (int(samples.size()) < requests) {
+                while (issued < requests && issued - int(samples.size()) < depth) {
+                    sent.append(clock.nsecsElapsed());
+                    client.send(query);
+                    ++issued;
+                }
+                if (!client.receive(&result) || result.status != LedgerQueryResult::Ok) {
+                    failures.fetch_add(1);
+                    return;
+                }
+                samples.push_back(clock.nsecsElapsed() - sent.takeFirst());
+            }
+        });
+        QObject::connect(thread, &QThread::finished, &loop, [&loop, &running]() {
+            if (--running == 0) {
+                loop.quit();
+            }
+        });
+        threads.append(thread);
+        thread->start();
+    }
+    loop.exec();
+    const qint64 elapsedMs = timer.elapsed();
+    for (QThread* thread : threads) {
+        thread->wait();
+    }
+    qDeleteAll(threads);
+
+    std::vector<qint64> all;
+    for (const auto& samples : latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&all](double p) {
+        return all.empty() ? 0.0 : all[qMin(all.size() - 1, size_t(p * all.size()))] / 1e6;
+    };
+
+    out << phase << ": " << clients << " clients x " << requests << " requests (" << depth
+        << " pipelined) in " << elapsedMs << " ms, "
+        << qRound64(all.size() * 1000.0 / qMax<qint64>(1, elapsedMs)) << " requests/s"
+        << ", latency p50 " << QString::number(percentile(0.5), 'f', 3) << " ms"
+        << ", p99 " << QString::number(percentile(0.99), 'f', 3) << " ms";
+    if (failures.load() > 0) {
+        out << ", " << failures.load() << " clients failed";
+    }
+    out << Qt::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    int rows = argc > 1 ? QString::fromLocal8Bit(argv[1]).toInt() : 1000000;
+    if (rows <= 0) {
+        out << "usage: MoneyTrackerBench [rows]" << Qt::endl;
+        return 1;
+    }
+
+    QTemporaryDir dir;
+    QString jsonPath = dir.filePath("ledger.json");
+    QString archivePath = dir.filePath("ledger.mtla");
+    QString csvPath = dir.filePath("ledger.csv");
+
+    out << "sizeof(Transaction): " << sizeof(Transaction) << " bytes" << Qt::endl;
+
+    {
+        LedgerGenerator generator;
+        TransactionManager manager;
+        QElapsedTimer timer;
+        HeapSample before = sampleHeap();
+        timer.start();
+        for (int i = 0; i < rows; ++i) {
+            Transaction transaction = generator.next();
+            transaction.setTags(benchTags(i));
+            manager.addTransaction(transaction);
+        }
+        report(out, "build", rows, timer.elapsed(), before, sampleHeap());
+        out << manager.memoryReport().toText() << Qt::endl;
+        out << "anomalies flagged while building: " << manager.getAnomalyCount() << Qt::endl;
+
+        timer.start();
+        if (!manager.saveToFile(jsonPath)) {
+            out << "failed to write " << jsonPath << Qt::endl;
+            return 1;
+        }
+        out << "save json: " << timer.elapsed() << " ms, "
+            << QFileInfo(jsonPath).size() << " bytes" << Qt::endl;
+
+        timer.start();
+        if (!manager.saveToArchive(archivePath)) {
+            out << "failed to write " << archivePath << Qt::endl;
+            return 1;
+        }
+        out << "save archive: " << timer.elapsed() << " ms, "
+            << QFileInfo(archivePath).size() << " bytes" << Qt::endl;
+
+        // What the dashboard reads at startup instead of the archive
+        timer.start();
+        if (!LedgerSummary::compute(manager.snapshot(), &manager.transferMatcher().pairedRows()).save(archivePath)) {
+            out << "failed to write " << LedgerSummary::sidecarPath(archivePath) << Qt::endl;
+            return 1;
+        }
+        out << "save summary: " << timer.elapsed() << " ms, "
+            << QFileInfo(LedgerSummary::sidecarPath(archivePath)).size() << " bytes" << Qt::endl;
+
+        timer.start();
+        const LedgerSummary summary = LedgerSummary::load(archivePath);
+        out << "load summary: " << timer.elapsed() << " ms, "
+            << (summary.isValid() ? summary.rowCount() : 0) << " rows summarized" << Qt::endl;
+
+        timer.start();
+        if (!manager.exportToCsv(csvPath)) {
+            out << "failed to write " << csvPath << Qt::endl;
+            return 1;
+        }
+        out << "save csv: " << timer.elapsed() << " ms, "
+            << QFileInfo(csvPath).size() << " bytes" << Qt::endl;
+    }
+
+    {
+        CsvImporter importer;
+        QList<Transaction> parsed;
+        QElapsedTimer timer;
+        timer.start();
+        if (!importer.parseFile(csvPath, &parsed)) {
+            out << "failed to parse " << csvPath << ": " << importer.errorString() << Qt::endl;
+            return 1;
+        }
+        reportThroughput(out, "parse csv", importer.rowsParsed(), timer.elapsed());
+
+        importer.setThreadCount(1);
+        parsed.clear();
+        timer.start();
+        importer.parseFile(csvPath, &parsed);
+        reportThroughput(out, "parse csv (1 thread)", importer.rowsParsed(), timer.elapsed());
+
+        TransactionManager imported;
+        importer.setThreadCount(QThread::idealThreadCount());
+        timer.start();
+        if (!importer.importFile(csvPath, &imported)) {
+            out << "failed to import " << csvPath << ": " << importer.errorString() << Qt::endl;
+            return 1;
+        }
+        reportThroughput(out, "import csv", importer.rowsAdded(), timer.elapsed());
+
+        // The same file again: every row is a duplicate and nothing is added
+        timer.start();
+        if (!importer.importFile(csvPath, &imported)) {
+            out << "failed to import " << csvPath << ": " << importer.errorString() << Qt::endl;
+            return 1;
+        }
+        reportThroughput(out, "re-import csv", importer.rowsParsed(), timer.elapsed());
+        out << "duplicates skipped: " << importer.duplicates().size() << Qt::endl;
+    }
+
+    {
+        // The same ledger split into shards, as one file per member and year would be
+        const int shardCount = 8;
+        LedgerGenerator generator;
+        QStringList shardPaths;
+        for (int shard = 0; shard < shardCount; ++shard) {
+            TransactionManager manager;
+            QList<Transaction> batch;
+            for (int i = shard; i < rows; i += shardCount) {
+                batch.append(generator.next());
+            }
+            manager.addTransactions(batch);
+            shardPaths.append(dir.filePath(QString("shard-%1.mtla").arg(shard)));
+            if (!manager.saveToArchive(shardPaths.last())) {
+                out << "failed to write " << shardPaths.last() << Qt::endl;
+                return 1;
+            }
+        }
+
+        LedgerFederation federation;
+        QElapsedTimer timer;
+        timer.start();
+        if (!federation.addShards(shardPaths)) {
+            out << federation.errorString() << Qt::endl;
+            return 1;
+        }
+        reportThroughput(out, QString("load %1 shards").arg(shardCount), federation.getTransactionCount(),
+                         timer.elapsed());
+
+        const QDateTime start(QDate(1, 1, 1), QTime(0, 0));
+        const QDateTime end(QDate(9999, 12, 31), QTime(23, 59, 59));
+        timer.start();
+        FederatedReport combined = federation.report(start, end);
+        reportThroughput(out, "federated report", combined.transactionCount, timer.elapsed());
+
+        federation.setThreadCount(1);
+        timer.start();
+        combined = federation.report(start, end);
+        reportThroughput(out, "federated report (1 thread)", combined.transactionCount, timer.elapsed());
+    }
+
+    {
+        // Every tenth row starts a transfer between our own accounts
+        LedgerGenerator generator;
+        QList<Transaction> batch;
+        batch.reserve(rows);
+        int transfers = 0;
+        while (batch.size() < rows) {
+            if (batch.size() % 10 == 0 && batch.size() + 2 <= rows) {
+                Transaction expense;
+                Transaction income;
+                generator.nextTransfer(&expense, &income);
+                batch.append(expense);
+                batch.append(income);
+                ++transfers;
+            } else {
+                batch.append(generator.next());
+            }
+        }
+
+        TransactionManager manager;
+        QElapsedTimer timer;
+        timer.start();
+        manager.addTransactions(batch);
+        reportThroughput(out, "index with transfer pairing", int(batch.size()), timer.elapsed());
+        out << "transfer pairs: " << manager.getTransferPairCount() << " of " << transfers << Qt::endl;
+
+        timer.start();
+        const QList<Transaction> net = manager.getTransactionsExcludingTransfers();
+        reportThroughput(out, "exclude transfers", int(net.size()), timer.elapsed());
+
+        // Every tenth row in one undoable batch
+        QStringList ids;
+        for (int i = 0; i < batch.size(); i += 10) {
+            ids.append(batch.at(i).getId());
+        }
+        timer.start();
+        const int deleted = manager.deleteTransactions(ids);
+        reportThroughput(out, "batch delete", deleted, timer.elapsed());
+    }
+
+    TransactionManager loaded;
+    QElapsedTimer timer;
+    HeapSample before = sampleHeap();
+    timer.start();
+    if (!loaded.loadFromFile(jsonPath)) {
+        out << "failed to read " << jsonPath << Qt::endl;
+        return 1;
+    }
+    report(out, "load json", loaded.getTransactionCount(), timer.elapsed(), before, sampleHeap());
+    out << loaded.memoryReport().toText() << Qt::endl;
+
+    loaded.clearAll();
+    before = sampleHeap();
+    timer.start();
+    if (!loaded.loadFromFile(archivePath)) {
+        out << "failed to read " << archivePath << Qt::endl;
+        return 1;
+    }
+    report(out, "load archive", loaded.getTransactionCount(), timer.elapsed(), before, sampleHeap());
+    out << loaded.memoryReport().toText() << Qt::endl;
+
+    // Category breakdown and daily trend, with the full pool and serially
+    const QList<Transaction> all = loaded.getTransactions();
+    const QDateTime first(QDate(1, 1, 1), QTime(0, 0));
+    const QDateTime last(QDate(9999, 12, 31), QTime(23, 59, 59));
+    StatisticsCalculator calculator;
+    for (int threads : {QThread::idealThreadCount(), 1}) {
+        calculator.setThreadCount(threads);
+        timer.start();
+        calculator.calculateExpenseByCategory(all);
+        calculator.calculateDailyTrend(first, last, all);
+        reportThroughput(out, QString("statistics (%1 threads)").arg(threads), int(all.size()), timer.elapsed());
+    }
+
+    // A tag expression intersected with a date range and a category, as the
+    // bills filter runs it; the tags came back through the archive
+    {
+        const QString expression = "reimbursable AND trip AND NOT refunded";
+        const QDateTime from(QDate(2019, 3, 15), QTime(12, 0));
+        const QDateTime to(QDate(2022, 8, 20), QTime(23, 59, 59));
+        const int repeats = 200;
+        int matched = 0;
+        timer.start();
+        for (int i = 0; i < repeats; ++i) {
+            matched = loaded.countByTags(expression, from, to, "餐饮");
+        }
+        const qint64 elapsedNs = timer.nsecsElapsed();
+        out << "tag query: " << matched << " rows, "
+            << QString::number(elapsedNs / 1000.0 / repeats, 'f', 1) << " us per query, tag index "
+            << loaded.tagIndex().bytesUsed() << " bytes" << Qt::endl;
+    }
+
+    // What the statistics tab shows before its background scan finishes
+    const StratifiedSample& sample = loaded.statisticsSample();
+    timer.start();
+    const ProgressiveReport estimate = ProgressiveStatistics::estimate(sample, "2020-06");
+    out << "statistics estimate: " << timer.elapsed() << " ms from " << sample.sampleSize()
+        << " sampled rows, total expense " << QString::number(estimate.totalExpense.value, 'f', 2)
+        << " +/- " << QString::number(estimate.totalExpense.margin, 'f', 2) << Qt::endl;
+
+    // Scripts querying the live ledger: round trips alone, then one month's
+    // statistics, each a full scan of a snapshot
+    {
+        LedgerQueryServer server(&loaded);
+        const QString name = QString("MoneyTrackerBench-%1").arg(QCoreApplication::applicationPid());
+        if (!server.listen(name)) {
+            out << "failed to listen on " << name << ": " << server.errorString() << Qt::endl;
+            return 1;
+        }
+
+        LedgerQuery month;
+        month.op = LedgerQuery::Statistics;
+        month.startMSecs = QDateTime(QDate(2020, 6, 1), QTime(0, 0)).toMSecsSinceEpoch();
+        month.endMSecs = QDateTime(QDate(2020, 7, 1), QTime(0, 0)).toMSecsSinceEpoch() - 1;
+
+        runQueryClients(out, "query service ping", name, LedgerQuery(), 32, 2000, 16);
+        runQueryClients(out, "query service statistics", name, month, 16, 8, 4);
+    }
+
+    return 0;
+}
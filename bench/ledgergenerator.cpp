@@ -0,0 +1,62 @@
+#include "ledgergenerator.h"
+#include <QStringList>
+
+namespace {
+
+const QStringList kCategories = {"餐饮", "交通", "购物", "娱乐", "医疗", "住房", "工资", "转账", "其他"};
+const QStringList kMethods = {"微信支付", "支付宝", "现金", "银行卡"};
+const int kCounterparties = 300;
+const QStringList kOwnAccounts = {"我的账户", "储蓄账户", "信用卡", "余额宝"};
+
+} // namespace
+
+LedgerGenerator::LedgerGenerator(quint32 seed)
+    : m_random(seed)
+    , m_start(QDate(2016, 1, 1), QTime(0, 0, 0))
+    , m_spanSeconds(10 * 365 * 24 * 3600)
+{
+}
+
+Transaction LedgerGenerator::next()
+{
+    QString category = kCategories.at(m_random.bounded(int(kCategories.size())));
+    QString method = kMethods.at(m_random.bounded(int(kMethods.size())));
+    QString counterparty = QString("商户%1").arg(m_random.bounded(kCounterparties));
+
+    bool income = category == "工资" || (category == "转账" && m_random.bounded(2) == 0);
+    TransactionType type = income ? TransactionType::INCOME : TransactionType::EXPENSE;
+    double amount = income ? 1000.0 + m_random.bounded(900000) / 100.0
+                           : 1.0 + m_random.bounded(50000) / 100.0;
+
+    QDateTime timestamp = m_start.addSecs(m_random.bounded(m_spanSeconds));
+
+    if (income) {
+        return Transaction(type, amount, counterparty, "我的账户", category, method, timestamp);
+    }
+    return Transaction(type, amount, "我的账户", counterparty, category, method, timestamp);
+}
+
+void LedgerGenerator::nextTransfer(Transaction* expense, Transaction* income)
+{
+    const int from = m_random.bounded(int(kOwnAccounts.size()));
+    const int to = (from + 1 + m_random.bounded(int(kOwnAccounts.size()) - 1)) % kOwnAccounts.size();
+    const QString method = kMethods.at(m_random.bounded(int(kMethods.size())));
+    const double amount = 100.0 + m_random.bounded(1000000) / 100.0;
+    const QDateTime sent = m_start.addSecs(m_random.bounded(m_spanSeconds));
+    const QDateTime received = sent.addSecs(m_random.bounded(3600));
+
+    *expense = Transaction(TransactionType::EXPENSE, amount, kOwnAccounts.at(from), kOwnAccounts.at(to),
+                           "转账", method, sent);
+    *income = Transaction(TransactionType::INCOME, amount, kOwnAccounts.at(from), kOwnAccounts.at(to),
+                          "转账", method, received);
+}
+
+QList<Transaction> LedgerGenerator::generate(int count)
+{
+    QList<Transaction> transactions;
+    transactions.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        transactions.append(next());
+    }
+    return transactions;
+}
@@ -0,0 +1,30 @@
+#ifndef LEDGERGENERATOR_H
+#define LEDGERGENERATOR_H
+
+#include "transaction.h"
+#include <QList>
+#include <QRandomGenerator>
+
+// Deterministic synthetic ledger used by the benchmark tool.
+//
+// Rows look like what the app produces: a handful of categories and methods,
+// a few hundred counterparties, and timestamps spread over several years.
+class LedgerGenerator
+{
+public:
+    explicit LedgerGenerator(quint32 seed = 20240101);
+
+    Transaction next();
+    QList<Transaction> generate(int count);
+
+    // Both halves of a transfer between two of our own accounts, recorded
+    // up to an hour apart
+    void nextTransfer(Transaction* expense, Transaction* income);
+
+private:
+    QRandomGenerator m_random;
+    QDateTime m_start;
+    int m_spanSeconds;
+};
+
+#endif // LEDGERGENERATOR_H
@@ -0,0 +1,152 @@
+#include "billstablemodel.h"
+#include "transactionmanager.h"
+#include <QColor>
+
+namespace {
+
+enum Column {
+    TypeColumn,
+    AmountColumn,
+    AccountColumn,
+    CategoryColumn,
+    MethodColumn,
+    TimeColumn,
+    TagsColumn,
+    NoteColumn,
+    ColumnCount
+};
+
+} // namespace
+
+BillsTableModel::BillsTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+    , m_manager(nullptr)
+{
+}
+
+void BillsTableModel::setTransactions(const QList<Transaction> &transactions)
+{
+    beginResetModel();
+    m_window.setRows(transactions);
+    endResetModel();
+}
+
+void BillsTableModel::setRange(qint64 start, qint64 end)
+{
+    const int first = m_window.lowerBound(start);
+    const int last = qMax(first, m_window.lowerBound(end));
+    const int oldFirst = m_window.first();
+    const int oldLast = m_window.last();
+
+    if (first == oldFirst && last == oldLast) {
+        return;
+    }
+
+    // A jump to a range that does not overlap the old one replaces everything
+    if (first >= oldLast || last <= oldFirst) {
+        beginResetModel();
+        m_window.setBounds(first, last);
+        endResetModel();
+        return;
+    }
+
+    // Newest edge: rows enter or leave at the top
+    if (last > oldLast) {
+        beginInsertRows(QModelIndex(), 0, last - oldLast - 1);
+        m_window.setBounds(oldFirst, last);
+        endInsertRows();
+    } else if (last < oldLast) {
+        beginRemoveRows(QModelIndex(), 0, oldLast - last - 1);
+        m_window.setBounds(oldFirst, last);
+        endRemoveRows();
+    }
+
+    // Oldest edge: rows enter or leave at the bottom
+    const int size = m_window.size();
+    if (first < oldFirst) {
+        beginInsertRows(QModelIndex(), size, size + (oldFirst - first) - 1);
+        m_window.setBounds(first, last);
+        endInsertRows();
+    } else if (first > oldFirst) {
+        beginRemoveRows(QModelIndex(), size - (first - oldFirst), size - 1);
+        m_window.setBounds(first, last);
+        endRemoveRows();
+    }
+}
+
+void BillsTableModel::setAnomalySource(const TransactionManager *manager)
+{
+    m_manager = manager;
+}
+
+const DateWindow &BillsTableModel::window() const
+{
+    return m_window;
+}
+
+Transaction BillsTableModel::transactionAt(int row) const
+{
+    return m_window.at(m_window.last() - 1 - row);
+}
+
+int BillsTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_window.size();
+}
+
+int BillsTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant BillsTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_window.size()) {
+        return QVariant();
+    }
+
+    const Transaction &transaction = m_window.at(m_window.last() - 1 - index.row());
+
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+        case TypeColumn:     return transaction.getTypeString();
+        case AmountColumn:   return transaction.getDisplayAmount();
+        case AccountColumn:  return transaction.getToAccount();
+        case CategoryColumn: return transaction.getCategory();
+        case MethodColumn:   return transaction.getMethod();
+        case TimeColumn:     return transaction.getTimestamp().toString("yyyy-MM-dd hh:mm");
+        case TagsColumn:     return transaction.getTags().join(", ");
+        case NoteColumn:     return transaction.getNote();
+        }
+    } else if (role == Qt::ForegroundRole && index.column() == AmountColumn) {
+        if (transaction.getType() == TransactionType::INCOME) {
+            return QColor(39, 174, 96); // Green
+        }
+        return QColor(231, 76, 60); // Red
+    } else if ((role == Qt::BackgroundRole || role == Qt::ToolTipRole) && m_manager) {
+        const AnomalyDetector::Anomaly anomaly = m_manager->anomalyOf(transaction);
+        if (!anomaly.isFlagged()) {
+            return QVariant();
+        }
+        if (role == Qt::BackgroundRole) {
+            return QColor(253, 235, 208); // Pale orange
+        }
+        return AnomalyDetector::describe(anomaly, transaction);
+    }
+    return QVariant();
+}
+
+QVariant BillsTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+
+    static const char *const titles[ColumnCount] = {
+        "类型", "金额", "对方账户", "类别", "方式", "时间", "标签", "备注"
+    };
+    if (section < 0 || section >= ColumnCount) {
+        return QVariant();
+    }
+    return QString::fromUtf8(titles[section]);
+}
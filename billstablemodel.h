@@ -0,0 +1,40 @@
+#ifndef BILLSTABLEMODEL_H
+#define BILLSTABLEMODEL_H
+
+#include "datewindow.h"
+#include <QAbstractTableModel>
+
+class TransactionManager;
+
+// Bills tab rows, newest first, over a DateWindow.
+//
+// Moving the date range inserts or removes only the rows at the window's
+// edges (the newest rows are at the top, the oldest at the bottom), so the
+// view keeps its other rows and the totals update by delta. Cells are
+// formatted on demand for the visible rows only. Rows the manager flags as
+// unusual (see AnomalyDetector) are highlighted, with the reason as tooltip.
+class BillsTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit BillsTableModel(QObject *parent = nullptr);
+
+    void setTransactions(const QList<Transaction> &transactions);
+    void setRange(qint64 start, qint64 end); // [start, end) in msecs since epoch
+    void setAnomalySource(const TransactionManager *manager);
+
+    const DateWindow &window() const;
+    Transaction transactionAt(int row) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    DateWindow m_window;
+    const TransactionManager *m_manager;
+};
+
+#endif // BILLSTABLEMODEL_H
@@ -0,0 +1,80 @@
+#include "bloomfilter.h"
+
+#include <cmath>
+
+BloomFilter::BloomFilter()
+    : m_hashCount(0)
+{
+}
+
+BloomFilter::BloomFilter(int expectedKeys, double falsePositiveRate)
+    : m_hashCount(0)
+{
+    // m = -n ln p / (ln 2)^2 bits, k = m/n ln 2 probes
+    const double ln2 = std::log(2.0);
+    const double keys = qMax(1, expectedKeys);
+    const double rate = qBound(1e-6, falsePositiveRate, 0.5);
+    const qint64 bits = qMax<qint64>(64, qint64(std::ceil(-keys * std::log(rate) / (ln2 * ln2))));
+
+    m_bits = QByteArray(int((bits + 7) / 8), '\0');
+    m_hashCount = qBound(1, int(std::round(double(bits) / keys * ln2)), 16);
+}
+
+void BloomFilter::add(quint64 fingerprint)
+{
+    if (m_bits.isEmpty()) {
+        return;
+    }
+
+    const quint64 bitCount = quint64(m_bits.size()) * 8;
+    const quint64 h1 = fingerprint;
+    const quint64 h2 = ((fingerprint >> 32) | (fingerprint << 32)) | 1;
+    char* bits = m_bits.data();
+    for (int i = 0; i < m_hashCount; ++i) {
+        const quint64 bit = (h1 + i * h2) % bitCount;
+        bits[bit >> 3] |= char(1 << (bit & 7));
+    }
+}
+
+bool BloomFilter::mightContain(quint64 fingerprint) const
+{
+    if (m_bits.isEmpty()) {
+        return true;
+    }
+
+    const quint64 bitCount = quint64(m_bits.size()) * 8;
+    const quint64 h1 = fingerprint;
+    const quint64 h2 = ((fingerprint >> 32) | (fingerprint << 32)) | 1;
+    const char* bits = m_bits.constData();
+    for (int i = 0; i < m_hashCount; ++i) {
+        const quint64 bit = (h1 + i * h2) % bitCount;
+        if (!(bits[bit >> 3] & char(1 << (bit & 7)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BloomFilter::isEmpty() const
+{
+    return m_bits.isEmpty();
+}
+
+QByteArray BloomFilter::toByteArray() const
+{
+    if (m_bits.isEmpty()) {
+        return QByteArray();
+    }
+    return char(m_hashCount) + m_bits;
+}
+
+BloomFilter BloomFilter::fromByteArray(const QByteArray& data)
+{
+    BloomFilter filter;
+    if (data.size() < 2 || data.at(0) < 1 || data.at(0) > 16) {
+        return filter;
+    }
+    filter.m_hashCount = data.at(0);
+    filter.m_bits = data.mid(1);
+    return filter;
+}
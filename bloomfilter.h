@@ -0,0 +1,30 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <QByteArray>
+
+// Bloom filter over 64-bit fingerprints.
+//
+// Probe positions come from the two halves of the fingerprint (double
+// hashing), so the key is never rehashed. A default-constructed filter holds
+// no information and reports every key as possibly present.
+class BloomFilter
+{
+public:
+    BloomFilter();
+    BloomFilter(int expectedKeys, double falsePositiveRate);
+
+    void add(quint64 fingerprint);
+    bool mightContain(quint64 fingerprint) const;
+    bool isEmpty() const;
+
+    // Hash count followed by the bit array
+    QByteArray toByteArray() const;
+    static BloomFilter fromByteArray(const QByteArray& data);
+
+private:
+    QByteArray m_bits;
+    int m_hashCount;
+};
+
+#endif // BLOOMFILTER_H
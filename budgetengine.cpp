@@ -0,0 +1,229 @@
+#include "budgetengine.h"
+#include "ledgerpartitions.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+
+QString BudgetRule::describe() const
+{
+    const QString scope = category.isEmpty() ? QStringLiteral("全部类别") : category;
+    const QString what = type == TransactionType::INCOME ? QStringLiteral("收入") : QStringLiteral("支出");
+    if (kind == SingleAmount) {
+        return QString("%1 单笔%2超过 ¥ %3").arg(scope, what).arg(threshold, 0, 'f', 2);
+    }
+    return QString("%1 每月%2预算 ¥ %3").arg(scope, what).arg(threshold, 0, 'f', 2);
+}
+
+QJsonObject BudgetRule::toJson() const
+{
+    QJsonObject json;
+    json["kind"] = kind == SingleAmount ? "single" : "monthly";
+    json["type"] = static_cast<int>(type);
+    if (!category.isEmpty()) {
+        json["category"] = category;
+    }
+    json["threshold"] = threshold;
+    return json;
+}
+
+BudgetRule BudgetRule::fromJson(const QJsonObject& json)
+{
+    BudgetRule rule;
+    rule.kind = json["kind"].toString() == "single" ? SingleAmount : MonthlyTotal;
+    rule.type = static_cast<TransactionType>(json["type"].toInt(static_cast<int>(TransactionType::EXPENSE)));
+    rule.category = json["category"].toString();
+    rule.threshold = json["threshold"].toDouble();
+    return rule;
+}
+
+BudgetEngine::BudgetEngine(QObject* parent)
+    : QObject(parent)
+{
+}
+
+void BudgetEngine::setRules(const QList<BudgetRule>& rules)
+{
+    m_rules = rules;
+    m_byCategory.clear();
+    m_anyCategory.clear();
+    for (int i = 0; i < m_rules.size(); ++i) {
+        if (m_rules.at(i).category.isEmpty()) {
+            m_anyCategory.append(i);
+        } else {
+            m_byCategory[m_rules.at(i).category].append(i);
+        }
+    }
+    clearState();
+}
+
+QList<BudgetRule> BudgetEngine::rules() const
+{
+    return m_rules;
+}
+
+bool BudgetEngine::isEmpty() const
+{
+    return m_rules.isEmpty();
+}
+
+template <typename Function>
+void BudgetEngine::forEachMatch(const Transaction& transaction, Function function) const
+{
+    auto visit = [&](const QList<int>& candidates) {
+        for (int rule : candidates) {
+            if (m_rules.at(rule).type == transaction.getType()) {
+                function(rule);
+            }
+        }
+    };
+
+    auto it = m_byCategory.constFind(transaction.getCategory());
+    if (it != m_byCategory.constEnd()) {
+        visit(it.value());
+    }
+    visit(m_anyCategory);
+}
+
+void BudgetEngine::addTransaction(const Transaction& transaction)
+{
+    if (m_rules.isEmpty()) {
+        return;
+    }
+
+    QString month;
+    forEachMatch(transaction, [&](int rule) {
+        const BudgetRule& budget = m_rules.at(rule);
+        if (budget.kind == BudgetRule::SingleAmount) {
+            if (transaction.getAmount() > budget.threshold) {
+                queue(rule, QString(), transaction.getAmount(), transaction, true);
+            }
+            return;
+        }
+
+        if (transaction.getTimestampMSecs() == Transaction::InvalidTimestamp) {
+            return;
+        }
+        if (month.isEmpty()) {
+            month = LedgerPartitions::monthKey(transaction.getTimestampMSecs());
+        }
+        RuleState& state = m_state[rule];
+        CompensatedSum& total = state.totals[month];
+        total.add(transaction.getAmount());
+        if (total.value() > budget.threshold && !state.exceeded.contains(month)) {
+            state.exceeded.insert(month);
+            queue(rule, month, total.value(), transaction, true);
+        }
+    });
+}
+
+void BudgetEngine::removeTransaction(const Transaction& transaction)
+{
+    if (m_rules.isEmpty()) {
+        return;
+    }
+
+    QString month;
+    forEachMatch(transaction, [&](int rule) {
+        const BudgetRule& budget = m_rules.at(rule);
+        if (budget.kind != BudgetRule::MonthlyTotal
+            || transaction.getTimestampMSecs() == Transaction::InvalidTimestamp) {
+            return;
+        }
+        if (month.isEmpty()) {
+            month = LedgerPartitions::monthKey(transaction.getTimestampMSecs());
+        }
+        RuleState& state = m_state[rule];
+        CompensatedSum& total = state.totals[month];
+        total.add(-transaction.getAmount());
+        if (total.value() <= budget.threshold && state.exceeded.remove(month)) {
+            queue(rule, month, total.value(), transaction, false);
+        }
+    });
+}
+
+void BudgetEngine::clearState()
+{
+    m_state.assign(m_rules.size(), RuleState());
+    m_pending.clear();
+}
+
+double BudgetEngine::monthTotal(int rule, const QString& month) const
+{
+    if (rule < 0 || rule >= int(m_state.size())) {
+        return 0.0;
+    }
+    return m_state[rule].totals.value(month).value();
+}
+
+bool BudgetEngine::isExceeded(int rule, const QString& month) const
+{
+    return rule >= 0 && rule < int(m_state.size()) && m_state[rule].exceeded.contains(month);
+}
+
+void BudgetEngine::flush()
+{
+    // Emitted from a copy: a receiver may edit the ledger and queue more
+    const QList<PendingAlert> pending = m_pending;
+    m_pending.clear();
+    for (const auto& entry : pending) {
+        if (entry.raised) {
+            emit alertRaised(entry.alert);
+        } else {
+            emit alertCleared(entry.alert);
+        }
+    }
+}
+
+void BudgetEngine::discardPending()
+{
+    m_pending.clear();
+}
+
+void BudgetEngine::queue(int rule, const QString& month, double amount, const Transaction& transaction,
+                         bool raised)
+{
+    PendingAlert entry;
+    entry.alert.rule = rule;
+    entry.alert.budget = m_rules.at(rule);
+    entry.alert.month = month;
+    entry.alert.amount = amount;
+    entry.alert.transaction = transaction;
+    entry.raised = raised;
+    m_pending.append(entry);
+}
+
+QList<BudgetRule> BudgetEngine::loadRules(const QString& filename, bool* ok)
+{
+    QList<BudgetRule> rules;
+    QFile file(filename);
+    bool success = file.open(QIODevice::ReadOnly);
+    if (success) {
+        QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+        success = doc.isArray();
+        for (const auto& value : doc.array()) {
+            if (value.isObject()) {
+                rules.append(BudgetRule::fromJson(value.toObject()));
+            }
+        }
+    }
+    if (ok) {
+        *ok = success;
+    }
+    return rules;
+}
+
+bool BudgetEngine::saveRules(const QString& filename, const QList<BudgetRule>& rules)
+{
+    QJsonArray array;
+    for (const auto& rule : rules) {
+        array.append(rule.toJson());
+    }
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(array).toJson());
+    return file.commit();
+}
@@ -0,0 +1,97 @@
+#ifndef BUDGETENGINE_H
+#define BUDGETENGINE_H
+
+#include "transaction.h"
+#include "compensatedsum.h"
+#include <QObject>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QSet>
+
+#include <vector>
+
+struct BudgetRule {
+    enum Kind {
+        MonthlyTotal,  // total of the matching rows in a calendar month
+        SingleAmount   // any one matching row
+    };
+
+    Kind kind = MonthlyTotal;
+    TransactionType type = TransactionType::EXPENSE;
+    QString category;  // empty matches every category
+    double threshold = 0.0;
+
+    QString describe() const;
+    QJsonObject toJson() const;
+    static BudgetRule fromJson(const QJsonObject& json);
+};
+
+struct BudgetAlert {
+    int rule = -1;          // index into BudgetEngine::rules()
+    BudgetRule budget;
+    QString month;          // "yyyy-MM" for MonthlyTotal rules
+    double amount = 0.0;    // the month's total, or the row's amount
+    Transaction transaction; // the row that crossed the threshold
+};
+
+// Budget and alert rules evaluated as rows enter and leave the ledger.
+//
+// Rules are compiled into an index by category (plus a list of rules for
+// every category), so a row only visits the rules that can match it. Each
+// MonthlyTotal rule keeps a running total per month and the set of months
+// over budget; crossing the threshold in either direction queues an alert.
+// TransactionManager feeds every indexed and unindexed row, emits the queued
+// alerts after user edits and drops them after loads, so opening a ledger
+// does not replay its history as alerts.
+class BudgetEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BudgetEngine(QObject* parent = nullptr);
+
+    void setRules(const QList<BudgetRule>& rules); // clears the running state
+    QList<BudgetRule> rules() const;
+    bool isEmpty() const;
+
+    void addTransaction(const Transaction& transaction);
+    void removeTransaction(const Transaction& transaction);
+    void clearState();
+
+    double monthTotal(int rule, const QString& month) const;
+    bool isExceeded(int rule, const QString& month) const;
+
+    void flush();          // emits the queued alerts
+    void discardPending();
+
+    static QList<BudgetRule> loadRules(const QString& filename, bool* ok = nullptr);
+    static bool saveRules(const QString& filename, const QList<BudgetRule>& rules);
+
+signals:
+    void alertRaised(const BudgetAlert& alert);
+    void alertCleared(const BudgetAlert& alert);
+
+private:
+    struct RuleState {
+        QHash<QString, CompensatedSum> totals; // month -> running total
+        QSet<QString> exceeded;
+    };
+
+    struct PendingAlert {
+        BudgetAlert alert;
+        bool raised;
+    };
+
+    template <typename Function>
+    void forEachMatch(const Transaction& transaction, Function function) const;
+    void queue(int rule, const QString& month, double amount, const Transaction& transaction, bool raised);
+
+    QList<BudgetRule> m_rules;
+    QHash<QString, QList<int>> m_byCategory;
+    QList<int> m_anyCategory;
+    std::vector<RuleState> m_state;
+    QList<PendingAlert> m_pending;
+};
+
+#endif // BUDGETENGINE_H
@@ -0,0 +1,35 @@
+#ifndef COMPENSATEDSUM_H
+#define COMPENSATEDSUM_H
+
+#include <QtGlobal>
+
+#include <cmath>
+
+// Running sum with Neumaier compensation. The low-order bits lost by each
+// addition are kept in a second term, so long series (a window scrubbed back
+// and forth, or millions of rows merged from chunks) do not drift.
+struct CompensatedSum {
+    double sum = 0.0;
+    double compensation = 0.0;
+
+    void add(double value)
+    {
+        const double total = sum + value;
+        if (std::abs(sum) >= std::abs(value)) {
+            compensation += (sum - total) + value;
+        } else {
+            compensation += (value - total) + sum;
+        }
+        sum = total;
+    }
+
+    void merge(const CompensatedSum& other)
+    {
+        add(other.sum);
+        compensation += other.compensation;
+    }
+
+    double value() const { return sum + compensation; }
+};
+
+#endif // COMPENSATEDSUM_H
@@ -0,0 +1,725 @@
+#include "csvimporter.h"
+#include "transactionmanager.h"
+#include <QFile>
+#include <QHash>
+#include <QThread>
+#include <QThreadPool>
+
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CSV_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+struct FieldRef {
+    const char* data;
+    int size;
+};
+
+FieldRef trimmed(FieldRef field)
+{
+    while (field.size > 0 && (field.data[0] == ' ' || field.data[0] == '\t')) {
+        ++field.data;
+        --field.size;
+    }
+    while (field.size > 0 && (field.data[field.size - 1] == ' ' || field.data[field.size - 1] == '\t')) {
+        --field.size;
+    }
+    return field;
+}
+
+// Splits [begin, end) into records. Field ends are found through a cached
+// 16-byte mask of delimiter, quote, CR and LF positions, so consecutive
+// short fields share one vector compare.
+class RecordReader
+{
+public:
+    RecordReader(const char* begin, const char* end, char delimiter)
+        : m_pos(begin)
+        , m_end(end)
+        , m_delimiter(delimiter)
+        , m_blockBase(nullptr)
+        , m_mask(0)
+    {
+    }
+
+    const char* position() const { return m_pos; }
+
+    // Fields point into the input or into storage owned by the reader that
+    // stays valid until the next call
+    bool next(std::vector<FieldRef>* fields)
+    {
+        fields->clear();
+        m_unescaped.clear();
+        if (m_pos >= m_end) {
+            return false;
+        }
+
+        for (;;) {
+            const char* p = m_pos;
+            FieldRef field;
+            if (p < m_end && *p == '"') {
+                p = readQuoted(p + 1, &field);
+                if (p < m_end && *p != m_delimiter && *p != '\n' && *p != '\r') {
+                    p = fieldEnd(p); // text after the closing quote is dropped
+                }
+            } else {
+                p = fieldEnd(p);
+                field = FieldRef{m_pos, int(p - m_pos)};
+            }
+            fields->push_back(field);
+
+            if (p >= m_end) {
+                m_pos = m_end;
+                return true;
+            }
+            const char c = *p++;
+            if (c == m_delimiter) {
+                m_pos = p;
+                continue;
+            }
+            if (c == '\r' && p < m_end && *p == '\n') {
+                ++p;
+            }
+            m_pos = p;
+            return true;
+        }
+    }
+
+private:
+    bool isSpecial(char c) const
+    {
+        return c == m_delimiter || c == '"' || c == '\n' || c == '\r';
+    }
+
+    const char* nextSpecial(const char* p)
+    {
+#ifdef CSV_USE_SSE2
+        for (;;) {
+            if (!m_blockBase || p < m_blockBase || p - m_blockBase >= 16) {
+                if (m_end - p < 16) {
+                    break;
+                }
+                loadBlock(p);
+            }
+            const quint32 mask = m_mask & (0xFFFFFFFFu << (p - m_blockBase));
+            if (mask) {
+                return m_blockBase + qCountTrailingZeroBits(mask);
+            }
+            p = m_blockBase + 16;
+        }
+#endif
+        while (p < m_end && !isSpecial(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+#ifdef CSV_USE_SSE2
+    void loadBlock(const char* p)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(m_delimiter)),
+                         _mm_cmpeq_epi8(block, _mm_set1_epi8('"'))),
+            _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')),
+                         _mm_cmpeq_epi8(block, _mm_set1_epi8('\r'))));
+        m_blockBase = p;
+        m_mask = quint32(_mm_movemask_epi8(hits));
+    }
+#endif
+
+    // A quote inside an unquoted field is literal
+    const char* fieldEnd(const char* p)
+    {
+        for (;;) {
+            p = nextSpecial(p);
+            if (p < m_end && *p == '"') {
+                ++p;
+                continue;
+            }
+            return p;
+        }
+    }
+
+    // p is just past the opening quote; returns the position after the
+    // closing one. Doubled quotes are unescaped into m_unescaped.
+    const char* readQuoted(const char* p, FieldRef* field)
+    {
+        const char* close = static_cast<const char*>(std::memchr(p, '"', m_end - p));
+        if (!close) {
+            *field = FieldRef{p, int(m_end - p)};
+            return m_end;
+        }
+        if (close + 1 >= m_end || close[1] != '"') {
+            *field = FieldRef{p, int(close - p)};
+            return close + 1;
+        }
+
+        QByteArray buffer;
+        for (;;) {
+            buffer.append(p, close - p + 1); // keeps one quote of the pair
+            p = close + 2;
+            close = static_cast<const char*>(std::memchr(p, '"', m_end - p));
+            if (!close) {
+                buffer.append(p, m_end - p);
+                p = m_end;
+                break;
+            }
+            if (close + 1 < m_end && close[1] == '"') {
+                continue;
+            }
+            buffer.append(p, close - p);
+            p = close + 1;
+            break;
+        }
+        m_unescaped.append(buffer);
+        *field = FieldRef{m_unescaped.constLast().constData(), int(buffer.size())};
+        return p;
+    }
+
+    const char* m_pos;
+    const char* m_end;
+    char m_delimiter;
+    const char* m_blockBase;
+    quint32 m_mask;
+    QList<QByteArray> m_unescaped;
+};
+
+// Chunk boundaries at the first record end after every chunkSize bytes. The
+// records are found by the same RecordReader the parser threads use, so a
+// cut never falls inside what they read as one quoted field, whatever the
+// stray quotes in unquoted fields. The pass only finds field ends, a small
+// part of the work of building rows.
+QList<qint64> splitRecords(const char* data, qint64 start, qint64 size, qint64 chunkSize, char delimiter)
+{
+    QList<qint64> bounds{start};
+    RecordReader reader(data + start, data + size, delimiter);
+    std::vector<FieldRef> fields;
+    qint64 target = start + chunkSize;
+    while (target < size && reader.next(&fields)) {
+        const qint64 pos = reader.position() - data;
+        if (pos >= target && pos < size) {
+            bounds.append(pos);
+            target = pos + chunkSize;
+        }
+    }
+    bounds.append(size);
+    return bounds;
+}
+
+bool parseAmount(FieldRef field, double* amount)
+{
+    if (field.size == 0) {
+        return false;
+    }
+    bool ok = false;
+    *amount = QByteArray::fromRawData(field.data, field.size).toDouble(&ok);
+    if (ok) {
+        return true;
+    }
+
+    // Formatted amounts: one number with thousands separators and at most
+    // one decimal point, currency symbols or codes around it, and the sign
+    // as the first or last character or "(12.00)" around the whole field.
+    // Anything else is a malformed row rather than a guess.
+    const char* begin = field.data;
+    const char* end = field.data + field.size;
+    bool negative = false;
+    if (*begin == '(') {
+        if (field.size < 2 || end[-1] != ')') {
+            return false;
+        }
+        negative = true;
+        ++begin;
+        --end;
+    } else if (*begin == '-') {
+        negative = true;
+        ++begin;
+    } else if (end[-1] == '-') {
+        negative = true;
+        --end;
+    }
+
+    QByteArray digits;
+    bool inNumber = false;
+    bool decimal = false;
+    for (const char* p = begin; p < end; ++p) {
+        const char c = *p;
+        if (c >= '0' && c <= '9') {
+            if (!inNumber && !digits.isEmpty()) {
+                return false; // a second number
+            }
+            inNumber = true;
+            digits.append(c);
+        } else if (inNumber && c == '.') {
+            if (decimal) {
+                return false;
+            }
+            decimal = true;
+            digits.append(c);
+        } else if (inNumber && c == ',') {
+            if (decimal) {
+                return false; // "1.234,56" is not read as 1.23456
+            }
+        } else {
+            inNumber = false;
+            const bool symbol = uchar(c) >= 0x80 || c == ' ' || c == '$' || (c >= 'A' && c <= 'Z')
+                                || (c >= 'a' && c <= 'z');
+            if (!symbol) {
+                return false;
+            }
+        }
+    }
+    if (digits.isEmpty()) {
+        return false;
+    }
+    *amount = digits.toDouble(&ok);
+    if (negative) {
+        *amount = -*amount;
+    }
+    return ok;
+}
+
+bool matchesAny(FieldRef field, std::initializer_list<const char*> tokens)
+{
+    const QLatin1String value(field.data, field.size);
+    for (const char* token : tokens) {
+        if (value.compare(QLatin1String(token), Qt::CaseInsensitive) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Type column values; the digits follow the JSON "type" field
+bool parseType(FieldRef field, TransactionType* type)
+{
+    if (matchesAny(field, {"0", "income", "in", "credit", "cr", "+", "收入"})) {
+        *type = TransactionType::INCOME;
+        return true;
+    }
+    if (matchesAny(field, {"1", "expense", "out", "debit", "dr", "-", "支出"})) {
+        *type = TransactionType::EXPENSE;
+        return true;
+    }
+    return false;
+}
+
+bool readNumber(const char** p, const char* end, int maxDigits, int* value)
+{
+    int digits = 0;
+    *value = 0;
+    while (*p < end && digits < maxDigits && **p >= '0' && **p <= '9') {
+        *value = *value * 10 + (**p - '0');
+        ++*p;
+        ++digits;
+    }
+    return digits > 0;
+}
+
+// Turns one record into a Transaction. Each parser thread has its own
+// builder, so the caches need no locking.
+class RowBuilder
+{
+public:
+    explicit RowBuilder(const CsvColumnMapping& mapping) : m_mapping(mapping) {}
+
+    bool build(const std::vector<FieldRef>& fields, Transaction* transaction)
+    {
+        double amount = 0.0;
+        if (!parseAmount(field(fields, m_mapping.amount), &amount)) {
+            return false;
+        }
+
+        TransactionType type = amount < 0 ? TransactionType::EXPENSE : TransactionType::INCOME;
+        if (m_mapping.type >= 0) {
+            parseType(field(fields, m_mapping.type), &type);
+        }
+
+        QUuid id;
+        if (m_mapping.id >= 0) {
+            FieldRef idField = field(fields, m_mapping.id);
+            const QLatin1String key(idField.data, idField.size);
+            id = QUuid::fromString(key);
+            if (id.isNull() && idField.size > 0) {
+                // A bank's own transaction number: importing the file again
+                // gives the row the same id
+                id = Transaction::foreignId(QByteArray(idField.data, idField.size));
+            }
+        }
+        if (id.isNull()) {
+            id = QUuid::createUuid();
+        }
+
+        transaction->setId(id);
+        transaction->setType(type);
+        transaction->setAmount(qAbs(amount));
+        transaction->setFromAccount(text(field(fields, m_mapping.fromAccount)));
+        transaction->setToAccount(text(field(fields, m_mapping.toAccount)));
+        transaction->setCategory(text(field(fields, m_mapping.category)));
+        transaction->setMethod(text(field(fields, m_mapping.method)));
+        FieldRef note = field(fields, m_mapping.note);
+        transaction->setNote(QString::fromUtf8(note.data, note.size));
+        transaction->setTimestampMSecs(timestamp(field(fields, m_mapping.timestamp)));
+        if (m_mapping.tags >= 0) {
+            FieldRef tags = field(fields, m_mapping.tags);
+            transaction->setTags(Transaction::parseTags(QString::fromUtf8(tags.data, tags.size)));
+        }
+        return true;
+    }
+
+private:
+    static FieldRef field(const std::vector<FieldRef>& fields, int column)
+    {
+        if (column < 0 || column >= int(fields.size())) {
+            return FieldRef{"", 0};
+        }
+        return trimmed(fields[column]);
+    }
+
+    // Repeated values decode once per chunk; TransactionManager interns
+    // them across the ledger afterwards
+    QString text(FieldRef field)
+    {
+        if (field.size == 0) {
+            return QString();
+        }
+        auto it = m_strings.constFind(QByteArray::fromRawData(field.data, field.size));
+        if (it != m_strings.constEnd()) {
+            return it.value();
+        }
+        QString value = QString::fromUtf8(field.data, field.size);
+        m_strings.insert(QByteArray(field.data, field.size), value);
+        return value;
+    }
+
+    qint64 timestamp(FieldRef field)
+    {
+        if (field.size == 0) {
+            return Transaction::InvalidTimestamp;
+        }
+        if (!m_mapping.timestampFormat.isEmpty()) {
+            QDateTime dateTime = QDateTime::fromString(QString::fromUtf8(field.data, field.size),
+                                                       m_mapping.timestampFormat);
+            return dateTime.isValid() ? dateTime.toMSecsSinceEpoch() : Transaction::InvalidTimestamp;
+        }
+
+        // Fast path: yyyy-MM-dd, yyyy/MM/dd or yyyy.MM.dd, optionally followed
+        // by [ T]HH:mm[:ss[.zzz]]
+        const char* p = field.data;
+        const char* end = field.data + field.size;
+        int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0, msec = 0;
+        bool fast = readNumber(&p, end, 4, &year) && p < end && (*p == '-' || *p == '/' || *p == '.');
+        if (fast) {
+            const char separator = *p++;
+            fast = readNumber(&p, end, 2, &month) && p < end && *p++ == separator
+                   && readNumber(&p, end, 2, &day);
+        }
+        if (fast && p < end && (*p == ' ' || *p == 'T')) {
+            ++p;
+            fast = readNumber(&p, end, 2, &hour) && p < end && *p++ == ':'
+                   && readNumber(&p, end, 2, &minute);
+            if (fast && p < end && *p == ':') {
+                ++p;
+                fast = readNumber(&p, end, 2, &second);
+                if (fast && p < end && *p == '.') {
+                    ++p;
+                    fast = readNumber(&p, end, 3, &msec);
+                }
+            }
+        }
+
+        const QDate date(year, month, day);
+        const QTime time(hour, minute, second, msec);
+        if (fast && p == end && date.isValid() && time.isValid()) {
+            return localMSecs(date, time);
+        }
+
+        // Zone suffixes and anything unusual
+        QDateTime dateTime = QDateTime::fromString(QString::fromUtf8(field.data, field.size), Qt::ISODate);
+        return dateTime.isValid() ? dateTime.toMSecsSinceEpoch() : Transaction::InvalidTimestamp;
+    }
+
+    // Local midnight is looked up once per day; days with a UTC offset
+    // change take the full conversion
+    qint64 localMSecs(const QDate& date, const QTime& time)
+    {
+        const qint64 julianDay = date.toJulianDay();
+        auto it = m_dayStarts.constFind(julianDay);
+        if (it == m_dayStarts.constEnd()) {
+            const qint64 start = date.startOfDay().toMSecsSinceEpoch();
+            const qint64 next = date.addDays(1).startOfDay().toMSecsSinceEpoch();
+            it = m_dayStarts.insert(julianDay, next - start == 86400000 ? start : Transaction::InvalidTimestamp);
+        }
+        if (it.value() != Transaction::InvalidTimestamp) {
+            return it.value() + time.msecsSinceStartOfDay();
+        }
+        return QDateTime(date, time).toMSecsSinceEpoch();
+    }
+
+    const CsvColumnMapping& m_mapping;
+    QHash<QByteArray, QString> m_strings;
+    QHash<qint64, qint64> m_dayStarts;
+};
+
+struct ChunkResult {
+    QList<Transaction> rows;
+    int skipped = 0;
+};
+
+void parseChunk(const char* begin, const char* end, char delimiter, const CsvColumnMapping& mapping,
+                ChunkResult* result)
+{
+    RecordReader reader(begin, end, delimiter);
+    RowBuilder builder(mapping);
+    std::vector<FieldRef> fields;
+    result->rows.reserve(int((end - begin) / 64));
+
+    while (reader.next(&fields)) {
+        if (fields.size() == 1 && fields[0].size == 0) {
+            continue; // blank line
+        }
+        Transaction transaction;
+        if (builder.build(fields, &transaction)) {
+            result->rows.append(transaction);
+        } else {
+            ++result->skipped;
+        }
+    }
+}
+
+int columnOf(const QStringList& header, std::initializer_list<const char*> names)
+{
+    for (int column = 0; column < header.size(); ++column) {
+        const QString name = header.at(column).trimmed();
+        for (const char* candidate : names) {
+            if (name.compare(QString::fromUtf8(candidate), Qt::CaseInsensitive) == 0) {
+                return column;
+            }
+        }
+    }
+    return -1;
+}
+
+} // namespace
+
+bool CsvColumnMapping::isValid() const
+{
+    return amount >= 0;
+}
+
+CsvColumnMapping CsvColumnMapping::fromHeader(const QStringList& header)
+{
+    CsvColumnMapping mapping;
+    mapping.id = columnOf(header, {"id", "交易号", "交易单号", "流水号"});
+    mapping.type = columnOf(header, {"type", "收/支", "收支", "收支类型", "direction"});
+    mapping.amount = columnOf(header, {"amount", "金额", "金额(元)", "金额（元）", "交易金额"});
+    mapping.fromAccount = columnOf(header, {"fromAccount", "from", "付款方", "付款账户", "付款人"});
+    mapping.toAccount = columnOf(header, {"toAccount", "to", "交易对方", "收款方", "收款人", "对方",
+                                          "payee", "counterparty"});
+    mapping.category = columnOf(header, {"category", "分类", "类别", "交易分类"});
+    mapping.method = columnOf(header, {"method", "支付方式", "收/付款方式", "付款方式", "payment method"});
+    mapping.note = columnOf(header, {"note", "备注", "商品", "商品说明", "memo", "description"});
+    mapping.timestamp = columnOf(header, {"timestamp", "date", "time", "datetime", "交易时间",
+                                          "交易创建时间", "日期", "时间"});
+    mapping.tags = columnOf(header, {"tags", "标签"});
+    return mapping;
+}
+
+CsvImporter::CsvImporter()
+    : m_delimiter(',')
+    , m_hasHeader(true)
+    , m_mappingSet(false)
+    , m_threadCount(QThread::idealThreadCount())
+    , m_chunkSize(DefaultChunkSize)
+    , m_batchSize(DefaultBatchSize)
+    , m_skipDuplicates(true)
+    , m_rowsParsed(0)
+    , m_rowsSkipped(0)
+    , m_rowsAdded(0)
+{
+}
+
+void CsvImporter::setDelimiter(char delimiter)
+{
+    m_delimiter = delimiter;
+}
+
+void CsvImporter::setHasHeader(bool hasHeader)
+{
+    m_hasHeader = hasHeader;
+}
+
+void CsvImporter::setColumnMapping(const CsvColumnMapping& mapping)
+{
+    m_mapping = mapping;
+    m_mappingSet = true;
+}
+
+void CsvImporter::setThreadCount(int threads)
+{
+    m_threadCount = qMax(1, threads);
+}
+
+void CsvImporter::setChunkSize(int bytes)
+{
+    m_chunkSize = qMax(1024, bytes);
+}
+
+void CsvImporter::setBatchSize(int rows)
+{
+    m_batchSize = qMax(1, rows);
+}
+
+void CsvImporter::setSkipDuplicates(bool skip)
+{
+    m_skipDuplicates = skip;
+}
+
+bool CsvImporter::importFile(const QString& filename, TransactionManager* manager)
+{
+    m_duplicates.clear();
+    m_rowsAdded = 0;
+
+    QList<Transaction> transactions;
+    if (!parseFile(filename, &transactions)) {
+        return false;
+    }
+
+    // Checked as a whole before batching, so repeats inside the file are
+    // weighed against the ledger as it was before this import
+    if (m_skipDuplicates) {
+        transactions = manager->filterDuplicates(transactions, &m_duplicates);
+    }
+
+    for (qsizetype i = 0; i < transactions.size(); i += m_batchSize) {
+        const QList<Transaction> batch = transactions.mid(i, m_batchSize);
+        if (!manager->addTransactions(batch)) {
+            m_errorString = manager->errorString();
+            return false;
+        }
+        m_rowsAdded += int(batch.size());
+    }
+    return true;
+}
+
+bool CsvImporter::parseFile(const QString& filename, QList<Transaction>* transactions)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_errorString = file.errorString();
+        return false;
+    }
+
+    const qint64 size = file.size();
+    const uchar* mapped = size > 0 ? file.map(0, size) : nullptr;
+    if (mapped) {
+        return parseData(reinterpret_cast<const char*>(mapped), size, transactions);
+    }
+
+    const QByteArray data = file.readAll();
+    return parseData(data.constData(), data.size(), transactions);
+}
+
+bool CsvImporter::parse(const QByteArray& data, QList<Transaction>* transactions)
+{
+    return parseData(data.constData(), data.size(), transactions);
+}
+
+int CsvImporter::rowsParsed() const
+{
+    return m_rowsParsed;
+}
+
+int CsvImporter::rowsSkipped() const
+{
+    return m_rowsSkipped;
+}
+
+int CsvImporter::rowsAdded() const
+{
+    return m_rowsAdded;
+}
+
+QList<Transaction> CsvImporter::duplicates() const
+{
+    return m_duplicates;
+}
+
+QString CsvImporter::errorString() const
+{
+    return m_errorString;
+}
+
+bool CsvImporter::parseData(const char* data, qint64 size, QList<Transaction>* transactions)
+{
+    m_rowsParsed = 0;
+    m_rowsSkipped = 0;
+    m_errorString.clear();
+
+    qint64 start = 0;
+    if (size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        start = 3; // UTF-8 byte order mark
+    }
+    if (start >= size) {
+        return true;
+    }
+
+    CsvColumnMapping mapping = m_mapping;
+    if (m_hasHeader) {
+        RecordReader reader(data + start, data + size, m_delimiter);
+        std::vector<FieldRef> fields;
+        reader.next(&fields);
+        if (!m_mappingSet) {
+            QStringList header;
+            for (const auto& field : fields) {
+                header.append(QString::fromUtf8(field.data, field.size));
+            }
+            mapping = CsvColumnMapping::fromHeader(header);
+        }
+        start = reader.position() - data;
+    }
+    if (!mapping.isValid()) {
+        m_errorString = "找不到金额列";
+        return false;
+    }
+
+    const QList<qint64> bounds = splitRecords(data, start, size, m_chunkSize, m_delimiter);
+    const int chunkCount = int(bounds.size()) - 1;
+    std::vector<ChunkResult> results(chunkCount);
+    auto parseOne = [&](int chunk) {
+        parseChunk(data + bounds.at(chunk), data + bounds.at(chunk + 1), m_delimiter, mapping,
+                   &results[chunk]);
+    };
+
+    if (chunkCount == 1 || m_threadCount == 1) {
+        for (int chunk = 0; chunk < chunkCount; ++chunk) {
+            parseOne(chunk);
+        }
+    } else {
+        QThreadPool pool;
+        pool.setMaxThreadCount(m_threadCount);
+        for (int chunk = 0; chunk < chunkCount; ++chunk) {
+            pool.start([&parseOne, chunk]() { parseOne(chunk); });
+        }
+        pool.waitForDone();
+    }
+
+    qsizetype total = transactions->size();
+    for (const auto& result : results) {
+        total += result.rows.size();
+    }
+    transactions->reserve(total);
+    for (auto& result : results) {
+        m_rowsParsed += int(result.rows.size());
+        m_rowsSkipped += result.skipped;
+        transactions->append(result.rows);
+        result.rows.clear();
+    }
+    return true;
+}
@@ -0,0 +1,98 @@
+#ifndef CSVIMPORTER_H
+#define CSVIMPORTER_H
+
+#include "transaction.h"
+#include <QList>
+#include <QStringList>
+
+class TransactionManager;
+
+// Zero-based CSV column for each Transaction field; -1 leaves the field
+// empty. Only the amount is required.
+//
+// Without a type column the sign of the amount decides: negative amounts
+// are expenses, everything else is income. Amounts are stored unsigned.
+struct CsvColumnMapping {
+    int id = -1;
+    int type = -1;
+    int amount = -1;
+    int fromAccount = -1;
+    int toAccount = -1;
+    int category = -1;
+    int method = -1;
+    int note = -1;
+    int timestamp = -1;
+    int tags = -1;
+
+    // QDateTime::fromString() format for the timestamp column. Empty accepts
+    // ISO 8601 and "yyyy/MM/dd HH:mm:ss"-style dates in local time.
+    QString timestampFormat;
+
+    bool isValid() const;
+
+    // Recognises the JSON field names and the usual bank and payment-app
+    // headers (交易时间, 金额, 收/支, 交易对方, ...)
+    static CsvColumnMapping fromHeader(const QStringList& header);
+};
+
+// Bulk CSV importer.
+//
+// The file is memory-mapped and split into chunks at record boundaries
+// (found with the parsers' own record reader, so quoted fields may contain
+// newlines). Chunks are
+// parsed in parallel on a private QThreadPool; each parser scans 16 bytes
+// at a time for delimiters, quotes and line ends with SSE2 where available
+// and falls back to a byte loop elsewhere. Rows keep the file order.
+class CsvImporter
+{
+public:
+    static constexpr int DefaultChunkSize = 4 << 20;
+    static constexpr int DefaultBatchSize = 100000;
+
+    CsvImporter();
+
+    void setDelimiter(char delimiter);
+    void setHasHeader(bool hasHeader);
+    void setColumnMapping(const CsvColumnMapping& mapping); // overrides header detection
+    void setThreadCount(int threads);
+    void setChunkSize(int bytes);
+    void setBatchSize(int rows);
+    void setSkipDuplicates(bool skip); // on by default
+
+    // Adds the parsed rows to manager through addTransactions(), batchSize
+    // rows at a time; each batch is one undo step. Rows the ledger already
+    // holds (TransactionManager::filterDuplicates()) are left out and listed
+    // in duplicates(). Stops at the first batch the manager refuses (see
+    // TransactionManager::addTransactions()) and returns false with its
+    // errorString(); the batches before it stay added, as rowsAdded() says.
+    bool importFile(const QString& filename, TransactionManager* manager);
+
+    bool parseFile(const QString& filename, QList<Transaction>* transactions);
+    bool parse(const QByteArray& data, QList<Transaction>* transactions);
+
+    // Results of the last import or parse
+    int rowsParsed() const;
+    int rowsSkipped() const; // malformed rows: no parsable amount
+    int rowsAdded() const; // importFile() only
+    QList<Transaction> duplicates() const; // importFile() only
+    QString errorString() const;
+
+private:
+    bool parseData(const char* data, qint64 size, QList<Transaction>* transactions);
+
+    char m_delimiter;
+    bool m_hasHeader;
+    CsvColumnMapping m_mapping;
+    bool m_mappingSet;
+    int m_threadCount;
+    int m_chunkSize;
+    int m_batchSize;
+    bool m_skipDuplicates;
+    int m_rowsParsed;
+    int m_rowsSkipped;
+    int m_rowsAdded;
+    QList<Transaction> m_duplicates;
+    QString m_errorString;
+};
+
+#endif // CSVIMPORTER_H
@@ -0,0 +1,115 @@
+#include "datewindow.h"
+
+#include <algorithm>
+
+DateWindow::DateWindow()
+    : m_first(0)
+    , m_last(0)
+{
+}
+
+void DateWindow::setRows(QList<Transaction> rows)
+{
+    rows.removeIf([](const Transaction& transaction) {
+        return transaction.getTimestampMSecs() == Transaction::InvalidTimestamp;
+    });
+    std::stable_sort(rows.begin(), rows.end(), [](const Transaction& a, const Transaction& b) {
+        return a.getTimestampMSecs() < b.getTimestampMSecs();
+    });
+
+    m_rows = rows;
+    m_times.clear();
+    m_times.reserve(m_rows.size());
+    for (const auto& transaction : std::as_const(m_rows)) {
+        m_times.push_back(transaction.getTimestampMSecs());
+    }
+
+    m_first = 0;
+    m_last = 0;
+    m_income = CompensatedSum();
+    m_expense = CompensatedSum();
+}
+
+int DateWindow::rowCount() const
+{
+    return int(m_rows.size());
+}
+
+int DateWindow::lowerBound(qint64 timestamp) const
+{
+    return int(std::lower_bound(m_times.begin(), m_times.end(), timestamp) - m_times.begin());
+}
+
+void DateWindow::setBounds(int first, int last)
+{
+    first = qBound(0, first, rowCount());
+    last = qBound(first, last, rowCount());
+
+    if (first >= m_last || last <= m_first) {
+        // Disjoint: the old window leaves entirely
+        m_income = CompensatedSum();
+        m_expense = CompensatedSum();
+        accumulate(first, last, 1.0);
+    } else {
+        if (first < m_first) {
+            accumulate(first, m_first, 1.0);
+        } else {
+            accumulate(m_first, first, -1.0);
+        }
+        if (last > m_last) {
+            accumulate(m_last, last, 1.0);
+        } else {
+            accumulate(last, m_last, -1.0);
+        }
+    }
+
+    m_first = first;
+    m_last = last;
+}
+
+int DateWindow::first() const
+{
+    return m_first;
+}
+
+int DateWindow::last() const
+{
+    return m_last;
+}
+
+int DateWindow::size() const
+{
+    return m_last - m_first;
+}
+
+const Transaction& DateWindow::at(int index) const
+{
+    return m_rows.at(index);
+}
+
+QList<Transaction> DateWindow::windowRows() const
+{
+    return m_rows.mid(m_first, m_last - m_first);
+}
+
+double DateWindow::totalIncome() const
+{
+    return m_income.value();
+}
+
+double DateWindow::totalExpense() const
+{
+    return m_expense.value();
+}
+
+void DateWindow::accumulate(int from, int to, double sign)
+{
+    for (int i = from; i < to; ++i) {
+        const Transaction& transaction = m_rows.at(i);
+        if (transaction.getType() == TransactionType::INCOME) {
+            m_income.add(sign * transaction.getAmount());
+        } else {
+            m_expense.add(sign * transaction.getAmount());
+        }
+    }
+}
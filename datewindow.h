@@ -0,0 +1,48 @@
+#ifndef DATEWINDOW_H
+#define DATEWINDOW_H
+
+#include "transaction.h"
+#include "compensatedsum.h"
+#include <QList>
+
+#include <vector>
+
+// Time-sorted rows with a movable [first, last) window over them.
+//
+// setBounds() adjusts the income and expense totals by the rows that enter
+// or leave at the two edges, so moving the window by a day costs the rows of
+// that day rather than a rescan of the range. Rows without a valid
+// timestamp are dropped.
+class DateWindow
+{
+public:
+    DateWindow();
+
+    void setRows(QList<Transaction> rows); // resets the window to empty
+
+    int rowCount() const;
+    int lowerBound(qint64 timestamp) const; // first row at or after timestamp
+
+    void setBounds(int first, int last);
+    int first() const;
+    int last() const;
+    int size() const;
+
+    const Transaction& at(int index) const; // index into all rows
+    QList<Transaction> windowRows() const;
+
+    double totalIncome() const;
+    double totalExpense() const;
+
+private:
+    void accumulate(int from, int to, double sign);
+
+    QList<Transaction> m_rows;
+    std::vector<qint64> m_times;
+    int m_first;
+    int m_last;
+    CompensatedSum m_income;
+    CompensatedSum m_expense;
+};
+
+#endif // DATEWINDOW_H
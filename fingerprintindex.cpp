@@ -0,0 +1,83 @@
+#include "fingerprintindex.h"
+
+namespace {
+
+// FNV-1a over the field bytes, finished with the splitmix64 mixer so the
+// two halves used by BloomFilter are independent enough
+class FingerprintHasher
+{
+public:
+    void addBytes(const void* data, qsizetype size)
+    {
+        const uchar* bytes = static_cast<const uchar*>(data);
+        for (qsizetype i = 0; i < size; ++i) {
+            m_hash = (m_hash ^ bytes[i]) * 0x100000001b3ULL;
+        }
+    }
+
+    void addInt(qint64 value) { addBytes(&value, sizeof(value)); }
+
+    void addString(const QString& value)
+    {
+        addInt(value.size());
+        addBytes(value.constData(), value.size() * qsizetype(sizeof(QChar)));
+    }
+
+    quint64 result() const
+    {
+        quint64 x = m_hash;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+private:
+    quint64 m_hash = 0xcbf29ce484222325ULL;
+};
+
+} // namespace
+
+quint64 transactionFingerprint(const Transaction& transaction)
+{
+    FingerprintHasher hasher;
+    hasher.addInt(qint64(transaction.getType()));
+    hasher.addInt(qRound64(transaction.getAmount() * 100.0));
+    hasher.addInt(transaction.getTimestampMSecs());
+    hasher.addString(transaction.getFromAccount());
+    hasher.addString(transaction.getToAccount());
+    hasher.addString(transaction.getMethod());
+    return hasher.result();
+}
+
+void FingerprintIndex::add(quint64 fingerprint)
+{
+    ++m_counts[fingerprint];
+}
+
+void FingerprintIndex::remove(quint64 fingerprint)
+{
+    auto it = m_counts.find(fingerprint);
+    if (it != m_counts.end() && --it.value() <= 0) {
+        m_counts.erase(it);
+    }
+}
+
+int FingerprintIndex::count(quint64 fingerprint) const
+{
+    return m_counts.value(fingerprint);
+}
+
+void FingerprintIndex::reserve(qsizetype size)
+{
+    m_counts.reserve(size);
+}
+
+void FingerprintIndex::clear()
+{
+    m_counts.clear();
+}
+
+qint64 FingerprintIndex::bytesUsed() const
+{
+    return m_counts.capacity() * qint64(sizeof(quint64) + sizeof(int) + 1);
+}
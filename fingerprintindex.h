@@ -0,0 +1,28 @@
+#ifndef FINGERPRINTINDEX_H
+#define FINGERPRINTINDEX_H
+
+#include "transaction.h"
+#include <QHash>
+
+// Content fingerprint of a transaction: type, amount to the cent, timestamp,
+// both accounts and method. The id, category and note are left out, so the
+// same payment exported twice, or by two apps, matches. The hash does not
+// depend on the process's hash seed and may be stored on disk.
+quint64 transactionFingerprint(const Transaction& transaction);
+
+// Multiset of fingerprints: how many rows carry each content
+class FingerprintIndex
+{
+public:
+    void add(quint64 fingerprint);
+    void remove(quint64 fingerprint);
+    int count(quint64 fingerprint) const;
+    void reserve(qsizetype size);
+    void clear();
+    qint64 bytesUsed() const; // estimated heap bytes
+
+private:
+    QHash<quint64, int> m_counts;
+};
+
+#endif // FINGERPRINTINDEX_H
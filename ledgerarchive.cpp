@@ -0,0 +1,644 @@
+#include "ledgerarchive.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QHash>
+#include <QVector>
+#include <QtEndian>
+#include <QtNumeric>
+
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const quint32 kArchiveMagic = 0x4D544C41; // "MTLA"
+const quint16 kArchiveVersion = 3; // 2 added the note column, 3 the tags column
+
+enum AmountEncoding : quint8 {
+    AmountCents = 0,
+    AmountRawDouble = 1
+};
+
+quint64 zigzagEncode(qint64 value)
+{
+    return (quint64(value) << 1) ^ quint64(value >> 63);
+}
+
+qint64 zigzagDecode(quint64 value)
+{
+    return qint64((value >> 1) ^ (0 - (value & 1)));
+}
+
+void appendVarint(QByteArray& out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+// Bounds-checked cursor over a decompressed block payload
+class ByteReader
+{
+public:
+    explicit ByteReader(const QByteArray& data)
+        : m_pos(data.constData())
+        , m_end(data.constData() + data.size())
+        , m_ok(true)
+    {
+    }
+
+    bool ok() const { return m_ok; }
+
+    quint8 byte()
+    {
+        if (m_pos >= m_end) {
+            m_ok = false;
+            return 0;
+        }
+        return quint8(*m_pos++);
+    }
+
+    quint64 varint()
+    {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            quint8 b = byte();
+            if (!m_ok) {
+                return 0;
+            }
+            value |= quint64(b & 0x7F) << shift;
+            if (!(b & 0x80)) {
+                return value;
+            }
+        }
+        m_ok = false;
+        return 0;
+    }
+
+    const char* take(qsizetype size)
+    {
+        if (size < 0 || m_end - m_pos < size) {
+            m_ok = false;
+            return nullptr;
+        }
+        const char* start = m_pos;
+        m_pos += size;
+        return start;
+    }
+
+private:
+    const char* m_pos;
+    const char* m_end;
+    bool m_ok;
+};
+
+// Fewest payload bytes a row can take: its 16-byte id, its type and one
+// byte each for its timestamp delta, amount and four text indices, plus the
+// note length from version 2 on and the tag count from version 3 on
+qsizetype minRowBytes(quint16 version)
+{
+    return 16 + 1 + 1 + 1 + 4 + (version >= 2 ? 1 : 0) + (version >= 3 ? 1 : 0);
+}
+
+bool isWholeCents(double amount, qint64* cents)
+{
+    if (!qIsFinite(amount) || qAbs(amount) > 1e15) {
+        return false;
+    }
+    *cents = qRound64(amount * 100.0);
+    return double(*cents) / 100.0 == amount;
+}
+
+QByteArray encodeBlock(const QList<Transaction>& rows, ArchiveBlockInfo* info)
+{
+    const qsizetype count = rows.size();
+    QByteArray raw;
+    raw.reserve(count * 32);
+
+    *info = ArchiveBlockInfo();
+    info->rowCount = quint32(count);
+
+    // Ids and types
+    for (const auto& row : rows) {
+        raw.append(row.getUuid().toRfc4122());
+    }
+    for (const auto& row : rows) {
+        raw.append(char(row.getType()));
+    }
+
+    // Timestamps: zigzag deltas, computed modulo 2^64 so the invalid
+    // sentinel round-trips like any other value
+    quint64 previous = 0;
+    for (const auto& row : rows) {
+        qint64 timestamp = row.getTimestampMSecs();
+        quint64 current = quint64(timestamp);
+        appendVarint(raw, zigzagEncode(qint64(current - previous)));
+        previous = current;
+
+        if (timestamp == Transaction::InvalidTimestamp) {
+            ++info->invalidTimestamps;
+        } else {
+            info->minTimestamp = qMin(info->minTimestamp, timestamp);
+            info->maxTimestamp = qMax(info->maxTimestamp, timestamp);
+        }
+    }
+
+    // Amounts
+    QVector<qint64> cents(count);
+    bool allCents = true;
+    qint64 minCents = std::numeric_limits<qint64>::max();
+    for (qsizetype i = 0; i < count; ++i) {
+        const Transaction& row = rows[i];
+        double amount = row.getAmount();
+        info->minAmount = qMin(info->minAmount, amount);
+        info->maxAmount = qMax(info->maxAmount, amount);
+        if (row.getType() == TransactionType::INCOME) {
+            info->totalIncome += amount;
+        } else {
+            info->totalExpense += amount;
+        }
+        if (allCents && isWholeCents(amount, &cents[i])) {
+            minCents = qMin(minCents, cents[i]);
+        } else {
+            allCents = false;
+        }
+    }
+
+    if (allCents) {
+        raw.append(char(AmountCents));
+        appendVarint(raw, zigzagEncode(count > 0 ? minCents : 0));
+        for (qint64 value : cents) {
+            appendVarint(raw, quint64(value - minCents));
+        }
+    } else {
+        raw.append(char(AmountRawDouble));
+        for (const auto& row : rows) {
+            double amount = row.getAmount();
+            quint64 bits;
+            std::memcpy(&bits, &amount, sizeof(bits));
+            bits = qToLittleEndian(bits);
+            raw.append(reinterpret_cast<const char*>(&bits), sizeof(bits));
+        }
+    }
+
+    // Dictionary-encoded text columns
+    QHash<QString, quint32> dictionary;
+    QList<QString> entries;
+    QVector<quint32> indices;
+    indices.reserve(count * 4);
+    QVector<quint32> tagIndices; // per row: the tag count, then that many indices
+    tagIndices.reserve(count);
+    auto indexOf = [&](const QString& value) {
+        auto it = dictionary.constFind(value);
+        if (it != dictionary.constEnd()) {
+            return it.value();
+        }
+        quint32 index = quint32(entries.size());
+        dictionary.insert(value, index);
+        entries.append(value);
+        return index;
+    };
+    for (const auto& row : rows) {
+        indices.append(indexOf(row.getFromAccount()));
+        indices.append(indexOf(row.getToAccount()));
+        indices.append(indexOf(row.getCategory()));
+        indices.append(indexOf(row.getMethod()));
+
+        const QStringList tags = row.getTags();
+        tagIndices.append(quint32(tags.size()));
+        for (const auto& tag : tags) {
+            tagIndices.append(indexOf(tag));
+        }
+    }
+
+    appendVarint(raw, quint64(entries.size()));
+    for (const auto& entry : entries) {
+        QByteArray utf8 = entry.toUtf8();
+        appendVarint(raw, quint64(utf8.size()));
+        raw.append(utf8);
+    }
+    // Column-major so runs of equal categories compress well
+    for (int column = 0; column < 4; ++column) {
+        for (qsizetype i = 0; i < count; ++i) {
+            appendVarint(raw, indices[i * 4 + column]);
+        }
+    }
+
+    // Notes are mostly unique, so they are stored inline
+    for (const auto& row : rows) {
+        QByteArray utf8 = row.getNote().toUtf8();
+        appendVarint(raw, quint64(utf8.size()));
+        raw.append(utf8);
+    }
+
+    // Tags share the string dictionary
+    for (quint32 value : std::as_const(tagIndices)) {
+        appendVarint(raw, value);
+    }
+
+    return qCompress(raw);
+}
+
+bool decodeBlock(const QByteArray& payload, quint32 rowCount, quint16 version, QList<Transaction>* out)
+{
+    QByteArray raw = qUncompress(payload);
+    if (raw.isEmpty() && rowCount > 0) {
+        return false;
+    }
+
+    // The row count comes from the file; check it against the payload
+    // before sizing the columns by it
+    const qsizetype count = rowCount;
+    if (count > raw.size() / minRowBytes(version)) {
+        return false;
+    }
+    ByteReader reader(raw);
+
+    QVector<QUuid> ids(count);
+    for (qsizetype i = 0; i < count; ++i) {
+        const char* bytes = reader.take(16);
+        if (!bytes) {
+            return false;
+        }
+        ids[i] = QUuid::fromRfc4122(QByteArrayView(bytes, 16));
+    }
+
+    QVector<quint8> types(count);
+    for (qsizetype i = 0; i < count; ++i) {
+        types[i] = reader.byte();
+        if (types[i] > quint8(TransactionType::EXPENSE)) {
+            return false;
+        }
+    }
+
+    QVector<qint64> timestamps(count);
+    quint64 previous = 0;
+    for (qsizetype i = 0; i < count; ++i) {
+        previous += quint64(zigzagDecode(reader.varint()));
+        timestamps[i] = qint64(previous);
+    }
+
+    QVector<double> amounts(count);
+    quint8 amountEncoding = reader.byte();
+    if (amountEncoding == AmountCents) {
+        qint64 base = zigzagDecode(reader.varint());
+        for (qsizetype i = 0; i < count; ++i) {
+            amounts[i] = double(base + qint64(reader.varint())) / 100.0;
+        }
+    } else if (amountEncoding == AmountRawDouble) {
+        for (qsizetype i = 0; i < count; ++i) {
+            const char* bytes = reader.take(8);
+            if (!bytes) {
+                return false;
+            }
+            quint64 bits = qFromLittleEndian<quint64>(bytes);
+            std::memcpy(&amounts[i], &bits, sizeof(bits));
+        }
+    } else {
+        return false;
+    }
+
+    quint64 entryCount = reader.varint();
+    if (!reader.ok() || entryCount > quint64(raw.size())) {
+        return false;
+    }
+    QList<QString> entries;
+    entries.reserve(qsizetype(entryCount));
+    for (quint64 i = 0; i < entryCount; ++i) {
+        qsizetype size = qsizetype(reader.varint());
+        const char* bytes = reader.take(size);
+        if (!bytes) {
+            return false;
+        }
+        entries.append(QString::fromUtf8(bytes, size));
+    }
+
+    QVector<quint32> indices(count * 4);
+    for (int column = 0; column < 4; ++column) {
+        for (qsizetype i = 0; i < count; ++i) {
+            quint64 index = reader.varint();
+            if (index >= entryCount) {
+                return false;
+            }
+            indices[i * 4 + column] = quint32(index);
+        }
+    }
+
+    QList<QString> notes(count);
+    if (version >= 2) {
+        for (qsizetype i = 0; i < count; ++i) {
+            qsizetype size = qsizetype(reader.varint());
+            const char* bytes = reader.take(size);
+            if (!bytes) {
+                return false;
+            }
+            if (size > 0) {
+                notes[i] = QString::fromUtf8(bytes, size);
+            }
+        }
+    }
+
+    QList<QStringList> tags(count);
+    if (version >= 3) {
+        for (qsizetype i = 0; i < count; ++i) {
+            const quint64 tagCount = reader.varint();
+            if (tagCount > entryCount) {
+                return false;
+            }
+            for (quint64 t = 0; t < tagCount; ++t) {
+                const quint64 index = reader.varint();
+                if (index >= entryCount) {
+                    return false;
+                }
+                tags[i].append(entries[index]);
+            }
+        }
+    }
+
+    if (!reader.ok()) {
+        return false;
+    }
+
+    out->reserve(out->size() + count);
+    for (qsizetype i = 0; i < count; ++i) {
+        Transaction row;
+        row.setId(ids[i]);
+        row.setType(static_cast<TransactionType>(types[i]));
+        row.setAmount(amounts[i]);
+        row.setFromAccount(entries[indices[i * 4]]);
+        row.setToAccount(entries[indices[i * 4 + 1]]);
+        row.setCategory(entries[indices[i * 4 + 2]]);
+        row.setMethod(entries[indices[i * 4 + 3]]);
+        row.setNote(notes[i]);
+        if (!tags[i].isEmpty()) {
+            row.setTags(tags[i]);
+        }
+        row.setTimestampMSecs(timestamps[i]);
+        out->append(row);
+    }
+    return true;
+}
+
+} // namespace
+
+ArchiveBlockInfo::ArchiveBlockInfo()
+    : rowCount(0)
+    , invalidTimestamps(0)
+    , minTimestamp(std::numeric_limits<qint64>::max())
+    , maxTimestamp(std::numeric_limits<qint64>::min())
+    , minAmount(std::numeric_limits<double>::max())
+    , maxAmount(std::numeric_limits<double>::lowest())
+    , totalIncome(0.0)
+    , totalExpense(0.0)
+{
+}
+
+bool ArchiveBlockInfo::overlapsDates(qint64 start, qint64 end) const
+{
+    return minTimestamp <= end && maxTimestamp >= start;
+}
+
+bool ArchiveBlockInfo::overlapsAmounts(double min, double max) const
+{
+    return minAmount <= max && maxAmount >= min;
+}
+
+bool ArchiveBlockInfo::insideDates(qint64 start, qint64 end) const
+{
+    return invalidTimestamps == 0 && rowCount > 0 && minTimestamp >= start && maxTimestamp <= end;
+}
+
+// ==================== Writer ====================
+
+LedgerArchiveWriter::LedgerArchiveWriter(QIODevice* device, int blockSize)
+    : m_device(device)
+    , m_stream(device)
+    , m_blockSize(qMax(1, blockSize))
+{
+    m_stream.setVersion(QDataStream::Qt_6_0);
+}
+
+bool LedgerArchiveWriter::open()
+{
+    m_stream << kArchiveMagic << kArchiveVersion << quint16(0);
+    m_pending.reserve(m_blockSize);
+    return m_stream.status() == QDataStream::Ok;
+}
+
+bool LedgerArchiveWriter::append(const Transaction& transaction)
+{
+    m_pending.append(transaction);
+    if (m_pending.size() >= m_blockSize) {
+        return flushBlock();
+    }
+    return true;
+}
+
+bool LedgerArchiveWriter::finish()
+{
+    return m_pending.isEmpty() || flushBlock();
+}
+
+bool LedgerArchiveWriter::flushBlock()
+{
+    ArchiveBlockInfo info;
+    QByteArray payload = encodeBlock(m_pending, &info);
+    m_pending.clear();
+
+    m_stream << info.rowCount << info.invalidTimestamps
+             << info.minTimestamp << info.maxTimestamp
+             << info.minAmount << info.maxAmount
+             << info.totalIncome << info.totalExpense
+             << quint32(payload.size());
+    m_stream.writeRawData(payload.constData(), int(payload.size()));
+    return m_stream.status() == QDataStream::Ok;
+}
+
+// ==================== Reader ====================
+
+LedgerArchiveReader::LedgerArchiveReader(QIODevice* device)
+    : m_device(device)
+    , m_stream(device)
+    , m_payloadSize(0)
+    , m_rowCount(0)
+    , m_version(0)
+    , m_error(false)
+{
+    m_stream.setVersion(QDataStream::Qt_6_0);
+}
+
+bool LedgerArchiveReader::open()
+{
+    quint32 magic = 0;
+    quint16 flags = 0;
+    m_stream >> magic >> m_version >> flags;
+    m_error = m_stream.status() != QDataStream::Ok || magic != kArchiveMagic
+              || m_version < 1 || m_version > kArchiveVersion;
+    return !m_error;
+}
+
+bool LedgerArchiveReader::nextBlock(ArchiveBlockInfo* info)
+{
+    if (m_error || m_device->atEnd()) {
+        return false;
+    }
+
+    m_stream >> info->rowCount >> info->invalidTimestamps
+             >> info->minTimestamp >> info->maxTimestamp
+             >> info->minAmount >> info->maxAmount
+             >> info->totalIncome >> info->totalExpense
+             >> m_payloadSize;
+    if (m_stream.status() != QDataStream::Ok) {
+        m_error = true;
+        return false;
+    }
+    m_rowCount = info->rowCount;
+    return true;
+}
+
+bool LedgerArchiveReader::readBlock(QList<Transaction>* transactions)
+{
+    QByteArray payload = m_device->read(m_payloadSize);
+    if (payload.size() != qsizetype(m_payloadSize)
+        || !decodeBlock(payload, m_rowCount, m_version, transactions)) {
+        m_error = true;
+        return false;
+    }
+    return true;
+}
+
+bool LedgerArchiveReader::skipBlock()
+{
+    if (m_device->skip(m_payloadSize) != qint64(m_payloadSize)) {
+        m_error = true;
+        return false;
+    }
+    return true;
+}
+
+bool LedgerArchiveReader::hasError() const
+{
+    return m_error;
+}
+
+// ==================== File helpers ====================
+
+bool LedgerArchive::isArchiveFile(const QString& filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    quint32 magic = 0;
+    stream >> magic;
+    return magic == kArchiveMagic;
+}
+
+bool LedgerArchive::save(const QString& filename, const QList<Transaction>& transactions, int blockSize)
+{
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    LedgerArchiveWriter writer(&file, blockSize);
+    if (!writer.open()) {
+        return false;
+    }
+    for (const auto& transaction : transactions) {
+        if (!writer.append(transaction)) {
+            return false;
+        }
+    }
+    return writer.finish() && file.commit();
+}
+
+bool LedgerArchive::load(const QString& filename, QList<Transaction>* transactions)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    LedgerArchiveReader reader(&file);
+    if (!reader.open()) {
+        return false;
+    }
+
+    ArchiveBlockInfo info;
+    while (reader.nextBlock(&info)) {
+        if (!reader.readBlock(transactions)) {
+            return false;
+        }
+    }
+    return !reader.hasError();
+}
+
+QList<Transaction> LedgerArchive::filterByDate(const QString& filename, const QDateTime& startDate,
+                                               const QDateTime& endDate, bool* ok)
+{
+    QList<Transaction> result;
+    const qint64 start = startDate.toMSecsSinceEpoch();
+    const qint64 end = endDate.toMSecsSinceEpoch();
+
+    QFile file(filename);
+    LedgerArchiveReader reader(&file);
+    bool success = file.open(QIODevice::ReadOnly) && reader.open();
+
+    ArchiveBlockInfo info;
+    while (success && reader.nextBlock(&info)) {
+        if (!info.overlapsDates(start, end)) {
+            success = reader.skipBlock();
+            continue;
+        }
+
+        QList<Transaction> block;
+        success = reader.readBlock(&block);
+        for (const auto& transaction : block) {
+            qint64 timestamp = transaction.getTimestampMSecs();
+            if (timestamp != Transaction::InvalidTimestamp && timestamp >= start && timestamp <= end) {
+                result.append(transaction);
+            }
+        }
+    }
+
+    if (ok) {
+        *ok = success && !reader.hasError();
+    }
+    return result;
+}
+
+QList<Transaction> LedgerArchive::filterByAmount(const QString& filename, double minAmount,
+                                                 double maxAmount, bool* ok)
+{
+    QList<Transaction> result;
+
+    QFile file(filename);
+    LedgerArchiveReader reader(&file);
+    bool success = file.open(QIODevice::ReadOnly) && reader.open();
+
+    ArchiveBlockInfo info;
+    while (success && reader.nextBlock(&info)) {
+        if (!info.overlapsAmounts(minAmount, maxAmount)) {
+            success = reader.skipBlock();
+            continue;
+        }
+
+        QList<Transaction> block;
+        success = reader.readBlock(&block);
+        for (const auto& transaction : block) {
+            double amount = transaction.getAmount();
+            if (amount >= minAmount && amount <= maxAmount) {
+                result.append(transaction);
+            }
+        }
+    }
+
+    if (ok) {
+        *ok = success && !reader.hasError();
+    }
+    return result;
+}
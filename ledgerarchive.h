@@ -0,0 +1,104 @@
+#ifndef LEDGERARCHIVE_H
+#define LEDGERARCHIVE_H
+
+#include "transaction.h"
+#include <QList>
+#include <QDataStream>
+
+class QIODevice;
+
+// Column-compressed archival ledger format.
+//
+// A file is a short header followed by independent blocks of up to
+// DefaultBlockSize rows. Each block starts with an uncompressed header
+// carrying row count, min/max timestamp, min/max amount and the income and
+// expense totals, so readers can skip or even answer a block without
+// touching its payload. The payload is zlib-compressed and stores the rows
+// column by column:
+//   - ids as raw 16-byte UUIDs, types as one byte each
+//   - timestamps as zigzag varint deltas from the previous row
+//   - amounts as integer cents, frame-of-reference against the block
+//     minimum (falls back to raw doubles if any amount is not whole cents)
+//   - accounts, category and method as varint indices into a per-block
+//     string dictionary
+//   - notes inline, then each row's tags as a count and dictionary indices
+
+struct ArchiveBlockInfo {
+    quint32 rowCount;
+    quint32 invalidTimestamps;
+    qint64 minTimestamp;    // over valid timestamps only
+    qint64 maxTimestamp;
+    double minAmount;
+    double maxAmount;
+    double totalIncome;
+    double totalExpense;
+
+    ArchiveBlockInfo();
+
+    bool overlapsDates(qint64 start, qint64 end) const;
+    bool overlapsAmounts(double min, double max) const;
+    bool insideDates(qint64 start, qint64 end) const;
+};
+
+class LedgerArchiveWriter
+{
+public:
+    explicit LedgerArchiveWriter(QIODevice* device, int blockSize = 4096);
+
+    bool open();
+    bool append(const Transaction& transaction);
+    bool finish();
+
+private:
+    bool flushBlock();
+
+    QIODevice* m_device;
+    QDataStream m_stream;
+    int m_blockSize;
+    QList<Transaction> m_pending;
+};
+
+class LedgerArchiveReader
+{
+public:
+    explicit LedgerArchiveReader(QIODevice* device);
+
+    bool open();
+
+    // Reads the next block header. Returns false at end of file or on error;
+    // use hasError() to tell them apart. Each successful call must be
+    // followed by exactly one readBlock() or skipBlock().
+    bool nextBlock(ArchiveBlockInfo* info);
+    bool readBlock(QList<Transaction>* transactions);
+    bool skipBlock();
+
+    bool hasError() const;
+
+private:
+    QIODevice* m_device;
+    QDataStream m_stream;
+    quint32 m_payloadSize;
+    quint32 m_rowCount;
+    quint16 m_version;
+    bool m_error;
+};
+
+class LedgerArchive
+{
+public:
+    static constexpr int DefaultBlockSize = 4096;
+
+    static bool isArchiveFile(const QString& filename);
+
+    static bool save(const QString& filename, const QList<Transaction>& transactions,
+                     int blockSize = DefaultBlockSize);
+    static bool load(const QString& filename, QList<Transaction>* transactions);
+
+    // Block-pruned filters with the same semantics as TransactionManager's
+    static QList<Transaction> filterByDate(const QString& filename, const QDateTime& startDate,
+                                           const QDateTime& endDate, bool* ok = nullptr);
+    static QList<Transaction> filterByAmount(const QString& filename, double minAmount,
+                                             double maxAmount, bool* ok = nullptr);
+};
+
+#endif // LEDGERARCHIVE_H
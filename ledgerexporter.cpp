@@ -0,0 +1,235 @@
+#include "ledgerexporter.h"
+#include <QIODevice>
+#include <QLocale>
+#include <QSaveFile>
+
+namespace {
+
+void appendJsonString(QByteArray* out, const QString& text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    out->append('"');
+    for (char c : utf8) {
+        switch (c) {
+        case '"':  out->append("\\\""); break;
+        case '\\': out->append("\\\\"); break;
+        case '\b': out->append("\\b"); break;
+        case '\f': out->append("\\f"); break;
+        case '\n': out->append("\\n"); break;
+        case '\r': out->append("\\r"); break;
+        case '\t': out->append("\\t"); break;
+        default:
+            if (uchar(c) < 0x20) {
+                static const char hex[] = "0123456789abcdef";
+                out->append("\\u00");
+                out->append(hex[uchar(c) >> 4]);
+                out->append(hex[uchar(c) & 0xF]);
+            } else {
+                out->append(c);
+            }
+        }
+    }
+    out->append('"');
+}
+
+// Quoted only when the importer would otherwise split or trim the value
+void appendCsvField(QByteArray* out, const QString& text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    const bool quote = utf8.contains(',') || utf8.contains('"') || utf8.contains('\n')
+                       || utf8.contains('\r') || utf8.startsWith(' ') || utf8.endsWith(' ')
+                       || utf8.startsWith('\t') || utf8.endsWith('\t');
+    if (!quote) {
+        out->append(utf8);
+        return;
+    }
+    out->append('"');
+    for (char c : utf8) {
+        if (c == '"') {
+            out->append('"');
+        }
+        out->append(c);
+    }
+    out->append('"');
+}
+
+QByteArray jsonNumber(double value)
+{
+    if (!qIsFinite(value)) {
+        return "null";
+    }
+    return QByteArray::number(value, 'g', QLocale::FloatingPointShortest);
+}
+
+template <typename Source>
+bool exportRows(const QString& filename, LedgerExporter::Format format, Source forEachRow)
+{
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    LedgerExporter exporter(&file, format);
+    bool ok = exporter.begin();
+    forEachRow([&ok, &exporter](const Transaction& transaction) {
+        ok = ok && exporter.write(transaction);
+    });
+    return ok && exporter.finish() && file.commit();
+}
+
+} // namespace
+
+LedgerExporter::LedgerExporter(QIODevice* device, Format format)
+    : m_device(device)
+    , m_format(format)
+    , m_archive(device)
+    , m_firstRow(true)
+    , m_ok(true)
+{
+}
+
+bool LedgerExporter::begin()
+{
+    switch (m_format) {
+    case Json:
+        m_buffer.reserve(BufferSize + 4096);
+        m_buffer.append("[\n");
+        return true;
+    case Csv:
+        m_buffer.reserve(BufferSize + 4096);
+        // The byte order mark makes spreadsheet apps read the file as UTF-8
+        m_buffer.append("\xEF\xBB\xBF" "id,type,amount,fromAccount,toAccount,category,method,note,timestamp,tags\n");
+        return true;
+    case Archive:
+        return m_archive.open();
+    }
+    return false;
+}
+
+bool LedgerExporter::write(const Transaction& transaction)
+{
+    switch (m_format) {
+    case Json:
+        writeJson(transaction);
+        break;
+    case Csv:
+        writeCsv(transaction);
+        break;
+    case Archive:
+        return m_archive.append(transaction);
+    }
+    m_firstRow = false;
+    return m_buffer.size() < BufferSize || flushBuffer();
+}
+
+bool LedgerExporter::finish()
+{
+    switch (m_format) {
+    case Json:
+        m_buffer.append(m_firstRow ? "]\n" : "\n]\n");
+        return flushBuffer();
+    case Csv:
+        return flushBuffer();
+    case Archive:
+        return m_archive.finish();
+    }
+    return false;
+}
+
+LedgerExporter::Format LedgerExporter::formatForFile(const QString& filename)
+{
+    if (filename.endsWith(".json", Qt::CaseInsensitive)) {
+        return Json;
+    }
+    if (filename.endsWith(".csv", Qt::CaseInsensitive)) {
+        return Csv;
+    }
+    return Archive;
+}
+
+bool LedgerExporter::exportSnapshot(const QString& filename, const LedgerSnapshot& snapshot, Format format)
+{
+    return exportRows(filename, format, [&snapshot](auto write) {
+        snapshot.forEach(write);
+    });
+}
+
+bool LedgerExporter::exportTransactions(const QString& filename, const QList<Transaction>& transactions,
+                                        Format format)
+{
+    return exportRows(filename, format, [&transactions](auto write) {
+        for (const auto& transaction : transactions) {
+            write(transaction);
+        }
+    });
+}
+
+// Same fields and layout as QJsonDocument::toJson() of Transaction::toJson():
+// indented, keys in sorted order, "note" only when set
+void LedgerExporter::writeJson(const Transaction& transaction)
+{
+    if (!m_firstRow) {
+        m_buffer.append(",\n");
+    }
+    m_buffer.append("    {\n        \"amount\": ");
+    m_buffer.append(jsonNumber(transaction.getAmount()));
+    m_buffer.append(",\n        \"category\": ");
+    appendJsonString(&m_buffer, transaction.getCategory());
+    m_buffer.append(",\n        \"fromAccount\": ");
+    appendJsonString(&m_buffer, transaction.getFromAccount());
+    m_buffer.append(",\n        \"id\": ");
+    appendJsonString(&m_buffer, transaction.getId());
+    m_buffer.append(",\n        \"method\": ");
+    appendJsonString(&m_buffer, transaction.getMethod());
+    if (!transaction.getNote().isEmpty()) {
+        m_buffer.append(",\n        \"note\": ");
+        appendJsonString(&m_buffer, transaction.getNote());
+    }
+    const QStringList tags = transaction.getTags();
+    if (!tags.isEmpty()) {
+        m_buffer.append(",\n        \"tags\": [");
+        for (int i = 0; i < tags.size(); ++i) {
+            m_buffer.append(i == 0 ? "\n            " : ",\n            ");
+            appendJsonString(&m_buffer, tags.at(i));
+        }
+        m_buffer.append("\n        ]");
+    }
+    m_buffer.append(",\n        \"timestamp\": ");
+    appendJsonString(&m_buffer, transaction.getTimestamp().toString(Qt::ISODate));
+    m_buffer.append(",\n        \"toAccount\": ");
+    appendJsonString(&m_buffer, transaction.getToAccount());
+    m_buffer.append(",\n        \"type\": ");
+    m_buffer.append(QByteArray::number(int(transaction.getType())));
+    m_buffer.append("\n    }");
+}
+
+void LedgerExporter::writeCsv(const Transaction& transaction)
+{
+    m_buffer.append(transaction.getUuid().toByteArray(QUuid::WithoutBraces));
+    m_buffer.append(',');
+    m_buffer.append(transaction.getTypeString().toUtf8());
+    m_buffer.append(',');
+    m_buffer.append(QByteArray::number(transaction.getAmount(), 'g', QLocale::FloatingPointShortest));
+    m_buffer.append(',');
+    appendCsvField(&m_buffer, transaction.getFromAccount());
+    m_buffer.append(',');
+    appendCsvField(&m_buffer, transaction.getToAccount());
+    m_buffer.append(',');
+    appendCsvField(&m_buffer, transaction.getCategory());
+    m_buffer.append(',');
+    appendCsvField(&m_buffer, transaction.getMethod());
+    m_buffer.append(',');
+    appendCsvField(&m_buffer, transaction.getNote());
+    m_buffer.append(',');
+    m_buffer.append(transaction.getTimestamp().toString("yyyy-MM-dd HH:mm:ss").toUtf8());
+    m_buffer.append(',');
+    appendCsvField(&m_buffer, transaction.getTags().join(';'));
+    m_buffer.append('\n');
+}
+
+bool LedgerExporter::flushBuffer()
+{
+    m_ok = m_ok && m_device->write(m_buffer) == m_buffer.size();
+    m_buffer.resize(0); // keeps the capacity
+    return m_ok;
+}
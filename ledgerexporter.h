@@ -0,0 +1,60 @@
+#ifndef LEDGEREXPORTER_H
+#define LEDGEREXPORTER_H
+
+#include "transaction.h"
+#include "ledgerarchive.h"
+#include "ledgersnapshot.h"
+#include <QByteArray>
+#include <QList>
+
+class QIODevice;
+
+// Streaming ledger writer.
+//
+// Rows are serialized one at a time into a fixed-size buffer that is
+// flushed to the device whenever it fills, so memory use does not depend on
+// the number of rows. Formats:
+//   - Json: the array written by TransactionManager::saveToFile(), one
+//     Transaction::toJson() object per row
+//   - Csv: a header row with the JSON field names, readable by CsvImporter;
+//     tags are joined with ';'
+//   - Archive: a LedgerArchive, written block by block
+class LedgerExporter
+{
+public:
+    enum Format {
+        Json,
+        Csv,
+        Archive
+    };
+
+    static constexpr int BufferSize = 64 * 1024;
+
+    LedgerExporter(QIODevice* device, Format format);
+
+    bool begin();
+    bool write(const Transaction& transaction);
+    bool finish();
+
+    // By suffix: .json, .csv, anything else is an archive
+    static Format formatForFile(const QString& filename);
+
+    // Write through QSaveFile, replacing filename only on success
+    static bool exportSnapshot(const QString& filename, const LedgerSnapshot& snapshot, Format format);
+    static bool exportTransactions(const QString& filename, const QList<Transaction>& transactions,
+                                   Format format);
+
+private:
+    void writeJson(const Transaction& transaction);
+    void writeCsv(const Transaction& transaction);
+    bool flushBuffer();
+
+    QIODevice* m_device;
+    Format m_format;
+    QByteArray m_buffer;
+    LedgerArchiveWriter m_archive;
+    bool m_firstRow;
+    bool m_ok;
+};
+
+#endif // LEDGEREXPORTER_H
@@ -0,0 +1,226 @@
+#include "ledgerfederation.h"
+#include "transactionmanager.h"
+#include "statisticscalculator.h"
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+namespace {
+
+template <typename Map>
+void mergeSums(Map* into, const Map& from)
+{
+    for (auto it = from.cbegin(); it != from.cend(); ++it) {
+        (*into)[it.key()] += it.value();
+    }
+}
+
+} // namespace
+
+void FederatedReport::merge(const FederatedReport& other)
+{
+    totalIncome += other.totalIncome;
+    totalExpense += other.totalExpense;
+    netAmount = totalIncome - totalExpense;
+    transactionCount += other.transactionCount;
+    mergeSums(&expenseByCategory, other.expenseByCategory);
+    mergeSums(&incomeByCategory, other.incomeByCategory);
+    mergeSums(&dailyTrend, other.dailyTrend);
+}
+
+LedgerFederation::LedgerFederation(QObject* parent)
+    : QObject(parent)
+    , m_threadCount(QThread::idealThreadCount())
+{
+}
+
+bool LedgerFederation::addShards(const QStringList& paths)
+{
+    // Created here so they belong to this thread; only loading runs on the pool
+    QList<TransactionManager*> loaded;
+    QList<qint64> weights;
+    for (const QString& path : paths) {
+        loaded.append(new TransactionManager(this));
+        weights.append(QFileInfo(path).size());
+    }
+
+    std::vector<char> ok(paths.size(), 0);
+    runLargestFirst(weights, [&](int i) {
+        ok[i] = QFileInfo(paths.at(i)).isDir() ? loaded.at(i)->openPartitionedLedger(paths.at(i))
+                                               : loaded.at(i)->loadFromFile(paths.at(i));
+    });
+
+    for (int i = 0; i < paths.size(); ++i) {
+        if (!ok[i]) {
+            m_errorString = QString("无法打开账本: %1").arg(paths.at(i));
+            qDeleteAll(loaded);
+            return false;
+        }
+    }
+
+    m_shards.append(loaded);
+    m_paths.append(paths);
+    m_errorString.clear();
+    return true;
+}
+
+void LedgerFederation::clear()
+{
+    qDeleteAll(m_shards);
+    m_shards.clear();
+    m_paths.clear();
+}
+
+int LedgerFederation::shardCount() const
+{
+    return int(m_shards.size());
+}
+
+QString LedgerFederation::shardPath(int index) const
+{
+    return m_paths.at(index);
+}
+
+const TransactionManager* LedgerFederation::shard(int index) const
+{
+    return m_shards.at(index);
+}
+
+QString LedgerFederation::errorString() const
+{
+    return m_errorString;
+}
+
+void LedgerFederation::setThreadCount(int count)
+{
+    m_threadCount = qMax(1, count);
+}
+
+int LedgerFederation::getTransactionCount() const
+{
+    int count = 0;
+    for (const TransactionManager* shard : m_shards) {
+        count += shard->getTransactionCount();
+    }
+    return count;
+}
+
+QList<Transaction> LedgerFederation::filterByDate(const QDateTime& startDate, const QDateTime& endDate) const
+{
+    std::vector<QList<Transaction>> partial(m_shards.size());
+    runLargestFirst(shardWeights(), [&](int i) {
+        partial[i] = m_shards.at(i)->filterByDate(startDate, endDate);
+    });
+
+    QList<Transaction> merged;
+    qsizetype total = 0;
+    for (const auto& rows : partial) {
+        total += rows.size();
+    }
+    merged.reserve(total);
+    for (const auto& rows : partial) {
+        merged.append(rows);
+    }
+    return merged;
+}
+
+QList<Transaction> LedgerFederation::search(const QString& query, int limit) const
+{
+    auto newer = [](const Transaction& a, const Transaction& b) {
+        return a.getTimestampMSecs() > b.getTimestampMSecs();
+    };
+
+    // A shard's own limit would keep its most recently added matches, which
+    // need not be its newest by timestamp: each takes every match and keeps
+    // its newest limit of them
+    std::vector<QList<Transaction>> partial(m_shards.size());
+    runLargestFirst(shardWeights(), [&](int i) {
+        QList<Transaction> rows = m_shards.at(i)->search(query, -1);
+        if (limit >= 0 && rows.size() > limit) {
+            std::nth_element(rows.begin(), rows.begin() + limit, rows.end(), newer);
+            rows.resize(limit);
+        }
+        partial[i] = rows;
+    });
+
+    QList<Transaction> merged;
+    for (const auto& rows : partial) {
+        merged.append(rows);
+    }
+    std::stable_sort(merged.begin(), merged.end(), newer);
+    if (limit >= 0 && merged.size() > limit) {
+        merged.resize(limit);
+    }
+    return merged;
+}
+
+FederatedReport LedgerFederation::report(const QDateTime& startDate, const QDateTime& endDate) const
+{
+    std::vector<FederatedReport> partial(m_shards.size());
+    runLargestFirst(shardWeights(), [&](int i) {
+        const QList<Transaction> rows = m_shards.at(i)->filterByDate(startDate, endDate);
+        StatisticsCalculator calculator;
+        calculator.setThreadCount(1); // the shards already run in parallel
+        FederatedReport& shardReport = partial[i];
+
+        for (const auto& transaction : rows) {
+            if (transaction.getType() == TransactionType::INCOME) {
+                shardReport.totalIncome += transaction.getAmount();
+            } else {
+                shardReport.totalExpense += transaction.getAmount();
+            }
+        }
+        shardReport.netAmount = shardReport.totalIncome - shardReport.totalExpense;
+        shardReport.transactionCount = int(rows.size());
+        shardReport.expenseByCategory = calculator.calculateExpenseByCategory(rows);
+        shardReport.incomeByCategory = calculator.calculateIncomeByCategory(rows);
+        shardReport.dailyTrend = calculator.calculateDailyTrend(startDate, endDate, rows);
+    });
+
+    // Merged in shard order so the sums are the same on every run
+    FederatedReport merged;
+    for (const auto& shardReport : partial) {
+        merged.merge(shardReport);
+    }
+    return merged;
+}
+
+void LedgerFederation::runLargestFirst(const QList<qint64>& weights, const std::function<void(int)>& task) const
+{
+    const int count = int(weights.size());
+    if (count == 1 || m_threadCount == 1) {
+        for (int i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    // Starting the largest shards first keeps one big shard from being
+    // queued behind the small ones
+    std::vector<int> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return weights.at(a) > weights.at(b);
+    });
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_threadCount);
+    for (int i : order) {
+        pool.start([&task, i]() { task(i); });
+    }
+    pool.waitForDone();
+}
+
+QList<qint64> LedgerFederation::shardWeights() const
+{
+    QList<qint64> weights;
+    weights.reserve(m_shards.size());
+    for (const TransactionManager* shard : m_shards) {
+        weights.append(shard->getTransactionCount());
+    }
+    return weights;
+}
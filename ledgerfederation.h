@@ -0,0 +1,72 @@
+#ifndef LEDGERFEDERATION_H
+#define LEDGERFEDERATION_H
+
+#include "transaction.h"
+#include <QObject>
+#include <QMap>
+#include <QDateTime>
+#include <QStringList>
+
+#include <functional>
+
+class TransactionManager;
+
+// Aggregates of one shard, or of several once merged
+struct FederatedReport {
+    double totalIncome;
+    double totalExpense;
+    double netAmount;
+    int transactionCount;
+    QMap<QString, double> expenseByCategory;
+    QMap<QString, double> incomeByCategory;
+    QMap<QDate, double> dailyTrend;
+
+    FederatedReport() : totalIncome(0.0), totalExpense(0.0), netAmount(0.0), transactionCount(0) {}
+
+    void merge(const FederatedReport& other);
+};
+
+// Read-only view over several ledgers ("shards"), e.g. one file per
+// household member and year.
+//
+// Every shard is a TransactionManager of its own. Loads, filters and reports
+// run one shard per pool thread, largest first, and the partial results are
+// merged in shard order, so a combined report takes about as long as the
+// largest shard and does not depend on scheduling. A shard is only ever
+// touched by one thread at a time.
+class LedgerFederation : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LedgerFederation(QObject* parent = nullptr);
+
+    // Ledger files (JSON or LedgerArchive) or month-partitioned directories,
+    // loaded in parallel. On failure no shard is added.
+    bool addShards(const QStringList& paths);
+    void clear();
+
+    int shardCount() const;
+    QString shardPath(int index) const;
+    const TransactionManager* shard(int index) const;
+    QString errorString() const;
+
+    void setThreadCount(int count);
+
+    int getTransactionCount() const;
+    QList<Transaction> filterByDate(const QDateTime& startDate, const QDateTime& endDate) const;
+    QList<Transaction> search(const QString& query, int limit = 500) const; // newest first
+    FederatedReport report(const QDateTime& startDate, const QDateTime& endDate) const;
+
+private:
+    // Runs task(i) for every i, heaviest weight first
+    void runLargestFirst(const QList<qint64>& weights, const std::function<void(int)>& task) const;
+    QList<qint64> shardWeights() const;
+
+    QList<TransactionManager*> m_shards;
+    QStringList m_paths;
+    int m_threadCount;
+    QString m_errorString;
+};
+
+#endif // LEDGERFEDERATION_H
@@ -0,0 +1,130 @@
+#include "ledgermemoryreport.h"
+#include <QStringList>
+
+namespace {
+
+// QArrayData header ahead of the characters: reference count, flags, capacity
+const qint64 kStringHeaderBytes = 16;
+
+qint64 payloadBytes(const QString& value)
+{
+    return kStringHeaderBytes + (value.capacity() + 1) * qint64(sizeof(QChar));
+}
+
+QString formatBytes(qint64 bytes)
+{
+    if (bytes >= 1024 * 1024) {
+        return QString::number(bytes / (1024.0 * 1024.0), 'f', 1) + " MiB";
+    }
+    if (bytes >= 1024) {
+        return QString::number(bytes / 1024.0, 'f', 1) + " KiB";
+    }
+    return QString::number(bytes) + " B";
+}
+
+} // namespace
+
+StringCensus::StringCensus()
+    : m_fields(0)
+    , m_bytes(0)
+    , m_unsharedBytes(0)
+{
+}
+
+void StringCensus::add(const QString& value)
+{
+    if (value.isEmpty()) {
+        return;
+    }
+
+    ++m_fields;
+    const qint64 bytes = payloadBytes(value);
+    m_unsharedBytes += bytes;
+
+    // Strings sharing one payload point at the same characters
+    const void* data = value.constData();
+    if (!m_seen.contains(data)) {
+        m_seen.insert(data);
+        m_bytes += bytes;
+    }
+}
+
+void StringCensus::addTransaction(const Transaction& transaction)
+{
+    add(transaction.getFromAccount());
+    add(transaction.getToAccount());
+    add(transaction.getCategory());
+    add(transaction.getMethod());
+    add(transaction.getNote());
+    const QStringList tags = transaction.getTags();
+    for (const auto& tag : tags) {
+        add(tag);
+    }
+}
+
+int StringCensus::fields() const
+{
+    return m_fields;
+}
+
+int StringCensus::distinct() const
+{
+    return int(m_seen.size());
+}
+
+qint64 StringCensus::bytes() const
+{
+    return m_bytes;
+}
+
+qint64 StringCensus::unsharedBytes() const
+{
+    return m_unsharedBytes;
+}
+
+qint64 LedgerMemoryReport::totalBytes() const
+{
+    return rowBytes + stringBytes + stringPoolBytes + idIndexBytes + accountIndexBytes + rollupBytes
+            + searchIndexBytes + fingerprintBytes + transferBytes + sampleBytes + tagIndexBytes
+            + anomalyBytes + rowCacheBytes + partitionCacheBytes + historyBytes;
+}
+
+double LedgerMemoryReport::bytesPerRow() const
+{
+    return rows > 0 ? double(totalBytes()) / rows : 0.0;
+}
+
+double LedgerMemoryReport::stringDuplication() const
+{
+    return distinctStrings > 0 ? double(stringFields) / distinctStrings : 0.0;
+}
+
+QString LedgerMemoryReport::toText() const
+{
+    auto line = [](const QString& name, qint64 bytes) {
+        return QString("  %1 %2").arg(name, -18).arg(formatBytes(bytes));
+    };
+
+    QStringList lines;
+    lines << QString("memory: %1 rows, %2 total, %3 bytes/row")
+                 .arg(rows).arg(formatBytes(totalBytes())).arg(bytesPerRow(), 0, 'f', 1);
+    lines << line("rows", rowBytes) + QString(" (%1 blocks)").arg(rowBlocks);
+    lines << line("strings", stringBytes)
+                 + QString(" (%1 fields, %2 distinct, %3x shared, %4 unshared)")
+                       .arg(stringFields).arg(distinctStrings)
+                       .arg(stringDuplication(), 0, 'f', 1).arg(formatBytes(unsharedStringBytes));
+    lines << line("string pool", stringPoolBytes) + QString(" (%1 intern calls)").arg(internRequests);
+    lines << line("id index", idIndexBytes);
+    lines << line("account index", accountIndexBytes);
+    lines << line("daily rollups", rollupBytes);
+    lines << line("search index", searchIndexBytes);
+    lines << line("fingerprints", fingerprintBytes);
+    lines << line("transfer pairs", transferBytes);
+    lines << line("statistics sample", sampleBytes);
+    lines << line("tag index", tagIndexBytes);
+    lines << line("anomaly baselines", anomalyBytes);
+    lines << line("row cache", rowCacheBytes);
+    lines << line("partition cache", partitionCacheBytes) + QString(" (%1 rows)").arg(partitionCacheRows);
+    lines << line("undo history", historyBytes);
+    return lines.join('\n');
+}
@@ -0,0 +1,73 @@
+#ifndef LEDGERMEMORYREPORT_H
+#define LEDGERMEMORYREPORT_H
+
+#include "transaction.h"
+#include <QSet>
+#include <QString>
+
+// Counts the string payloads reachable from rows, each shared payload once
+class StringCensus
+{
+public:
+    StringCensus();
+
+    void add(const QString& value);
+    void addTransaction(const Transaction& transaction);
+
+    int fields() const;          // non-empty string fields seen
+    int distinct() const;        // distinct payloads among them
+    qint64 bytes() const;        // heap bytes of the distinct payloads
+    qint64 unsharedBytes() const; // heap bytes if every field had its own copy
+
+private:
+    QSet<const void*> m_seen;
+    int m_fields;
+    qint64 m_bytes;
+    qint64 m_unsharedBytes;
+};
+
+// Memory use of a TransactionManager by component.
+//
+// Figures are estimates from object sizes and container capacities, not
+// allocator measurements: malloc headers and fragmentation are left out.
+// MoneyTrackerBench prints them next to the heap it measures around a load.
+struct LedgerMemoryReport {
+    int rows = 0;
+
+    // Row storage: row map nodes including the Transaction values
+    qint64 rowBytes = 0;
+    qint64 rowBlocks = 0;
+
+    // String data referenced by the rows
+    qint64 stringBytes = 0;
+    qint64 unsharedStringBytes = 0;
+    int stringFields = 0;
+    int distinctStrings = 0;
+    qint64 stringPoolBytes = 0;   // the interning table itself
+    qint64 internRequests = 0;    // since the ledger was loaded or cleared
+
+    // Indexes and rollups
+    qint64 idIndexBytes = 0;
+    qint64 accountIndexBytes = 0;
+    qint64 rollupBytes = 0;       // per-day balance trees of AccountIndex
+    qint64 searchIndexBytes = 0;
+    qint64 fingerprintBytes = 0;
+    qint64 transferBytes = 0;     // transfer pairing table
+    qint64 sampleBytes = 0;       // per-month statistics sample
+    qint64 tagIndexBytes = 0;     // tag, category and date bitmaps
+    qint64 anomalyBytes = 0;      // anomaly baselines and flagged rows
+
+    // Caches and history
+    qint64 rowCacheBytes = 0;
+    qint64 partitionCacheBytes = 0;
+    int partitionCacheRows = 0;
+    qint64 historyBytes = 0;      // undo/redo row lists; versions share row nodes
+
+    qint64 totalBytes() const;
+    double bytesPerRow() const;
+    double stringDuplication() const; // string fields per distinct payload
+
+    QString toText() const;
+};
+
+#endif // LEDGERMEMORYREPORT_H
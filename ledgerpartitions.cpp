@@ -0,0 +1,281 @@
+#include "ledgerpartitions.h"
+#include "ledgerarchive.h"
+#include "fingerprintindex.h"
+#include "ledgermemoryreport.h"
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace {
+
+const int kDefaultCacheRows = 500000;
+const char* kManifestName = "manifest.json";
+
+} // namespace
+
+const QString LedgerPartitions::UndatedPartition = QStringLiteral("undated");
+
+LedgerPartitions::LedgerPartitions()
+    : m_cache(kDefaultCacheRows)
+{
+}
+
+bool LedgerPartitions::open(const QString& directory)
+{
+    close();
+
+    QDir dir(directory);
+    if (!dir.exists() && !dir.mkpath(".")) {
+        return false;
+    }
+
+    m_directory = dir.absolutePath();
+    if (!readManifest()) {
+        m_directory.clear();
+        return false;
+    }
+    return true;
+}
+
+bool LedgerPartitions::isLedgerDirectory(const QString& directory)
+{
+    return QFile::exists(QDir(directory).filePath(kManifestName));
+}
+
+void LedgerPartitions::close()
+{
+    m_directory.clear();
+    m_partitions.clear();
+    m_cache.clear();
+}
+
+bool LedgerPartitions::isOpen() const
+{
+    return !m_directory.isEmpty();
+}
+
+QString LedgerPartitions::directory() const
+{
+    return m_directory;
+}
+
+QString LedgerPartitions::monthKey(qint64 timestampMSecs)
+{
+    if (timestampMSecs == Transaction::InvalidTimestamp) {
+        return UndatedPartition;
+    }
+    return QDateTime::fromMSecsSinceEpoch(timestampMSecs).date().toString("yyyy-MM");
+}
+
+QList<PartitionInfo> LedgerPartitions::partitions() const
+{
+    return m_partitions.values();
+}
+
+bool LedgerPartitions::contains(const QString& month) const
+{
+    return m_partitions.contains(month);
+}
+
+PartitionInfo LedgerPartitions::partition(const QString& month) const
+{
+    return m_partitions.value(month);
+}
+
+QStringList LedgerPartitions::monthsBetween(qint64 start, qint64 end) const
+{
+    QStringList months;
+    if (start > end) {
+        return months;
+    }
+
+    // "yyyy-MM" keys sort chronologically, and "undated" sorts after them all
+    const QString first = monthKey(start);
+    const QString last = monthKey(end);
+    for (auto it = m_partitions.lowerBound(first); it != m_partitions.constEnd(); ++it) {
+        if (it.key() > last || it.key() == UndatedPartition) {
+            break;
+        }
+        months.append(it.key());
+    }
+    return months;
+}
+
+QList<Transaction> LedgerPartitions::cachedPartition(const QString& month, bool* ok)
+{
+    if (ok) {
+        *ok = true;
+    }
+
+    if (QList<Transaction>* cached = m_cache.object(month)) {
+        return *cached;
+    }
+
+    bool loaded = false;
+    QList<Transaction> rows = loadPartition(month, &loaded);
+    if (!loaded) {
+        if (ok) {
+            *ok = false;
+        }
+        return rows;
+    }
+
+    // QCache evicts least recently used partitions to stay under the limit
+    m_cache.insert(month, new QList<Transaction>(rows), qMax(1, int(rows.size())));
+    return rows;
+}
+
+QString LedgerPartitions::findCachedMonth(const QUuid& id) const
+{
+    const QList<QString> months = m_cache.keys();
+    for (const auto& month : months) {
+        const QList<Transaction>* rows = m_cache.object(month);
+        for (const auto& transaction : *rows) {
+            if (transaction.getUuid() == id) {
+                return month;
+            }
+        }
+    }
+    return QString();
+}
+
+void LedgerPartitions::setCacheLimit(int rows)
+{
+    m_cache.setMaxCost(rows);
+}
+
+int LedgerPartitions::cacheLimit() const
+{
+    return int(m_cache.maxCost());
+}
+
+int LedgerPartitions::cachedRowCount() const
+{
+    return int(m_cache.totalCost());
+}
+
+qint64 LedgerPartitions::cacheBytes() const
+{
+    StringCensus strings;
+    qint64 bytes = 0;
+    const QList<QString> months = m_cache.keys();
+    for (const auto& month : months) {
+        const QList<Transaction>* rows = m_cache.object(month);
+        bytes += rows->capacity() * qint64(sizeof(Transaction));
+        for (const auto& transaction : *rows) {
+            strings.addTransaction(transaction);
+        }
+    }
+    return bytes + strings.bytes();
+}
+
+QList<Transaction> LedgerPartitions::loadPartition(const QString& month, bool* ok)
+{
+    QList<Transaction> rows;
+    m_cache.remove(month);
+
+    bool success = true;
+    if (m_partitions.contains(month)) {
+        success = LedgerArchive::load(partitionPath(month), &rows);
+    }
+
+    if (ok) {
+        *ok = success;
+    }
+    return rows;
+}
+
+bool LedgerPartitions::writePartition(const QString& month, const QList<Transaction>& rows)
+{
+    m_cache.remove(month);
+
+    if (rows.isEmpty()) {
+        m_partitions.remove(month);
+        QFile::remove(partitionPath(month));
+        return true;
+    }
+
+    if (!LedgerArchive::save(partitionPath(month), rows)) {
+        return false;
+    }
+
+    PartitionInfo info;
+    info.month = month;
+    info.rowCount = int(rows.size());
+    info.fingerprints = BloomFilter(info.rowCount, 0.01);
+    for (const auto& transaction : rows) {
+        info.fingerprints.add(transactionFingerprint(transaction));
+        if (transaction.getType() == TransactionType::INCOME) {
+            info.totalIncome += transaction.getAmount();
+        } else {
+            info.totalExpense += transaction.getAmount();
+        }
+    }
+    m_partitions.insert(month, info);
+    return true;
+}
+
+bool LedgerPartitions::saveManifest()
+{
+    QJsonArray partitions;
+    for (const auto& info : std::as_const(m_partitions)) {
+        QJsonObject json;
+        json["month"] = info.month;
+        json["rows"] = info.rowCount;
+        json["income"] = info.totalIncome;
+        json["expense"] = info.totalExpense;
+        json["bloom"] = QString::fromLatin1(info.fingerprints.toByteArray().toBase64());
+        partitions.append(json);
+    }
+
+    QJsonObject manifest;
+    manifest["version"] = 1;
+    manifest["partitions"] = partitions;
+
+    QSaveFile file(QDir(m_directory).filePath(kManifestName));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(manifest).toJson());
+    return file.commit();
+}
+
+QString LedgerPartitions::partitionPath(const QString& month) const
+{
+    return QDir(m_directory).filePath(month + ".mtla");
+}
+
+bool LedgerPartitions::readManifest()
+{
+    QFile file(QDir(m_directory).filePath(kManifestName));
+    if (!file.exists()) {
+        return true; // new, empty ledger
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    if (!doc.isObject()) {
+        return false;
+    }
+
+    const QJsonArray partitions = doc.object()["partitions"].toArray();
+    for (const auto& value : partitions) {
+        QJsonObject json = value.toObject();
+        PartitionInfo info;
+        info.month = json["month"].toString();
+        info.rowCount = json["rows"].toInt();
+        info.totalIncome = json["income"].toDouble();
+        info.totalExpense = json["expense"].toDouble();
+        info.fingerprints = BloomFilter::fromByteArray(
+            QByteArray::fromBase64(json["bloom"].toString().toLatin1()));
+        if (!info.month.isEmpty()) {
+            m_partitions.insert(info.month, info);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef LEDGERPARTITIONS_H
+#define LEDGERPARTITIONS_H
+
+#include "transaction.h"
+#include "bloomfilter.h"
+#include <QCache>
+#include <QList>
+#include <QMap>
+#include <QStringList>
+
+struct PartitionInfo {
+    QString month;   // "yyyy-MM", or UndatedPartition
+    int rowCount;
+    double totalIncome;
+    double totalExpense;
+    BloomFilter fingerprints; // of transactionFingerprint(); empty for old manifests
+
+    PartitionInfo() : rowCount(0), totalIncome(0.0), totalExpense(0.0) {}
+};
+
+// On-disk ledger split into one LedgerArchive file per calendar month plus a
+// manifest.json that records each partition's row count, totals and a
+// Bloom filter of its rows' content fingerprints.
+//
+// Cold partitions are read through an LRU cache whose cost is the number of
+// cached rows, so scanning years of history keeps memory bounded. Partitions
+// that are being edited are owned by TransactionManager instead (see
+// loadPartition()).
+class LedgerPartitions
+{
+public:
+    static const QString UndatedPartition;
+
+    LedgerPartitions();
+
+    bool open(const QString& directory);
+    static bool isLedgerDirectory(const QString& directory); // has a manifest
+    void close();
+    bool isOpen() const;
+    QString directory() const;
+
+    static QString monthKey(qint64 timestampMSecs);
+
+    QList<PartitionInfo> partitions() const;
+    bool contains(const QString& month) const;
+    PartitionInfo partition(const QString& month) const;
+
+    // Existing dated partitions whose month intersects [start, end]
+    QStringList monthsBetween(qint64 start, qint64 end) const;
+
+    // Read-only access through the LRU cache
+    QList<Transaction> cachedPartition(const QString& month, bool* ok = nullptr);
+    QString findCachedMonth(const QUuid& id) const;
+    void setCacheLimit(int rows);
+    int cacheLimit() const;
+    int cachedRowCount() const;
+    qint64 cacheBytes() const; // estimated, rows and their strings
+
+    // Loads a partition for editing, bypassing and dropping any cached copy
+    QList<Transaction> loadPartition(const QString& month, bool* ok = nullptr);
+
+    // Rewrites one partition; an empty row list removes it
+    bool writePartition(const QString& month, const QList<Transaction>& rows);
+    bool saveManifest();
+
+private:
+    QString partitionPath(const QString& month) const;
+    bool readManifest();
+
+    QString m_directory;
+    QMap<QString, PartitionInfo> m_partitions;
+    QCache<QString, QList<Transaction>> m_cache;
+};
+
+#endif // LEDGERPARTITIONS_H
@@ -0,0 +1,487 @@
+#include "ledgerqueryserver.h"
+#include "transactionmanager.h"
+#include "compensatedsum.h"
+#include <QBuffer>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QtEndian>
+
+namespace {
+
+constexpr int kHeaderBytes = 4;
+
+QByteArray frame(const QByteArray& payload)
+{
+    QByteArray result(kHeaderBytes, Qt::Uninitialized);
+    qToBigEndian<quint32>(quint32(payload.size()), result.data());
+    result.append(payload);
+    return result;
+}
+
+// Length of the frame at the start of data, or -1 while its header is incomplete
+qint64 frameLength(const char* data, qint64 available)
+{
+    if (available < kHeaderBytes) {
+        return -1;
+    }
+    return qFromBigEndian<quint32>(data);
+}
+
+void writeTransaction(QDataStream& stream, const Transaction& transaction)
+{
+    stream << transaction.getUuid() << transaction.getTimestampMSecs() << transaction.getAmount()
+           << quint8(transaction.getType()) << transaction.getFromAccount() << transaction.getToAccount()
+           << transaction.getCategory() << transaction.getMethod() << transaction.getNote()
+           << transaction.getTags();
+}
+
+Transaction readTransaction(QDataStream& stream)
+{
+    QUuid id;
+    qint64 timestamp;
+    double amount;
+    quint8 type;
+    QString fromAccount;
+    QString toAccount;
+    QString category;
+    QString method;
+    QString note;
+    QStringList tags;
+    stream >> id >> timestamp >> amount >> type >> fromAccount >> toAccount >> category >> method >> note
+           >> tags;
+
+    Transaction transaction;
+    transaction.setId(id);
+    transaction.setTimestampMSecs(timestamp);
+    transaction.setAmount(amount);
+    transaction.setType(type == quint8(TransactionType::INCOME) ? TransactionType::INCOME
+                                                                : TransactionType::EXPENSE);
+    transaction.setFromAccount(fromAccount);
+    transaction.setToAccount(toAccount);
+    transaction.setCategory(category);
+    transaction.setMethod(method);
+    transaction.setNote(note);
+    transaction.setTags(tags);
+    return transaction;
+}
+
+QByteArray errorResponse(quint32 id, LedgerQueryResult::Status status, LedgerQuery::Op op,
+                         const QString& errorString)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << id << quint8(status) << quint8(op) << errorString;
+    return frame(payload);
+}
+
+// Runs on the server's thread pool; touches nothing but its arguments
+QByteArray answer(quint32 id, const LedgerQuery& query, const LedgerSnapshot& rows,
+                  const RoaringBitmap* pairedTransfers)
+{
+    int matched = 0;
+    auto visit = [&](auto function) {
+        rows.forEachWithSequence([&](quint32 sequence, const Transaction& transaction) {
+            if (query.matches(transaction) && (!pairedTransfers || !pairedTransfers->contains(sequence))) {
+                ++matched;
+                function(transaction);
+            }
+        });
+    };
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    switch (query.op) {
+    case LedgerQuery::Ping:
+        stream << id << quint8(LedgerQueryResult::Ok) << quint8(query.op);
+        break;
+    case LedgerQuery::Filter: {
+        QList<Transaction> found;
+        visit([&](const Transaction& transaction) {
+            if (query.limit == 0 || quint32(found.size()) < query.limit) {
+                found.append(transaction);
+            }
+        });
+        stream << id << quint8(LedgerQueryResult::Ok) << quint8(query.op) << qint32(matched)
+               << quint32(found.size());
+        for (const auto& transaction : found) {
+            writeTransaction(stream, transaction);
+        }
+        break;
+    }
+    case LedgerQuery::Statistics: {
+        CompensatedSum income;
+        CompensatedSum expense;
+        QHash<QString, CompensatedSum> byCategory;
+        visit([&](const Transaction& transaction) {
+            if (transaction.getType() == TransactionType::INCOME) {
+                income.add(transaction.getAmount());
+            } else {
+                expense.add(transaction.getAmount());
+                byCategory[transaction.getCategory()].add(transaction.getAmount());
+            }
+        });
+        QMap<QString, double> expenseByCategory;
+        for (auto it = byCategory.constBegin(); it != byCategory.constEnd(); ++it) {
+            expenseByCategory.insert(it.key(), it.value().value());
+        }
+        stream << id << quint8(LedgerQueryResult::Ok) << quint8(query.op) << qint32(matched)
+               << income.value() << expense.value() << expenseByCategory;
+        break;
+    }
+    case LedgerQuery::Export: {
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        LedgerExporter exporter(&buffer, query.format);
+        bool ok = exporter.begin();
+        visit([&](const Transaction& transaction) {
+            ok = ok && exporter.write(transaction);
+        });
+        ok = ok && exporter.finish();
+        if (!ok) {
+            return errorResponse(id, LedgerQueryResult::Failed, query.op, "export failed");
+        }
+        stream << id << quint8(LedgerQueryResult::Ok) << quint8(query.op) << qint32(matched)
+               << buffer.data();
+        break;
+    }
+    }
+    return frame(payload);
+}
+
+} // namespace
+
+bool LedgerQuery::matches(const Transaction& transaction) const
+{
+    const qint64 timestamp = transaction.getTimestampMSecs();
+    if (timestamp < startMSecs || timestamp > endMSecs) {
+        return false;
+    }
+    const double amount = transaction.getAmount();
+    if (amount < minAmount || amount > maxAmount) {
+        return false;
+    }
+    if (!category.isEmpty() && transaction.getCategory() != category) {
+        return false;
+    }
+    if (!text.isEmpty()) {
+        return transaction.getNote().contains(text, Qt::CaseInsensitive)
+               || transaction.getFromAccount().contains(text, Qt::CaseInsensitive)
+               || transaction.getToAccount().contains(text, Qt::CaseInsensitive)
+               || transaction.getCategory().contains(text, Qt::CaseInsensitive);
+    }
+    return true;
+}
+
+void LedgerQuery::write(QDataStream& stream) const
+{
+    stream << quint8(op) << startMSecs << endMSecs << minAmount << maxAmount << category << text
+           << excludeTransfers << limit << quint8(format);
+}
+
+bool LedgerQuery::read(QDataStream& stream)
+{
+    quint8 opValue;
+    quint8 formatValue;
+    stream >> opValue >> startMSecs >> endMSecs >> minAmount >> maxAmount >> category >> text
+           >> excludeTransfers >> limit >> formatValue;
+    if (stream.status() != QDataStream::Ok || opValue > Export || formatValue > LedgerExporter::Archive) {
+        return false;
+    }
+    op = Op(opValue);
+    format = LedgerExporter::Format(formatValue);
+    return true;
+}
+
+LedgerQueryServer::LedgerQueryServer(TransactionManager* manager, QObject* parent)
+    : QObject(parent)
+    , m_manager(manager)
+    , m_server(new QLocalServer(this))
+    , m_nextClient(0)
+    , m_answered(0)
+{
+    // Ledger data is private to the user running the app
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    m_pool.setObjectName("MoneyTracker queries");
+    connect(m_server, &QLocalServer::newConnection, this, &LedgerQueryServer::onNewConnection);
+}
+
+LedgerQueryServer::~LedgerQueryServer()
+{
+    close();
+    m_pool.waitForDone();
+}
+
+bool LedgerQueryServer::listen(const QString& name)
+{
+    close();
+    m_errorString.clear();
+
+    // A socket that still accepts connections belongs to a running instance;
+    // only one nobody answers on is stale and safe to remove
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(500)) {
+        probe.disconnectFromServer();
+        m_errorString = QString("another server is listening on %1").arg(name);
+        return false;
+    }
+    QLocalServer::removeServer(name);
+    return m_server->listen(name);
+}
+
+void LedgerQueryServer::close()
+{
+    m_server->close();
+    for (auto it = m_connections.begin(); it != m_connections.end(); ++it) {
+        it->socket->abort();
+        it->socket->deleteLater();
+    }
+    m_connections.clear();
+}
+
+bool LedgerQueryServer::isListening() const
+{
+    return m_server->isListening();
+}
+
+QString LedgerQueryServer::fullServerName() const
+{
+    return m_server->fullServerName();
+}
+
+QString LedgerQueryServer::errorString() const
+{
+    return m_errorString.isEmpty() ? m_server->errorString() : m_errorString;
+}
+
+int LedgerQueryServer::clientCount() const
+{
+    return int(m_connections.size());
+}
+
+quint64 LedgerQueryServer::requestsAnswered() const
+{
+    return m_answered;
+}
+
+void LedgerQueryServer::onNewConnection()
+{
+    while (QLocalSocket* socket = m_server->nextPendingConnection()) {
+        const quint64 client = m_nextClient++;
+        Connection connection;
+        connection.socket = socket;
+        m_connections.insert(client, connection);
+
+        connect(socket, &QLocalSocket::readyRead, this, [this, client]() {
+            readRequests(client);
+        });
+        // Queued: the socket may disconnect in the middle of a write
+        connect(socket, &QLocalSocket::disconnected, this, [this, client]() {
+            dropClient(client);
+        }, Qt::QueuedConnection);
+        readRequests(client);
+    }
+}
+
+// Reads every complete request in the socket's buffer, up to MaxPipelined
+// in flight; the rest is read once responses go out
+void LedgerQueryServer::readRequests(quint64 client)
+{
+    auto it = m_connections.find(client);
+    if (it == m_connections.end()) {
+        return;
+    }
+    Connection& connection = *it;
+    QLocalSocket* socket = connection.socket;
+
+    while (connection.nextRequest - connection.nextResponse < quint64(MaxPipelined)) {
+        char header[kHeaderBytes];
+        const qint64 length = frameLength(header, socket->peek(header, kHeaderBytes));
+        if (length < 0) {
+            return;
+        }
+        if (length > MaxRequestBytes) {
+            socket->abort();
+            return;
+        }
+        if (socket->bytesAvailable() < kHeaderBytes + length) {
+            return;
+        }
+        socket->skip(kHeaderBytes);
+        dispatch(client, connection.nextRequest++, socket->read(length));
+    }
+}
+
+void LedgerQueryServer::dispatch(quint64 client, quint64 order, const QByteArray& payload)
+{
+    QDataStream stream(payload);
+    stream.setVersion(QDataStream::Qt_6_0);
+    quint32 id = 0;
+    LedgerQuery query;
+    stream >> id;
+    if (!query.read(stream)) {
+        deliver(client, order, errorResponse(id, LedgerQueryResult::BadRequest, query.op, "malformed request"));
+        return;
+    }
+    if (query.op == LedgerQuery::Ping) {
+        deliver(client, order, answer(id, query, LedgerSnapshot(), nullptr));
+        return;
+    }
+
+    // Copies that share their data and that later edits do not affect
+    const LedgerSnapshot rows = m_manager->snapshot();
+    std::shared_ptr<const RoaringBitmap> pairedTransfers;
+    if (query.excludeTransfers) {
+        pairedTransfers = std::make_shared<const RoaringBitmap>(m_manager->transferMatcher().pairedRows());
+    }
+    m_pool.start([this, client, order, id, query, rows, pairedTransfers]() {
+        const QByteArray response = answer(id, query, rows, pairedTransfers.get());
+        QMetaObject::invokeMethod(this, [this, client, order, response]() {
+            deliver(client, order, response);
+            readRequests(client);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void LedgerQueryServer::deliver(quint64 client, quint64 order, const QByteArray& frame)
+{
+    auto it = m_connections.find(client);
+    if (it == m_connections.end()) {
+        return; // the client has gone
+    }
+    Connection& connection = *it;
+    connection.finished.insert(order, frame);
+    while (!connection.finished.isEmpty() && connection.finished.firstKey() == connection.nextResponse) {
+        connection.socket->write(connection.finished.take(connection.nextResponse));
+        ++connection.nextResponse;
+        ++m_answered;
+    }
+}
+
+void LedgerQueryServer::dropClient(quint64 client)
+{
+    auto it = m_connections.find(client);
+    if (it == m_connections.end()) {
+        return;
+    }
+    it->socket->deleteLater();
+    m_connections.erase(it);
+}
+
+LedgerQueryClient::LedgerQueryClient()
+    : m_nextId(1)
+{
+}
+
+LedgerQueryClient::~LedgerQueryClient() = default;
+
+bool LedgerQueryClient::connectToServer(const QString& name, int msecs)
+{
+    m_socket.reset(new QLocalSocket());
+    m_buffer.clear();
+    m_socket->connectToServer(name);
+    if (!m_socket->waitForConnected(msecs)) {
+        m_errorString = m_socket->errorString();
+        m_socket.reset();
+        return false;
+    }
+    return true;
+}
+
+void LedgerQueryClient::disconnectFromServer()
+{
+    if (m_socket) {
+        m_socket->disconnectFromServer();
+        m_socket.reset();
+    }
+    m_buffer.clear();
+}
+
+bool LedgerQueryClient::isConnected() const
+{
+    return m_socket && m_socket->state() == QLocalSocket::ConnectedState;
+}
+
+QString LedgerQueryClient::errorString() const
+{
+    return m_errorString;
+}
+
+quint32 LedgerQueryClient::send(const LedgerQuery& query)
+{
+    const quint32 id = m_nextId++;
+    if (!m_socket) {
+        return id;
+    }
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << id;
+    query.write(stream);
+    m_socket->write(frame(payload));
+    m_socket->flush();
+    return id;
+}
+
+bool LedgerQueryClient::receive(LedgerQueryResult* result, int msecs)
+{
+    if (!m_socket) {
+        m_errorString = "not connected";
+        return false;
+    }
+
+    qint64 length = frameLength(m_buffer.constData(), m_buffer.size());
+    while (length < 0 || m_buffer.size() < kHeaderBytes + length) {
+        if (m_socket->bytesAvailable() == 0 && !m_socket->waitForReadyRead(msecs)) {
+            m_errorString = m_socket->errorString();
+            return false;
+        }
+        m_buffer.append(m_socket->readAll());
+        length = frameLength(m_buffer.constData(), m_buffer.size());
+    }
+
+    QDataStream stream(QByteArray::fromRawData(m_buffer.constData() + kHeaderBytes, length));
+    stream.setVersion(QDataStream::Qt_6_0);
+    quint8 status;
+    quint8 op;
+    *result = LedgerQueryResult();
+    stream >> result->id >> status >> op;
+    result->status = LedgerQueryResult::Status(status);
+    result->op = LedgerQuery::Op(op);
+
+    if (result->status != LedgerQueryResult::Ok) {
+        stream >> result->errorString;
+    } else if (result->op == LedgerQuery::Filter) {
+        qint32 matched;
+        quint32 count;
+        stream >> matched >> count;
+        result->matched = matched;
+        result->rows.reserve(int(qMin<quint32>(count, 1u << 20)));
+        for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+            result->rows.append(readTransaction(stream));
+        }
+    } else if (result->op == LedgerQuery::Statistics) {
+        qint32 matched;
+        stream >> matched >> result->income >> result->expense >> result->expenseByCategory;
+        result->matched = matched;
+    } else if (result->op == LedgerQuery::Export) {
+        qint32 matched;
+        stream >> matched >> result->document;
+        result->matched = matched;
+    }
+    const bool ok = stream.status() == QDataStream::Ok;
+    m_buffer.remove(0, kHeaderBytes + length);
+    if (!ok) {
+        m_errorString = "malformed response";
+    }
+    return ok;
+}
+
+bool LedgerQueryClient::query(const LedgerQuery& query, LedgerQueryResult* result, int msecs)
+{
+    send(query);
+    return receive(result, msecs);
+}
@@ -0,0 +1,160 @@
+#ifndef LEDGERQUERYSERVER_H
+#define LEDGERQUERYSERVER_H
+
+#include "transaction.h"
+#include "ledgerexporter.h"
+#include <QByteArray>
+#include <QDataStream>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QThreadPool>
+
+#include <limits>
+#include <memory>
+
+class QLocalServer;
+class QLocalSocket;
+class TransactionManager;
+
+// One request to a LedgerQueryServer.
+//
+// Filter returns the matching rows in insertion order, Statistics the
+// income, expense and expense by category of the matching rows, Export the
+// matching rows as a LedgerExporter document, and Ping nothing (it measures
+// the round trip). Every condition below applies to all three.
+struct LedgerQuery {
+    enum Op : quint8 {
+        Ping,
+        Filter,
+        Statistics,
+        Export
+    };
+
+    Op op = Ping;
+    qint64 startMSecs = std::numeric_limits<qint64>::min(); // inclusive
+    qint64 endMSecs = std::numeric_limits<qint64>::max();   // inclusive
+    double minAmount = 0.0;
+    double maxAmount = std::numeric_limits<double>::infinity();
+    QString category;              // empty matches every category
+    QString text;                  // case-insensitive substring of note, accounts or category
+    bool excludeTransfers = false; // leave paired internal transfers out
+    quint32 limit = 0;             // Filter: at most this many rows, 0 for all
+    LedgerExporter::Format format = LedgerExporter::Csv; // Export
+
+    bool matches(const Transaction& transaction) const;
+
+    void write(QDataStream& stream) const;
+    bool read(QDataStream& stream);
+};
+
+struct LedgerQueryResult {
+    enum Status : quint8 {
+        Ok,
+        BadRequest,
+        Failed
+    };
+
+    quint32 id = 0;
+    Status status = Ok;
+    LedgerQuery::Op op = LedgerQuery::Ping;
+    QString errorString;
+
+    int matched = 0;                      // rows that met the conditions
+    QList<Transaction> rows;              // Filter
+    double income = 0.0;                  // Statistics
+    double expense = 0.0;
+    QMap<QString, double> expenseByCategory;
+    QByteArray document;                  // Export
+};
+
+// Embedded query service for scripts that need the live ledger.
+//
+// Listens on a local socket (a Unix domain socket, or a named pipe on
+// Windows) and answers LedgerQuery requests from any number of clients.
+// Every message is a frame: a big-endian quint32 payload length followed by
+// a QDataStream (Qt 6.0) payload.
+//   request:  quint32 id, quint8 op, the LedgerQuery fields
+//   response: quint32 id, quint8 status, quint8 op, the result for op
+// Clients may pipeline: send several requests before reading any response.
+// Each request is answered from a snapshot taken when it is read, on the
+// server's thread pool, so slow queries from one client do not hold up the
+// others and edits in the GUI never wait for a query. Responses on one
+// connection come back in request order. In partitioned mode the snapshot
+// holds the resident months, as TransactionManager::snapshot() does.
+//
+// The server must live on the thread that owns the TransactionManager.
+class LedgerQueryServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr quint32 MaxRequestBytes = 64 * 1024;
+    static constexpr int MaxPipelined = 64; // requests in flight per connection
+
+    explicit LedgerQueryServer(TransactionManager* manager, QObject* parent = nullptr);
+    ~LedgerQueryServer() override;
+
+    // Replaces a socket left behind by a server that did not shut down, but
+    // fails while another server still answers on name
+    bool listen(const QString& name);
+    void close();
+    bool isListening() const;
+    QString fullServerName() const;
+    QString errorString() const;
+
+    int clientCount() const;
+    quint64 requestsAnswered() const;
+
+private slots:
+    void onNewConnection();
+
+private:
+    struct Connection {
+        QLocalSocket* socket = nullptr;
+        quint64 nextRequest = 0;    // order of the next request read
+        quint64 nextResponse = 0;   // order of the next response to write
+        QMap<quint64, QByteArray> finished; // responses waiting for earlier ones
+    };
+
+    void readRequests(quint64 client);
+    void dispatch(quint64 client, quint64 order, const QByteArray& payload);
+    void deliver(quint64 client, quint64 order, const QByteArray& frame);
+    void dropClient(quint64 client);
+
+    TransactionManager* m_manager;
+    QLocalServer* m_server;
+    QThreadPool m_pool;
+    QHash<quint64, Connection> m_connections;
+    quint64 m_nextClient;
+    quint64 m_answered;
+    QString m_errorString;
+};
+
+// Blocking client for LedgerQueryServer, usable from any thread without an
+// event loop. send() only queues a request, so a caller can pipeline several
+// and then receive() the responses in the same order.
+class LedgerQueryClient
+{
+public:
+    LedgerQueryClient();
+    ~LedgerQueryClient();
+
+    bool connectToServer(const QString& name, int msecs = 5000);
+    void disconnectFromServer();
+    bool isConnected() const;
+    QString errorString() const;
+
+    quint32 send(const LedgerQuery& query); // returns the request id
+    bool receive(LedgerQueryResult* result, int msecs = 30000);
+    bool query(const LedgerQuery& query, LedgerQueryResult* result, int msecs = 30000);
+
+private:
+    std::unique_ptr<QLocalSocket> m_socket;
+    QByteArray m_buffer;
+    QString m_errorString;
+    quint32 m_nextId;
+};
+
+#endif // LEDGERQUERYSERVER_H
@@ -0,0 +1,50 @@
+#ifndef LEDGERSNAPSHOT_H
+#define LEDGERSNAPSHOT_H
+
+#include "transaction.h"
+#include "persistentrowmap.h"
+#include <QList>
+
+// Read-only view of one ledger version.
+//
+// Taking a snapshot is O(1) and later edits never affect it, so it can be
+// handed to a worker thread for saving, exporting or aggregation while the
+// GUI keeps editing the live ledger.
+class LedgerSnapshot
+{
+public:
+    LedgerSnapshot() = default;
+    explicit LedgerSnapshot(const PersistentRowMap<Transaction>& rows) : m_rows(rows) {}
+
+    int size() const { return m_rows.size(); }
+    bool isEmpty() const { return m_rows.isEmpty(); }
+
+    // Visits rows in insertion order
+    template <typename Function>
+    void forEach(Function function) const
+    {
+        m_rows.forEach([&function](quint32, const Transaction& transaction) {
+            function(transaction);
+        });
+    }
+
+    // Same, with each row's sequence number in TransactionManager's store
+    template <typename Function>
+    void forEachWithSequence(Function function) const
+    {
+        m_rows.forEach(function);
+    }
+
+    QList<Transaction> toList() const
+    {
+        QList<Transaction> rows;
+        rows.reserve(m_rows.size());
+        forEach([&rows](const Transaction& transaction) { rows.append(transaction); });
+        return rows;
+    }
+
+private:
+    PersistentRowMap<Transaction> m_rows;
+};
+
+#endif // LEDGERSNAPSHOT_H
@@ -0,0 +1,290 @@
+#include "ledgersummary.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+
+#include <limits>
+
+namespace {
+
+const quint32 kSummaryMagic = 0x4D54534D; // "MTSM"
+const quint16 kSummaryVersion = 1;
+const qint64 kStampBytes = 64 * 1024;     // hashed at each end of the ledger
+
+// Per-view accumulators: [0] every row, [1] without paired transfers
+struct Accumulator {
+    CubeCell total;
+    QHash<qint64, CubeCell> days; // Julian day
+    QHash<QString, CubeCell> categories;
+    CubeCell undated;
+
+    void add(qint64 day, const Transaction& transaction)
+    {
+        CubeCell cell;
+        if (transaction.getType() == TransactionType::INCOME) {
+            cell.income = transaction.getAmount();
+        } else {
+            cell.expense = transaction.getAmount();
+        }
+        cell.count = 1;
+
+        total.merge(cell);
+        categories[transaction.getCategory()].merge(cell);
+        if (day == std::numeric_limits<qint64>::min()) {
+            undated.merge(cell);
+        } else {
+            days[day].merge(cell);
+        }
+    }
+
+    LedgerRollup toRollup() const
+    {
+        LedgerRollup rollup;
+        rollup.total = total;
+        for (auto it = days.constBegin(); it != days.constEnd(); ++it) {
+            const QDate date = QDate::fromJulianDay(it.key());
+            rollup.days.insert(date.toString("yyyy-MM-dd"), it.value());
+            rollup.months[date.toString("yyyy-MM")].merge(it.value());
+        }
+        if (undated.count > 0) {
+            rollup.days.insert(QString(), undated);
+            rollup.months.insert(QString(), undated);
+        }
+        for (auto it = categories.constBegin(); it != categories.constEnd(); ++it) {
+            rollup.categories.insert(it.key(), it.value());
+        }
+        return rollup;
+    }
+};
+
+void writeCell(QDataStream& stream, const CubeCell& cell)
+{
+    stream << cell.income << cell.expense << qint32(cell.count);
+}
+
+void readCell(QDataStream& stream, CubeCell* cell)
+{
+    qint32 count;
+    stream >> cell->income >> cell->expense >> count;
+    cell->count = count;
+}
+
+void writeCells(QDataStream& stream, const QMap<QString, CubeCell>& cells)
+{
+    stream << quint32(cells.size());
+    for (auto it = cells.constBegin(); it != cells.constEnd(); ++it) {
+        stream << it.key();
+        writeCell(stream, it.value());
+    }
+}
+
+bool readCells(QDataStream& stream, QMap<QString, CubeCell>* cells)
+{
+    quint32 count;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString label;
+        CubeCell cell;
+        stream >> label;
+        readCell(stream, &cell);
+        cells->insert(label, cell);
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+void writeRollup(QDataStream& stream, const LedgerRollup& rollup)
+{
+    writeCell(stream, rollup.total);
+    writeCells(stream, rollup.months);
+    writeCells(stream, rollup.days);
+    writeCells(stream, rollup.categories);
+}
+
+bool readRollup(QDataStream& stream, LedgerRollup* rollup)
+{
+    readCell(stream, &rollup->total);
+    return readCells(stream, &rollup->months) && readCells(stream, &rollup->days)
+           && readCells(stream, &rollup->categories);
+}
+
+} // namespace
+
+LedgerRollup::LedgerRollup(const AggregationCube& cube)
+    : total(cube.total())
+    , months(cube.breakdown(AggregationCube::Month))
+    , days(cube.breakdown(AggregationCube::Day))
+    , categories(cube.breakdown(AggregationCube::Category))
+{
+}
+
+bool LedgerSummary::Stamp::operator==(const Stamp& other) const
+{
+    return size == other.size && modified == other.modified && digest == other.digest;
+}
+
+LedgerSummary::LedgerSummary()
+    : m_valid(false)
+    , m_rowCount(0)
+    , m_transferPairs(0)
+    , m_transferred(0.0)
+{
+}
+
+LedgerSummary LedgerSummary::compute(const LedgerSnapshot& snapshot, const RoaringBitmap* pairedTransfers)
+{
+    Accumulator views[2];
+    LedgerSummary summary;
+
+    // Rows of the same local day reuse the last conversion
+    qint64 dayStart = 1;
+    qint64 dayEnd = 0;
+    qint64 day = 0;
+    snapshot.forEachWithSequence([&](quint32 sequence, const Transaction& transaction) {
+        const qint64 timestamp = transaction.getTimestampMSecs();
+        qint64 key = std::numeric_limits<qint64>::min();
+        if (timestamp != Transaction::InvalidTimestamp) {
+            if (timestamp < dayStart || timestamp >= dayEnd) {
+                const QDate date = QDateTime::fromMSecsSinceEpoch(timestamp).date();
+                dayStart = QDateTime(date, QTime(0, 0)).toMSecsSinceEpoch();
+                dayEnd = QDateTime(date.addDays(1), QTime(0, 0)).toMSecsSinceEpoch();
+                day = date.toJulianDay();
+            }
+            key = day;
+        }
+
+        views[0].add(key, transaction);
+        if (pairedTransfers && pairedTransfers->contains(sequence)) {
+            if (transaction.getType() == TransactionType::EXPENSE) {
+                ++summary.m_transferPairs;
+                summary.m_transferred += transaction.getAmount();
+            }
+        } else {
+            views[1].add(key, transaction);
+        }
+    });
+
+    summary.m_valid = true;
+    summary.m_rowCount = snapshot.size();
+    summary.m_all = views[0].toRollup();
+    summary.m_excludingTransfers = views[1].toRollup();
+    return summary;
+}
+
+bool LedgerSummary::isValid() const
+{
+    return m_valid;
+}
+
+int LedgerSummary::rowCount() const
+{
+    return m_rowCount;
+}
+
+double LedgerSummary::balance() const
+{
+    return m_all.total.net();
+}
+
+const LedgerRollup& LedgerSummary::rollup(bool excludeTransfers) const
+{
+    return excludeTransfers ? m_excludingTransfers : m_all;
+}
+
+int LedgerSummary::transferPairs() const
+{
+    return m_transferPairs;
+}
+
+double LedgerSummary::transferred() const
+{
+    return m_transferred;
+}
+
+QString LedgerSummary::sidecarPath(const QString& ledgerPath)
+{
+    return ledgerPath + ".summary";
+}
+
+bool LedgerSummary::save(const QString& ledgerPath) const
+{
+    Stamp stamp;
+    if (!m_valid || !stampFile(ledgerPath, &stamp)) {
+        return false;
+    }
+
+    QSaveFile file(sidecarPath(ledgerPath));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << kSummaryMagic << kSummaryVersion;
+    stream << stamp.size << stamp.modified << stamp.digest;
+    stream << qint32(m_rowCount) << qint32(m_transferPairs) << m_transferred;
+    writeRollup(stream, m_all);
+    writeRollup(stream, m_excludingTransfers);
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+LedgerSummary LedgerSummary::load(const QString& ledgerPath)
+{
+    LedgerSummary summary;
+    QFile file(sidecarPath(ledgerPath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return summary;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic;
+    quint16 version;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != kSummaryMagic || version != kSummaryVersion) {
+        return summary;
+    }
+
+    Stamp recorded;
+    Stamp current;
+    stream >> recorded.size >> recorded.modified >> recorded.digest;
+    if (stream.status() != QDataStream::Ok || !stampFile(ledgerPath, &current) || !(recorded == current)) {
+        return summary;
+    }
+
+    qint32 rowCount;
+    qint32 transferPairs;
+    stream >> rowCount >> transferPairs >> summary.m_transferred;
+    if (!readRollup(stream, &summary.m_all) || !readRollup(stream, &summary.m_excludingTransfers)
+        || !stream.atEnd()) {
+        return LedgerSummary();
+    }
+    summary.m_rowCount = rowCount;
+    summary.m_transferPairs = transferPairs;
+    summary.m_valid = true;
+    return summary;
+}
+
+bool LedgerSummary::stampFile(const QString& path, Stamp* stamp)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QFileInfo info(file);
+    stamp->size = file.size();
+    stamp->modified = info.lastModified().toMSecsSinceEpoch();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(file.read(kStampBytes));
+    if (stamp->size > kStampBytes) {
+        if (!file.seek(qMax(kStampBytes, stamp->size - kStampBytes))) {
+            return false;
+        }
+        hash.addData(file.read(kStampBytes));
+    }
+    stamp->digest = hash.result();
+    return true;
+}
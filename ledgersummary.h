@@ -0,0 +1,77 @@
+#ifndef LEDGERSUMMARY_H
+#define LEDGERSUMMARY_H
+
+#include "aggregationcube.h"
+#include "ledgersnapshot.h"
+#include "roaringbitmap.h"
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+
+// The figures the dashboard shows, rolled up from one cube by category and
+// day. Labels are as in AggregationCube; undated rows fall under the empty
+// month and day.
+struct LedgerRollup {
+    CubeCell total;
+    QMap<QString, CubeCell> months;     // "yyyy-MM"
+    QMap<QString, CubeCell> days;       // "yyyy-MM-dd"
+    QMap<QString, CubeCell> categories;
+
+    LedgerRollup() = default;
+    explicit LedgerRollup(const AggregationCube& cube);
+};
+
+// Precomputed aggregates of a whole-file ledger, kept in a small sidecar
+// next to it ("<ledger>.summary") so the dashboard can be drawn before the
+// ledger itself has been parsed.
+//
+// The sidecar records the ledger file it was computed from: its size, its
+// modification time and a SHA-1 over its first and last 64 KiB. load()
+// rejects a sidecar when any of them differ, so a ledger replaced or edited
+// behind our back is never shown with stale figures; the caller recomputes
+// from the rows instead. Checking costs two small reads whatever the size
+// of the ledger.
+class LedgerSummary
+{
+public:
+    LedgerSummary(); // invalid
+
+    // One pass over the rows; pairedTransfers, when given, holds the
+    // sequences of the snapshot's paired rows (TransferMatcher::pairedRows())
+    static LedgerSummary compute(const LedgerSnapshot& snapshot, const RoaringBitmap* pairedTransfers);
+
+    bool isValid() const;
+    int rowCount() const;
+    double balance() const;
+    const LedgerRollup& rollup(bool excludeTransfers) const;
+    int transferPairs() const;
+    double transferred() const; // the expense half of each pair
+
+    static QString sidecarPath(const QString& ledgerPath);
+
+    // Writes the sidecar for ledgerPath as that file is now; call it after
+    // the ledger has been written
+    bool save(const QString& ledgerPath) const;
+    // An invalid summary when the sidecar is missing, unreadable or stale
+    static LedgerSummary load(const QString& ledgerPath);
+
+private:
+    struct Stamp {
+        qint64 size = -1;
+        qint64 modified = 0; // ms since the epoch, UTC
+        QByteArray digest;
+
+        bool operator==(const Stamp& other) const;
+    };
+
+    static bool stampFile(const QString& path, Stamp* stamp);
+
+    bool m_valid;
+    int m_rowCount;
+    LedgerRollup m_all;
+    LedgerRollup m_excludingTransfers;
+    int m_transferPairs;
+    double m_transferred;
+};
+
+#endif // LEDGERSUMMARY_H
@@ -2,6 +2,7 @@
 #include <QApplication>
 #include <QStyleFactory>
 #include <QFile>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[])
 {
@@ -12,6 +13,15 @@ int main(int argc, char *argv[])
     app.setApplicationVersion("1.0");
     app.setOrganizationName("MoneyTracker");
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption queryServerOption("query-server",
+                                         "Answer ledger queries on the local socket <name>.",
+                                         "name");
+    parser.addOption(queryServerOption);
+    parser.process(app);
+
     // Set modern style
     app.setStyle(QStyleFactory::create("Fusion"));
 
@@ -35,6 +45,9 @@ int main(int argc, char *argv[])
     // Create and show main window
     MainWindow window;
     window.show();
+    if (parser.isSet(queryServerOption)) {
+        window.startQueryServer(parser.value(queryServerOption));
+    }
 
     return app.exec();
 }
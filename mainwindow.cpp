@@ -1,5 +1,9 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "csvimporter.h"
+#include "ledgerexporter.h"
+#include "trendchartwidget.h"
+#include "billstablemodel.h"
 
 #include <QPushButton>
 #include <QHBoxLayout>
@@ -8,6 +12,7 @@
 #include <QListWidget>
 #include <QLineEdit>
 #include <QComboBox>
+#include <QCheckBox>
 #include <QDateEdit>
 #include <QDoubleSpinBox>
 #include <QDialog>
@@ -16,33 +21,75 @@
 #include <QMessageBox>
 #include <QTabWidget>
 #include <QGroupBox>
-#include <QTableWidget>
+#include <QTableView>
 #include <QHeaderView>
 #include <QFileDialog>
 #include <QScrollArea>
 #include <QFrame>
 #include <QSpacerItem>
+#include <QShortcut>
+#include <QCompleter>
+#include <QStringListModel>
+#include <QStandardPaths>
+#include <QFile>
+#include <QCloseEvent>
+#include <QStatusBar>
+#include <QThread>
+#include <QProgressBar>
+#include <QTimer>
+
+namespace {
+
+// The categories offered when adding a transaction or a budget
+const QStringList &transactionCategories()
+{
+    static const QStringList categories{"餐饮", "交通", "购物", "娱乐", "医疗", "住房", "工资", "转账", "其他"};
+    return categories;
+}
+
+} // namespace
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , m_transactionManager(new TransactionManager(this))
     , m_statsCalculator(new StatisticsCalculator(this))
+    , m_progressiveStats(new ProgressiveStatistics(this))
+    , m_autoSaver(nullptr)
+    , m_queryServer(nullptr)
     , m_tabWidget(nullptr)
     , m_balanceLabel(nullptr)
     , m_incomeLabel(nullptr)
     , m_expenseLabel(nullptr)
     , m_transactionList(nullptr)
+    , m_undoButton(nullptr)
+    , m_redoButton(nullptr)
+    , m_statsTab(nullptr)
     , m_statsList(nullptr)
     , m_categoryList(nullptr)
+    , m_trendChart(nullptr)
+    , m_budgetList(nullptr)
+    , m_billsTab(nullptr)
     , m_billsTable(nullptr)
+    , m_billsModel(nullptr)
+    , m_billsTotalsLabel(nullptr)
     , m_startDateEdit(nullptr)
     , m_endDateEdit(nullptr)
+    , m_searchEdit(nullptr)
+    , m_tagQueryEdit(nullptr)
+    , m_searchTimer(nullptr)
     , m_quickAddBtn(nullptr)
+    , m_undoShortcut(nullptr)
+    , m_redoShortcut(nullptr)
+    , m_loadProgress(nullptr)
+    , m_statsStale(true)
+    , m_billsStale(true)
+    , m_excludeTransfers(true)
 {
     ui->setupUi(this);
-    setupUI();
 
+    // Applied before any child exists, so each widget is polished once
+    // when it is created instead of the whole tree being repolished
     setStyleSheet(
         // 主窗口和基础部件
         "QMainWindow { background-color: #f5f6fa; }"
@@ -61,7 +108,7 @@ MainWindow::MainWindow(QWidget *parent)
 
         // 列表和表格
         "QListWidget { background-color: white; border: 1px solid #C2C7CB; border-radius: 3px; alternate-background-color: #f8f9fa; }"
-        "QTableWidget { background-color: white; border: 1px solid #C2C7CB; border-radius: 3px; alternate-background-color: #f8f9fa; gridline-color: #E1E5E9; }"
+        "QTableView { background-color: white; border: 1px solid #C2C7CB; border-radius: 3px; alternate-background-color: #f8f9fa; gridline-color: #E1E5E9; }"
         "QHeaderView::section { background-color: #667eea; color: white; padding: 5px; border: 0px; }"
 
         // 按钮
@@ -77,11 +124,12 @@ MainWindow::MainWindow(QWidget *parent)
         "QDialog { background-color: white; }"
         );
 
+    setupUI();
     setupConnections();
-    loadSampleData();
-    updateQuickStats();
-    updateTransactionList();
-    updateStatistics();
+    loadBudgets();
+
+    // Home tab content comes from the transactionsChanged() of the load
+    loadLedger();
 }
 
 MainWindow::~MainWindow()
@@ -89,6 +137,28 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+bool MainWindow::startQueryServer(const QString &name)
+{
+    if (!m_queryServer) {
+        m_queryServer = new LedgerQueryServer(m_transactionManager, this);
+    }
+    if (!m_queryServer->listen(name)) {
+        QMessageBox::warning(this, "错误", "无法启动查询服务:\n" + m_queryServer->errorString());
+        return false;
+    }
+    statusBar()->showMessage("查询服务已启动: " + m_queryServer->fullServerName(), 5000);
+    return true;
+}
+
+void MainWindow::closeEvent(QCloseEvent *event)
+{
+    // Write out edits still waiting for the debounce before quitting
+    if (m_autoSaver) {
+        m_autoSaver->flush();
+    }
+    QMainWindow::closeEvent(event);
+}
+
 void MainWindow::setupUI()
 {
     setWindowTitle("记账本系统");
@@ -129,17 +199,59 @@ void MainWindow::setupUI()
     m_transactionList = new QListWidget();
     recentLayout->addWidget(m_transactionList);
 
-    // Delete button
+    // Delete / undo / redo buttons
+    QHBoxLayout *editLayout = new QHBoxLayout();
+
     QPushButton *deleteButton = new QPushButton("删除选中交易");
     connect(deleteButton, &QPushButton::clicked, this, &MainWindow::onDeleteTransactionClicked);
-    recentLayout->addWidget(deleteButton);
+
+    m_undoButton = new QPushButton("撤销");
+    m_undoButton->setEnabled(false);
+    m_redoButton = new QPushButton("重做");
+    m_redoButton->setEnabled(false);
+
+    editLayout->addWidget(deleteButton);
+    editLayout->addWidget(m_undoButton);
+    editLayout->addWidget(m_redoButton);
+    recentLayout->addLayout(editLayout);
 
     homeLayout->addWidget(statsGroup);
     homeLayout->addWidget(recentGroup);
 
-    // ==================== Statistics Tab ====================
-    QWidget *statsTab = new QWidget();
-    QVBoxLayout *statsTabLayout = new QVBoxLayout(statsTab);
+    // The statistics and bills tabs are filled in on first activation
+    m_statsTab = new QWidget();
+    m_billsTab = new QWidget();
+
+    // Add tabs
+    m_tabWidget->addTab(homeTab, "🏠 首页");
+    m_tabWidget->addTab(m_statsTab, "📊 统计");
+    m_tabWidget->addTab(m_billsTab, "📝 账单");
+
+    mainLayout->addWidget(m_tabWidget);
+
+    // Quick add button
+    m_quickAddBtn = new QPushButton("+", centralWidget);
+    m_quickAddBtn->setFixedSize(60, 60);
+    m_quickAddBtn->setStyleSheet(
+        "QPushButton {"
+        "background: qlineargradient(x1:0, y1:0, x2:1, y2:1, stop:0 #667eea, stop:1 #764ba2);"
+        "color: white; border-radius: 30px; font-size: 24px; font-weight: bold;"
+        "}"
+        "QPushButton:hover { background: qlineargradient(x1:0, y1:0, x2:1, y2:1, stop:0 #5a6fd8, stop:1 #6a4190); }"
+        );
+
+    // Create overlay layout for floating button
+    QHBoxLayout *overlayLayout = new QHBoxLayout();
+    overlayLayout->addStretch();
+    overlayLayout->addWidget(m_quickAddBtn);
+    mainLayout->addLayout(overlayLayout);
+
+    setCentralWidget(centralWidget);
+}
+
+void MainWindow::buildStatisticsTab()
+{
+    QVBoxLayout *statsTabLayout = new QVBoxLayout(m_statsTab);
 
     // Statistics overview
     QGroupBox *statsOverviewGroup = new QGroupBox("统计概览");
@@ -148,6 +260,15 @@ void MainWindow::setupUI()
     m_statsList = new QListWidget();
     statsOverviewLayout->addWidget(m_statsList);
 
+    QCheckBox *excludeTransfersBox = new QCheckBox("排除内部转账（已配对的转出与转入）");
+    excludeTransfersBox->setChecked(m_excludeTransfers);
+    statsOverviewLayout->addWidget(excludeTransfersBox);
+    connect(excludeTransfersBox, &QCheckBox::toggled, this, [this](bool checked) {
+        m_excludeTransfers = checked;
+        updateQuickStats();
+        refreshStatisticsDisplay();
+    });
+
     // Category breakdown
     QGroupBox *categoryGroup = new QGroupBox("支出分类统计");
     QVBoxLayout *categoryLayout = new QVBoxLayout(categoryGroup);
@@ -155,71 +276,125 @@ void MainWindow::setupUI()
     m_categoryList = new QListWidget();
     categoryLayout->addWidget(m_categoryList);
 
+    // Daily trend over the whole history
+    QGroupBox *trendGroup = new QGroupBox("收支趋势");
+    QVBoxLayout *trendLayout = new QVBoxLayout(trendGroup);
+
+    m_trendChart = new TrendChartWidget();
+    trendLayout->addWidget(m_trendChart);
+
+    // Budgets with this month's progress
+    QGroupBox *budgetGroup = new QGroupBox("预算");
+    QVBoxLayout *budgetLayout = new QVBoxLayout(budgetGroup);
+
+    m_budgetList = new QListWidget();
+    QHBoxLayout *budgetButtons = new QHBoxLayout();
+    QPushButton *addBudgetBtn = new QPushButton("添加预算");
+    QPushButton *deleteBudgetBtn = new QPushButton("删除预算");
+    budgetButtons->addWidget(addBudgetBtn);
+    budgetButtons->addWidget(deleteBudgetBtn);
+    budgetButtons->addStretch();
+    budgetLayout->addWidget(m_budgetList);
+    budgetLayout->addLayout(budgetButtons);
+
+    connect(addBudgetBtn, &QPushButton::clicked, this, &MainWindow::onAddBudgetClicked);
+    connect(deleteBudgetBtn, &QPushButton::clicked, this, &MainWindow::onDeleteBudgetClicked);
+
     statsTabLayout->addWidget(statsOverviewGroup);
     statsTabLayout->addWidget(categoryGroup);
+    statsTabLayout->addWidget(budgetGroup);
+    statsTabLayout->addWidget(trendGroup, 1);
+}
 
-    // ==================== Bills Tab ====================
-    QWidget *billsTab = new QWidget();
-    QVBoxLayout *billsLayout = new QVBoxLayout(billsTab);
+void MainWindow::buildBillsTab()
+{
+    QVBoxLayout *billsLayout = new QVBoxLayout(m_billsTab);
 
     // Filter controls
     QGroupBox *filterGroup = new QGroupBox("筛选条件");
     QHBoxLayout *filterLayout = new QHBoxLayout(filterGroup);
 
+    // The table follows the dates live; moving a date only touches the rows at the edges.
+    // A tag query selects by date itself, so it is run again instead.
     m_startDateEdit = new QDateEdit(QDate::currentDate().addDays(-30));
     m_endDateEdit = new QDateEdit(QDate::currentDate());
-
-    QPushButton *filterButton = new QPushButton("筛选");
-    connect(filterButton, &QPushButton::clicked, this, &MainWindow::onFilterApplied);
+    auto onDatesChanged = [this]() {
+        if (m_tagQueryEdit->text().trimmed().isEmpty() && m_searchEdit->text().trimmed().isEmpty()) {
+            applyBillsRange();
+        } else {
+            updateBillsTable();
+        }
+    };
+    connect(m_startDateEdit, &QDateEdit::dateChanged, this, onDatesChanged);
+    connect(m_endDateEdit, &QDateEdit::dateChanged, this, onDatesChanged);
+
+    QPushButton *importButton = new QPushButton("导入CSV");
+    connect(importButton, &QPushButton::clicked, this, &MainWindow::onImportCsvClicked);
+
+    QPushButton *exportButton = new QPushButton("导出");
+    connect(exportButton, &QPushButton::clicked, this, &MainWindow::onExportBillsClicked);
+
+    // Search as you type over notes, accounts and categories. Each key
+    // restarts the timer, so a query runs once typing pauses.
+    m_searchTimer = new QTimer(this);
+    m_searchTimer->setSingleShot(true);
+    m_searchTimer->setInterval(250);
+    connect(m_searchTimer, &QTimer::timeout, this, &MainWindow::updateBillsTable);
+
+    m_searchEdit = new QLineEdit();
+    m_searchEdit->setPlaceholderText("搜索备注、账户或类别");
+    m_searchEdit->setClearButtonEnabled(true);
+    connect(m_searchEdit, &QLineEdit::textChanged, m_searchTimer, qOverload<>(&QTimer::start));
+
+    // Boolean tag conditions, answered from the tag bitmaps
+    m_tagQueryEdit = new QLineEdit();
+    m_tagQueryEdit->setPlaceholderText("标签条件，如 出差 AND 可报销 AND NOT 已退款");
+    m_tagQueryEdit->setClearButtonEnabled(true);
+    connect(m_tagQueryEdit, &QLineEdit::textChanged, m_searchTimer, qOverload<>(&QTimer::start));
 
     filterLayout->addWidget(new QLabel("开始日期:"));
     filterLayout->addWidget(m_startDateEdit);
     filterLayout->addWidget(new QLabel("结束日期:"));
     filterLayout->addWidget(m_endDateEdit);
-    filterLayout->addWidget(filterButton);
-    filterLayout->addStretch();
+    filterLayout->addWidget(m_searchEdit, 1);
+    filterLayout->addWidget(m_tagQueryEdit, 1);
+    filterLayout->addWidget(importButton);
+    filterLayout->addWidget(exportButton);
 
     // Bills table
     QGroupBox *billsTableGroup = new QGroupBox("账单明细");
     QVBoxLayout *billsTableLayout = new QVBoxLayout(billsTableGroup);
 
-    m_billsTable = new QTableWidget();
-    m_billsTable->setColumnCount(6);
-    m_billsTable->setHorizontalHeaderLabels({"类型", "金额", "对方账户", "类别", "方式", "时间"});
+    m_billsModel = new BillsTableModel(this);
+    m_billsModel->setAnomalySource(m_transactionManager);
+    m_billsTable = new QTableView();
+    m_billsTable->setModel(m_billsModel);
     m_billsTable->horizontalHeader()->setStretchLastSection(true);
+    m_billsTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
     m_billsTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_billsTable->setSelectionMode(QAbstractItemView::ExtendedSelection);
     m_billsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
 
-    billsTableLayout->addWidget(m_billsTable);
-
-    billsLayout->addWidget(filterGroup);
-    billsLayout->addWidget(billsTableGroup);
+    QShortcut *deleteShortcut = new QShortcut(QKeySequence::Delete, m_billsTable);
+    deleteShortcut->setContext(Qt::WidgetShortcut);
+    connect(deleteShortcut, &QShortcut::activated, this, &MainWindow::onDeleteBillsClicked);
 
-    // Add tabs
-    m_tabWidget->addTab(homeTab, "🏠 首页");
-    m_tabWidget->addTab(statsTab, "📊 统计");
-    m_tabWidget->addTab(billsTab, "📝 账单");
+    m_billsTotalsLabel = new QLabel();
+    QPushButton *deleteBillsButton = new QPushButton("删除所选");
+    connect(deleteBillsButton, &QPushButton::clicked, this, &MainWindow::onDeleteBillsClicked);
+    QPushButton *tagBillsButton = new QPushButton("编辑标签");
+    connect(tagBillsButton, &QPushButton::clicked, this, &MainWindow::onTagBillsClicked);
 
-    mainLayout->addWidget(m_tabWidget);
+    QHBoxLayout *billsFooterLayout = new QHBoxLayout();
+    billsFooterLayout->addWidget(m_billsTotalsLabel, 1);
+    billsFooterLayout->addWidget(tagBillsButton);
+    billsFooterLayout->addWidget(deleteBillsButton);
 
-    // Quick add button
-    m_quickAddBtn = new QPushButton("+", centralWidget);
-    m_quickAddBtn->setFixedSize(60, 60);
-    m_quickAddBtn->setStyleSheet(
-        "QPushButton {"
-        "background: qlineargradient(x1:0, y1:0, x2:1, y2:1, stop:0 #667eea, stop:1 #764ba2);"
-        "color: white; border-radius: 30px; font-size: 24px; font-weight: bold;"
-        "}"
-        "QPushButton:hover { background: qlineargradient(x1:0, y1:0, x2:1, y2:1, stop:0 #5a6fd8, stop:1 #6a4190); }"
-        );
-
-    // Create overlay layout for floating button
-    QHBoxLayout *overlayLayout = new QHBoxLayout();
-    overlayLayout->addStretch();
-    overlayLayout->addWidget(m_quickAddBtn);
-    mainLayout->addLayout(overlayLayout);
+    billsTableLayout->addWidget(m_billsTable);
+    billsTableLayout->addLayout(billsFooterLayout);
 
-    setCentralWidget(centralWidget);
+    billsLayout->addWidget(filterGroup);
+    billsLayout->addWidget(billsTableGroup);
 }
 
 void MainWindow::setupConnections()
@@ -230,56 +405,138 @@ void MainWindow::setupConnections()
     // Connect transaction list
     connect(m_transactionList, &QListWidget::itemClicked, this, &MainWindow::onTransactionSelected);
 
+    connect(m_tabWidget, &QTabWidget::currentChanged, this, &MainWindow::onTabChanged);
+
+    // Connect undo / redo
+    connect(m_undoButton, &QPushButton::clicked, this, &MainWindow::onUndoClicked);
+    connect(m_redoButton, &QPushButton::clicked, this, &MainWindow::onRedoClicked);
+    m_undoShortcut = new QShortcut(QKeySequence::Undo, this);
+    m_redoShortcut = new QShortcut(QKeySequence::Redo, this);
+    connect(m_undoShortcut, &QShortcut::activated, this, &MainWindow::onUndoClicked);
+    connect(m_redoShortcut, &QShortcut::activated, this, &MainWindow::onRedoClicked);
+
     // Connect transaction manager signals
     connect(m_transactionManager, &TransactionManager::transactionsChanged,
             this, &MainWindow::onTransactionsChanged);
+    connect(m_transactionManager, &TransactionManager::historyChanged,
+            this, &MainWindow::updateHistoryButtons);
+    connect(m_transactionManager->budgetEngine(), &BudgetEngine::alertRaised,
+            this, &MainWindow::onBudgetAlert);
+    connect(m_progressiveStats, &ProgressiveStatistics::progress,
+            this, &MainWindow::onStatisticsProgress);
+}
+
+void MainWindow::loadLedger()
+{
+    const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    const QString directory = dataDir + "/ledger";
+    const QString filename = dataDir + "/ledger.mtla"; // single-file ledger of earlier versions
+
+    // The ledger is kept as month partitions: only the recent months are
+    // read at startup, older ones when a query reaches them. A new ledger
+    // starts empty: sample rows would be autosaved as the user's own.
+    if (LedgerPartitions::isLedgerDirectory(directory) || !QFile::exists(filename)) {
+        if (!m_transactionManager->openPartitionedLedger(directory)) {
+            // Never autosave over a ledger we could not read
+            QMessageBox::warning(this, "错误", "无法读取账本目录，本次修改将不会自动保存:\n" + directory);
+            return;
+        }
+        startAutoSave(directory);
+        return;
+    }
+
+    // A single-file ledger is converted once: read and indexed on a worker
+    // thread, written out as partitions, then opened like any other. Adding,
+    // undo/redo and the bills tab stay disabled until then so no edit can be
+    // lost; the rows are empty, so nothing else can change them.
+    m_tabWidget->setTabEnabled(m_tabWidget->indexOf(m_billsTab), false);
+    m_quickAddBtn->setEnabled(false);
+    m_undoShortcut->setEnabled(false);
+    m_redoShortcut->setEnabled(false);
+    m_loadProgress = new QProgressBar();
+    m_loadProgress->setRange(0, 0);
+    m_loadProgress->setMaximumWidth(200);
+    statusBar()->addPermanentWidget(m_loadProgress);
+
+    // Meanwhile the dashboard shows the figures saved with the file. A
+    // sidecar that does not match it is ignored; the figures then appear
+    // once the partitions are open.
+    m_startupSummary = LedgerSummary::load(filename);
+    if (m_startupSummary.isValid()) {
+        statusBar()->showMessage("正在转换账本，统计数据来自上次保存...");
+        updateQuickStats();
+        updateStatistics();
+    } else {
+        statusBar()->showMessage("正在转换账本...");
+    }
+
+    auto converted = std::make_shared<bool>(false);
+    QThread *thread = QThread::create([converted, filename, directory]() {
+        TransactionManager manager;
+        *converted = manager.loadFromFile(filename) && manager.savePartitionedLedger(directory);
+    });
+
+    connect(thread, &QThread::finished, this, [this, thread, converted, filename, directory]() {
+        thread->deleteLater();
+        statusBar()->removeWidget(m_loadProgress);
+        delete m_loadProgress;
+        m_loadProgress = nullptr;
+        statusBar()->clearMessage();
+        m_tabWidget->setTabEnabled(m_tabWidget->indexOf(m_billsTab), true);
+        m_quickAddBtn->setEnabled(true);
+        m_undoShortcut->setEnabled(true);
+        m_redoShortcut->setEnabled(true);
+        m_startupSummary = LedgerSummary();
+
+        if (!*converted || !m_transactionManager->openPartitionedLedger(directory)) {
+            // Never autosave over a ledger we could not read
+            QMessageBox::warning(this, "错误", "无法转换账本文件，本次修改将不会自动保存:\n" + filename);
+            updateQuickStats();
+            updateStatistics();
+            return;
+        }
+
+        // The old file is kept as a backup; its summary describes it alone
+        QFile::remove(filename + ".bak");
+        QFile::rename(filename, filename + ".bak");
+        QFile::remove(LedgerSummary::sidecarPath(filename));
+        startAutoSave(directory);
+    });
+    thread->start();
 }
 
-void MainWindow::loadSampleData()
-{
-    // Add some sample transactions
-    QDateTime now = QDateTime::currentDateTime();
-
-    // 修复：创建 QDateTime 对象时使用正确的构造函数
-    Transaction t1(TransactionType::INCOME, 8500.0, "公司", "我的账户", "工资", "银行卡",
-                   QDateTime(now.date().addDays(-5), QTime(9, 0, 0)));
-    Transaction t2(TransactionType::EXPENSE, 2500.0, "我的账户", "房东", "住房", "支付宝",
-                   QDateTime(now.date().addDays(-4), QTime(10, 30, 0)));
-    Transaction t3(TransactionType::EXPENSE, 38.5, "我的账户", "星巴克", "餐饮", "微信支付",
-                   QDateTime(now.date().addDays(-3), QTime(15, 15, 0)));
-    Transaction t4(TransactionType::EXPENSE, 25.0, "我的账户", "滴滴出行", "交通", "支付宝",
-                   QDateTime(now.date().addDays(-2), QTime(8, 45, 0)));
-    Transaction t5(TransactionType::INCOME, 2000.0, "张三", "我的账户", "转账", "微信支付",
-                   QDateTime(now.date().addDays(-1), QTime(14, 20, 0)));
-    Transaction t6(TransactionType::EXPENSE, 156.8, "我的账户", "超市", "购物", "微信支付",
-                   QDateTime(now.date().addDays(-1), QTime(18, 30, 0)));
-    Transaction t7(TransactionType::EXPENSE, 89.0, "我的账户", "电影院", "娱乐", "支付宝",
-                   QDateTime(now.date(), QTime(20, 0, 0)));
-
-    m_transactionManager->addTransaction(t1);
-    m_transactionManager->addTransaction(t2);
-    m_transactionManager->addTransaction(t3);
-    m_transactionManager->addTransaction(t4);
-    m_transactionManager->addTransaction(t5);
-    m_transactionManager->addTransaction(t6);
-    m_transactionManager->addTransaction(t7);
+void MainWindow::startAutoSave(const QString &filename)
+{
+    m_autoSaver = new AutoSaver(m_transactionManager, filename, this);
+    connect(m_autoSaver, &AutoSaver::saveFinished, this, &MainWindow::onAutoSaveFinished);
+}
+
+void MainWindow::onAutoSaveFinished(bool ok, const QString &errorString)
+{
+    if (ok) {
+        statusBar()->showMessage("已自动保存", 2000);
+    } else {
+        statusBar()->showMessage("自动保存失败: " + errorString);
+    }
 }
 
 void MainWindow::updateQuickStats()
 {
-    double balance = m_transactionManager->calculateBalance();
+    // While the ledger loads, the figures saved with it
+    double balance = m_startupSummary.isValid() ? m_startupSummary.balance()
+                                                : m_transactionManager->calculateBalance();
 
     // Calculate total income and expense
     double totalIncome = 0.0;
     double totalExpense = 0.0;
 
-    auto transactions = m_transactionManager->getTransactions();
-    for (const auto& transaction : transactions) {
-        if (transaction.getType() == TransactionType::INCOME) {
-            totalIncome += transaction.getAmount();
-        } else {
-            totalExpense += transaction.getAmount();
-        }
+    if (m_startupSummary.isValid()) {
+        const CubeCell total = m_startupSummary.rollup(m_excludeTransfers).total;
+        totalIncome = total.income;
+        totalExpense = total.expense;
+    } else {
+        // Cold months of a partitioned ledger come from their manifest totals
+        m_transactionManager->calculateTotals(&totalIncome, &totalExpense, m_excludeTransfers);
     }
 
     if (m_balanceLabel) {
@@ -301,26 +558,47 @@ void MainWindow::updateTransactionList()
 
     m_transactionList->clear();
 
-    auto transactions = m_transactionManager->getTransactions();
-
-    // Sort transactions by timestamp (newest first)
-    std::sort(transactions.begin(), transactions.end(),
-              [](const Transaction& a, const Transaction& b) {
-                  return a.getTimestamp() > b.getTimestamp();
-              });
+    // Show only recent transactions (last 10), newest first. One pass keeping
+    // the ten newest avoids sorting (and copying) the whole ledger.
+    const int recentCount = 10;
+    auto newer = [](const Transaction& a, const Transaction& b) {
+        return a.getTimestampMSecs() > b.getTimestampMSecs();
+    };
+    QList<Transaction> transactions;
+    m_transactionManager->snapshot().forEach([&](const Transaction& transaction) {
+        if (transactions.size() == recentCount && !newer(transaction, transactions.last())) {
+            return;
+        }
+        transactions.insert(std::upper_bound(transactions.begin(), transactions.end(), transaction, newer),
+                            transaction);
+        if (transactions.size() > recentCount) {
+            transactions.removeLast();
+        }
+    });
 
-    // Show only recent transactions (last 10)
-    int count = qMin(10, transactions.size());
-    for (int i = 0; i < count; ++i) {
+    for (int i = 0; i < transactions.size(); ++i) {
         const auto& transaction = transactions[i];
         QString displayText = QString("%1 %2 - %3 - %4")
                                   .arg(transaction.getDisplayAmount())
                                   .arg(transaction.getToAccount())
                                   .arg(transaction.getCategory())
                                   .arg(transaction.getTimestamp().toString("MM/dd hh:mm"));
+        if (!transaction.getTags().isEmpty()) {
+            displayText += "  #" + transaction.getTags().join(" #");
+        }
+
+        // Unusual expenses stand out, with the reason on hover
+        const AnomalyDetector::Anomaly anomaly = m_transactionManager->anomalyOf(transaction);
+        if (anomaly.isFlagged()) {
+            displayText = "⚠ " + displayText;
+        }
 
         QListWidgetItem *item = new QListWidgetItem(displayText);
         item->setData(Qt::UserRole, transaction.getId());
+        if (anomaly.isFlagged()) {
+            item->setBackground(QColor(253, 235, 208)); // Pale orange
+            item->setToolTip(AnomalyDetector::describe(anomaly, transaction));
+        }
 
         // Color code based on type
         if (transaction.getType() == TransactionType::INCOME) {
@@ -335,86 +613,359 @@ void MainWindow::updateTransactionList()
 
 void MainWindow::updateStatistics()
 {
+    // A hidden tab is refreshed when it is next shown
+    if (m_tabWidget->currentWidget() != m_statsTab) {
+        m_statsStale = true;
+        return;
+    }
     refreshStatisticsDisplay();
+    m_statsStale = false;
 }
 
 void MainWindow::refreshStatisticsDisplay()
 {
     if (!m_statsList || !m_categoryList) return;
 
-    m_statsList->clear();
-    m_categoryList->clear();
+    if (m_startupSummary.isValid()) {
+        m_progressiveStats->cancel();
+        showStatistics(m_startupSummary.rollup(m_excludeTransfers), m_startupSummary.transferPairs(),
+                       m_startupSummary.transferred());
+        return;
+    }
 
-    auto transactions = m_transactionManager->getTransactions();
+    const RoaringBitmap *transfers = m_excludeTransfers ? &m_transactionManager->transferMatcher().pairedRows()
+                                                        : nullptr;
+    const LedgerSnapshot snapshot = m_transactionManager->snapshot();
+    if (snapshot.size() >= ProgressiveStatistics::MinimumRows) {
+        // Sample estimates now, refined by a background scan of the snapshot
+        const QString month = QDate::currentDate().toString("yyyy-MM");
+        const StratifiedSample &sample = m_transactionManager->statisticsSample();
+        showStatisticsEstimate(ProgressiveStatistics::estimate(sample, month, transfers));
+        m_progressiveStats->start(snapshot, sample, month, transfers);
+        return;
+    }
 
-    // Calculate monthly stats for current month
-    QDate currentDate = QDate::currentDate();
-    MonthlyStats monthlyStats = m_statsCalculator->calculateMonthlyStats(
-        currentDate.month(), currentDate.year(), transactions);
+    // One pass over the rows; every view below is a roll-up of this cube
+    m_progressiveStats->cancel();
+    const QList<Transaction> rows = m_excludeTransfers
+            ? m_transactionManager->getTransactionsExcludingTransfers()
+            : m_transactionManager->getTransactions();
+    showStatistics(m_statsCalculator->groupBy(rows, {AggregationCube::Category, AggregationCube::Day}));
+}
 
-    // Add statistics to list
-    m_statsList->addItem(QString("本月收入: ¥ %1").arg(monthlyStats.totalIncome, 0, 'f', 2));
-    m_statsList->addItem(QString("本月支出: ¥ %1").arg(monthlyStats.totalExpense, 0, 'f', 2));
-    m_statsList->addItem(QString("本月结余: ¥ %1").arg(monthlyStats.netAmount, 0, 'f', 2));
+void MainWindow::onStatisticsProgress(const ProgressiveReport &report)
+{
+    if (report.final) {
+        showStatistics(report.cube);
+    } else {
+        showStatisticsEstimate(report);
+    }
+}
 
-    // Calculate category breakdown
-    auto expenseBreakdown = m_statsCalculator->calculateExpenseByCategory(transactions);
-    double totalExpense = monthlyStats.totalExpense;
+void MainWindow::showStatistics(const AggregationCube &cube)
+{
+    const QList<QPair<Transaction, Transaction>> transfers = m_transactionManager->getTransferPairs();
+    double transferred = 0.0;
+    for (const auto &pair : transfers) {
+        transferred += pair.first.getAmount();
+    }
+    showStatistics(LedgerRollup(cube), int(transfers.size()), transferred);
+}
+
+void MainWindow::showStatistics(const LedgerRollup &rollup, int transferPairs, double transferred)
+{
+    m_statsList->clear();
+    m_categoryList->clear();
+
+    // Monthly stats for current month
+    const CubeCell month = rollup.months.value(QDate::currentDate().toString("yyyy-MM"));
+    m_statsList->addItem(QString("本月收入: ¥ %1").arg(month.income, 0, 'f', 2));
+    m_statsList->addItem(QString("本月支出: ¥ %1").arg(month.expense, 0, 'f', 2));
+    m_statsList->addItem(QString("本月结余: ¥ %1").arg(month.net(), 0, 'f', 2));
+
+    if (transferPairs > 0) {
+        m_statsList->addItem(QString("内部转账: %1 笔, ¥ %2%3")
+                                 .arg(transferPairs)
+                                 .arg(transferred, 0, 'f', 2)
+                                 .arg(m_excludeTransfers ? "（未计入收支）" : ""));
+    }
 
-    // Add category breakdown to list
-    for (auto it = expenseBreakdown.begin(); it != expenseBreakdown.end(); ++it) {
-        if (it.value() > 0) {
-            double percentage = (it.value() / totalExpense) * 100;
+    // The roll-up covers the resident months of a partitioned ledger
+    const int coldMonths = m_startupSummary.isValid() ? 0 : m_transactionManager->coldMonthCount();
+    if (coldMonths > 0) {
+        m_statsList->addItem(QString("分类统计不含 %1 个未加载的较早月份").arg(coldMonths));
+    }
+
+    // Expense by category, as a share of all expenses
+    const QMap<QString, CubeCell> &categories = rollup.categories;
+    const double totalExpense = rollup.total.expense;
+    for (auto it = categories.begin(); it != categories.end(); ++it) {
+        if (it.value().expense > 0) {
+            double percentage = (it.value().expense / totalExpense) * 100;
             m_categoryList->addItem(
                 QString("%1: ¥ %2 (%3%)")
                     .arg(it.key())
-                    .arg(it.value(), 0, 'f', 2)
+                    .arg(it.value().expense, 0, 'f', 2)
                     .arg(percentage, 0, 'f', 1)
                 );
         }
     }
+
+    // The chart keeps its own pyramid; only the daily values are computed here
+    QMap<QDate, double> dailyTrend;
+    const QMap<QString, CubeCell> &days = rollup.days;
+    for (auto it = days.begin(); it != days.end(); ++it) {
+        if (!it.key().isEmpty()) {
+            dailyTrend.insert(QDate::fromString(it.key(), "yyyy-MM-dd"), it.value().net());
+        }
+    }
+    m_trendChart->setTrend(dailyTrend);
+
+    updateBudgetList();
 }
 
-void MainWindow::updateBillsTable()
+void MainWindow::showStatisticsEstimate(const ProgressiveReport &report)
 {
-    if (!m_billsTable) return;
+    m_statsList->clear();
+    m_categoryList->clear();
+
+    auto money = [](const SampleEstimate &estimate) {
+        if (estimate.exact) {
+            return QString("¥ %1").arg(estimate.value, 0, 'f', 2);
+        }
+        return QString("≈ ¥ %1 ± %2").arg(estimate.value, 0, 'f', 2).arg(estimate.margin, 0, 'f', 2);
+    };
+
+    QListWidgetItem *status = new QListWidgetItem(
+        QString("估算值（95% 置信区间），正在精确统计: 已完成 %1%")
+            .arg(report.scanned * 100, 0, 'f', 0));
+    status->setForeground(QColor(127, 140, 141)); // Grey
+    m_statsList->addItem(status);
+
+    // Income and expense come from the same rows, so their margins add up
+    SampleEstimate net;
+    net.value = report.monthIncome.value - report.monthExpense.value;
+    net.margin = report.monthIncome.margin + report.monthExpense.margin;
+    net.exact = report.monthIncome.exact && report.monthExpense.exact;
+    m_statsList->addItem(QString("本月收入: %1").arg(money(report.monthIncome)));
+    m_statsList->addItem(QString("本月支出: %1").arg(money(report.monthExpense)));
+    m_statsList->addItem(QString("本月结余: %1").arg(money(net)));
+
+    const double totalExpense = report.totalExpense.value;
+    for (auto it = report.expenseByCategory.begin(); it != report.expenseByCategory.end(); ++it) {
+        double percentage = totalExpense > 0 ? (it.value().value / totalExpense) * 100 : 0.0;
+        m_categoryList->addItem(
+            QString("%1: %2 (%3%)")
+                .arg(it.key())
+                .arg(money(it.value()))
+                .arg(percentage, 0, 'f', 1)
+            );
+    }
+
+    updateBudgetList();
+}
+
+void MainWindow::updateBudgetList()
+{
+    if (!m_budgetList) return;
+
+    m_budgetList->clear();
+    const BudgetEngine *engine = m_transactionManager->budgetEngine();
+    const QList<BudgetRule> rules = engine->rules();
+    const QString month = QDate::currentDate().toString("yyyy-MM");
+    for (int i = 0; i < rules.size(); ++i) {
+        const BudgetRule &rule = rules.at(i);
+        QListWidgetItem *item = new QListWidgetItem(rule.describe());
+        if (rule.kind == BudgetRule::MonthlyTotal) {
+            item->setText(QString("%1    本月: ¥ %2 / ¥ %3")
+                              .arg(rule.describe())
+                              .arg(engine->monthTotal(i, month), 0, 'f', 2)
+                              .arg(rule.threshold, 0, 'f', 2));
+            if (engine->isExceeded(i, month)) {
+                item->setForeground(QColor(231, 76, 60)); // Red
+            }
+        }
+        m_budgetList->addItem(item);
+    }
+}
+
+QString MainWindow::budgetsPath() const
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/budgets.json";
+}
+
+void MainWindow::loadBudgets()
+{
+    if (QFile::exists(budgetsPath())) {
+        m_transactionManager->setBudgetRules(BudgetEngine::loadRules(budgetsPath()));
+    }
+}
 
-    // 修复：将 QDate 转换为 QDateTime
-    QDateTime startDate = QDateTime(m_startDateEdit->date(), QTime(0, 0, 0));
-    QDateTime endDate = QDateTime(m_endDateEdit->date().addDays(1), QTime(0, 0, 0)); // Include the end date
+void MainWindow::saveBudgets()
+{
+    if (!BudgetEngine::saveRules(budgetsPath(), m_transactionManager->budgetRules())) {
+        QMessageBox::warning(this, "错误", "无法保存预算设置:\n" + budgetsPath());
+    }
+}
 
-    auto filteredTransactions = m_transactionManager->filterByDate(startDate, endDate);
+void MainWindow::onAddBudgetClicked()
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle("添加预算");
+    dialog.setMinimumWidth(360);
+
+    QFormLayout form(&dialog);
 
-    // Sort by timestamp (newest first)
-    std::sort(filteredTransactions.begin(), filteredTransactions.end(),
-              [](const Transaction& a, const Transaction& b) {
-                  return a.getTimestamp() > b.getTimestamp();
-              });
+    QComboBox *kindCombo = new QComboBox();
+    kindCombo->addItem("月度类别预算", static_cast<int>(BudgetRule::MonthlyTotal));
+    kindCombo->addItem("单笔支出上限", static_cast<int>(BudgetRule::SingleAmount));
 
-    m_billsTable->setRowCount(filteredTransactions.size());
+    QComboBox *categoryCombo = new QComboBox();
+    categoryCombo->addItem("全部类别", QString());
+    for (const QString &category : transactionCategories()) {
+        categoryCombo->addItem(category, category);
+    }
 
-    for (int i = 0; i < filteredTransactions.size(); ++i) {
-        const auto& transaction = filteredTransactions[i];
+    QDoubleSpinBox *amountSpin = new QDoubleSpinBox();
+    amountSpin->setRange(0.01, 100000000.0);
+    amountSpin->setDecimals(2);
+    amountSpin->setPrefix("¥ ");
+    amountSpin->setValue(2000.0);
 
-        m_billsTable->setItem(i, 0, new QTableWidgetItem(transaction.getTypeString()));
+    form.addRow("类型:", kindCombo);
+    form.addRow("类别:", categoryCombo);
+    form.addRow("金额:", amountSpin);
 
-        QTableWidgetItem *amountItem = new QTableWidgetItem(transaction.getDisplayAmount());
-        if (transaction.getType() == TransactionType::INCOME) {
-            amountItem->setForeground(QColor(39, 174, 96)); // Green
+    QDialogButtonBox buttons(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    form.addRow(&buttons);
+
+    connect(&buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(&buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+
+    if (dialog.exec() == QDialog::Accepted) {
+        BudgetRule rule;
+        rule.kind = static_cast<BudgetRule::Kind>(kindCombo->currentData().toInt());
+        rule.category = categoryCombo->currentData().toString();
+        rule.threshold = amountSpin->value();
+
+        QList<BudgetRule> rules = m_transactionManager->budgetRules();
+        rules.append(rule);
+        m_transactionManager->setBudgetRules(rules);
+        saveBudgets();
+        updateBudgetList();
+    }
+}
+
+void MainWindow::onDeleteBudgetClicked()
+{
+    const int row = m_budgetList->currentRow();
+    if (row < 0) {
+        QMessageBox::warning(this, "警告", "请先选择要删除的预算！");
+        return;
+    }
+
+    QList<BudgetRule> rules = m_transactionManager->budgetRules();
+    rules.removeAt(row);
+    m_transactionManager->setBudgetRules(rules);
+    saveBudgets();
+    updateBudgetList();
+}
+
+void MainWindow::onBudgetAlert(const BudgetAlert &alert)
+{
+    // One edit can cross several rules; collect them and report once
+    if (m_pendingAlerts.isEmpty()) {
+        QTimer::singleShot(0, this, &MainWindow::showBudgetAlerts);
+    }
+    m_pendingAlerts.append(alert);
+}
+
+void MainWindow::showBudgetAlerts()
+{
+    if (m_pendingAlerts.isEmpty()) return;
+
+    // An import can cross a rule many times; the dialog lists the first ten
+    QStringList lines;
+    for (int i = 0; i < m_pendingAlerts.size() && i < 10; ++i) {
+        const BudgetAlert &alert = m_pendingAlerts.at(i);
+        if (alert.budget.kind == BudgetRule::SingleAmount) {
+            lines << QString("%1: %2 ¥ %3 (%4)")
+                         .arg(alert.budget.describe(),
+                              alert.transaction.getCategory())
+                         .arg(alert.amount, 0, 'f', 2)
+                         .arg(alert.transaction.getTimestamp().toString("yyyy-MM-dd hh:mm"));
         } else {
-            amountItem->setForeground(QColor(231, 76, 60)); // Red
+            lines << QString("%1: %2 已支出 ¥ %3")
+                         .arg(alert.budget.describe(), alert.month)
+                         .arg(alert.amount, 0, 'f', 2);
         }
-        m_billsTable->setItem(i, 1, amountItem);
+    }
+    if (m_pendingAlerts.size() > lines.size()) {
+        lines.append(QString("……等共 %1 条").arg(m_pendingAlerts.size()));
+    }
+    m_pendingAlerts.clear();
+
+    statusBar()->showMessage(QString("预算提醒: %1").arg(lines.first()), 10000);
+    QMessageBox::warning(this, "预算提醒", lines.join("\n"));
+}
 
-        m_billsTable->setItem(i, 2, new QTableWidgetItem(transaction.getToAccount()));
-        m_billsTable->setItem(i, 3, new QTableWidgetItem(transaction.getCategory()));
-        m_billsTable->setItem(i, 4, new QTableWidgetItem(transaction.getMethod()));
-        m_billsTable->setItem(i, 5, new QTableWidgetItem(
-                                        transaction.getTimestamp().toString("yyyy-MM-dd hh:mm")));
+void MainWindow::updateBillsTable()
+{
+    if (!m_billsTable) return;
+    m_searchTimer->stop();
+
+    // Without a query the model holds every row and moving the dates only
+    // slides its window. A query is answered for the date range alone: the
+    // indexes narrow by date before any row is read, so only the rows the
+    // table shows are materialized, however many match elsewhere.
+    QString query = m_searchEdit->text().trimmed();
+    QString tagQuery = m_tagQueryEdit->text().trimmed();
+    QString tagError;
+    QList<Transaction> rows;
+    const QDateTime start(m_startDateEdit->date(), QTime(0, 0));
+    const QDateTime end(m_endDateEdit->date(), QTime(23, 59, 59, 999));
+    if (!tagQuery.isEmpty()) {
+        // The text query is checked on the rows the tags selected
+        rows = m_transactionManager->filterByTags(tagQuery, start, end, QString(), &tagError);
+        if (!query.isEmpty()) {
+            rows.removeIf([&query](const Transaction &transaction) {
+                return !SearchIndex::matches(transaction, query);
+            });
+        }
+    } else if (query.isEmpty()) {
+        rows = m_transactionManager->filterByDate(QDateTime(QDate(1, 1, 1), QTime(0, 0)),
+                                                  QDateTime(QDate(9999, 12, 31), QTime(23, 59, 59)));
+    } else {
+        rows = m_transactionManager->search(query, start, end);
+    }
+    m_tagQueryEdit->setStyleSheet(tagError.isEmpty() ? QString() : "QLineEdit { border-color: #e74c3c; }");
+    m_tagQueryEdit->setToolTip(tagError);
+
+    const bool firstFill = m_billsModel->rowCount() == 0;
+    m_billsModel->setTransactions(rows);
+    applyBillsRange();
+
+    // Sized from a sample of rows, so only once rather than on every change
+    if (firstFill) {
+        m_billsTable->resizeColumnsToContents();
     }
+}
 
-    // Resize columns to content
-    m_billsTable->resizeColumnsToContents();
+void MainWindow::applyBillsRange()
+{
+    if (!m_billsModel) return;
+
+    // [start of the first day, start of the day after the last)
+    const qint64 start = QDateTime(m_startDateEdit->date(), QTime(0, 0)).toMSecsSinceEpoch();
+    const qint64 end = QDateTime(m_endDateEdit->date().addDays(1), QTime(0, 0)).toMSecsSinceEpoch();
+    m_billsModel->setRange(start, end);
+
+    const DateWindow &window = m_billsModel->window();
+    m_billsTotalsLabel->setText(QString("共 %1 条    收入: ¥ %2    支出: ¥ %3    结余: ¥ %4")
+                                    .arg(window.size())
+                                    .arg(window.totalIncome(), 0, 'f', 2)
+                                    .arg(window.totalExpense(), 0, 'f', 2)
+                                    .arg(window.totalIncome() - window.totalExpense(), 0, 'f', 2));
 }
 
 void MainWindow::onTransactionsChanged()
@@ -422,7 +973,33 @@ void MainWindow::onTransactionsChanged()
     updateTransactionList();
     updateQuickStats();
     updateStatistics();
-    updateBillsTable();
+
+    if (m_tabWidget->currentWidget() == m_billsTab) {
+        updateBillsTable();
+    } else {
+        m_billsStale = true;
+    }
+}
+
+void MainWindow::onTabChanged(int index)
+{
+    QWidget *tab = m_tabWidget->widget(index);
+    if (tab == m_statsTab) {
+        if (!m_statsList) {
+            buildStatisticsTab();
+        }
+        if (m_statsStale) {
+            updateStatistics();
+        }
+    } else if (tab == m_billsTab) {
+        if (!m_billsTable) {
+            buildBillsTab();
+        }
+        if (m_billsStale) {
+            updateBillsTable();
+            m_billsStale = false;
+        }
+    }
 }
 
 void MainWindow::showAddTransactionDialog()
@@ -451,9 +1028,20 @@ void MainWindow::showAddTransactionDialog()
     QLineEdit *toAccountEdit = new QLineEdit();
     toAccountEdit->setPlaceholderText("例如：超市");
 
+    // Account autocomplete from the ledger's prefix index
+    for (QLineEdit *accountEdit : {fromAccountEdit, toAccountEdit}) {
+        QStringListModel *suggestions = new QStringListModel(accountEdit);
+        QCompleter *completer = new QCompleter(suggestions, accountEdit);
+        completer->setCaseSensitivity(Qt::CaseInsensitive);
+        accountEdit->setCompleter(completer);
+        connect(accountEdit, &QLineEdit::textEdited, accountEdit, [this, suggestions](const QString& text) {
+            suggestions->setStringList(m_transactionManager->completeAccount(text));
+        });
+    }
+
     // Category
     QComboBox *categoryCombo = new QComboBox();
-    categoryCombo->addItems({"餐饮", "交通", "购物", "娱乐", "医疗", "住房", "工资", "转账", "其他"});
+    categoryCombo->addItems(transactionCategories());
 
     // Method
     QComboBox *methodCombo = new QComboBox();
@@ -470,6 +1058,10 @@ void MainWindow::showAddTransactionDialog()
     QLineEdit *noteEdit = new QLineEdit();
     noteEdit->setPlaceholderText("可选备注信息");
 
+    // Tags
+    QLineEdit *tagsEdit = new QLineEdit();
+    tagsEdit->setPlaceholderText("可选，用逗号分隔，如 出差, 可报销");
+
     form.addRow("类型:", typeCombo);
     form.addRow("金额:", amountSpin);
     form.addRow("付款方:", fromAccountEdit);
@@ -479,6 +1071,7 @@ void MainWindow::showAddTransactionDialog()
     form.addRow("日期:", dateEdit);
     form.addRow("时间:", timeEdit);
     form.addRow("备注:", noteEdit);
+    form.addRow("标签:", tagsEdit);
 
     QDialogButtonBox buttons(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
     form.addRow(&buttons);
@@ -508,10 +1101,22 @@ void MainWindow::showAddTransactionDialog()
         Transaction transaction(type, amountSpin->value(), fromAccount,
                                 toAccount, categoryCombo->currentText(),
                                 methodCombo->currentText(), transactionDateTime);
+        transaction.setNote(noteEdit->text().trimmed());
+        transaction.setTags(Transaction::parseTags(tagsEdit->text()));
 
-        m_transactionManager->addTransaction(transaction);
+        if (!m_transactionManager->addTransaction(transaction)) {
+            QMessageBox::warning(this, "添加失败", m_transactionManager->errorString());
+            return;
+        }
 
-        QMessageBox::information(this, "成功", "交易记录已添加！");
+        const AnomalyDetector::Anomaly anomaly = m_transactionManager->anomalyOf(transaction);
+        if (anomaly.isFlagged()) {
+            QMessageBox::warning(this, "已添加，请核对",
+                                 "交易记录已添加，但看起来不太寻常:\n"
+                                     + AnomalyDetector::describe(anomaly, transaction));
+        } else {
+            QMessageBox::information(this, "成功", "交易记录已添加！");
+        }
     }
 }
 
@@ -545,6 +1150,100 @@ void MainWindow::onDeleteTransactionClicked()
     }
 }
 
+void MainWindow::onDeleteBillsClicked()
+{
+    const QModelIndexList selected = m_billsTable->selectionModel()->selectedRows();
+    if (selected.isEmpty()) {
+        QMessageBox::warning(this, "警告", "请先选择要删除的交易记录！");
+        return;
+    }
+
+    QMessageBox::StandardButton reply;
+    reply = QMessageBox::question(this, "确认删除",
+                                  QString("确定要删除选中的 %1 条交易记录吗？").arg(selected.size()),
+                                  QMessageBox::Yes | QMessageBox::No);
+    if (reply != QMessageBox::Yes) {
+        return;
+    }
+
+    QStringList ids;
+    ids.reserve(selected.size());
+    for (const QModelIndex &index : selected) {
+        ids.append(m_billsModel->transactionAt(index.row()).getId());
+    }
+
+    // One undo step for the whole selection
+    int deleted = m_transactionManager->deleteTransactions(ids);
+    statusBar()->showMessage(QString("已删除 %1 条记录，可撤销").arg(deleted), 5000);
+}
+
+void MainWindow::onTagBillsClicked()
+{
+    const QModelIndexList selected = m_billsTable->selectionModel()->selectedRows();
+    if (selected.isEmpty()) {
+        QMessageBox::warning(this, "警告", "请先选择要编辑标签的交易记录！");
+        return;
+    }
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(QString("编辑 %1 条记录的标签").arg(selected.size()));
+    dialog.setMinimumWidth(360);
+    QFormLayout form(&dialog);
+
+    QLineEdit *addEdit = new QLineEdit();
+    addEdit->setPlaceholderText("用逗号分隔，如 出差, 可报销");
+    QLineEdit *removeEdit = new QLineEdit();
+    removeEdit->setPlaceholderText("用逗号分隔");
+
+    // Offer the tags already in use
+    QCompleter *completer = new QCompleter(m_transactionManager->getTags(), addEdit);
+    completer->setCaseSensitivity(Qt::CaseInsensitive);
+    addEdit->setCompleter(completer);
+
+    form.addRow("添加标签:", addEdit);
+    form.addRow("移除标签:", removeEdit);
+
+    QDialogButtonBox buttons(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    form.addRow(&buttons);
+    connect(&buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(&buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    QStringList ids;
+    ids.reserve(selected.size());
+    for (const QModelIndex &index : selected) {
+        ids.append(m_billsModel->transactionAt(index.row()).getId());
+    }
+
+    // One undo step for the whole selection
+    int changed = m_transactionManager->tagTransactions(ids, Transaction::parseTags(addEdit->text()),
+                                                        Transaction::parseTags(removeEdit->text()));
+    statusBar()->showMessage(QString("已更新 %1 条记录的标签，可撤销").arg(changed), 5000);
+}
+
+void MainWindow::onUndoClicked()
+{
+    m_transactionManager->undo();
+}
+
+void MainWindow::onRedoClicked()
+{
+    m_transactionManager->redo();
+}
+
+void MainWindow::updateHistoryButtons()
+{
+    if (m_undoButton) {
+        m_undoButton->setEnabled(m_transactionManager->canUndo());
+    }
+    if (m_redoButton) {
+        m_redoButton->setEnabled(m_transactionManager->canRedo());
+    }
+}
+
 void MainWindow::onTransactionSelected(QListWidgetItem *item)
 {
     // Show transaction details
@@ -559,21 +1258,106 @@ void MainWindow::onTransactionSelected(QListWidgetItem *item)
                           "收款方: %4\n"
                           "类别: %5\n"
                           "方式: %6\n"
-                          "时间: %7"
+                          "时间: %7\n"
+                          "备注: %8"
                           ).arg(transaction.getTypeString())
                           .arg(transaction.getDisplayAmount())
                           .arg(transaction.getFromAccount())
                           .arg(transaction.getToAccount())
                           .arg(transaction.getCategory())
                           .arg(transaction.getMethod())
-                          .arg(transaction.getTimestamp().toString("yyyy-MM-dd hh:mm"));
+                          .arg(transaction.getTimestamp().toString("yyyy-MM-dd hh:mm"))
+                          .arg(transaction.getNote());
 
     QMessageBox::information(this, "交易详情", details);
 }
 
-void MainWindow::onFilterApplied()
+void MainWindow::onImportCsvClicked()
 {
-    updateBillsTable();
+    QString filename = QFileDialog::getOpenFileName(this, "导入CSV账单", QString(),
+                                                    "CSV 文件 (*.csv);;所有文件 (*)");
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    // Parse on a worker thread; the rows are added here as one undo step
+    auto importer = std::make_shared<CsvImporter>();
+    auto rows = std::make_shared<QList<Transaction>>();
+    auto ok = std::make_shared<bool>(false);
+    QThread *thread = QThread::create([importer, rows, ok, filename]() {
+        *ok = importer->parseFile(filename, rows.get());
+    });
+
+    statusBar()->showMessage("正在导入 " + filename + " ...");
+    connect(thread, &QThread::finished, this, [this, thread, importer, rows, ok]() {
+        thread->deleteLater();
+        if (!*ok) {
+            statusBar()->clearMessage();
+            QMessageBox::warning(this, "导入失败", importer->errorString());
+            return;
+        }
+        // Rows already in the ledger (an overlapping export) are not added again
+        QList<Transaction> duplicates;
+        const int flaggedBefore = m_transactionManager->getAnomalyCount();
+        int added = m_transactionManager->addNewTransactions(*rows, &duplicates);
+        if (added < 0) {
+            statusBar()->clearMessage();
+            QMessageBox::warning(this, "导入失败", m_transactionManager->errorString());
+            return;
+        }
+        QString message = QString("已导入 %1 条记录，跳过 %2 条无效记录、%3 条重复记录")
+                              .arg(added)
+                              .arg(importer->rowsSkipped())
+                              .arg(duplicates.size());
+        const int flagged = m_transactionManager->getAnomalyCount() - flaggedBefore;
+        if (flagged > 0) {
+            message += QString("，%1 条支出看起来异常，已标出").arg(flagged);
+        }
+        statusBar()->showMessage(message, 5000);
+
+        if (!duplicates.isEmpty()) {
+            QStringList lines;
+            for (int i = 0; i < duplicates.size() && i < 10; ++i) {
+                const Transaction &transaction = duplicates.at(i);
+                lines.append(QString("%1  %2  %3")
+                                 .arg(transaction.getTimestamp().toString("yyyy-MM-dd hh:mm"))
+                                 .arg(transaction.getDisplayAmount())
+                                 .arg(transaction.getToAccount()));
+            }
+            if (duplicates.size() > lines.size()) {
+                lines.append(QString("……等共 %1 条").arg(duplicates.size()));
+            }
+            QMessageBox::information(this, "跳过重复记录",
+                                     "以下记录已存在于账本中，未重复导入:\n\n" + lines.join("\n"));
+        }
+    });
+    thread->start();
+}
+
+void MainWindow::onExportBillsClicked()
+{
+    QString filename = QFileDialog::getSaveFileName(this, "导出账单", "账单.csv",
+                                                    "CSV 文件 (*.csv);;JSON 文件 (*.json);;账本归档 (*.mtla)");
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    // The rows on screen, shared rather than copied with the writer thread
+    QList<Transaction> rows = m_billsModel->window().windowRows();
+    auto ok = std::make_shared<bool>(false);
+    QThread *thread = QThread::create([rows, ok, filename]() {
+        *ok = LedgerExporter::exportTransactions(filename, rows, LedgerExporter::formatForFile(filename));
+    });
+
+    connect(thread, &QThread::finished, this, [this, thread, ok, filename, count = rows.size()]() {
+        thread->deleteLater();
+        if (*ok) {
+            statusBar()->showMessage(QString("已导出 %1 条记录到 %2").arg(count).arg(filename), 5000);
+        } else {
+            QMessageBox::warning(this, "导出失败", "无法写入文件:\n" + filename);
+        }
+    });
+    thread->start();
 }
 
 void MainWindow::onShowStatistics()
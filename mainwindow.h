@@ -4,6 +4,10 @@
 #include "transaction.h"
 #include "transactionmanager.h"
 #include "statisticscalculator.h"
+#include "autosaver.h"
+#include "progressivestatistics.h"
+#include "ledgerqueryserver.h"
+#include "ledgersummary.h"
 
 #include <QMainWindow>
 #include <QListWidgetItem>
@@ -13,12 +17,18 @@ class QVBoxLayout;
 class QHBoxLayout;
 class QLabel;
 class QListWidget;
-class QTableWidget;
+class QTableView;
 class QDateEdit;
 class QPushButton;
 class QComboBox;
 class QGroupBox;
 class QTabWidget;
+class QLineEdit;
+class QProgressBar;
+class QShortcut;
+class QTimer;
+class TrendChartWidget;
+class BillsTableModel;
 
 namespace Ui {
 class MainWindow;
@@ -32,26 +42,49 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    // Serves the live ledger to local scripts (see LedgerQueryServer)
+    bool startQueryServer(const QString &name);
+
+protected:
+    void closeEvent(QCloseEvent *event) override;
+
 private slots:
     void onAddTransactionClicked();
     void onDeleteTransactionClicked();
+    void onDeleteBillsClicked();
+    void onTagBillsClicked();
     void onTransactionSelected(QListWidgetItem *item);
-    void onFilterApplied();
+    void onImportCsvClicked();
+    void onExportBillsClicked();
     void onShowStatistics();
     void onShowBills();
     void onShowProfile();
     void onShowHome();
+    void onUndoClicked();
+    void onRedoClicked();
+    void onAddBudgetClicked();
+    void onDeleteBudgetClicked();
+    void onBudgetAlert(const BudgetAlert &alert);
+    void showBudgetAlerts();
+    void onStatisticsProgress(const ProgressiveReport &report);
 
     void onTransactionsChanged();
     void updateTransactionList();
     void updateStatistics();
     void updateQuickStats();
     void updateBillsTable();
+    void applyBillsRange();
+    void updateHistoryButtons();
+    void onAutoSaveFinished(bool ok, const QString &errorString);
+    void onTabChanged(int index);
 
 private:
     Ui::MainWindow *ui;
     TransactionManager *m_transactionManager;
     StatisticsCalculator *m_statsCalculator;
+    ProgressiveStatistics *m_progressiveStats;
+    AutoSaver *m_autoSaver;
+    LedgerQueryServer *m_queryServer;
 
     // UI components
     QTabWidget *m_tabWidget;
@@ -61,24 +94,53 @@ private:
     QLabel *m_incomeLabel;
     QLabel *m_expenseLabel;
     QListWidget *m_transactionList;
+    QPushButton *m_undoButton;
+    QPushButton *m_redoButton;
 
-    // Statistics tab
+    // Statistics tab (built on first activation)
+    QWidget *m_statsTab;
     QListWidget *m_statsList;
     QListWidget *m_categoryList;
-
-    // Bills tab
-    QTableWidget *m_billsTable;
+    TrendChartWidget *m_trendChart;
+    QListWidget *m_budgetList;
+
+    // Bills tab (built on first activation)
+    QWidget *m_billsTab;
+    QTableView *m_billsTable;
+    BillsTableModel *m_billsModel;
+    QLabel *m_billsTotalsLabel;
     QDateEdit *m_startDateEdit;
     QDateEdit *m_endDateEdit;
+    QLineEdit *m_searchEdit;
+    QLineEdit *m_tagQueryEdit;
+    QTimer *m_searchTimer; // runs a query once typing pauses
 
     // Common
     QPushButton *m_quickAddBtn;
+    QShortcut *m_undoShortcut;
+    QShortcut *m_redoShortcut;
+    QProgressBar *m_loadProgress;
+    bool m_statsStale;
+    bool m_billsStale;
+    bool m_excludeTransfers; // leave paired internal transfers out of the totals
+    LedgerSummary m_startupSummary; // valid only while the ledger loads
+    QList<BudgetAlert> m_pendingAlerts; // shown together once the edit finishes
 
     void setupUI();
     void setupConnections();
-    void loadSampleData();
+    void buildStatisticsTab();
+    void buildBillsTab();
+    void loadLedger();
+    void startAutoSave(const QString &filename);
     void showAddTransactionDialog();
     void refreshStatisticsDisplay();
+    void showStatistics(const AggregationCube &cube);
+    void showStatistics(const LedgerRollup &rollup, int transferPairs, double transferred);
+    void showStatisticsEstimate(const ProgressiveReport &report);
+    void updateBudgetList();
+    void loadBudgets();
+    void saveBudgets();
+    QString budgetsPath() const;
 
 };
 
@@ -0,0 +1,315 @@
+#ifndef PERSISTENTROWMAP_H
+#define PERSISTENTROWMAP_H
+
+#include <QtGlobal>
+#include <QtAlgorithms>
+
+#include <memory>
+#include <vector>
+
+// Immutable map from a 32-bit row sequence number to a value.
+//
+// Implemented as a fixed-depth, 32-way hash array mapped trie keyed by the
+// sequence number itself, so iteration runs in key (insertion) order.
+// insert() and remove() copy only the seven nodes on the path to the key and
+// share everything else with the previous version, which makes every version
+// an O(1) snapshot and every mutation O(log32 n).
+//
+// set() and erase() are the in-place forms: they edit nodes that no other
+// version references (bulk loads) and fall back to path copying as soon as a
+// node is shared, so other versions are never affected and can be read from
+// any thread.
+template <typename T>
+class PersistentRowMap
+{
+public:
+    PersistentRowMap() : m_size(0) {}
+
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+
+    const T* find(quint32 key) const
+    {
+        const Node* node = m_root.get();
+        for (int shift = RootShift; node; shift -= BitsPerLevel) {
+            const quint32 bit = bitFor(key, shift);
+            if (!(node->bitmap & bit)) {
+                return nullptr;
+            }
+            const int pos = positionOf(node->bitmap, bit);
+            if (shift == 0) {
+                return &node->values[pos];
+            }
+            node = node->children[pos].get();
+        }
+        return nullptr;
+    }
+
+    bool contains(quint32 key) const { return find(key) != nullptr; }
+
+    // Returns a new version with key set to value
+    PersistentRowMap insert(quint32 key, const T& value) const
+    {
+        PersistentRowMap result = *this;
+        result.setImpl(key, value, false);
+        return result;
+    }
+
+    // Returns a new version without key (or this version if key is absent)
+    PersistentRowMap remove(quint32 key) const
+    {
+        PersistentRowMap result = *this;
+        result.eraseImpl(key, false);
+        return result;
+    }
+
+    // Returns a new version holding the keys of both, with other's value
+    // where both have a key. Subtrees only other has are shared with it, so
+    // grafting one layer of fresh keys onto many versions copies just the
+    // paths where the layer meets each of them.
+    PersistentRowMap merged(const PersistentRowMap& other) const
+    {
+        PersistentRowMap result = *this;
+        int added = 0;
+        result.m_root = mergeAt(m_root, other.m_root, RootShift, &added);
+        result.m_size += added;
+        return result;
+    }
+
+    void set(quint32 key, const T& value) { setImpl(key, value, true); }
+    void erase(quint32 key) { eraseImpl(key, true); }
+
+    // Visits (key, value) pairs in ascending key order
+    template <typename Function>
+    void forEach(Function function) const
+    {
+        if (m_root) {
+            visit(m_root.get(), RootShift, 0, function);
+        }
+    }
+
+    // Heap bytes of this version's nodes, counting nodes shared with other
+    // versions too but nothing the values themselves point to
+    qint64 bytesUsed() const { return m_root ? nodeBytes(m_root.get(), RootShift) : 0; }
+
+    // Live node allocations of this version (node plus its array)
+    qint64 nodeBlocks() const { return m_root ? nodeCount(m_root.get(), RootShift) * 2 : 0; }
+
+private:
+    static constexpr int BitsPerLevel = 5;
+    static constexpr int RootShift = 30; // levels at shifts 30, 25, ..., 0
+
+    struct Node {
+        quint32 bitmap = 0;
+        std::vector<std::shared_ptr<const Node>> children; // inner levels
+        std::vector<T> values;                             // leaf level
+    };
+    using NodePtr = std::shared_ptr<const Node>;
+
+    static quint32 bitFor(quint32 key, int shift)
+    {
+        return 1u << ((key >> shift) & 31u);
+    }
+
+    static int positionOf(quint32 bitmap, quint32 bit)
+    {
+        return int(qPopulationCount(bitmap & (bit - 1)));
+    }
+
+    void setImpl(quint32 key, const T& value, bool inPlace)
+    {
+        bool added = false;
+        m_root = insertAt(m_root, RootShift, key, value, &added, inPlace);
+        if (added) {
+            ++m_size;
+        }
+    }
+
+    void eraseImpl(quint32 key, bool inPlace)
+    {
+        if (contains(key)) {
+            m_root = removeAt(m_root, RootShift, key, inPlace);
+            --m_size;
+        }
+    }
+
+    // A node may be edited in place only if nothing but the path we came
+    // down holds a reference to it
+    static std::shared_ptr<Node> writable(const NodePtr& node, bool inPlace)
+    {
+        if (!node) {
+            return std::make_shared<Node>();
+        }
+        if (inPlace && node.use_count() == 1) {
+            return std::const_pointer_cast<Node>(node);
+        }
+        return std::make_shared<Node>(*node);
+    }
+
+    static NodePtr insertAt(const NodePtr& node, int shift, quint32 key, const T& value, bool* added,
+                            bool inPlace)
+    {
+        std::shared_ptr<Node> copy = writable(node, inPlace);
+        const quint32 bit = bitFor(key, shift);
+        const int pos = positionOf(copy->bitmap, bit);
+        const bool present = (copy->bitmap & bit) != 0;
+
+        if (shift == 0) {
+            if (present) {
+                copy->values[pos] = value;
+            } else {
+                copy->values.insert(copy->values.begin() + pos, value);
+                copy->bitmap |= bit;
+                *added = true;
+            }
+        } else {
+            // Children of a copied node are shared with the original, so their
+            // use count keeps them from being edited in place
+            NodePtr newChild = present
+                    ? insertAt(copy->children[pos], shift - BitsPerLevel, key, value, added, inPlace)
+                    : insertAt(NodePtr(), shift - BitsPerLevel, key, value, added, inPlace);
+            if (present) {
+                copy->children[pos] = newChild;
+            } else {
+                copy->children.insert(copy->children.begin() + pos, newChild);
+                copy->bitmap |= bit;
+            }
+        }
+        return copy;
+    }
+
+    // Caller guarantees key is present. Returns null when the node empties.
+    static NodePtr removeAt(const NodePtr& node, int shift, quint32 key, bool inPlace)
+    {
+        const quint32 bit = bitFor(key, shift);
+        const int pos = positionOf(node->bitmap, bit);
+
+        if (shift == 0) {
+            if (node->bitmap == bit) {
+                return NodePtr();
+            }
+            std::shared_ptr<Node> copy = writable(node, inPlace);
+            copy->values.erase(copy->values.begin() + pos);
+            copy->bitmap &= ~bit;
+            return copy;
+        }
+
+        // A shared node's children are reachable from other versions even
+        // when their own use count is one
+        const bool childInPlace = inPlace && node.use_count() == 1;
+        NodePtr newChild = removeAt(node->children[pos], shift - BitsPerLevel, key, childInPlace);
+        if (!newChild && node->bitmap == bit) {
+            return NodePtr();
+        }
+        std::shared_ptr<Node> copy = writable(node, inPlace);
+        if (newChild) {
+            copy->children[pos] = newChild;
+        } else {
+            copy->children.erase(copy->children.begin() + pos);
+            copy->bitmap &= ~bit;
+        }
+        return copy;
+    }
+
+    static NodePtr mergeAt(const NodePtr& node, const NodePtr& other, int shift, int* added)
+    {
+        if (!other) {
+            return node;
+        }
+        if (!node) {
+            *added += valueCount(other.get(), shift);
+            return other;
+        }
+
+        std::shared_ptr<Node> copy = std::make_shared<Node>(*node);
+        quint32 bitmap = other->bitmap;
+        int otherPos = 0;
+        while (bitmap) {
+            const quint32 bit = bitmap & (0u - bitmap);
+            bitmap &= bitmap - 1;
+            const int pos = positionOf(copy->bitmap, bit);
+            const bool present = (copy->bitmap & bit) != 0;
+
+            if (shift == 0) {
+                if (present) {
+                    copy->values[pos] = other->values[otherPos];
+                } else {
+                    copy->values.insert(copy->values.begin() + pos, other->values[otherPos]);
+                    copy->bitmap |= bit;
+                    ++*added;
+                }
+            } else {
+                NodePtr child = mergeAt(present ? copy->children[pos] : NodePtr(), other->children[otherPos],
+                                        shift - BitsPerLevel, added);
+                if (present) {
+                    copy->children[pos] = child;
+                } else {
+                    copy->children.insert(copy->children.begin() + pos, child);
+                    copy->bitmap |= bit;
+                }
+            }
+            ++otherPos;
+        }
+        return copy;
+    }
+
+    static int valueCount(const Node* node, int shift)
+    {
+        if (shift == 0) {
+            return int(node->values.size());
+        }
+        int count = 0;
+        for (const NodePtr& child : node->children) {
+            count += valueCount(child.get(), shift - BitsPerLevel);
+        }
+        return count;
+    }
+
+    template <typename Function>
+    static void visit(const Node* node, int shift, quint32 prefix, Function& function)
+    {
+        quint32 bitmap = node->bitmap;
+        int pos = 0;
+        while (bitmap) {
+            const int index = qCountTrailingZeroBits(bitmap);
+            bitmap &= bitmap - 1;
+            const quint32 key = prefix | (quint32(index) << shift);
+            if (shift == 0) {
+                function(key, node->values[pos]);
+            } else {
+                visit(node->children[pos].get(), shift - BitsPerLevel, key, function);
+            }
+            ++pos;
+        }
+    }
+
+    static qint64 nodeBytes(const Node* node, int shift)
+    {
+        // make_shared puts the control block (two counts, vtable) next to the node
+        qint64 bytes = qint64(sizeof(Node)) + 2 * qint64(sizeof(void*)) + 8
+                + qint64(node->children.capacity() * sizeof(NodePtr))
+                + qint64(node->values.capacity() * sizeof(T));
+        if (shift > 0) {
+            for (const NodePtr& child : node->children) {
+                bytes += nodeBytes(child.get(), shift - BitsPerLevel);
+            }
+        }
+        return bytes;
+    }
+
+    static qint64 nodeCount(const Node* node, int shift)
+    {
+        qint64 count = 1;
+        if (shift > 0) {
+            for (const NodePtr& child : node->children) {
+                count += nodeCount(child.get(), shift - BitsPerLevel);
+            }
+        }
+        return count;
+    }
+
+    NodePtr m_root;
+    int m_size;
+};
+
+#endif // PERSISTENTROWMAP_H
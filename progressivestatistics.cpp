@@ -0,0 +1,185 @@
+#include "progressivestatistics.h"
+#include "ledgerpartitions.h"
+#include <QSet>
+
+namespace {
+
+// Exact sums over the rows scanned so far, per month
+struct ScanTotals {
+    int rows = 0;
+    QHash<QString, int> monthRows;
+    QHash<QString, double> income;
+    QHash<QString, double> expense;
+    QHash<QString, QHash<QString, double>> categoryExpense; // category -> month -> sum
+};
+
+ProgressiveReport buildReport(const StratifiedSample& sample, const QString& month,
+                              const RoaringBitmap* pairedTransfers, const ScanTotals& scanned)
+{
+    auto counts = [pairedTransfers](const SampledRow& row) {
+        return !pairedTransfers || !pairedTransfers->contains(row.sequence);
+    };
+    auto income = [&counts](const SampledRow& row) {
+        return counts(row) && row.transaction.getType() == TransactionType::INCOME
+                ? row.transaction.getAmount() : 0.0;
+    };
+    auto expense = [&counts](const SampledRow& row) {
+        return counts(row) && row.transaction.getType() == TransactionType::EXPENSE
+                ? row.transaction.getAmount() : 0.0;
+    };
+
+    ProgressiveReport report;
+    report.scanned = sample.population() > 0 ? double(scanned.rows) / sample.population() : 1.0;
+    report.monthIncome = sample.estimateRemainder(income, {month}, scanned.monthRows, scanned.income);
+    report.monthExpense = sample.estimateRemainder(expense, {month}, scanned.monthRows, scanned.expense);
+    report.totalExpense = sample.estimateRemainder(expense, QStringList(), scanned.monthRows, scanned.expense);
+
+    // Categories seen by the sample or the scan; a rare one may only show up
+    // once the scan reaches it
+    QSet<QString> categories;
+    for (const auto& stratum : sample.months()) {
+        const QList<SampledRow> rows = sample.rows(stratum);
+        for (const auto& row : rows) {
+            if (row.transaction.getType() == TransactionType::EXPENSE) {
+                categories.insert(row.transaction.getCategory());
+            }
+        }
+    }
+    for (auto it = scanned.categoryExpense.constBegin(); it != scanned.categoryExpense.constEnd(); ++it) {
+        categories.insert(it.key());
+    }
+
+    const QHash<QString, double> none;
+    for (const auto& category : categories) {
+        auto inCategory = [&expense, &category](const SampledRow& row) {
+            return row.transaction.getCategory() == category ? expense(row) : 0.0;
+        };
+        const SampleEstimate estimate = sample.estimateRemainder(
+            inCategory, QStringList(), scanned.monthRows, scanned.categoryExpense.value(category, none));
+        if (estimate.value > 0.0 || !estimate.exact) {
+            report.expenseByCategory.insert(category, estimate);
+        }
+    }
+    return report;
+}
+
+} // namespace
+
+void ProgressiveStatisticsWorker::scan(quint64 generation, const LedgerSnapshot& rows,
+                                       const StratifiedSample& sample, const QString& month,
+                                       const std::shared_ptr<const RoaringBitmap>& pairedTransfers,
+                                       const std::shared_ptr<std::atomic<bool>>& cancelled)
+{
+    ScanTotals scanned;
+    QList<Transaction> counted;
+    counted.reserve(rows.size());
+
+    rows.forEachWithSequence([&](quint32 sequence, const Transaction& transaction) {
+        if (cancelled->load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        const QString key = LedgerPartitions::monthKey(transaction.getTimestampMSecs());
+        ++scanned.rows;
+        ++scanned.monthRows[key];
+        if (!pairedTransfers || !pairedTransfers->contains(sequence)) {
+            if (transaction.getType() == TransactionType::INCOME) {
+                scanned.income[key] += transaction.getAmount();
+            } else {
+                scanned.expense[key] += transaction.getAmount();
+                scanned.categoryExpense[transaction.getCategory()][key] += transaction.getAmount();
+            }
+            counted.append(transaction);
+        }
+
+        if (scanned.rows % ProgressiveStatistics::ChunkRows == 0 && scanned.rows < rows.size()) {
+            emit progress(generation, buildReport(sample, month, pairedTransfers.get(), scanned));
+        }
+    });
+
+    if (cancelled->load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    // Every month is fully scanned now, so the sample no longer contributes
+    ProgressiveReport report = buildReport(sample, month, pairedTransfers.get(), scanned);
+    report.scanned = 1.0;
+    report.final = true;
+    report.cube = AggregationCube(counted, {AggregationCube::Category, AggregationCube::Day});
+    emit progress(generation, report);
+}
+
+ProgressiveStatistics::ProgressiveStatistics(QObject* parent)
+    : QObject(parent)
+    , m_worker(new ProgressiveStatisticsWorker())
+    , m_generation(0)
+    , m_running(false)
+{
+    qRegisterMetaType<ProgressiveReport>();
+
+    m_thread.setObjectName("MoneyTracker statistics");
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    connect(m_worker, &ProgressiveStatisticsWorker::progress, this, &ProgressiveStatistics::onWorkerProgress);
+    m_thread.start(QThread::LowPriority);
+}
+
+ProgressiveStatistics::~ProgressiveStatistics()
+{
+    cancel();
+    m_thread.quit();
+    m_thread.wait();
+}
+
+ProgressiveReport ProgressiveStatistics::estimate(const StratifiedSample& sample, const QString& month,
+                                                  const RoaringBitmap* pairedTransfers)
+{
+    ProgressiveReport report = buildReport(sample, month, pairedTransfers, ScanTotals());
+    report.scanned = 0.0;
+    return report;
+}
+
+void ProgressiveStatistics::start(const LedgerSnapshot& rows, const StratifiedSample& sample,
+                                  const QString& month, const RoaringBitmap* pairedTransfers)
+{
+    cancel();
+    m_cancelled = std::make_shared<std::atomic<bool>>(false);
+    m_running = true;
+
+    const quint64 generation = ++m_generation;
+    // Shares the bitmap's containers; later edits do not reach this copy
+    std::shared_ptr<const RoaringBitmap> pairs;
+    if (pairedTransfers) {
+        pairs = std::make_shared<const RoaringBitmap>(*pairedTransfers);
+    }
+    std::shared_ptr<std::atomic<bool>> cancelled = m_cancelled;
+    ProgressiveStatisticsWorker* worker = m_worker;
+    QMetaObject::invokeMethod(m_worker, [worker, generation, rows, sample, month, pairs, cancelled]() {
+        worker->scan(generation, rows, sample, month, pairs, cancelled);
+    }, Qt::QueuedConnection);
+}
+
+void ProgressiveStatistics::cancel()
+{
+    if (m_cancelled) {
+        m_cancelled->store(true);
+    }
+    m_running = false;
+}
+
+bool ProgressiveStatistics::isRunning() const
+{
+    return m_running;
+}
+
+void ProgressiveStatistics::onWorkerProgress(quint64 generation, const ProgressiveReport& report)
+{
+    // Reports of a cancelled scan may still be queued
+    if (generation != m_generation || !m_running) {
+        return;
+    }
+    if (report.final) {
+        m_running = false;
+    }
+    emit progress(report);
+}
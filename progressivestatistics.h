@@ -0,0 +1,91 @@
+#ifndef PROGRESSIVESTATISTICS_H
+#define PROGRESSIVESTATISTICS_H
+
+#include "aggregationcube.h"
+#include "ledgersnapshot.h"
+#include "stratifiedsample.h"
+#include "roaringbitmap.h"
+#include <QMap>
+#include <QObject>
+#include <QThread>
+
+#include <atomic>
+#include <memory>
+
+struct ProgressiveReport {
+    double scanned = 0.0;  // fraction of the rows summed exactly
+    bool final = false;    // every figure below is exact
+
+    SampleEstimate monthIncome;
+    SampleEstimate monthExpense;
+    SampleEstimate totalExpense;
+    QMap<QString, SampleEstimate> expenseByCategory;
+
+    AggregationCube cube;  // {Category, Day} over every row; final report only
+};
+
+// Scans one snapshot on the statistics thread. Paired transfers are left
+// out when pairedTransfers is set.
+class ProgressiveStatisticsWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    using QObject::QObject;
+
+    void scan(quint64 generation, const LedgerSnapshot& rows, const StratifiedSample& sample,
+              const QString& month, const std::shared_ptr<const RoaringBitmap>& pairedTransfers,
+              const std::shared_ptr<std::atomic<bool>>& cancelled);
+
+signals:
+    void progress(quint64 generation, const ProgressiveReport& report);
+};
+
+// Statistics for ledgers too large to scan while the user waits.
+//
+// estimate() answers from TransactionManager's StratifiedSample in a few
+// milliseconds, with a 95% confidence interval on every figure. start()
+// then scans a snapshot on a background thread and reports after every
+// chunk: the months' scanned rows are summed exactly and only the rest is
+// estimated, so the intervals narrow until the final report, which is exact
+// and carries the same cube the direct path builds. The scan visits rows in
+// insertion order, which is not random, so intermediate estimates of the
+// unscanned rest lean on the sample being representative of it.
+class ProgressiveStatistics : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Below this many rows the exact figures are quick enough to compute directly
+    static constexpr int MinimumRows = 200000;
+    static constexpr int ChunkRows = 65536;
+
+    explicit ProgressiveStatistics(QObject* parent = nullptr);
+    ~ProgressiveStatistics() override;
+
+    // Figures for month ("yyyy-MM") from the sample alone. pairedTransfers
+    // (TransferMatcher::pairedRows()) leaves those rows out.
+    static ProgressiveReport estimate(const StratifiedSample& sample, const QString& month,
+                                      const RoaringBitmap* pairedTransfers = nullptr);
+
+    // Cancels any scan in progress; pairedTransfers is copied
+    void start(const LedgerSnapshot& rows, const StratifiedSample& sample, const QString& month,
+               const RoaringBitmap* pairedTransfers = nullptr);
+    void cancel();
+    bool isRunning() const;
+
+signals:
+    void progress(const ProgressiveReport& report); // the last one has final set
+
+private slots:
+    void onWorkerProgress(quint64 generation, const ProgressiveReport& report);
+
+private:
+    QThread m_thread;
+    ProgressiveStatisticsWorker* m_worker;
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+    quint64 m_generation;
+    bool m_running;
+};
+
+#endif // PROGRESSIVESTATISTICS_H
@@ -0,0 +1,416 @@
+#include "roaringbitmap.h"
+
+#include <algorithm>
+#include <iterator>
+
+RoaringBitmap::RoaringBitmap()
+    : m_cardinality(0)
+{
+}
+
+void RoaringBitmap::add(quint32 value)
+{
+    const quint16 key = quint16(value >> 16);
+    const quint16 low = quint16(value & 0xffff);
+
+    int index = lowerBound(key);
+    if (index == m_containers.size() || m_containers.at(index).key != key) {
+        Container container;
+        container.key = key;
+        m_containers.insert(index, container);
+    }
+    Container& container = m_containers[index];
+
+    if (container.isBitmap()) {
+        quint64& word = container.words[low >> 6];
+        const quint64 bit = quint64(1) << (low & 63);
+        if (word & bit) {
+            return;
+        }
+        word |= bit;
+    } else {
+        // Rows arrive in sequence order, so most inserts append
+        QList<quint16>& values = container.values;
+        if (values.isEmpty() || values.constLast() < low) {
+            values.append(low);
+        } else {
+            auto it = std::lower_bound(values.begin(), values.end(), low);
+            if (*it == low) {
+                return;
+            }
+            values.insert(it, low);
+        }
+    }
+    ++container.cardinality;
+    ++m_cardinality;
+    if (!container.isBitmap() && container.cardinality > ArrayLimit) {
+        toBitmap(container);
+    }
+}
+
+void RoaringBitmap::remove(quint32 value)
+{
+    const int index = indexOf(quint16(value >> 16));
+    if (index < 0) {
+        return;
+    }
+    Container& container = m_containers[index];
+    const quint16 low = quint16(value & 0xffff);
+
+    if (container.isBitmap()) {
+        quint64& word = container.words[low >> 6];
+        const quint64 bit = quint64(1) << (low & 63);
+        if (!(word & bit)) {
+            return;
+        }
+        word &= ~bit;
+    } else {
+        QList<quint16>& values = container.values;
+        auto it = std::lower_bound(values.begin(), values.end(), low);
+        if (it == values.end() || *it != low) {
+            return;
+        }
+        values.erase(it);
+    }
+    --container.cardinality;
+    --m_cardinality;
+    if (container.cardinality == 0) {
+        m_containers.removeAt(index);
+    } else if (container.isBitmap() && container.cardinality <= ArrayLimit) {
+        toArray(container);
+    }
+}
+
+bool RoaringBitmap::contains(quint32 value) const
+{
+    const int index = indexOf(quint16(value >> 16));
+    if (index < 0) {
+        return false;
+    }
+    const Container& container = m_containers.at(index);
+    const quint16 low = quint16(value & 0xffff);
+    if (container.isBitmap()) {
+        return container.words.at(low >> 6) & (quint64(1) << (low & 63));
+    }
+    return std::binary_search(container.values.cbegin(), container.values.cend(), low);
+}
+
+void RoaringBitmap::clear()
+{
+    m_containers.clear();
+    m_cardinality = 0;
+}
+
+bool RoaringBitmap::isEmpty() const
+{
+    return m_cardinality == 0;
+}
+
+qint64 RoaringBitmap::cardinality() const
+{
+    return m_cardinality;
+}
+
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap& other) const
+{
+    RoaringBitmap result;
+    int i = 0;
+    int j = 0;
+    while (i < m_containers.size() && j < other.m_containers.size()) {
+        const Container& a = m_containers.at(i);
+        const Container& b = other.m_containers.at(j);
+        if (a.key < b.key) {
+            ++i;
+        } else if (b.key < a.key) {
+            ++j;
+        } else {
+            Container both = intersect(a, b);
+            if (both.cardinality > 0) {
+                result.m_cardinality += both.cardinality;
+                result.m_containers.append(std::move(both));
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap& other) const
+{
+    if (isEmpty()) {
+        return other;
+    }
+    if (other.isEmpty()) {
+        return *this;
+    }
+
+    RoaringBitmap result;
+    result.m_containers.reserve(qMax(m_containers.size(), other.m_containers.size()));
+    int i = 0;
+    int j = 0;
+    while (i < m_containers.size() || j < other.m_containers.size()) {
+        if (j == other.m_containers.size()
+            || (i < m_containers.size() && m_containers.at(i).key < other.m_containers.at(j).key)) {
+            result.m_containers.append(m_containers.at(i++));
+        } else if (i == m_containers.size() || other.m_containers.at(j).key < m_containers.at(i).key) {
+            result.m_containers.append(other.m_containers.at(j++));
+        } else {
+            result.m_containers.append(unite(m_containers.at(i++), other.m_containers.at(j++)));
+        }
+        result.m_cardinality += result.m_containers.constLast().cardinality;
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator-(const RoaringBitmap& other) const
+{
+    RoaringBitmap result;
+    int j = 0;
+    for (const auto& a : m_containers) {
+        while (j < other.m_containers.size() && other.m_containers.at(j).key < a.key) {
+            ++j;
+        }
+        if (j == other.m_containers.size() || other.m_containers.at(j).key != a.key) {
+            result.m_containers.append(a);
+            result.m_cardinality += a.cardinality;
+            continue;
+        }
+        Container rest = subtract(a, other.m_containers.at(j));
+        if (rest.cardinality > 0) {
+            result.m_cardinality += rest.cardinality;
+            result.m_containers.append(std::move(rest));
+        }
+    }
+    return result;
+}
+
+RoaringBitmap& RoaringBitmap::operator&=(const RoaringBitmap& other)
+{
+    *this = *this & other;
+    return *this;
+}
+
+RoaringBitmap& RoaringBitmap::operator|=(const RoaringBitmap& other)
+{
+    *this = *this | other;
+    return *this;
+}
+
+RoaringBitmap& RoaringBitmap::operator-=(const RoaringBitmap& other)
+{
+    *this = *this - other;
+    return *this;
+}
+
+bool RoaringBitmap::operator==(const RoaringBitmap& other) const
+{
+    if (m_cardinality != other.m_cardinality || m_containers.size() != other.m_containers.size()) {
+        return false;
+    }
+    // Both sides keep the same representation for the same cardinality
+    for (int i = 0; i < m_containers.size(); ++i) {
+        const Container& a = m_containers.at(i);
+        const Container& b = other.m_containers.at(i);
+        if (a.key != b.key || a.cardinality != b.cardinality || a.values != b.values || a.words != b.words) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QList<quint32> RoaringBitmap::toList() const
+{
+    QList<quint32> values;
+    values.reserve(m_cardinality);
+    forEach([&values](quint32 value) { values.append(value); });
+    return values;
+}
+
+qint64 RoaringBitmap::bytesUsed() const
+{
+    qint64 bytes = m_containers.capacity() * qint64(sizeof(Container));
+    for (const auto& container : m_containers) {
+        bytes += container.values.capacity() * qint64(sizeof(quint16))
+                 + container.words.capacity() * qint64(sizeof(quint64));
+    }
+    return bytes;
+}
+
+void RoaringBitmap::toBitmap(Container& container)
+{
+    container.words = QList<quint64>(BitmapWords, 0);
+    for (quint16 low : std::as_const(container.values)) {
+        container.words[low >> 6] |= quint64(1) << (low & 63);
+    }
+    container.values = QList<quint16>();
+}
+
+void RoaringBitmap::toArray(Container& container)
+{
+    QList<quint16> values;
+    values.reserve(container.cardinality);
+    for (int i = 0; i < BitmapWords; ++i) {
+        quint64 word = container.words.at(i);
+        while (word) {
+            values.append(quint16(i * 64 + qCountTrailingZeroBits(word)));
+            word &= word - 1;
+        }
+    }
+    container.values = values;
+    container.words = QList<quint64>();
+}
+
+// Picks the representation that fits the cardinality
+void RoaringBitmap::normalize(Container& container)
+{
+    if (container.isBitmap() && container.cardinality <= ArrayLimit) {
+        toArray(container);
+    } else if (!container.isBitmap() && container.cardinality > ArrayLimit) {
+        toBitmap(container);
+    }
+}
+
+RoaringBitmap::Container RoaringBitmap::intersect(const Container& a, const Container& b)
+{
+    Container result;
+    result.key = a.key;
+
+    if (a.isBitmap() && b.isBitmap()) {
+        result.words = QList<quint64>(BitmapWords, 0);
+        for (int i = 0; i < BitmapWords; ++i) {
+            const quint64 word = a.words.at(i) & b.words.at(i);
+            result.words[i] = word;
+            result.cardinality += qPopulationCount(word);
+        }
+        normalize(result);
+        return result;
+    }
+
+    if (a.isBitmap() || b.isBitmap()) {
+        const Container& array = a.isBitmap() ? b : a;
+        const Container& bitmap = a.isBitmap() ? a : b;
+        for (quint16 low : array.values) {
+            if (bitmap.words.at(low >> 6) & (quint64(1) << (low & 63))) {
+                result.values.append(low);
+            }
+        }
+        result.cardinality = int(result.values.size());
+        return result;
+    }
+
+    // Two arrays: a merge, or a binary search per value when one side is
+    // much smaller
+    const QList<quint16>& small = a.values.size() <= b.values.size() ? a.values : b.values;
+    const QList<quint16>& large = a.values.size() <= b.values.size() ? b.values : a.values;
+    if (small.size() * 32 < large.size()) {
+        auto from = large.cbegin();
+        for (quint16 low : small) {
+            from = std::lower_bound(from, large.cend(), low);
+            if (from == large.cend()) {
+                break;
+            }
+            if (*from == low) {
+                result.values.append(low);
+            }
+        }
+    } else {
+        std::set_intersection(small.cbegin(), small.cend(), large.cbegin(), large.cend(),
+                              std::back_inserter(result.values));
+    }
+    result.cardinality = int(result.values.size());
+    return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::unite(const Container& a, const Container& b)
+{
+    Container result;
+    result.key = a.key;
+
+    if (!a.isBitmap() && !b.isBitmap()) {
+        result.values.reserve(a.values.size() + b.values.size());
+        std::set_union(a.values.cbegin(), a.values.cend(), b.values.cbegin(), b.values.cend(),
+                       std::back_inserter(result.values));
+        result.cardinality = int(result.values.size());
+        normalize(result);
+        return result;
+    }
+
+    if (a.isBitmap() && b.isBitmap()) {
+        result.words = QList<quint64>(BitmapWords, 0);
+        for (int i = 0; i < BitmapWords; ++i) {
+            const quint64 word = a.words.at(i) | b.words.at(i);
+            result.words[i] = word;
+            result.cardinality += qPopulationCount(word);
+        }
+        return result;
+    }
+
+    const Container& array = a.isBitmap() ? b : a;
+    const Container& bitmap = a.isBitmap() ? a : b;
+    result.words = bitmap.words;
+    result.cardinality = bitmap.cardinality;
+    for (quint16 low : array.values) {
+        quint64& word = result.words[low >> 6];
+        const quint64 bit = quint64(1) << (low & 63);
+        if (!(word & bit)) {
+            word |= bit;
+            ++result.cardinality;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::subtract(const Container& a, const Container& b)
+{
+    Container result;
+    result.key = a.key;
+
+    if (!a.isBitmap()) {
+        for (quint16 low : a.values) {
+            const bool inB = b.isBitmap() ? bool(b.words.at(low >> 6) & (quint64(1) << (low & 63)))
+                                          : std::binary_search(b.values.cbegin(), b.values.cend(), low);
+            if (!inB) {
+                result.values.append(low);
+            }
+        }
+        result.cardinality = int(result.values.size());
+        return result;
+    }
+
+    result.words = a.words;
+    if (b.isBitmap()) {
+        for (int i = 0; i < BitmapWords; ++i) {
+            const quint64 word = a.words.at(i) & ~b.words.at(i);
+            result.words[i] = word;
+            result.cardinality += qPopulationCount(word);
+        }
+    } else {
+        result.cardinality = a.cardinality;
+        for (quint16 low : b.values) {
+            quint64& word = result.words[low >> 6];
+            const quint64 bit = quint64(1) << (low & 63);
+            if (word & bit) {
+                word &= ~bit;
+                --result.cardinality;
+            }
+        }
+    }
+    normalize(result);
+    return result;
+}
+
+int RoaringBitmap::indexOf(quint16 key) const
+{
+    const int index = lowerBound(key);
+    return index < m_containers.size() && m_containers.at(index).key == key ? index : -1;
+}
+
+int RoaringBitmap::lowerBound(quint16 key) const
+{
+    auto it = std::lower_bound(m_containers.cbegin(), m_containers.cend(), key,
+                               [](const Container& container, quint16 value) {
+                                   return container.key < value;
+                               });
+    return int(it - m_containers.cbegin());
+}
@@ -0,0 +1,95 @@
+#ifndef ROARINGBITMAP_H
+#define ROARINGBITMAP_H
+
+#include <QList>
+#include <QtAlgorithms>
+
+// Compressed set of 32-bit row sequence numbers.
+//
+// Values are split by their high 16 bits into containers of up to 65536
+// values each, kept sorted by key. A sparse container is a sorted array of
+// the low 16 bits (2 bytes per value); once it holds more than ArrayLimit
+// values it becomes a 1024-word bitmap (8 KiB), and turns back into an array
+// when it drops to ArrayLimit again. Set operations walk the two container
+// lists in step and combine matching containers word by word or by merging,
+// so intersecting a million rows touches at most 16 containers.
+//
+// Copies share their containers until either side changes.
+class RoaringBitmap
+{
+public:
+    static constexpr int ArrayLimit = 4096;
+
+    RoaringBitmap();
+
+    void add(quint32 value);
+    void remove(quint32 value);
+    bool contains(quint32 value) const;
+    void clear();
+
+    bool isEmpty() const;
+    qint64 cardinality() const;
+
+    RoaringBitmap operator&(const RoaringBitmap& other) const;
+    RoaringBitmap operator|(const RoaringBitmap& other) const;
+    RoaringBitmap operator-(const RoaringBitmap& other) const; // values not in other
+    RoaringBitmap& operator&=(const RoaringBitmap& other);
+    RoaringBitmap& operator|=(const RoaringBitmap& other);
+    RoaringBitmap& operator-=(const RoaringBitmap& other);
+    bool operator==(const RoaringBitmap& other) const;
+
+    // Visits the values in ascending order
+    template <typename Function>
+    void forEach(Function function) const;
+    QList<quint32> toList() const;
+
+    qint64 bytesUsed() const; // estimated heap bytes
+
+private:
+    static constexpr int BitmapWords = 1024;
+
+    struct Container {
+        quint16 key = 0;
+        int cardinality = 0;
+        QList<quint16> values; // sorted low bits while an array
+        QList<quint64> words;  // BitmapWords words while a bitmap
+
+        bool isBitmap() const { return !words.isEmpty(); }
+    };
+
+    static void toBitmap(Container& container);
+    static void toArray(Container& container);
+    static void normalize(Container& container);
+    static Container intersect(const Container& a, const Container& b);
+    static Container unite(const Container& a, const Container& b);
+    static Container subtract(const Container& a, const Container& b);
+
+    int indexOf(quint16 key) const; // -1 when absent
+    int lowerBound(quint16 key) const;
+
+    QList<Container> m_containers;
+    qint64 m_cardinality;
+};
+
+template <typename Function>
+void RoaringBitmap::forEach(Function function) const
+{
+    for (const auto& container : m_containers) {
+        const quint32 high = quint32(container.key) << 16;
+        if (container.isBitmap()) {
+            for (int i = 0; i < BitmapWords; ++i) {
+                quint64 word = container.words.at(i);
+                while (word) {
+                    function(high | quint32(i * 64 + qCountTrailingZeroBits(word)));
+                    word &= word - 1;
+                }
+            }
+        } else {
+            for (quint16 low : container.values) {
+                function(high | low);
+            }
+        }
+    }
+}
+
+#endif // ROARINGBITMAP_H
@@ -0,0 +1,243 @@
+#include "searchindex.h"
+#include <QSet>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// Separates fields so that no bigram spans two of them
+const QChar kFieldSeparator = QChar(u'\n');
+
+quint32 unigramKey(QChar c)
+{
+    return quint32(c.unicode()) << 16;
+}
+
+quint32 bigramKey(QChar first, QChar second)
+{
+    return (quint32(first.unicode()) << 16) | second.unicode();
+}
+
+} // namespace
+
+SearchIndex::SearchIndex()
+    : m_liveRows(0)
+{
+}
+
+void SearchIndex::addTransaction(quint32 sequence, const Transaction& transaction)
+{
+    ++m_liveRows;
+    addAccount(transaction.getFromAccount());
+    addAccount(transaction.getToAccount());
+
+    // A row restored by undo still has its postings unless a compaction
+    // purged them; the insert below skips the ones that survived
+    if (m_deleted.remove(sequence) && !m_purging.remove(sequence)) {
+        return;
+    }
+
+    const QList<quint32> grams = gramsOf(normalize(searchableText(transaction)), false);
+    for (quint32 gram : grams) {
+        std::vector<quint32>& postings = m_grams[gram];
+        // New rows arrive in sequence order; undo re-inserts older ones
+        if (postings.empty() || postings.back() < sequence) {
+            postings.push_back(sequence);
+        } else {
+            auto it = std::lower_bound(postings.begin(), postings.end(), sequence);
+            if (it == postings.end() || *it != sequence) {
+                postings.insert(it, sequence);
+            }
+        }
+    }
+}
+
+void SearchIndex::removeTransaction(quint32 sequence, const Transaction& transaction)
+{
+    --m_liveRows;
+    m_deleted.insert(sequence);
+    removeAccount(transaction.getFromAccount());
+    removeAccount(transaction.getToAccount());
+}
+
+void SearchIndex::clear()
+{
+    m_grams.clear();
+    m_accounts.clear();
+    m_liveRows = 0;
+    m_deleted.clear();
+    m_purging.clear();
+    m_compactQueue.clear();
+}
+
+int SearchIndex::tombstoneCount() const
+{
+    return int(m_deleted.size());
+}
+
+bool SearchIndex::needsCompaction() const
+{
+    const qint64 tombstones = m_deleted.size() - m_purging.size();
+    return tombstones >= MinimumTombstones && tombstones >= CompactionRatio * (m_liveRows + tombstones);
+}
+
+bool SearchIndex::compact(int maxGrams)
+{
+    if (m_compactQueue.isEmpty()) {
+        if (m_deleted.isEmpty()) {
+            return false;
+        }
+        // Grams created from here on never hold a purged row
+        m_purging = m_deleted;
+        m_compactQueue = m_grams.keys();
+    }
+
+    for (int done = 0; done < maxGrams && !m_compactQueue.isEmpty(); ++done) {
+        auto entry = m_grams.find(m_compactQueue.takeLast());
+        if (entry == m_grams.end()) {
+            continue;
+        }
+        std::vector<quint32>& postings = entry.value();
+        postings.erase(std::remove_if(postings.begin(), postings.end(), [this](quint32 sequence) {
+            return m_purging.contains(sequence);
+        }), postings.end());
+        if (postings.empty()) {
+            m_grams.erase(entry);
+        } else if (postings.capacity() > 2 * postings.size()) {
+            postings.shrink_to_fit();
+        }
+    }
+
+    if (!m_compactQueue.isEmpty()) {
+        return true;
+    }
+    for (quint32 sequence : std::as_const(m_purging)) {
+        m_deleted.remove(sequence);
+    }
+    m_purging.clear();
+    return false;
+}
+
+QList<quint32> SearchIndex::candidates(const QString& query) const
+{
+    QList<quint32> result;
+    const QList<quint32> grams = gramsOf(normalize(query), true);
+    if (grams.isEmpty()) {
+        return result;
+    }
+
+    QList<const std::vector<quint32>*> lists;
+    for (quint32 gram : grams) {
+        auto it = m_grams.constFind(gram);
+        if (it == m_grams.constEnd()) {
+            return result;
+        }
+        lists.append(&it.value());
+    }
+    std::sort(lists.begin(), lists.end(), [](const std::vector<quint32>* a, const std::vector<quint32>* b) {
+        return a->size() < b->size();
+    });
+
+    // Intersect starting from the rarest gram; each probe is a binary search
+    // into the longer lists
+    for (quint32 sequence : *lists.first()) {
+        if (m_deleted.contains(sequence)) {
+            continue;
+        }
+        bool inAll = true;
+        for (int i = 1; i < lists.size() && inAll; ++i) {
+            inAll = std::binary_search(lists[i]->begin(), lists[i]->end(), sequence);
+        }
+        if (inAll) {
+            result.append(sequence);
+        }
+    }
+    return result;
+}
+
+bool SearchIndex::matches(const Transaction& transaction, const QString& query)
+{
+    return normalize(searchableText(transaction)).contains(normalize(query));
+}
+
+qint64 SearchIndex::bytesUsed() const
+{
+    qint64 bytes = m_grams.capacity() * qint64(sizeof(quint32) + sizeof(std::vector<quint32>) + 1);
+    for (auto it = m_grams.cbegin(); it != m_grams.cend(); ++it) {
+        bytes += qint64(it.value().capacity() * sizeof(quint32));
+    }
+    bytes += (m_deleted.capacity() + m_purging.capacity()) * qint64(sizeof(quint32) + 1);
+
+    // QMap nodes: colour and three links ahead of the key and value
+    const qint64 accountNode = 4 * qint64(sizeof(void*)) + qint64(sizeof(QString) + sizeof(AccountEntry));
+    bytes += qint64(m_accounts.size()) * accountNode;
+    return bytes;
+}
+
+QStringList SearchIndex::completeAccount(const QString& prefix, int limit) const
+{
+    QStringList names;
+    const QString key = normalize(prefix);
+    for (auto it = m_accounts.lowerBound(key); it != m_accounts.constEnd() && names.size() < limit; ++it) {
+        if (!it.key().startsWith(key)) {
+            break;
+        }
+        names.append(it.value().name);
+    }
+    return names;
+}
+
+QString SearchIndex::normalize(const QString& text)
+{
+    return text.toCaseFolded();
+}
+
+QString SearchIndex::searchableText(const Transaction& transaction)
+{
+    return transaction.getNote() + kFieldSeparator
+           + transaction.getFromAccount() + kFieldSeparator
+           + transaction.getToAccount() + kFieldSeparator
+           + transaction.getCategory();
+}
+
+QList<quint32> SearchIndex::gramsOf(const QString& normalized, bool forQuery)
+{
+    QSet<quint32> grams;
+    for (qsizetype i = 0; i < normalized.size(); ++i) {
+        QChar c = normalized.at(i);
+        if (c == kFieldSeparator) {
+            continue;
+        }
+        bool hasNext = i + 1 < normalized.size() && normalized.at(i + 1) != kFieldSeparator;
+        if (hasNext) {
+            grams.insert(bigramKey(c, normalized.at(i + 1)));
+        }
+        // Rows are indexed by every unigram so one-character queries work;
+        // longer queries only need their bigrams
+        if (!forQuery || normalized.size() == 1) {
+            grams.insert(unigramKey(c));
+        }
+    }
+    return grams.values();
+}
+
+void SearchIndex::addAccount(const QString& account)
+{
+    if (account.isEmpty()) {
+        return;
+    }
+    AccountEntry& entry = m_accounts[normalize(account)];
+    if (entry.references == 0) {
+        entry.name = account;
+    }
+    ++entry.references;
+}
+
+void SearchIndex::removeAccount(const QString& account)
+{
+    auto it = m_accounts.find(normalize(account));
+    if (it != m_accounts.end() && --it.value().references <= 0) {
+        m_accounts.erase(it);
+    }
+}
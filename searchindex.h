@@ -0,0 +1,77 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include "transaction.h"
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QSet>
+#include <QStringList>
+
+#include <vector>
+
+// Full-text index over notes, counterparties and categories.
+//
+// Text is case-folded and broken into character unigrams and bigrams, which
+// works for Chinese (no word boundaries) as well as Latin text. Each gram
+// maps to a sorted list of row sequence numbers; a query intersects the
+// lists of its grams, smallest first, and the caller verifies the surviving
+// candidates. Account names additionally go into a sorted prefix index for
+// autocomplete.
+//
+// Removing a row leaves its postings in place and records a tombstone, so a
+// delete costs a set insert instead of shifting the long posting lists of
+// common grams; candidates() skips tombstoned rows. Once tombstones make up
+// CompactionRatio of the indexed rows, compact() purges them a bounded
+// number of posting lists per call, so the work can be spread over idle
+// time. Sequence numbers are never reused, except by undo restoring the
+// same row, which just lifts its tombstone.
+class SearchIndex
+{
+public:
+    static constexpr double CompactionRatio = 0.2;
+    static constexpr int MinimumTombstones = 1024;
+
+    SearchIndex();
+
+    void addTransaction(quint32 sequence, const Transaction& transaction);
+    void removeTransaction(quint32 sequence, const Transaction& transaction);
+    void clear();
+
+    int tombstoneCount() const;
+    bool needsCompaction() const;
+    bool compact(int maxGrams); // true while posting lists remain to be purged
+
+    // Rows that contain every gram of the query: a superset of the matches
+    QList<quint32> candidates(const QString& query) const;
+    static bool matches(const Transaction& transaction, const QString& query);
+
+    QStringList completeAccount(const QString& prefix, int limit) const;
+
+    qint64 bytesUsed() const; // estimated heap bytes
+
+private:
+    struct AccountEntry {
+        QString name;
+        int references = 0;
+    };
+
+    static QString normalize(const QString& text);
+    static QString searchableText(const Transaction& transaction);
+    static QList<quint32> gramsOf(const QString& normalized, bool forQuery);
+
+    void addAccount(const QString& account);
+    void removeAccount(const QString& account);
+
+    QHash<quint32, std::vector<quint32>> m_grams;
+    QMap<QString, AccountEntry> m_accounts; // normalized name -> entry
+    int m_liveRows;
+
+    // Tombstones, and the ones the compaction in progress is purging from
+    // the grams still queued
+    QSet<quint32> m_deleted;
+    QSet<quint32> m_purging;
+    QList<quint32> m_compactQueue;
+};
+
+#endif // SEARCHINDEX_H
@@ -1,130 +1,315 @@
 #include "statisticscalculator.h"
+#include "compensatedsum.h"
+#include "ledgerarchive.h"
 #include <QDate>
+#include <QFile>
+#include <QHash>
+#include <QThread>
+
+#include <algorithm>
+
+namespace {
+
+struct IncomeExpense {
+    CompensatedSum income;
+    CompensatedSum expense;
+
+    void add(const Transaction& transaction)
+    {
+        if (transaction.getType() == TransactionType::INCOME) {
+            income.add(transaction.getAmount());
+        } else {
+            expense.add(transaction.getAmount());
+        }
+    }
+
+    void merge(const IncomeExpense& other)
+    {
+        income.merge(other.income);
+        expense.merge(other.expense);
+    }
+};
+
+using CategorySums = QHash<QString, CompensatedSum>;
+
+// Local midnight of the first day of each month of year, plus January of
+// the next year, so month membership is a comparison of raw timestamps
+std::vector<qint64> monthStarts(int year)
+{
+    std::vector<qint64> starts;
+    for (int month = 1; month <= 13; ++month) {
+        const QDate first = month <= 12 ? QDate(year, month, 1) : QDate(year + 1, 1, 1);
+        starts.push_back(QDateTime(first, QTime(0, 0)).toMSecsSinceEpoch());
+    }
+    return starts;
+}
+
+QMap<QString, double> mergeCategories(const std::vector<CategorySums>& partials)
+{
+    CategorySums merged;
+    for (const auto& partial : partials) {
+        for (auto it = partial.cbegin(); it != partial.cend(); ++it) {
+            merged[it.key()].merge(it.value());
+        }
+    }
+
+    QMap<QString, double> result;
+    for (auto it = merged.cbegin(); it != merged.cend(); ++it) {
+        result.insert(it.key(), it.value().value());
+    }
+    return result;
+}
+
+} // namespace
 
 StatisticsCalculator::StatisticsCalculator(QObject* parent)
     : QObject(parent)
 {
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+void StatisticsCalculator::setThreadCount(int threads)
+{
+    m_pool.setMaxThreadCount(qMax(1, threads));
+}
+
+int StatisticsCalculator::threadCount() const
+{
+    return m_pool.maxThreadCount();
+}
+
+template <typename Partial, typename Accumulate>
+std::vector<Partial> StatisticsCalculator::mapChunks(const QList<Transaction>& transactions,
+                                                     Accumulate accumulate)
+{
+    // Chunk boundaries depend on the input size only, never on the threads
+    const qsizetype chunkCount = qMax<qsizetype>(1, (transactions.size() + ChunkRows - 1) / ChunkRows);
+    std::vector<Partial> partials(chunkCount);
+    auto runChunk = [&](qsizetype chunk) {
+        const qsizetype end = qMin(transactions.size(), (chunk + 1) * ChunkRows);
+        for (qsizetype i = chunk * ChunkRows; i < end; ++i) {
+            accumulate(partials[chunk], transactions.at(i));
+        }
+    };
+
+    if (transactions.size() < ParallelThreshold || m_pool.maxThreadCount() == 1) {
+        for (qsizetype chunk = 0; chunk < chunkCount; ++chunk) {
+            runChunk(chunk);
+        }
+    } else {
+        for (qsizetype chunk = 0; chunk < chunkCount; ++chunk) {
+            m_pool.start([&runChunk, chunk]() { runChunk(chunk); });
+        }
+        m_pool.waitForDone();
+    }
+    return partials;
 }
 
 double StatisticsCalculator::calculateTotalAmount(const QList<Transaction>& transactions)
 {
-    double total = 0.0;
-    for (const auto& transaction : transactions) {
-        total += transaction.getAmount();
+    const auto partials = mapChunks<CompensatedSum>(transactions,
+        [](CompensatedSum& sum, const Transaction& transaction) {
+            sum.add(transaction.getAmount());
+        });
+
+    CompensatedSum total;
+    for (const auto& partial : partials) {
+        total.merge(partial);
     }
-    return total;
+    return total.value();
 }
 
 MonthlyStats StatisticsCalculator::calculateMonthlyStats(int month, int year, const QList<Transaction>& transactions)
 {
+    const std::vector<qint64> starts = monthStarts(year);
+    const qint64 start = starts[month - 1];
+    const qint64 end = starts[month];
+
+    const auto partials = mapChunks<IncomeExpense>(transactions,
+        [start, end](IncomeExpense& sums, const Transaction& transaction) {
+            const qint64 timestamp = transaction.getTimestampMSecs();
+            if (timestamp >= start && timestamp < end) {
+                sums.add(transaction);
+            }
+        });
+
+    IncomeExpense total;
+    for (const auto& partial : partials) {
+        total.merge(partial);
+    }
+
     MonthlyStats stats;
+    stats.totalIncome = total.income.value();
+    stats.totalExpense = total.expense.value();
+    stats.netAmount = stats.totalIncome - stats.totalExpense;
+    return stats;
+}
 
-    for (const auto& transaction : transactions) {
-        if (isTransactionInMonth(transaction, month, year)) {
-            if (transaction.getType() == TransactionType::INCOME) {
-                stats.totalIncome += transaction.getAmount();
-            } else {
-                stats.totalExpense += transaction.getAmount();
+MonthlyStats StatisticsCalculator::calculateMonthlyStatsFromArchive(int month, int year,
+                                                                   const QString& filename, bool* ok)
+{
+    QDate firstDay(year, month, 1);
+    const qint64 start = QDateTime(firstDay, QTime(0, 0, 0)).toMSecsSinceEpoch();
+    const qint64 end = QDateTime(firstDay.addMonths(1), QTime(0, 0, 0)).toMSecsSinceEpoch() - 1;
+
+    QFile file(filename);
+    LedgerArchiveReader reader(&file);
+    bool success = file.open(QIODevice::ReadOnly) && reader.open();
+
+    // Block totals and rows go into one compensated sum, like the chunks of
+    // calculateMonthlyStats()
+    IncomeExpense total;
+    ArchiveBlockInfo info;
+    while (success && reader.nextBlock(&info)) {
+        if (!info.overlapsDates(start, end)) {
+            success = reader.skipBlock();
+        } else if (info.insideDates(start, end)) {
+            total.income.add(info.totalIncome);
+            total.expense.add(info.totalExpense);
+            success = reader.skipBlock();
+        } else {
+            QList<Transaction> block;
+            success = reader.readBlock(&block);
+            for (const auto& transaction : std::as_const(block)) {
+                const qint64 timestamp = transaction.getTimestampMSecs();
+                if (timestamp >= start && timestamp <= end) {
+                    total.add(transaction);
+                }
             }
         }
     }
 
+    if (ok) {
+        *ok = success && !reader.hasError();
+    }
+
+    MonthlyStats stats;
+    stats.totalIncome = total.income.value();
+    stats.totalExpense = total.expense.value();
     stats.netAmount = stats.totalIncome - stats.totalExpense;
     return stats;
 }
 
 YearlyStats StatisticsCalculator::calculateYearlyStats(int year, const QList<Transaction>& transactions)
 {
-    YearlyStats yearlyStats;
-
-    // Initialize monthly data
-    for (int month = 1; month <= 12; ++month) {
-        yearlyStats.monthlyData[month] = calculateMonthlyStats(month, year, transactions);
-    }
+    // All twelve months in one pass
+    using YearSums = std::vector<IncomeExpense>;
+    const std::vector<qint64> starts = monthStarts(year);
 
-    // Calculate yearly totals
-    for (const auto& transaction : transactions) {
-        if (isTransactionInYear(transaction, year)) {
-            if (transaction.getType() == TransactionType::INCOME) {
-                yearlyStats.totalIncome += transaction.getAmount();
-            } else {
-                yearlyStats.totalExpense += transaction.getAmount();
+    const auto partials = mapChunks<YearSums>(transactions,
+        [&starts](YearSums& sums, const Transaction& transaction) {
+            const qint64 timestamp = transaction.getTimestampMSecs();
+            if (timestamp < starts.front() || timestamp >= starts.back()) {
+                return;
             }
+            if (sums.empty()) {
+                sums.resize(12);
+            }
+            const int month = int(std::upper_bound(starts.begin(), starts.end(), timestamp) - starts.begin()) - 1;
+            sums[month].add(transaction);
+        });
+
+    YearSums months(12);
+    for (const auto& partial : partials) {
+        for (size_t month = 0; month < partial.size(); ++month) {
+            months[month].merge(partial[month]);
         }
     }
 
+    YearlyStats yearlyStats;
+    IncomeExpense total;
+    for (int month = 1; month <= 12; ++month) {
+        const IncomeExpense& sums = months[month - 1];
+        MonthlyStats stats;
+        stats.totalIncome = sums.income.value();
+        stats.totalExpense = sums.expense.value();
+        stats.netAmount = stats.totalIncome - stats.totalExpense;
+        yearlyStats.monthlyData[month] = stats;
+        total.merge(sums);
+    }
+
+    yearlyStats.totalIncome = total.income.value();
+    yearlyStats.totalExpense = total.expense.value();
     yearlyStats.netAmount = yearlyStats.totalIncome - yearlyStats.totalExpense;
     return yearlyStats;
 }
 
 QMap<QString, double> StatisticsCalculator::calculateCategoryBreakdown(const QList<Transaction>& transactions)
 {
-    QMap<QString, double> breakdown;
-
-    for (const auto& transaction : transactions) {
-        QString category = transaction.getCategory();
-        breakdown[category] += transaction.getAmount();
-    }
-
-    return breakdown;
+    return mergeCategories(mapChunks<CategorySums>(transactions,
+        [](CategorySums& sums, const Transaction& transaction) {
+            sums[transaction.getCategory()].add(transaction.getAmount());
+        }));
 }
 
 QMap<QString, double> StatisticsCalculator::calculateExpenseByCategory(const QList<Transaction>& transactions)
 {
-    QMap<QString, double> expenseBreakdown;
-
-    for (const auto& transaction : transactions) {
-        if (transaction.getType() == TransactionType::EXPENSE) {
-            QString category = transaction.getCategory();
-            expenseBreakdown[category] += transaction.getAmount();
-        }
-    }
-
-    return expenseBreakdown;
+    return mergeCategories(mapChunks<CategorySums>(transactions,
+        [](CategorySums& sums, const Transaction& transaction) {
+            if (transaction.getType() == TransactionType::EXPENSE) {
+                sums[transaction.getCategory()].add(transaction.getAmount());
+            }
+        }));
 }
 
 QMap<QString, double> StatisticsCalculator::calculateIncomeByCategory(const QList<Transaction>& transactions)
 {
-    QMap<QString, double> incomeBreakdown;
-
-    for (const auto& transaction : transactions) {
-        if (transaction.getType() == TransactionType::INCOME) {
-            QString category = transaction.getCategory();
-            incomeBreakdown[category] += transaction.getAmount();
-        }
-    }
-
-    return incomeBreakdown;
+    return mergeCategories(mapChunks<CategorySums>(transactions,
+        [](CategorySums& sums, const Transaction& transaction) {
+            if (transaction.getType() == TransactionType::INCOME) {
+                sums[transaction.getCategory()].add(transaction.getAmount());
+            }
+        }));
 }
 
 QMap<QDate, double> StatisticsCalculator::calculateDailyTrend(const QDateTime& startDate,
                                                               const QDateTime& endDate,
                                                               const QList<Transaction>& transactions)
 {
-    QMap<QDate, double> dailyTrend;
+    struct DaySums {
+        QHash<qint64, CompensatedSum> days; // Julian day -> net amount
+        qint64 dayStart = 1;                // local day of the previous row
+        qint64 dayEnd = 0;
+        qint64 julianDay = 0;
+    };
 
-    for (const auto& transaction : transactions) {
-        QDateTime timestamp = transaction.getTimestamp();
-        if (timestamp >= startDate && timestamp <= endDate) {
-            QDate date = timestamp.date();
+    const qint64 start = startDate.toMSecsSinceEpoch();
+    const qint64 end = endDate.toMSecsSinceEpoch();
+    const auto partials = mapChunks<DaySums>(transactions,
+        [start, end](DaySums& sums, const Transaction& transaction) {
+            const qint64 timestamp = transaction.getTimestampMSecs();
+            if (timestamp == Transaction::InvalidTimestamp || timestamp < start || timestamp > end) {
+                return;
+            }
+            if (timestamp < sums.dayStart || timestamp >= sums.dayEnd) {
+                const QDate date = QDateTime::fromMSecsSinceEpoch(timestamp).date();
+                sums.dayStart = QDateTime(date, QTime(0, 0)).toMSecsSinceEpoch();
+                sums.dayEnd = QDateTime(date.addDays(1), QTime(0, 0)).toMSecsSinceEpoch();
+                sums.julianDay = date.toJulianDay();
+            }
             if (transaction.getType() == TransactionType::INCOME) {
-                dailyTrend[date] += transaction.getAmount();
+                sums.days[sums.julianDay].add(transaction.getAmount());
             } else {
-                dailyTrend[date] -= transaction.getAmount();
+                sums.days[sums.julianDay].add(-transaction.getAmount());
             }
+        });
+
+    QHash<qint64, CompensatedSum> merged;
+    for (const auto& partial : partials) {
+        for (auto it = partial.days.cbegin(); it != partial.days.cend(); ++it) {
+            merged[it.key()].merge(it.value());
         }
     }
 
+    QMap<QDate, double> dailyTrend;
+    for (auto it = merged.cbegin(); it != merged.cend(); ++it) {
+        dailyTrend.insert(QDate::fromJulianDay(it.key()), it.value().value());
+    }
     return dailyTrend;
 }
 
-bool StatisticsCalculator::isTransactionInMonth(const Transaction& transaction, int month, int year)
-{
-    QDateTime timestamp = transaction.getTimestamp();
-    return timestamp.date().month() == month && timestamp.date().year() == year;
-}
-
-bool StatisticsCalculator::isTransactionInYear(const Transaction& transaction, int year)
+AggregationCube StatisticsCalculator::groupBy(const QList<Transaction>& transactions,
+                                              const QList<AggregationCube::Dimension>& dimensions)
 {
-    return transaction.getTimestamp().date().year() == year;
+    return AggregationCube(transactions, dimensions);
 }
@@ -2,9 +2,13 @@
 #define STATISTICSCALCULATOR_H
 
 #include "transaction.h"
+#include "aggregationcube.h"
 #include <QObject>
 #include <QMap>
 #include <QDateTime>
+#include <QThreadPool>
+
+#include <vector>
 
 struct MonthlyStats {
     double totalIncome;
@@ -23,18 +27,37 @@ struct YearlyStats {
     YearlyStats() : totalIncome(0.0), totalExpense(0.0), netAmount(0.0) {}
 };
 
+// Aggregates over transaction lists.
+//
+// Inputs are cut into chunks of ChunkRows whatever the thread count; each
+// chunk is summed with Neumaier compensation and the partial results are
+// merged in chunk order. Chunks run on a private pool whose idle threads
+// take the next chunk from the queue, so uneven chunks balance out. Results
+// are identical for every setThreadCount(), and inputs below
+// ParallelThreshold run on the calling thread.
 class StatisticsCalculator : public QObject
 {
     Q_OBJECT
 
 public:
+    static constexpr int ChunkRows = 32768;
+    static constexpr int ParallelThreshold = 4 * ChunkRows;
+
     explicit StatisticsCalculator(QObject* parent = nullptr);
 
+    void setThreadCount(int threads); // 1 runs everything serially
+    int threadCount() const;
+
     // Core statistics
     double calculateTotalAmount(const QList<Transaction>& transactions);
     MonthlyStats calculateMonthlyStats(int month, int year, const QList<Transaction>& transactions);
     YearlyStats calculateYearlyStats(int year, const QList<Transaction>& transactions);
 
+    // Reads a LedgerArchive directly: blocks outside the month are skipped and
+    // blocks entirely inside it are answered from their header totals.
+    MonthlyStats calculateMonthlyStatsFromArchive(int month, int year, const QString& filename,
+                                                  bool* ok = nullptr);
+
     // Category analysis
     QMap<QString, double> calculateCategoryBreakdown(const QList<Transaction>& transactions);
     QMap<QString, double> calculateExpenseByCategory(const QList<Transaction>& transactions);
@@ -44,9 +67,18 @@ public:
     QMap<QDate, double> calculateDailyTrend(const QDateTime& startDate, const QDateTime& endDate,
                                             const QList<Transaction>& transactions);
 
+    // Cross-tab over any subset of attributes in one pass. Slice and roll up
+    // the result instead of calling the functions above once per view.
+    AggregationCube groupBy(const QList<Transaction>& transactions,
+                            const QList<AggregationCube::Dimension>& dimensions);
+
 private:
-    bool isTransactionInMonth(const Transaction& transaction, int month, int year);
-    bool isTransactionInYear(const Transaction& transaction, int year);
+    // Runs accumulate(partial, transaction) over every chunk and returns the
+    // per-chunk partials in chunk order
+    template <typename Partial, typename Accumulate>
+    std::vector<Partial> mapChunks(const QList<Transaction>& transactions, Accumulate accumulate);
+
+    QThreadPool m_pool;
 };
 
 #endif // STATISTICSCALCULATOR_H
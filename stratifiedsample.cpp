@@ -0,0 +1,142 @@
+#include "stratifiedsample.h"
+#include "ledgerpartitions.h"
+
+StratifiedSample::StratifiedSample(int rowsPerMonth)
+    : m_rowsPerMonth(qMax(1, rowsPerMonth))
+    , m_population(0)
+    , m_sampleSize(0)
+    , m_random(20240101)
+{
+}
+
+void StratifiedSample::addTransaction(quint32 sequence, const Transaction& transaction)
+{
+    Stratum& stratum = m_strata[LedgerPartitions::monthKey(transaction.getTimestampMSecs())];
+    ++stratum.population;
+    ++m_population;
+
+    const int pending = stratum.pendingSampled + stratum.pendingUnsampled;
+    if (pending > 0) {
+        // Random pairing: the new row takes the place of a deleted one,
+        // sampled with the probability that the deleted one was
+        if (int(m_random.bounded(pending)) < stratum.pendingSampled) {
+            --stratum.pendingSampled;
+            insertRow(stratum, sequence, transaction);
+        } else {
+            --stratum.pendingUnsampled;
+        }
+        return;
+    }
+
+    // Reservoir sampling: the n-th row is kept with probability capacity / n
+    if (stratum.rows.size() < m_rowsPerMonth) {
+        insertRow(stratum, sequence, transaction);
+    } else {
+        const int slot = int(m_random.bounded(stratum.population));
+        if (slot < m_rowsPerMonth) {
+            replaceRow(stratum, slot, sequence, transaction);
+        }
+    }
+}
+
+void StratifiedSample::removeTransaction(quint32 sequence, const Transaction& transaction)
+{
+    auto it = m_strata.find(LedgerPartitions::monthKey(transaction.getTimestampMSecs()));
+    if (it == m_strata.end()) {
+        return;
+    }
+
+    Stratum& stratum = it.value();
+    --stratum.population;
+    --m_population;
+    if (stratum.population == 0) {
+        m_sampleSize -= int(stratum.rows.size());
+        m_strata.erase(it);
+        return;
+    }
+
+    const int slot = stratum.slots.value(sequence, -1);
+    if (slot >= 0) {
+        removeSlot(stratum, slot);
+        ++stratum.pendingSampled;
+    } else {
+        ++stratum.pendingUnsampled;
+    }
+}
+
+void StratifiedSample::clear()
+{
+    m_strata.clear();
+    m_population = 0;
+    m_sampleSize = 0;
+}
+
+int StratifiedSample::population() const
+{
+    return m_population;
+}
+
+int StratifiedSample::sampleSize() const
+{
+    return m_sampleSize;
+}
+
+QStringList StratifiedSample::months() const
+{
+    return m_strata.keys();
+}
+
+int StratifiedSample::population(const QString& month) const
+{
+    auto it = m_strata.constFind(month);
+    return it == m_strata.constEnd() ? 0 : it->population;
+}
+
+QList<SampledRow> StratifiedSample::rows(const QString& month) const
+{
+    auto it = m_strata.constFind(month);
+    return it == m_strata.constEnd() ? QList<SampledRow>() : it->rows;
+}
+
+bool StratifiedSample::isComplete(const QString& month) const
+{
+    auto it = m_strata.constFind(month);
+    return it == m_strata.constEnd() || it->rows.size() >= it->population;
+}
+
+qint64 StratifiedSample::bytesUsed() const
+{
+    qint64 bytes = m_strata.capacity() * qint64(sizeof(QString) + sizeof(Stratum) + 1);
+    for (const auto& stratum : m_strata) {
+        bytes += stratum.rows.capacity() * qint64(sizeof(SampledRow))
+                + stratum.slots.capacity() * qint64(sizeof(quint32) + sizeof(int) + 1);
+    }
+    return bytes;
+}
+
+void StratifiedSample::insertRow(Stratum& stratum, quint32 sequence, const Transaction& transaction)
+{
+    stratum.slots.insert(sequence, int(stratum.rows.size()));
+    stratum.rows.append(SampledRow{sequence, transaction});
+    ++m_sampleSize;
+}
+
+void StratifiedSample::replaceRow(Stratum& stratum, int slot, quint32 sequence, const Transaction& transaction)
+{
+    stratum.slots.remove(stratum.rows.at(slot).sequence);
+    stratum.slots.insert(sequence, slot);
+    stratum.rows[slot] = SampledRow{sequence, transaction};
+}
+
+void StratifiedSample::removeSlot(Stratum& stratum, int slot)
+{
+    // Fill the hole with the last row so the reservoir stays contiguous
+    stratum.slots.remove(stratum.rows.at(slot).sequence);
+    const int last = int(stratum.rows.size()) - 1;
+    if (slot != last) {
+        stratum.rows[slot] = stratum.rows.at(last);
+        stratum.slots[stratum.rows.at(slot).sequence] = slot;
+    }
+    stratum.rows.removeLast();
+    --m_sampleSize;
+}
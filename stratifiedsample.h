@@ -0,0 +1,155 @@
+#ifndef STRATIFIEDSAMPLE_H
+#define STRATIFIEDSAMPLE_H
+
+#include "transaction.h"
+#include <QHash>
+#include <QList>
+#include <QRandomGenerator>
+#include <QStringList>
+
+#include <cmath>
+
+struct SampleEstimate {
+    double value = 0.0;
+    double margin = 0.0;  // half-width of the 95% confidence interval
+    bool exact = false;
+};
+
+struct SampledRow {
+    quint32 sequence;     // row in TransactionManager's store
+    Transaction transaction;
+};
+
+// Uniform random sample of the ledger rows, kept per month.
+//
+// Each month ("yyyy-MM", or "undated") is a stratum with a bounded
+// reservoir maintained by random pairing: inserts follow reservoir sampling,
+// and a delete leaves a gap that a later insert into the same month fills
+// with the right probability, so the sample stays uniform under any mix of
+// edits without rescanning. Months with no more rows than the reservoir
+// holds are sampled completely, which makes their figures exact.
+//
+// Copies share the reservoirs until either side changes, so a copy can be
+// handed to a worker thread next to a LedgerSnapshot.
+class StratifiedSample
+{
+public:
+    static constexpr int DefaultRowsPerMonth = 256;
+
+    explicit StratifiedSample(int rowsPerMonth = DefaultRowsPerMonth);
+
+    void addTransaction(quint32 sequence, const Transaction& transaction);
+    void removeTransaction(quint32 sequence, const Transaction& transaction);
+    void clear();
+
+    int population() const;
+    int sampleSize() const;
+    QStringList months() const;
+    int population(const QString& month) const;
+    QList<SampledRow> rows(const QString& month) const;
+    bool isComplete(const QString& month) const; // every row of the month is sampled
+
+    // Stratified estimate of the sum of value(row) over every row of the
+    // given months (all months when empty), with a normal-approximation
+    // confidence interval
+    template <typename Value>
+    SampleEstimate estimateSum(Value value, const QStringList& months = QStringList()) const;
+
+    // The same for a scan in progress that has summed scannedRows[month]
+    // rows of a month exactly to scannedSums[month]: only the rest of each
+    // month is estimated, so the interval narrows as the scan advances
+    template <typename Value>
+    SampleEstimate estimateRemainder(Value value, const QStringList& months, const QHash<QString, int>& scannedRows,
+                                     const QHash<QString, double>& scannedSums) const;
+
+    qint64 bytesUsed() const;
+
+private:
+    struct Stratum {
+        int population = 0;
+        int pendingSampled = 0;   // deletes of sampled rows not yet compensated
+        int pendingUnsampled = 0; // deletes of other rows not yet compensated
+        QList<SampledRow> rows;
+        QHash<quint32, int> slots; // sequence -> index in rows
+    };
+
+    void insertRow(Stratum& stratum, quint32 sequence, const Transaction& transaction);
+    void replaceRow(Stratum& stratum, int slot, quint32 sequence, const Transaction& transaction);
+    void removeSlot(Stratum& stratum, int slot);
+
+    int m_rowsPerMonth;
+    int m_population;
+    int m_sampleSize;
+    QHash<QString, Stratum> m_strata;
+    QRandomGenerator m_random;
+};
+
+template <typename Value>
+SampleEstimate StratifiedSample::estimateSum(Value value, const QStringList& months) const
+{
+    return estimateRemainder(value, months, QHash<QString, int>(), QHash<QString, double>());
+}
+
+template <typename Value>
+SampleEstimate StratifiedSample::estimateRemainder(Value value, const QStringList& months,
+                                                   const QHash<QString, int>& scannedRows,
+                                                   const QHash<QString, double>& scannedSums) const
+{
+    SampleEstimate estimate;
+    estimate.exact = true;
+    double variance = 0.0;
+
+    auto addStratum = [&](const QString& month, const Stratum& stratum) {
+        const int sampled = int(stratum.rows.size());
+        const int remaining = stratum.population - scannedRows.value(month);
+        if (remaining <= 0) {
+            estimate.value += scannedSums.value(month);
+            return;
+        }
+        if (sampled == 0) {
+            estimate.exact = false;
+            return;
+        }
+
+        double sum = 0.0;
+        double squares = 0.0;
+        for (const auto& row : stratum.rows) {
+            const double x = value(row);
+            sum += x;
+            squares += x * x;
+        }
+        if (sampled >= stratum.population) {
+            estimate.value += sum;
+            return;
+        }
+
+        // Expansion estimator for the unscanned rows, with the finite
+        // population correction of the whole month
+        estimate.exact = false;
+        const double mean = sum / sampled;
+        estimate.value += scannedSums.value(month) + remaining * mean;
+        if (sampled > 1) {
+            const double spread = qMax(0.0, (squares - sum * mean) / (sampled - 1));
+            const double correction = 1.0 - double(sampled) / stratum.population;
+            variance += double(remaining) * remaining * correction * spread / sampled;
+        }
+    };
+
+    if (months.isEmpty()) {
+        for (auto it = m_strata.constBegin(); it != m_strata.constEnd(); ++it) {
+            addStratum(it.key(), it.value());
+        }
+    } else {
+        for (const auto& month : months) {
+            auto it = m_strata.constFind(month);
+            if (it != m_strata.constEnd()) {
+                addStratum(month, it.value());
+            }
+        }
+    }
+
+    estimate.margin = 1.96 * std::sqrt(variance);
+    return estimate;
+}
+
+#endif // STRATIFIEDSAMPLE_H
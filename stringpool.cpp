@@ -0,0 +1,51 @@
+#include "stringpool.h"
+
+StringPool::StringPool()
+    : m_bytes(0)
+    , m_requests(0)
+{
+}
+
+QString StringPool::intern(const QString& value)
+{
+    if (value.isEmpty()) {
+        return QString();
+    }
+
+    ++m_requests;
+    auto it = m_strings.constFind(value);
+    if (it != m_strings.constEnd()) {
+        return *it;
+    }
+
+    m_strings.insert(value);
+    m_bytes += value.capacity() * qint64(sizeof(QChar));
+    return value;
+}
+
+int StringPool::size() const
+{
+    return m_strings.size();
+}
+
+qint64 StringPool::bytesUsed() const
+{
+    return m_bytes;
+}
+
+qint64 StringPool::tableBytes() const
+{
+    return m_strings.capacity() * qint64(sizeof(QString) + 1);
+}
+
+qint64 StringPool::requestCount() const
+{
+    return m_requests;
+}
+
+void StringPool::clear()
+{
+    m_strings.clear();
+    m_bytes = 0;
+    m_requests = 0;
+}
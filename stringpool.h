@@ -0,0 +1,32 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QString>
+#include <QSet>
+
+// Per-ledger interning table for the free-text fields of Transaction.
+//
+// Categories, methods and account names repeat across nearly every row, so
+// handing out one shared QString per distinct value collapses millions of
+// small heap blocks into a few hundred.
+class StringPool
+{
+public:
+    StringPool();
+
+    // Returns a QString sharing its data with the pooled copy of value.
+    QString intern(const QString& value);
+
+    int size() const;
+    qint64 bytesUsed() const;
+    qint64 tableBytes() const;   // the lookup table itself, estimated
+    qint64 requestCount() const; // intern() calls with a non-empty value
+    void clear();
+
+private:
+    QSet<QString> m_strings;
+    qint64 m_bytes;
+    qint64 m_requests;
+};
+
+#endif // STRINGPOOL_H
@@ -0,0 +1,315 @@
+#include "tagindex.h"
+#include <QDateTime>
+
+#include <algorithm>
+
+namespace {
+
+QStringList tokenize(const QString& expression)
+{
+    QStringList tokens;
+    QString current;
+    for (const QChar c : expression) {
+        if (c.isSpace() || c == '(' || c == ')') {
+            if (!current.isEmpty()) {
+                tokens.append(current);
+                current.clear();
+            }
+            if (!c.isSpace()) {
+                tokens.append(QString(c));
+            }
+        } else {
+            current.append(c);
+        }
+    }
+    if (!current.isEmpty()) {
+        tokens.append(current);
+    }
+    return tokens;
+}
+
+// Recursive descent over the tokens, evaluating as it goes
+class ExpressionParser
+{
+public:
+    ExpressionParser(const TagIndex& index, const QStringList& tokens)
+        : m_index(index)
+        , m_tokens(tokens)
+        , m_position(0)
+    {
+    }
+
+    bool parse(RoaringBitmap* rows)
+    {
+        *rows = parseOr();
+        if (m_error.isEmpty() && m_position < m_tokens.size()) {
+            m_error = QString("无法识别“%1”").arg(m_tokens.at(m_position));
+        }
+        return m_error.isEmpty();
+    }
+
+    QString error() const { return m_error; }
+
+private:
+    struct Term {
+        RoaringBitmap rows;
+        bool negated;
+    };
+
+    bool atKeyword(const char* keyword) const
+    {
+        return m_position < m_tokens.size()
+               && m_tokens.at(m_position).compare(QLatin1String(keyword), Qt::CaseInsensitive) == 0;
+    }
+
+    bool atTermStart() const
+    {
+        return m_position < m_tokens.size() && !atKeyword("AND") && !atKeyword("OR")
+               && m_tokens.at(m_position) != ")";
+    }
+
+    RoaringBitmap parseOr()
+    {
+        RoaringBitmap rows = parseAnd();
+        while (m_error.isEmpty() && atKeyword("OR")) {
+            ++m_position;
+            rows |= parseAnd();
+        }
+        return rows;
+    }
+
+    // Intersects the plain terms smallest first, then subtracts the negated
+    // ones, so "a AND NOT b" never materializes the complement of b
+    RoaringBitmap parseAnd()
+    {
+        QList<Term> terms;
+        terms.append(parseTerm());
+        while (m_error.isEmpty()) {
+            if (atKeyword("AND")) {
+                ++m_position;
+            } else if (!atTermStart()) {
+                break;
+            }
+            terms.append(parseTerm());
+        }
+        if (!m_error.isEmpty()) {
+            return RoaringBitmap();
+        }
+
+        std::sort(terms.begin(), terms.end(), [](const Term& a, const Term& b) {
+            return a.rows.cardinality() < b.rows.cardinality();
+        });
+        RoaringBitmap rows;
+        bool started = false;
+        for (const auto& term : std::as_const(terms)) {
+            if (!term.negated) {
+                rows = started ? rows & term.rows : term.rows;
+                started = true;
+            }
+        }
+        if (!started) {
+            rows = m_index.allRows();
+        }
+        for (const auto& term : std::as_const(terms)) {
+            if (term.negated && !rows.isEmpty()) {
+                rows -= term.rows;
+            }
+        }
+        return rows;
+    }
+
+    Term parseTerm()
+    {
+        Term term{RoaringBitmap(), false};
+        while (atKeyword("NOT")) {
+            ++m_position;
+            term.negated = !term.negated;
+        }
+        if (!atTermStart()) {
+            m_error = m_position < m_tokens.size() ? QString("“%1”前缺少标签").arg(m_tokens.at(m_position))
+                                                   : QString("条件不完整");
+            return term;
+        }
+
+        const QString token = m_tokens.at(m_position++);
+        if (token == "(") {
+            term.rows = parseOr();
+            if (m_error.isEmpty()) {
+                if (m_position < m_tokens.size() && m_tokens.at(m_position) == ")") {
+                    ++m_position;
+                } else {
+                    m_error = "括号不匹配";
+                }
+            }
+        } else {
+            term.rows = m_index.rowsWithTag(token);
+        }
+        return term;
+    }
+
+    const TagIndex& m_index;
+    QStringList m_tokens;
+    int m_position;
+    QString m_error;
+};
+
+} // namespace
+
+void TagIndex::addTransaction(quint32 sequence, const Transaction& transaction)
+{
+    m_all.add(sequence);
+    const QStringList tags = transaction.getTags();
+    for (const auto& tag : tags) {
+        m_tags[tag].add(sequence);
+    }
+    m_categories[transaction.getCategory()].add(sequence);
+
+    const qint64 timestamp = transaction.getTimestampMSecs();
+    if (timestamp != Transaction::InvalidTimestamp) {
+        const QDate day = QDateTime::fromMSecsSinceEpoch(timestamp).date();
+        m_months[monthKey(day)].add(sequence);
+        m_days[day.toJulianDay()].add(sequence);
+    }
+}
+
+void TagIndex::removeTransaction(quint32 sequence, const Transaction& transaction)
+{
+    auto removeFrom = [sequence](auto& bitmaps, const auto& key) {
+        auto it = bitmaps.find(key);
+        if (it != bitmaps.end()) {
+            it->remove(sequence);
+            if (it->isEmpty()) {
+                bitmaps.erase(it);
+            }
+        }
+    };
+
+    m_all.remove(sequence);
+    const QStringList tags = transaction.getTags();
+    for (const auto& tag : tags) {
+        removeFrom(m_tags, tag);
+    }
+    removeFrom(m_categories, transaction.getCategory());
+
+    const qint64 timestamp = transaction.getTimestampMSecs();
+    if (timestamp != Transaction::InvalidTimestamp) {
+        const QDate day = QDateTime::fromMSecsSinceEpoch(timestamp).date();
+        removeFrom(m_months, monthKey(day));
+        removeFrom(m_days, day.toJulianDay());
+    }
+}
+
+void TagIndex::clear()
+{
+    m_tags.clear();
+    m_categories.clear();
+    m_months.clear();
+    m_days.clear();
+    m_all.clear();
+}
+
+QStringList TagIndex::tags() const
+{
+    QStringList tags = m_tags.keys();
+    tags.sort();
+    return tags;
+}
+
+int TagIndex::rowCount(const QString& tag) const
+{
+    auto it = m_tags.constFind(tag);
+    return it != m_tags.constEnd() ? int(it->cardinality()) : 0;
+}
+
+const RoaringBitmap& TagIndex::allRows() const
+{
+    return m_all;
+}
+
+RoaringBitmap TagIndex::rowsWithTag(const QString& tag) const
+{
+    return m_tags.value(tag);
+}
+
+RoaringBitmap TagIndex::rowsInCategory(const QString& category) const
+{
+    return m_categories.value(category);
+}
+
+RoaringBitmap TagIndex::rowsOn(const QDate& day) const
+{
+    return m_days.value(day.toJulianDay());
+}
+
+RoaringBitmap TagIndex::rowsBetween(const QDate& first, const QDate& last) const
+{
+    RoaringBitmap rows;
+    if (m_months.isEmpty()) {
+        return rows;
+    }
+
+    // Clip open or far-off ends to the months that hold rows
+    const int firstKey = m_months.firstKey();
+    const int lastKey = m_months.lastKey();
+    const QDate earliest(firstKey / 12, firstKey % 12 + 1, 1);
+    const QDate latestMonth(lastKey / 12, lastKey % 12 + 1, 1);
+    const QDate latest(latestMonth.year(), latestMonth.month(), latestMonth.daysInMonth());
+    QDate day = first.isValid() ? qMax(first, earliest) : earliest;
+    const QDate end = last.isValid() ? qMin(last, latest) : latest;
+
+    while (day <= end) {
+        const QDate monthEnd(day.year(), day.month(), day.daysInMonth());
+        if (day.day() == 1 && monthEnd <= end) {
+            rows |= m_months.value(monthKey(day));
+            day = monthEnd.addDays(1);
+        } else {
+            rows |= m_days.value(day.toJulianDay());
+            day = day.addDays(1);
+        }
+    }
+    return rows;
+}
+
+bool TagIndex::evaluate(const QString& expression, RoaringBitmap* rows, QString* error) const
+{
+    const QStringList tokens = tokenize(expression);
+    if (tokens.isEmpty()) {
+        *rows = m_all;
+        return true;
+    }
+
+    ExpressionParser parser(*this, tokens);
+    if (!parser.parse(rows)) {
+        rows->clear();
+        if (error) {
+            *error = parser.error();
+        }
+        return false;
+    }
+    return true;
+}
+
+qint64 TagIndex::bytesUsed() const
+{
+    qint64 bytes = m_all.bytesUsed();
+    for (const auto* bitmaps : {&m_tags, &m_categories}) {
+        bytes += bitmaps->capacity() * qint64(sizeof(QString) + sizeof(RoaringBitmap));
+        for (const auto& rows : *bitmaps) {
+            bytes += rows.bytesUsed();
+        }
+    }
+    bytes += m_months.size() * qint64(sizeof(int) + sizeof(RoaringBitmap) + 3 * sizeof(void*));
+    for (const auto& rows : m_months) {
+        bytes += rows.bytesUsed();
+    }
+    bytes += m_days.capacity() * qint64(sizeof(qint64) + sizeof(RoaringBitmap));
+    for (const auto& rows : m_days) {
+        bytes += rows.bytesUsed();
+    }
+    return bytes;
+}
+
+int TagIndex::monthKey(const QDate& date)
+{
+    return date.year() * 12 + date.month() - 1;
+}
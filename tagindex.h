@@ -0,0 +1,60 @@
+#ifndef TAGINDEX_H
+#define TAGINDEX_H
+
+#include "roaringbitmap.h"
+#include "transaction.h"
+#include <QDate>
+#include <QHash>
+#include <QMap>
+#include <QStringList>
+
+// Bitmap indexes over the row sequence numbers of TransactionManager.
+//
+// Every tag, every category, every month and every day has a RoaringBitmap
+// of the rows that carry it, so a tag expression intersected with a date
+// range and a category is a handful of bitmap operations rather than a scan.
+// Date ranges use the month bitmaps for whole months and the day bitmaps at
+// the partial ends; dates are local, as in LedgerPartitions::monthKey().
+//
+// Expressions combine tags with AND, OR, NOT (case-insensitive) and
+// parentheses; NOT binds tightest, then AND, then OR, and two terms with
+// no operator between them are ANDed:
+//   reimbursable AND trip-2026 AND NOT refunded
+//   (出差 OR 会议) 可报销
+// An empty expression selects every row; a tag no row carries selects none.
+class TagIndex
+{
+public:
+    TagIndex() = default;
+
+    void addTransaction(quint32 sequence, const Transaction& transaction);
+    void removeTransaction(quint32 sequence, const Transaction& transaction);
+    void clear();
+
+    QStringList tags() const; // sorted
+    int rowCount(const QString& tag) const;
+
+    const RoaringBitmap& allRows() const;
+    RoaringBitmap rowsWithTag(const QString& tag) const;
+    RoaringBitmap rowsInCategory(const QString& category) const;
+    RoaringBitmap rowsOn(const QDate& day) const;
+    // Rows dated first through last; an invalid date leaves that end open.
+    // Undated rows are never included.
+    RoaringBitmap rowsBetween(const QDate& first, const QDate& last) const;
+
+    // False, with a message in error, when the expression does not parse
+    bool evaluate(const QString& expression, RoaringBitmap* rows, QString* error = nullptr) const;
+
+    qint64 bytesUsed() const; // estimated heap bytes
+
+private:
+    static int monthKey(const QDate& date);
+
+    QHash<QString, RoaringBitmap> m_tags;
+    QHash<QString, RoaringBitmap> m_categories;
+    QMap<int, RoaringBitmap> m_months;   // year * 12 + month - 1, ordered for range clipping
+    QHash<qint64, RoaringBitmap> m_days; // Julian day
+    RoaringBitmap m_all;
+};
+
+#endif // TAGINDEX_H
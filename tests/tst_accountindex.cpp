@@ -0,0 +1,145 @@
+#include "accountindex.h"
+#include <QRandomGenerator>
+#include <QTest>
+
+#include <limits>
+
+namespace {
+
+const qint64 kDay = 24 * 3600 * 1000;
+const qint64 kStart = QDateTime(QDate(2024, 3, 1), QTime(0, 0)).toMSecsSinceEpoch();
+
+Transaction move(double amount, const QString& from, const QString& to, qint64 timestamp)
+{
+    Transaction transaction(TransactionType::EXPENSE, amount, from, to, "转账", "银行卡");
+    transaction.setTimestampMSecs(timestamp);
+    return transaction;
+}
+
+// What balanceAt() should return, straight from the rows
+double expectedBalance(const QList<Transaction>& rows, const QString& account, qint64 timestamp)
+{
+    double balance = 0.0;
+    for (const auto& row : rows) {
+        if (row.getTimestampMSecs() > timestamp) {
+            continue;
+        }
+        if (row.getFromAccount() == account) {
+            balance -= row.getAmount();
+        }
+        if (row.getToAccount() == account) {
+            balance += row.getAmount();
+        }
+    }
+    return balance;
+}
+
+} // namespace
+
+class TestAccountIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void balances();
+    void statement();
+    void removal();
+    void growsBothWays();
+};
+
+void TestAccountIndex::balances()
+{
+    AccountIndex index;
+    index.addTransaction(0, move(100.0, "工资卡", "钱包", kStart + 9 * 3600 * 1000));
+    index.addTransaction(1, move(30.0, "钱包", "食堂", kStart + 12 * 3600 * 1000));
+    index.addTransaction(2, move(50.0, "工资卡", "钱包", kStart + 3 * kDay));
+
+    QCOMPARE(index.accounts(), QStringList({"工资卡", "钱包", "食堂"}));
+    QCOMPARE(index.balanceAt("钱包", kStart), 0.0);
+    QCOMPARE(index.balanceAt("钱包", kStart + 9 * 3600 * 1000), 100.0); // inclusive
+    QCOMPARE(index.balanceAt("钱包", kStart + 12 * 3600 * 1000 - 1), 100.0);
+    QCOMPARE(index.balanceAt("钱包", kStart + kDay), 70.0);
+    QCOMPARE(index.balanceAt("钱包", kStart + 10 * kDay), 120.0);
+    QCOMPARE(index.balanceAt("工资卡", kStart + 10 * kDay), -150.0);
+    QCOMPARE(index.balanceAt("不存在", kStart), 0.0);
+
+    // Undated rows have no place in time
+    Transaction undated = move(5.0, "钱包", "食堂", 0);
+    undated.setTimestampMSecs(Transaction::InvalidTimestamp);
+    index.addTransaction(3, undated);
+    QCOMPARE(index.balanceAt("钱包", kStart + 10 * kDay), 120.0);
+}
+
+void TestAccountIndex::statement()
+{
+    AccountIndex index;
+    index.addTransaction(0, move(100.0, "工资卡", "钱包", kStart));
+    index.addTransaction(1, move(30.0, "钱包", "食堂", kStart + kDay));
+    index.addTransaction(2, move(20.0, "钱包", "钱包", kStart + 2 * kDay)); // both sides
+    index.addTransaction(3, move(10.0, "钱包", "地铁", kStart + 3 * kDay));
+
+    const QList<AccountPosting> lines = index.statement("钱包", kStart + kDay, kStart + 2 * kDay);
+    QCOMPARE(int(lines.size()), 3);
+    QCOMPARE(lines.at(0).sequence, 1u);
+    QCOMPARE(lines.at(0).amount, -30.0);
+    QCOMPARE(lines.at(0).balance, 70.0); // carries the balance from before the range
+    QCOMPARE(lines.at(1).amount, -20.0);
+    QCOMPARE(lines.at(2).amount, 20.0);
+    QCOMPARE(lines.at(2).balance, 70.0);
+
+    const QList<AccountPosting> all = index.statement("钱包", std::numeric_limits<qint64>::min(),
+                                                      std::numeric_limits<qint64>::max());
+    QCOMPARE(int(all.size()), 5);
+    QCOMPARE(all.constLast().balance, 60.0);
+    QVERIFY(index.statement("钱包", kStart + kDay, kStart).isEmpty());
+    QVERIFY(index.statement("不存在", kStart, kStart + kDay).isEmpty());
+}
+
+void TestAccountIndex::removal()
+{
+    AccountIndex index;
+    const Transaction first = move(100.0, "工资卡", "钱包", kStart);
+    const Transaction second = move(30.0, "钱包", "食堂", kStart + kDay);
+    index.addTransaction(0, first);
+    index.addTransaction(1, second);
+
+    index.removeTransaction(1, second);
+    QCOMPARE(index.balanceAt("钱包", kStart + 2 * kDay), 100.0);
+    QCOMPARE(index.accounts(), QStringList({"工资卡", "钱包"})); // emptied accounts go
+
+    // Removing what was never added changes nothing
+    index.removeTransaction(7, second);
+    QCOMPARE(index.balanceAt("钱包", kStart + 2 * kDay), 100.0);
+
+    index.clear();
+    QVERIFY(index.accounts().isEmpty());
+    QCOMPARE(index.bytesUsed(), qint64(0));
+}
+
+// Rows arrive far before and after the days the tree was built for, and
+// across the epoch, so it is rebuilt several times
+void TestAccountIndex::growsBothWays()
+{
+    AccountIndex index;
+    QList<Transaction> rows;
+    QRandomGenerator random(42);
+    for (int i = 0; i < 400; ++i) {
+        const qint64 offset = qint64(random.bounded(-2000, 2000)) * kDay / 3 + random.bounded(1000);
+        const qint64 timestamp = (i % 2 == 0 ? kStart : 0) + (i < 200 ? offset / 50 : offset);
+        const QString from = i % 3 == 0 ? "工资卡" : "钱包";
+        rows.append(move(double(random.bounded(1, 500)), from, i % 5 == 0 ? "工资卡" : "商家", timestamp));
+        index.addTransaction(quint32(i), rows.constLast());
+    }
+    QVERIFY(index.rollupBytes() > 0);
+
+    for (int i = 0; i < 50; ++i) {
+        const qint64 at = qint64(random.bounded(-800, 800)) * kDay + random.bounded(int(kDay))
+                          + (i % 2 == 0 ? kStart : 0);
+        for (const QString& account : {QStringLiteral("工资卡"), QStringLiteral("钱包"), QStringLiteral("商家")}) {
+            QCOMPARE(index.balanceAt(account, at), expectedBalance(rows, account, at));
+        }
+    }
+}
+
+QTEST_APPLESS_MAIN(TestAccountIndex)
+#include "tst_accountindex.moc"
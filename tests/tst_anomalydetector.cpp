@@ -0,0 +1,174 @@
+#include "anomalydetector.h"
+#include <QTest>
+
+namespace {
+
+const QDateTime kStart(QDate(2024, 5, 1), QTime(12, 0));
+
+Transaction expense(double amount, const QDateTime& timestamp, const QString& payee = "食堂",
+                    const QString& category = "餐饮")
+{
+    return Transaction(TransactionType::EXPENSE, amount, "我的账户", payee, category, "支付宝", timestamp);
+}
+
+// A day apart, so neither duplicates nor bursts
+QList<Transaction> history()
+{
+    QList<Transaction> rows;
+    for (int i = 0; i < 10; ++i) {
+        rows.append(expense(20.0 + (i * 7) % 10, kStart.addDays(i)));
+    }
+    return rows;
+}
+
+void addAll(AnomalyDetector* detector, const QList<Transaction>& rows, quint32 firstSequence = 0)
+{
+    for (int i = 0; i < rows.size(); ++i) {
+        detector->addTransaction(firstSequence + quint32(i), rows.at(i));
+    }
+}
+
+} // namespace
+
+class TestAnomalyDetector : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void outlier();
+    void removalRestoresBaseline();
+    void duplicate();
+    void burst();
+    void oldRowIsNotBurst();
+    void incomeIsNotScored();
+};
+
+void TestAnomalyDetector::outlier()
+{
+    AnomalyDetector detector;
+    const QList<Transaction> rows = history();
+    addAll(&detector, rows);
+    QCOMPARE(detector.flaggedCount(), 0);
+
+    detector.addTransaction(100, expense(500.0, kStart.addDays(20)));
+    const AnomalyDetector::Anomaly anomaly = detector.anomaly(100);
+    QVERIFY(anomaly.flags.testFlag(AnomalyDetector::Outlier));
+    double mean = 0.0;
+    for (const auto& row : rows) {
+        mean += row.getAmount() / rows.size();
+    }
+    QCOMPARE(anomaly.typicalAmount, mean);
+    QCOMPARE(detector.flaggedRows(), QList<quint32>({100}));
+    QVERIFY(!AnomalyDetector::describe(anomaly, expense(500.0, kStart)).isEmpty());
+
+    detector.addTransaction(101, expense(40.0, kStart.addDays(21)));
+    QVERIFY(!detector.anomaly(101).isFlagged());
+}
+
+// Welford's update is reversed on removal, so a detector that saw a row come
+// and go scores the next one exactly as one that never saw it
+void TestAnomalyDetector::removalRestoresBaseline()
+{
+    const QList<Transaction> rows = history();
+    const Transaction spike = expense(400.0, kStart.addDays(15));
+    const Transaction next = expense(500.0, kStart.addDays(20));
+
+    AnomalyDetector edited;
+    addAll(&edited, rows);
+    edited.addTransaction(50, spike);
+    QVERIFY(edited.anomaly(50).isFlagged());
+    edited.removeTransaction(50, spike);
+    QCOMPARE(edited.flaggedCount(), 0);
+    edited.addTransaction(51, next);
+
+    AnomalyDetector fresh;
+    addAll(&fresh, rows);
+    fresh.addTransaction(51, next);
+
+    QVERIFY(edited.anomaly(51).flags == fresh.anomaly(51).flags);
+    QCOMPARE(edited.anomaly(51).typicalAmount, fresh.anomaly(51).typicalAmount);
+
+    // Below MinHistory rows again there is no baseline to compare with
+    AnomalyDetector shrunk;
+    addAll(&shrunk, rows);
+    for (int i = 0; i < rows.size() - AnomalyDetector::MinHistory + 1; ++i) {
+        shrunk.removeTransaction(quint32(i), rows.at(i));
+    }
+    shrunk.addTransaction(51, next);
+    QVERIFY(!shrunk.anomaly(51).isFlagged());
+
+    // Emptied baselines start over
+    for (int i = rows.size() - AnomalyDetector::MinHistory + 1; i < rows.size(); ++i) {
+        shrunk.removeTransaction(quint32(i), rows.at(i));
+    }
+    shrunk.removeTransaction(51, next);
+    addAll(&shrunk, rows, 60);
+    shrunk.addTransaction(70, next);
+    QCOMPARE(shrunk.anomaly(70).typicalAmount, fresh.anomaly(51).typicalAmount);
+}
+
+void TestAnomalyDetector::duplicate()
+{
+    AnomalyDetector detector;
+    detector.addTransaction(0, expense(35.0, kStart));
+    detector.addTransaction(1, expense(35.0, kStart.addSecs(10 * 60)));
+    detector.addTransaction(2, expense(35.0, kStart.addSecs(3 * 3600)));
+    detector.addTransaction(3, expense(36.0, kStart.addSecs(3 * 3600 + 60)));
+
+    QVERIFY(detector.anomaly(1).flags.testFlag(AnomalyDetector::Duplicate));
+    QVERIFY(!detector.anomaly(2).isFlagged());
+    QVERIFY(!detector.anomaly(3).isFlagged());
+
+    // Gone from the recent charges once removed
+    detector.removeTransaction(2, expense(35.0, kStart.addSecs(3 * 3600)));
+    detector.addTransaction(4, expense(35.0, kStart.addSecs(3 * 3600 + 120)));
+    QVERIFY(!detector.anomaly(4).isFlagged());
+}
+
+// Each charge a minute after the last: four leave the decayed count just
+// under BurstCount, five take it over
+void TestAnomalyDetector::burst()
+{
+    AnomalyDetector detector;
+    for (int i = 0; i < 6; ++i) {
+        detector.addTransaction(quint32(i), expense(10.0 + i, kStart.addSecs(i * 60), "自动售货机"));
+    }
+    for (int i = 0; i < 5; ++i) {
+        QVERIFY2(!detector.anomaly(quint32(i)).isFlagged(), qPrintable(QString::number(i)));
+    }
+    QVERIFY(detector.anomaly(5).flags.testFlag(AnomalyDetector::Burst));
+}
+
+// The decayed count describes the latest charge only; a row from well
+// before it is not judged by it
+void TestAnomalyDetector::oldRowIsNotBurst()
+{
+    AnomalyDetector detector;
+    for (int i = 0; i < 6; ++i) {
+        detector.addTransaction(quint32(i), expense(10.0 + i, kStart.addSecs(i * 60), "自动售货机"));
+    }
+    detector.addTransaction(10, expense(50.0, kStart.addDays(-3), "自动售货机"));
+    QVERIFY(!detector.anomaly(10).isFlagged());
+
+    // Within a half-life of the latest charge the check still applies
+    detector.addTransaction(11, expense(51.0, kStart.addSecs(4 * 60), "自动售货机"));
+    QVERIFY(detector.anomaly(11).flags.testFlag(AnomalyDetector::Burst));
+}
+
+void TestAnomalyDetector::incomeIsNotScored()
+{
+    AnomalyDetector detector;
+    addAll(&detector, history());
+    Transaction salary = expense(500.0, kStart.addDays(20));
+    salary.setType(TransactionType::INCOME);
+    detector.addTransaction(100, salary);
+    QVERIFY(!detector.anomaly(100).isFlagged());
+
+    detector.clear();
+    QCOMPARE(detector.flaggedCount(), 0);
+    detector.addTransaction(101, expense(500.0, kStart.addDays(20)));
+    QVERIFY(!detector.anomaly(101).isFlagged());
+}
+
+QTEST_APPLESS_MAIN(TestAnomalyDetector)
+#include "tst_anomalydetector.moc"
@@ -0,0 +1,226 @@
+#include "budgetengine.h"
+#include "ledgerpartitions.h"
+#include "transactionmanager.h"
+#include <QTemporaryDir>
+#include <QTest>
+
+namespace {
+
+const QDateTime kMay(QDate(2024, 5, 10), QTime(12, 0));
+
+Transaction expense(double amount, const QDateTime& timestamp = kMay, const QString& category = "餐饮")
+{
+    return Transaction(TransactionType::EXPENSE, amount, "我的账户", "商家", category, "支付宝", timestamp);
+}
+
+BudgetRule monthly(double threshold, const QString& category = QString())
+{
+    BudgetRule rule;
+    rule.category = category;
+    rule.threshold = threshold;
+    return rule;
+}
+
+// Collects what the engine emits
+struct Alerts {
+    explicit Alerts(BudgetEngine* engine)
+    {
+        QObject::connect(engine, &BudgetEngine::alertRaised, [this](const BudgetAlert& alert) {
+            raised.append(alert);
+        });
+        QObject::connect(engine, &BudgetEngine::alertCleared, [this](const BudgetAlert& alert) {
+            cleared.append(alert);
+        });
+    }
+
+    QList<BudgetAlert> raised;
+    QList<BudgetAlert> cleared;
+};
+
+} // namespace
+
+class TestBudgetEngine : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void monthlyCrossings();
+    void singleAmount();
+    void matching();
+    void rulesFile();
+    void managerAlerts();
+};
+
+// One alert per crossing, in either direction, and only once flushed
+void TestBudgetEngine::monthlyCrossings()
+{
+    BudgetEngine engine;
+    Alerts alerts(&engine);
+    engine.setRules({monthly(100.0)});
+    const QString may = LedgerPartitions::monthKey(kMay.toMSecsSinceEpoch());
+
+    const Transaction first = expense(60.0);
+    const Transaction second = expense(50.0, kMay.addDays(1));
+    engine.addTransaction(first);
+    engine.addTransaction(second);
+    engine.addTransaction(expense(10.0, kMay.addDays(2)));
+    QVERIFY(alerts.raised.isEmpty());
+    engine.flush();
+    QCOMPARE(int(alerts.raised.size()), 1);
+    QCOMPARE(alerts.raised.constFirst().rule, 0);
+    QCOMPARE(alerts.raised.constFirst().month, may);
+    QCOMPARE(alerts.raised.constFirst().amount, 110.0);
+    QCOMPARE(alerts.raised.constFirst().transaction.getUuid(), second.getUuid());
+    QVERIFY(engine.isExceeded(0, may));
+    QCOMPARE(engine.monthTotal(0, may), 120.0);
+
+    // Other months keep their own totals
+    engine.addTransaction(expense(90.0, kMay.addMonths(1)));
+    QVERIFY(!engine.isExceeded(0, LedgerPartitions::monthKey(kMay.addMonths(1).toMSecsSinceEpoch())));
+
+    engine.removeTransaction(second);
+    engine.removeTransaction(first);
+    engine.flush();
+    QCOMPARE(int(alerts.cleared.size()), 1);
+    QCOMPARE(alerts.cleared.constFirst().amount, 70.0);
+    QVERIFY(!engine.isExceeded(0, may));
+
+    // A threshold reached exactly is not exceeded
+    engine.addTransaction(expense(90.0));
+    QVERIFY(!engine.isExceeded(0, may));
+
+    // Dropped alerts are never emitted
+    engine.addTransaction(expense(1.0));
+    engine.discardPending();
+    engine.flush();
+    QCOMPARE(int(alerts.raised.size()), 1);
+    QVERIFY(engine.isExceeded(0, may));
+
+    engine.clearState();
+    QCOMPARE(engine.monthTotal(0, may), 0.0);
+    QVERIFY(!engine.isExceeded(0, may));
+    QCOMPARE(engine.monthTotal(5, may), 0.0);
+    QVERIFY(!engine.isExceeded(-1, may));
+}
+
+void TestBudgetEngine::singleAmount()
+{
+    BudgetEngine engine;
+    Alerts alerts(&engine);
+    BudgetRule rule;
+    rule.kind = BudgetRule::SingleAmount;
+    rule.threshold = 200.0;
+    engine.setRules({rule});
+
+    engine.addTransaction(expense(200.0));
+    Transaction undated = expense(300.0);
+    undated.setTimestampMSecs(Transaction::InvalidTimestamp);
+    engine.addTransaction(undated);
+    engine.removeTransaction(undated);
+    engine.flush();
+
+    // Any row, dated or not; removing it clears nothing
+    QCOMPARE(int(alerts.raised.size()), 1);
+    QCOMPARE(alerts.raised.constFirst().amount, 300.0);
+    QVERIFY(alerts.raised.constFirst().month.isEmpty());
+    QVERIFY(alerts.cleared.isEmpty());
+    QVERIFY(!rule.describe().isEmpty());
+}
+
+// Rows visit the rules for their category, the rules for every category
+// and only rules of their own type
+void TestBudgetEngine::matching()
+{
+    BudgetEngine engine;
+    BudgetRule salary = monthly(1000.0);
+    salary.type = TransactionType::INCOME;
+    engine.setRules({monthly(10.0, "餐饮"), monthly(10.0, "交通"), monthly(10.0), salary});
+    const QString may = LedgerPartitions::monthKey(kMay.toMSecsSinceEpoch());
+
+    engine.addTransaction(expense(20.0));
+    engine.addTransaction(expense(5.0, kMay, "购物"));
+    Transaction undated = expense(7.0);
+    undated.setTimestampMSecs(Transaction::InvalidTimestamp);
+    engine.addTransaction(undated);
+
+    QCOMPARE(engine.monthTotal(0, may), 20.0);
+    QCOMPARE(engine.monthTotal(1, may), 0.0);
+    QCOMPARE(engine.monthTotal(2, may), 25.0);
+    QCOMPARE(engine.monthTotal(3, may), 0.0);
+
+    // New rules start from nothing
+    engine.setRules({monthly(10.0)});
+    QCOMPARE(engine.monthTotal(0, may), 0.0);
+    QCOMPARE(int(engine.rules().size()), 1);
+    engine.setRules({});
+    QVERIFY(engine.isEmpty());
+    engine.addTransaction(expense(20.0));
+}
+
+void TestBudgetEngine::rulesFile()
+{
+    BudgetRule single;
+    single.kind = BudgetRule::SingleAmount;
+    single.type = TransactionType::INCOME;
+    single.threshold = 5000.5;
+    const QList<BudgetRule> rules = {monthly(800.0, "餐饮"), single};
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString path = directory.filePath("budgets.json");
+    QVERIFY(BudgetEngine::saveRules(path, rules));
+
+    bool ok = false;
+    const QList<BudgetRule> loaded = BudgetEngine::loadRules(path, &ok);
+    QVERIFY(ok);
+    QCOMPARE(int(loaded.size()), 2);
+    QVERIFY(loaded.at(0).kind == BudgetRule::MonthlyTotal);
+    QVERIFY(loaded.at(0).type == TransactionType::EXPENSE);
+    QCOMPARE(loaded.at(0).category, QString("餐饮"));
+    QCOMPARE(loaded.at(0).threshold, 800.0);
+    QVERIFY(loaded.at(1).kind == BudgetRule::SingleAmount);
+    QVERIFY(loaded.at(1).type == TransactionType::INCOME);
+    QVERIFY(loaded.at(1).category.isEmpty());
+    QCOMPARE(loaded.at(1).threshold, 5000.5);
+
+    QVERIFY(BudgetEngine::loadRules(directory.filePath("missing.json"), &ok).isEmpty());
+    QVERIFY(!ok);
+}
+
+// Edits, undo and redo alert; setting rules over existing rows does not
+void TestBudgetEngine::managerAlerts()
+{
+    TransactionManager manager;
+    QVERIFY(manager.addTransaction(expense(80.0)));
+    Alerts alerts(manager.budgetEngine());
+    manager.setBudgetRules({monthly(100.0, "餐饮")});
+    QCOMPARE(manager.budgetEngine()->monthTotal(0, LedgerPartitions::monthKey(kMay.toMSecsSinceEpoch())), 80.0);
+    QVERIFY(alerts.raised.isEmpty());
+
+    QVERIFY(manager.addTransaction(expense(30.0)));
+    QCOMPARE(int(alerts.raised.size()), 1);
+    QVERIFY(manager.undo());
+    QCOMPARE(int(alerts.cleared.size()), 1);
+    QVERIFY(manager.redo());
+    QCOMPARE(int(alerts.raised.size()), 2);
+
+    // Opening a ledger does not replay its history as alerts; the current
+    // month is resident once opened, so its rows reach the engine
+    const QDateTime now = QDateTime::currentDateTime();
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    {
+        TransactionManager writer;
+        QVERIFY(writer.addTransaction(expense(150.0, now)));
+        QVERIFY(writer.savePartitionedLedger(directory.path()));
+    }
+    TransactionManager reader;
+    Alerts readerAlerts(reader.budgetEngine());
+    reader.setBudgetRules({monthly(100.0, "餐饮")});
+    QVERIFY(reader.openPartitionedLedger(directory.path()));
+    QVERIFY(reader.budgetEngine()->isExceeded(0, LedgerPartitions::monthKey(now.toMSecsSinceEpoch())));
+    QVERIFY(readerAlerts.raised.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestBudgetEngine)
+#include "tst_budgetengine.moc"
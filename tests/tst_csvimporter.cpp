@@ -0,0 +1,249 @@
+#include "csvimporter.h"
+#include "transactionmanager.h"
+#include <QDir>
+#include <QFile>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QTest>
+
+namespace {
+
+// Quoted notes with line breaks, delimiters and doubled quotes, unquoted
+// notes with a stray quote, CRLF line ends and rows without an amount
+QByteArray sampleCsv(int rows)
+{
+    QByteArray data = "id,amount,to,note,timestamp\n";
+    for (int i = 0; i < rows; ++i) {
+        QByteArray note = "午餐";
+        if (i % 7 == 0) {
+            note = "\"第一行\n第二行, \"\"引号\"\"\"";
+        } else if (i % 11 == 0) {
+            note = "5\"寸屏";
+        }
+        const QByteArray amount = i % 13 == 0 ? "abc" : QByteArray::number(-1.0 - i * 0.25, 'f', 2);
+        data += "T" + QByteArray::number(i) + "," + amount + ",商家" + QByteArray::number(i % 5) + ","
+                + note + ",2024-03-" + QByteArray::number(1 + i % 28).rightJustified(2, '0') + " 12:30"
+                + (i % 3 == 0 ? "\r\n" : "\n");
+    }
+    return data;
+}
+
+bool writeFile(const QString& path, const QByteArray& data)
+{
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+} // namespace
+
+class TestCsvImporter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void fields();
+    void chunksMatchSinglePass_data();
+    void chunksMatchSinglePass();
+    void amounts_data();
+    void amounts();
+    void headerMapping();
+    void duplicateIdsAreReplaced();
+    void importCountsRows();
+    void importStopsAtRefusedBatch();
+};
+
+void TestCsvImporter::fields()
+{
+    CsvImporter importer;
+    QList<Transaction> rows;
+    QVERIFY(importer.parse(sampleCsv(14), &rows));
+    QCOMPARE(importer.rowsSkipped(), 2);
+    QCOMPARE(importer.rowsParsed(), 12);
+
+    const Transaction& quoted = rows.at(6); // i == 7
+    QCOMPARE(quoted.getNote(), QString("第一行\n第二行, \"引号\""));
+    QVERIFY(quoted.getType() == TransactionType::EXPENSE);
+    QCOMPARE(quoted.getAmount(), 2.75);
+    QCOMPARE(quoted.getToAccount(), QString("商家2"));
+    QCOMPARE(quoted.getTimestamp(), QDateTime(QDate(2024, 3, 8), QTime(12, 30)));
+    QCOMPARE(quoted.getUuid(), Transaction::foreignId("T7"));
+    QCOMPARE(rows.at(10).getNote(), QString("5\"寸屏")); // i == 11
+}
+
+void TestCsvImporter::chunksMatchSinglePass_data()
+{
+    QTest::addColumn<int>("chunkSize");
+    QTest::addColumn<int>("threads");
+    QTest::newRow("1 KiB, one thread") << 1024 << 1;
+    QTest::newRow("1 KiB, four threads") << 1024 << 4;
+    QTest::newRow("1.5 KiB, four threads") << 1536 << 4;
+    QTest::newRow("4 KiB, two threads") << 4096 << 2;
+}
+
+void TestCsvImporter::chunksMatchSinglePass()
+{
+    QFETCH(int, chunkSize);
+    QFETCH(int, threads);
+    const QByteArray data = sampleCsv(600);
+
+    CsvImporter whole;
+    whole.setThreadCount(1);
+    QList<Transaction> expected;
+    QVERIFY(whole.parse(data, &expected));
+
+    CsvImporter chunked;
+    chunked.setChunkSize(chunkSize);
+    chunked.setThreadCount(threads);
+    QList<Transaction> actual;
+    QVERIFY(chunked.parse(data, &actual));
+
+    QCOMPARE(chunked.rowsParsed(), whole.rowsParsed());
+    QCOMPARE(chunked.rowsSkipped(), whole.rowsSkipped());
+    QCOMPARE(actual.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        QCOMPARE(actual.at(i).getUuid(), expected.at(i).getUuid());
+        QCOMPARE(actual.at(i).getAmount(), expected.at(i).getAmount());
+        QCOMPARE(actual.at(i).getNote(), expected.at(i).getNote());
+        QCOMPARE(actual.at(i).getTimestampMSecs(), expected.at(i).getTimestampMSecs());
+    }
+}
+
+void TestCsvImporter::amounts_data()
+{
+    QTest::addColumn<QByteArray>("field");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<double>("amount");
+    QTest::addColumn<bool>("expense");
+    QTest::newRow("plain") << QByteArray("12.50") << true << 12.5 << false;
+    QTest::newRow("minus") << QByteArray("-12.50") << true << 12.5 << true;
+    QTest::newRow("symbol") << QByteArray("¥1,234.50") << true << 1234.5 << false;
+    QTest::newRow("leading minus") << QByteArray("-¥1,234.50") << true << 1234.5 << true;
+    QTest::newRow("trailing minus") << QByteArray("1,234.50-") << true << 1234.5 << true;
+    QTest::newRow("parentheses") << QByteArray("(12.00)") << true << 12.0 << true;
+    QTest::newRow("unit") << QByteArray("12.50 元") << true << 12.5 << false;
+    QTest::newRow("code") << QByteArray("USD 7") << true << 7.0 << false;
+    QTest::newRow("inner minus") << QByteArray("1-2") << false << 0.0 << false;
+    QTest::newRow("doubled minus") << QByteArray("--5") << false << 0.0 << false;
+    QTest::newRow("open parenthesis") << QByteArray("(12.00") << false << 0.0 << false;
+    QTest::newRow("close parenthesis") << QByteArray("12.00)") << false << 0.0 << false;
+    QTest::newRow("two points") << QByteArray("¥1.2.3") << false << 0.0 << false;
+    QTest::newRow("decimal comma") << QByteArray("¥1.234,56") << false << 0.0 << false;
+    QTest::newRow("two numbers") << QByteArray("¥12 34") << false << 0.0 << false;
+    QTest::newRow("no digits") << QByteArray("¥") << false << 0.0 << false;
+}
+
+void TestCsvImporter::amounts()
+{
+    QFETCH(QByteArray, field);
+    QFETCH(bool, valid);
+    QFETCH(double, amount);
+    QFETCH(bool, expense);
+
+    CsvImporter importer;
+    QList<Transaction> rows;
+    QVERIFY(importer.parse("amount\n\"" + field + "\"\n", &rows));
+    QCOMPARE(importer.rowsSkipped(), valid ? 0 : 1);
+    QCOMPARE(int(rows.size()), valid ? 1 : 0);
+    if (valid) {
+        QCOMPARE(rows.constFirst().getAmount(), amount);
+        QCOMPARE(rows.constFirst().getType() == TransactionType::EXPENSE, expense);
+    }
+}
+
+void TestCsvImporter::headerMapping()
+{
+    const CsvColumnMapping mapping = CsvColumnMapping::fromHeader(
+        {"交易时间", "交易对方", "商品", "收/支", "金额(元)", "支付方式", "交易单号"});
+    QCOMPARE(mapping.timestamp, 0);
+    QCOMPARE(mapping.toAccount, 1);
+    QCOMPARE(mapping.note, 2);
+    QCOMPARE(mapping.type, 3);
+    QCOMPARE(mapping.amount, 4);
+    QCOMPARE(mapping.method, 5);
+    QCOMPARE(mapping.id, 6);
+    QCOMPARE(mapping.category, -1);
+
+    CsvImporter importer;
+    QList<Transaction> rows;
+    QVERIFY(!importer.parse("date,note\n2024-01-01,x\n", &rows));
+    QVERIFY(!importer.errorString().isEmpty());
+}
+
+// Two rows with one id would share a key in the id index; the second gets a
+// fresh id and the signal reports the row as stored
+void TestCsvImporter::duplicateIdsAreReplaced()
+{
+    TransactionManager manager;
+    QList<QUuid> added;
+    connect(&manager, &TransactionManager::transactionAdded, this, [&added](const Transaction& transaction) {
+        added.append(transaction.getUuid());
+    });
+
+    const Transaction row(TransactionType::EXPENSE, 9.5, "我的账户", "便利店", "餐饮", "支付宝",
+                          QDateTime(QDate(2024, 3, 1), QTime(8, 0)));
+    QVERIFY(manager.addTransaction(row));
+    QVERIFY(manager.addTransaction(row));
+    QVERIFY(manager.addTransactions({row, row}));
+
+    QCOMPARE(manager.getTransactionCount(), 4);
+    QSet<QUuid> ids;
+    for (const auto& transaction : manager.getTransactions()) {
+        ids.insert(transaction.getUuid());
+    }
+    QCOMPARE(ids.size(), qsizetype(4));
+    QVERIFY(ids.contains(row.getUuid()));
+    QCOMPARE(added.size(), qsizetype(2));
+    QCOMPARE(added.at(0), row.getUuid());
+    QVERIFY(added.at(1) != row.getUuid());
+    QVERIFY(ids.contains(added.at(1)));
+}
+
+void TestCsvImporter::importCountsRows()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString path = directory.filePath("import.csv");
+    QVERIFY(writeFile(path, sampleCsv(100)));
+
+    TransactionManager manager;
+    CsvImporter importer;
+    importer.setBatchSize(30);
+    QVERIFY(importer.importFile(path, &manager));
+    QCOMPARE(importer.rowsAdded(), importer.rowsParsed());
+    QCOMPARE(manager.getTransactionCount(), importer.rowsAdded());
+
+    // Everything again is a duplicate
+    QVERIFY(importer.importFile(path, &manager));
+    QCOMPARE(importer.rowsAdded(), 0);
+    QCOMPARE(int(importer.duplicates().size()), importer.rowsParsed());
+}
+
+// A partition the manager cannot read refuses the batch that needs it
+void TestCsvImporter::importStopsAtRefusedBatch()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString ledger = directory.filePath("ledger");
+    {
+        TransactionManager writer;
+        QVERIFY(writer.addTransaction(Transaction(TransactionType::EXPENSE, 5.0, "我的账户", "商家", "餐饮",
+                                                  "现金", QDateTime(QDate(2024, 3, 2), QTime(9, 0)))));
+        QVERIFY(writer.savePartitionedLedger(ledger));
+    }
+    QVERIFY(writeFile(QDir(ledger).filePath("2024-03.mtla"), "damaged"));
+
+    TransactionManager manager;
+    QVERIFY(manager.openPartitionedLedger(ledger));
+    const QString path = directory.filePath("import.csv");
+    QVERIFY(writeFile(path, sampleCsv(20)));
+
+    CsvImporter importer;
+    QVERIFY(!importer.importFile(path, &manager));
+    QCOMPARE(importer.errorString(), manager.errorString());
+    QVERIFY(!importer.errorString().isEmpty());
+    QCOMPARE(importer.rowsAdded(), 0);
+    QVERIFY(!manager.canUndo());
+}
+
+QTEST_GUILESS_MAIN(TestCsvImporter)
+#include "tst_csvimporter.moc"
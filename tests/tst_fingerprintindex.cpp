@@ -0,0 +1,198 @@
+#include "bloomfilter.h"
+#include "fingerprintindex.h"
+#include "transactionmanager.h"
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QTest>
+
+namespace {
+
+const qint64 kNewYear = 1704067200000; // 2024-01-01T00:00:00Z
+
+Transaction lunch(double amount = 12.34)
+{
+    Transaction transaction(TransactionType::EXPENSE, amount, "我的账户", "食堂", "餐饮", "现金");
+    transaction.setTimestampMSecs(kNewYear);
+    return transaction;
+}
+
+// Spread-out keys, as transactionFingerprint() produces
+quint64 key(quint64 i)
+{
+    quint64 x = i + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+} // namespace
+
+class TestFingerprintIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void fingerprintFields();
+    void fingerprintIsStable();
+    void multiset();
+    void bloomFilter();
+    void bloomFilterBytes();
+    void duplicatesInBatch();
+    void duplicatesInColdMonth();
+};
+
+void TestFingerprintIndex::fingerprintFields()
+{
+    const Transaction row = lunch();
+    const quint64 fingerprint = transactionFingerprint(row);
+
+    // Left out: the id, category and note, and anything below a cent
+    Transaction same = lunch();
+    same.setCategory("其他");
+    same.setNote("两份");
+    QVERIFY(same.getUuid() != row.getUuid());
+    QCOMPARE(transactionFingerprint(same), fingerprint);
+    QCOMPARE(transactionFingerprint(lunch(12.341)), fingerprint);
+
+    QVERIFY(transactionFingerprint(lunch(12.35)) != fingerprint);
+    Transaction other = lunch();
+    other.setType(TransactionType::INCOME);
+    QVERIFY(transactionFingerprint(other) != fingerprint);
+    other = lunch();
+    other.setTimestampMSecs(kNewYear + 1);
+    QVERIFY(transactionFingerprint(other) != fingerprint);
+    other = lunch();
+    other.setMethod("支付宝");
+    QVERIFY(transactionFingerprint(other) != fingerprint);
+
+    // Fields are length-prefixed, so text moving between them shows
+    other = lunch();
+    other.setFromAccount("我的账户食");
+    other.setToAccount("堂");
+    QVERIFY(transactionFingerprint(other) != fingerprint);
+}
+
+// Partition manifests store filters built from these values
+void TestFingerprintIndex::fingerprintIsStable()
+{
+    if (QSysInfo::ByteOrder != QSysInfo::LittleEndian) {
+        QSKIP("The reference value was computed on a little-endian machine");
+    }
+    QCOMPARE(transactionFingerprint(lunch()), Q_UINT64_C(0x6422ea69548e4eb0));
+}
+
+void TestFingerprintIndex::multiset()
+{
+    FingerprintIndex index;
+    index.add(1);
+    index.add(1);
+    index.add(2);
+    QCOMPARE(index.count(1), 2);
+    QCOMPARE(index.count(3), 0);
+
+    index.remove(1);
+    QCOMPARE(index.count(1), 1);
+    index.remove(1);
+    index.remove(1); // not held any more
+    QCOMPARE(index.count(1), 0);
+    QCOMPARE(index.count(2), 1);
+    QVERIFY(index.bytesUsed() > 0);
+
+    index.clear();
+    QCOMPARE(index.count(2), 0);
+}
+
+void TestFingerprintIndex::bloomFilter()
+{
+    const int keys = 10000;
+    BloomFilter filter(keys, 0.01);
+    QVERIFY(!filter.isEmpty());
+    for (int i = 0; i < keys; ++i) {
+        filter.add(key(i));
+    }
+    for (int i = 0; i < keys; ++i) {
+        QVERIFY(filter.mightContain(key(i)));
+    }
+
+    int falsePositives = 0;
+    const int probes = 100000;
+    for (int i = 0; i < probes; ++i) {
+        falsePositives += filter.mightContain(key(keys + i)) ? 1 : 0;
+    }
+    QVERIFY2(falsePositives < probes / 50, qPrintable(QString::number(falsePositives)));
+
+    // Without information every key might be present
+    BloomFilter none;
+    QVERIFY(none.isEmpty());
+    QVERIFY(none.mightContain(key(0)));
+    none.add(key(0));
+    QVERIFY(none.isEmpty());
+}
+
+void TestFingerprintIndex::bloomFilterBytes()
+{
+    BloomFilter filter(100, 0.01);
+    for (int i = 0; i < 100; ++i) {
+        filter.add(key(i));
+    }
+    const BloomFilter copy = BloomFilter::fromByteArray(filter.toByteArray());
+    QCOMPARE(copy.toByteArray(), filter.toByteArray());
+    for (int i = 0; i < 1000; ++i) {
+        QCOMPARE(copy.mightContain(key(i)), filter.mightContain(key(i)));
+    }
+
+    // Old manifests have no filter; damaged ones are treated the same way
+    QVERIFY(BloomFilter().toByteArray().isEmpty());
+    QVERIFY(BloomFilter::fromByteArray(QByteArray()).isEmpty());
+    QVERIFY(BloomFilter::fromByteArray(QByteArray("\x00\xff", 2)).isEmpty());
+    QVERIFY(BloomFilter::fromByteArray(QByteArray("\x11\xff", 2)).isEmpty());
+    QVERIFY(BloomFilter::fromByteArray(QByteArray("\x03", 1)).isEmpty());
+}
+
+// A row is new once the batch holds more of its content than the ledger
+void TestFingerprintIndex::duplicatesInBatch()
+{
+    TransactionManager manager;
+    QVERIFY(manager.addTransaction(lunch()));
+
+    QList<Transaction> duplicates;
+    const QList<Transaction> fresh = manager.filterDuplicates({lunch(), lunch(), lunch(20.0)}, &duplicates);
+    QCOMPARE(int(fresh.size()), 2);
+    QCOMPARE(int(duplicates.size()), 1);
+    QCOMPARE(fresh.constLast().getAmount(), 20.0);
+
+    QCOMPARE(manager.addNewTransactions({lunch(), lunch()}), 1);
+    QCOMPARE(manager.getTransactionCount(), 2);
+    QCOMPARE(manager.addNewTransactions({lunch(), lunch()}), 0);
+
+    // Deleted rows no longer count
+    QVERIFY(manager.deleteTransaction(manager.getTransactions().constFirst().getId()));
+    QCOMPARE(manager.addNewTransactions({lunch(), lunch()}), 1);
+}
+
+// Cold months are asked through their filters and read only on a hit,
+// without becoming resident
+void TestFingerprintIndex::duplicatesInColdMonth()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    {
+        TransactionManager writer;
+        QVERIFY(writer.addTransaction(lunch()));
+        QVERIFY(writer.savePartitionedLedger(directory.path()));
+    }
+
+    TransactionManager manager;
+    QVERIFY(manager.openPartitionedLedger(directory.path()));
+    const int cold = manager.coldMonthCount();
+    QVERIFY(cold > 0);
+
+    QList<Transaction> duplicates;
+    const QList<Transaction> fresh = manager.filterDuplicates({lunch(), lunch(), lunch(20.0)}, &duplicates);
+    QCOMPARE(int(duplicates.size()), 1);
+    QCOMPARE(int(fresh.size()), 2);
+    QCOMPARE(manager.coldMonthCount(), cold);
+}
+
+QTEST_GUILESS_MAIN(TestFingerprintIndex)
+#include "tst_fingerprintindex.moc"
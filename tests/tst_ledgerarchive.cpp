@@ -0,0 +1,161 @@
+#include "ledgerarchive.h"
+#include <QBuffer>
+#include <QTest>
+#include <QtEndian>
+
+namespace {
+
+// Both types, notes that need escaping in other formats, tags, an undated
+// row and one amount that is not whole cents
+QList<Transaction> sampleRows()
+{
+    const QDateTime start(QDate(2024, 1, 31), QTime(23, 59, 59));
+    QList<Transaction> rows;
+    for (int i = 0; i < 10; ++i) {
+        rows.append(Transaction(i % 3 == 0 ? TransactionType::INCOME : TransactionType::EXPENSE, 12.5 + i,
+                                "我的账户", QString("商家%1").arg(i % 4), i % 2 ? "餐饮" : "交通", "支付宝",
+                                start.addSecs(qint64(i) * 3600)));
+    }
+    rows[3].setNote("含,逗号\n和换行");
+    rows[4].setTags({"出差", "可报销"});
+    rows[5].setTimestampMSecs(Transaction::InvalidTimestamp);
+    rows[6].setAmount(0.125);
+    return rows;
+}
+
+QByteArray encode(const QList<Transaction>& rows, int blockSize)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    LedgerArchiveWriter writer(&buffer, blockSize);
+    bool ok = writer.open();
+    for (const auto& row : rows) {
+        ok = ok && writer.append(row);
+    }
+    return ok && writer.finish() ? data : QByteArray();
+}
+
+bool decode(QByteArray data, QList<Transaction>* rows, int* blocks = nullptr)
+{
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    LedgerArchiveReader reader(&buffer);
+    if (!reader.open()) {
+        return false;
+    }
+    ArchiveBlockInfo info;
+    while (reader.nextBlock(&info)) {
+        if (!reader.readBlock(rows)) {
+            return false;
+        }
+        if (blocks) {
+            ++*blocks;
+        }
+    }
+    return !reader.hasError();
+}
+
+} // namespace
+
+class TestLedgerArchive : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void blockHeaders();
+    void rejectsRowCountBeyondPayload();
+    void rejectsUnknownType();
+    void rejectsTruncatedPayload();
+};
+
+void TestLedgerArchive::roundTrip_data()
+{
+    QTest::addColumn<int>("blockSize");
+    QTest::newRow("one row per block") << 1;
+    QTest::newRow("partial last block") << 4;
+    QTest::newRow("single block") << LedgerArchive::DefaultBlockSize;
+}
+
+void TestLedgerArchive::roundTrip()
+{
+    QFETCH(int, blockSize);
+    const QList<Transaction> rows = sampleRows();
+    const QByteArray data = encode(rows, blockSize);
+    QVERIFY(!data.isEmpty());
+
+    QList<Transaction> decoded;
+    QVERIFY(decode(data, &decoded));
+    QCOMPARE(decoded.size(), rows.size());
+    for (int i = 0; i < rows.size(); ++i) {
+        const Transaction& expected = rows.at(i);
+        const Transaction& actual = decoded.at(i);
+        QCOMPARE(actual.getUuid(), expected.getUuid());
+        QVERIFY(actual.getType() == expected.getType());
+        QCOMPARE(actual.getAmount(), expected.getAmount());
+        QCOMPARE(actual.getFromAccount(), expected.getFromAccount());
+        QCOMPARE(actual.getToAccount(), expected.getToAccount());
+        QCOMPARE(actual.getCategory(), expected.getCategory());
+        QCOMPARE(actual.getMethod(), expected.getMethod());
+        QCOMPARE(actual.getNote(), expected.getNote());
+        QCOMPARE(actual.getTags(), expected.getTags());
+        QCOMPARE(actual.getTimestampMSecs(), expected.getTimestampMSecs());
+    }
+}
+
+void TestLedgerArchive::blockHeaders()
+{
+    QByteArray data = encode(sampleRows(), 4);
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    LedgerArchiveReader reader(&buffer);
+    QVERIFY(reader.open());
+
+    QList<quint32> counts;
+    quint32 invalid = 0;
+    ArchiveBlockInfo info;
+    while (reader.nextBlock(&info)) {
+        counts.append(info.rowCount);
+        invalid += info.invalidTimestamps;
+        QVERIFY(reader.skipBlock());
+    }
+    QVERIFY(!reader.hasError());
+    QCOMPARE(counts, QList<quint32>({4, 4, 2}));
+    QCOMPARE(invalid, quint32(1));
+}
+
+// The file header is magic, version and flags (8 bytes); the first block
+// header starts with its row count
+void TestLedgerArchive::rejectsRowCountBeyondPayload()
+{
+    QByteArray data = encode(sampleRows(), LedgerArchive::DefaultBlockSize);
+    QVERIFY(data.size() > 12);
+    qToBigEndian<quint32>(0x10000000u, data.data() + 8);
+
+    QList<Transaction> decoded;
+    QVERIFY(!decode(data, &decoded));
+    QVERIFY(decoded.isEmpty());
+}
+
+void TestLedgerArchive::rejectsUnknownType()
+{
+    QList<Transaction> rows = sampleRows();
+    rows[2].setType(static_cast<TransactionType>(7));
+
+    QList<Transaction> decoded;
+    QVERIFY(!decode(encode(rows, LedgerArchive::DefaultBlockSize), &decoded));
+}
+
+void TestLedgerArchive::rejectsTruncatedPayload()
+{
+    QByteArray data = encode(sampleRows(), LedgerArchive::DefaultBlockSize);
+    data.chop(5);
+
+    QList<Transaction> decoded;
+    QVERIFY(!decode(data, &decoded));
+}
+
+QTEST_APPLESS_MAIN(TestLedgerArchive)
+#include "tst_ledgerarchive.moc"
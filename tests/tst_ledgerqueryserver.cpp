@@ -0,0 +1,360 @@
+#include "ledgerqueryserver.h"
+#include "transactionmanager.h"
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QLocalSocket>
+#include <QTest>
+#include <QThread>
+#include <QTimer>
+#include <QtEndian>
+
+namespace {
+
+const QDateTime kMay(QDate(2024, 5, 1), QTime(12, 0));
+
+Transaction row(TransactionType type, double amount, const QString& category, const QDateTime& timestamp,
+                const QString& note = QString())
+{
+    Transaction transaction(type, amount, "我的账户", "商家", category, "支付宝", timestamp);
+    transaction.setNote(note);
+    return transaction;
+}
+
+Transaction transfer(TransactionType type, const QDateTime& timestamp)
+{
+    return Transaction(type, 500.0, "我的账户", "储蓄卡", "转账", "银行卡", timestamp);
+}
+
+LedgerQuery inMay(LedgerQuery::Op op)
+{
+    LedgerQuery query;
+    query.op = op;
+    query.startMSecs = kMay.toMSecsSinceEpoch();
+    query.endMSecs = kMay.addMonths(1).toMSecsSinceEpoch() - 1;
+    return query;
+}
+
+// Runs a blocking client on its own thread while this one serves it;
+// false if it did not finish within msecs
+template <typename Function>
+bool runClient(Function function, int msecs = 20000)
+{
+    QThread* thread = QThread::create(function);
+    QEventLoop loop;
+    QObject::connect(thread, &QThread::finished, &loop, &QEventLoop::quit);
+    QTimer::singleShot(msecs, &loop, &QEventLoop::quit);
+    thread->start();
+    loop.exec();
+    const bool finished = thread->wait(1000);
+    if (finished) {
+        delete thread;
+    }
+    return finished;
+}
+
+} // namespace
+
+class TestLedgerQueryServer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void matches();
+    void streamRoundTrip();
+    void readRejects();
+    void answers();
+    void pipelined();
+    void badRequests();
+    void secondServer();
+
+private:
+    TransactionManager m_manager;
+    QList<Transaction> m_rows;
+    QString m_name;
+    std::unique_ptr<LedgerQueryServer> m_server;
+};
+
+void TestLedgerQueryServer::initTestCase()
+{
+    m_rows = {
+        row(TransactionType::EXPENSE, 30.0, "餐饮", kMay, "午餐"),
+        row(TransactionType::EXPENSE, 200.0, "购物", kMay.addDays(9), "Shoes"),
+        row(TransactionType::INCOME, 1000.0, "工资", kMay.addDays(14)),
+        transfer(TransactionType::EXPENSE, kMay.addDays(19)),
+        transfer(TransactionType::INCOME, kMay.addDays(19).addSecs(3600)),
+        row(TransactionType::EXPENSE, 40.0, "餐饮", kMay.addMonths(1), "晚餐"),
+    };
+    m_rows[1].setTags({"鞋"});
+    QVERIFY(m_manager.addTransactions(m_rows));
+    QCOMPARE(m_manager.getTransferPairCount(), 1);
+
+    m_name = QString("tst_ledgerqueryserver-%1").arg(QCoreApplication::applicationPid());
+    m_server.reset(new LedgerQueryServer(&m_manager));
+    QVERIFY2(m_server->listen(m_name), qPrintable(m_server->errorString()));
+    QVERIFY(m_server->isListening());
+}
+
+void TestLedgerQueryServer::matches()
+{
+    const Transaction lunch = m_rows.at(0);
+    LedgerQuery query;
+    QVERIFY(query.matches(lunch));
+
+    // Both ends of the range are inclusive
+    query.startMSecs = lunch.getTimestampMSecs();
+    query.endMSecs = lunch.getTimestampMSecs();
+    QVERIFY(query.matches(lunch));
+    query.startMSecs = lunch.getTimestampMSecs() + 1;
+    QVERIFY(!query.matches(lunch));
+
+    query = LedgerQuery();
+    query.minAmount = 30.0;
+    query.maxAmount = 30.0;
+    QVERIFY(query.matches(lunch));
+    query.minAmount = 30.01;
+    QVERIFY(!query.matches(lunch));
+
+    query = LedgerQuery();
+    query.category = "餐饮";
+    QVERIFY(query.matches(lunch));
+    query.category = "餐";
+    QVERIFY(!query.matches(lunch));
+
+    // Text looks at the note, both accounts and the category, not the method
+    query = LedgerQuery();
+    for (const QString& text : {"午餐", "我的", "商家", "饮"}) {
+        query.text = text;
+        QVERIFY2(query.matches(lunch), qPrintable(text));
+    }
+    query.text = "支付宝";
+    QVERIFY(!query.matches(lunch));
+    query.text = "shoes";
+    QVERIFY(query.matches(m_rows.at(1)));
+}
+
+void TestLedgerQueryServer::streamRoundTrip()
+{
+    LedgerQuery query = inMay(LedgerQuery::Export);
+    query.minAmount = 1.5;
+    query.maxAmount = 999.0;
+    query.category = "餐饮";
+    query.text = "午";
+    query.excludeTransfers = true;
+    query.limit = 7;
+    query.format = LedgerExporter::Archive;
+
+    QByteArray bytes;
+    {
+        QDataStream stream(&bytes, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_6_0);
+        query.write(stream);
+    }
+    QDataStream stream(bytes);
+    stream.setVersion(QDataStream::Qt_6_0);
+    LedgerQuery copy;
+    QVERIFY(copy.read(stream));
+    QVERIFY(copy.op == query.op);
+    QCOMPARE(copy.startMSecs, query.startMSecs);
+    QCOMPARE(copy.endMSecs, query.endMSecs);
+    QCOMPARE(copy.minAmount, query.minAmount);
+    QCOMPARE(copy.maxAmount, query.maxAmount);
+    QCOMPARE(copy.category, query.category);
+    QCOMPARE(copy.text, query.text);
+    QCOMPARE(copy.excludeTransfers, query.excludeTransfers);
+    QCOMPARE(copy.limit, query.limit);
+    QVERIFY(copy.format == query.format);
+    QVERIFY(stream.atEnd());
+}
+
+void TestLedgerQueryServer::readRejects()
+{
+    auto encoded = [](const LedgerQuery& query) {
+        QByteArray bytes;
+        QDataStream stream(&bytes, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_6_0);
+        query.write(stream);
+        return bytes;
+    };
+    auto readBack = [](const QByteArray& bytes) {
+        QDataStream stream(bytes);
+        stream.setVersion(QDataStream::Qt_6_0);
+        LedgerQuery query;
+        return query.read(stream);
+    };
+
+    const QByteArray good = encoded(inMay(LedgerQuery::Filter));
+    QVERIFY(readBack(good));
+    QVERIFY(!readBack(good.left(good.size() - 1)));
+    QVERIFY(!readBack(QByteArray()));
+
+    QByteArray badOp = good;
+    badOp[0] = char(LedgerQuery::Export + 1);
+    QVERIFY(!readBack(badOp));
+
+    LedgerQuery badFormat;
+    badFormat.format = LedgerExporter::Format(LedgerExporter::Archive + 1);
+    QVERIFY(!readBack(encoded(badFormat)));
+}
+
+void TestLedgerQueryServer::answers()
+{
+    LedgerQueryResult ping;
+    LedgerQueryResult withTransfers;
+    LedgerQueryResult withoutTransfers;
+    LedgerQueryResult limited;
+    LedgerQueryResult byText;
+    LedgerQueryResult exported;
+    bool ok = false;
+    QVERIFY(runClient([&]() {
+        LedgerQueryClient client;
+        if (!client.connectToServer(m_name)) {
+            return;
+        }
+        const LedgerQuery statistics = inMay(LedgerQuery::Statistics);
+        LedgerQuery spending = statistics;
+        spending.excludeTransfers = true;
+        LedgerQuery filter;
+        filter.op = LedgerQuery::Filter;
+        filter.category = "餐饮";
+        filter.limit = 1;
+        LedgerQuery text;
+        text.op = LedgerQuery::Filter;
+        text.text = "SHOES";
+        LedgerQuery exportAll;
+        exportAll.op = LedgerQuery::Export;
+
+        ok = client.query(LedgerQuery(), &ping)
+             && client.query(statistics, &withTransfers)
+             && client.query(spending, &withoutTransfers)
+             && client.query(filter, &limited)
+             && client.query(text, &byText)
+             && client.query(exportAll, &exported);
+        client.disconnectFromServer();
+    }));
+    QVERIFY(ok);
+
+    QVERIFY(ping.status == LedgerQueryResult::Ok);
+    QVERIFY(ping.op == LedgerQuery::Ping);
+
+    QCOMPARE(withTransfers.matched, 5);
+    QCOMPARE(withTransfers.income, 1500.0);
+    QCOMPARE(withTransfers.expense, 730.0);
+    QCOMPARE(withoutTransfers.matched, 3);
+    QCOMPARE(withoutTransfers.income, 1000.0);
+    QCOMPARE(withoutTransfers.expense, 230.0);
+    QCOMPARE(withoutTransfers.expenseByCategory.keys(), QStringList({"购物", "餐饮"}));
+    QCOMPARE(withoutTransfers.expenseByCategory.value("购物"), 200.0);
+
+    // The limit caps the rows, not the count; rows come in insertion order
+    QCOMPARE(limited.matched, 2);
+    QCOMPARE(int(limited.rows.size()), 1);
+    QCOMPARE(limited.rows.constFirst().getUuid(), m_rows.at(0).getUuid());
+
+    QCOMPARE(byText.matched, 1);
+    QCOMPARE(int(byText.rows.size()), 1);
+    const Transaction& shoes = byText.rows.constFirst();
+    const Transaction& expected = m_rows.at(1);
+    QCOMPARE(shoes.getUuid(), expected.getUuid());
+    QCOMPARE(shoes.getTimestampMSecs(), expected.getTimestampMSecs());
+    QCOMPARE(shoes.getAmount(), expected.getAmount());
+    QVERIFY(shoes.getType() == expected.getType());
+    QCOMPARE(shoes.getFromAccount(), expected.getFromAccount());
+    QCOMPARE(shoes.getToAccount(), expected.getToAccount());
+    QCOMPARE(shoes.getCategory(), expected.getCategory());
+    QCOMPARE(shoes.getMethod(), expected.getMethod());
+    QCOMPARE(shoes.getNote(), expected.getNote());
+    QCOMPARE(shoes.getTags(), expected.getTags());
+
+    QCOMPARE(exported.matched, int(m_rows.size()));
+    QVERIFY(exported.document.contains("Shoes"));
+}
+
+// Responses come back in request order whatever order the pool finishes in
+void TestLedgerQueryServer::pipelined()
+{
+    const int requests = LedgerQueryServer::MaxPipelined * 2;
+    QList<LedgerQueryResult> results;
+    QList<quint32> ids;
+    bool ok = false;
+    const quint64 before = m_server->requestsAnswered();
+    QVERIFY(runClient([&]() {
+        LedgerQueryClient client;
+        if (!client.connectToServer(m_name)) {
+            return;
+        }
+        for (int i = 0; i < requests; ++i) {
+            ids.append(client.send(i % 3 == 0 ? LedgerQuery() : inMay(LedgerQuery::Op(1 + i % 3))));
+        }
+        ok = true;
+        for (int i = 0; i < requests && ok; ++i) {
+            LedgerQueryResult result;
+            ok = client.receive(&result);
+            results.append(result);
+        }
+    }));
+    QVERIFY(ok);
+    for (int i = 0; i < requests; ++i) {
+        QCOMPARE(results.at(i).id, ids.at(i));
+        QVERIFY(results.at(i).status == LedgerQueryResult::Ok);
+    }
+    QCOMPARE(m_server->requestsAnswered(), before + requests);
+}
+
+void TestLedgerQueryServer::badRequests()
+{
+    // A request the server cannot read is answered, and the connection
+    // stays usable
+    LedgerQueryResult bad;
+    LedgerQueryResult after;
+    bool ok = false;
+    QVERIFY(runClient([&]() {
+        LedgerQueryClient client;
+        if (!client.connectToServer(m_name)) {
+            return;
+        }
+        LedgerQuery query;
+        query.op = LedgerQuery::Export;
+        query.format = LedgerExporter::Format(LedgerExporter::Archive + 1);
+        ok = client.query(query, &bad) && client.query(LedgerQuery(), &after);
+    }));
+    QVERIFY(ok);
+    QVERIFY(bad.status == LedgerQueryResult::BadRequest);
+    QVERIFY(!bad.errorString.isEmpty());
+    QVERIFY(after.status == LedgerQueryResult::Ok);
+
+    // An oversized frame closes the connection
+    bool dropped = false;
+    QVERIFY(runClient([&]() {
+        QLocalSocket socket;
+        socket.connectToServer(m_name);
+        if (!socket.waitForConnected(5000)) {
+            return;
+        }
+        char header[4];
+        qToBigEndian<quint32>(LedgerQueryServer::MaxRequestBytes + 1, header);
+        socket.write(header, sizeof(header));
+        socket.flush();
+        dropped = socket.state() == QLocalSocket::UnconnectedState || socket.waitForDisconnected(5000);
+    }));
+    QVERIFY(dropped);
+    QTRY_COMPARE(m_server->clientCount(), 0);
+}
+
+// A name another server answers on is not taken over
+void TestLedgerQueryServer::secondServer()
+{
+    LedgerQueryServer other(&m_manager);
+    QVERIFY(!other.listen(m_name));
+    QVERIFY(!other.errorString().isEmpty());
+    QVERIFY(m_server->isListening());
+
+    // A closed server frees the name
+    m_server->close();
+    QVERIFY(!m_server->isListening());
+    QVERIFY2(other.listen(m_name), qPrintable(other.errorString()));
+    other.close();
+}
+
+QTEST_GUILESS_MAIN(TestLedgerQueryServer)
+#include "tst_ledgerqueryserver.moc"
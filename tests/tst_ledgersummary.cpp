@@ -0,0 +1,136 @@
+#include "ledgersummary.h"
+#include "transactionmanager.h"
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+namespace {
+
+void fillLedger(TransactionManager* manager)
+{
+    const QDateTime start(QDate(2024, 2, 27), QTime(9, 0));
+    for (int i = 0; i < 20; ++i) {
+        manager->addTransaction(Transaction(i % 4 == 0 ? TransactionType::INCOME : TransactionType::EXPENSE,
+                                            10.0 + i, "我的账户", "商家", i % 2 ? "餐饮" : "交通", "支付宝",
+                                            start.addDays(i)));
+    }
+    Transaction undated(TransactionType::EXPENSE, 3.0, "我的账户", "商家", "餐饮", "现金");
+    undated.setTimestampMSecs(Transaction::InvalidTimestamp);
+    manager->addTransaction(undated);
+}
+
+LedgerSummary summarize(const TransactionManager& manager)
+{
+    return LedgerSummary::compute(manager.snapshot(), &manager.transferMatcher().pairedRows());
+}
+
+void compareCells(const QMap<QString, CubeCell>& actual, const QMap<QString, CubeCell>& expected)
+{
+    QCOMPARE(actual.keys(), expected.keys());
+    for (auto it = expected.constBegin(); it != expected.constEnd(); ++it) {
+        const CubeCell cell = actual.value(it.key());
+        QCOMPARE(cell.income, it->income);
+        QCOMPARE(cell.expense, it->expense);
+        QCOMPARE(cell.count, it->count);
+    }
+}
+
+} // namespace
+
+class TestLedgerSummary : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void compute();
+    void roundTrip();
+    void staleAfterLedgerChange();
+    void rejectsDamagedSidecar();
+
+private:
+    QTemporaryDir m_directory;
+    QString m_ledgerPath;
+};
+
+void TestLedgerSummary::init()
+{
+    QVERIFY(m_directory.isValid());
+    m_ledgerPath = m_directory.filePath("ledger.json");
+    QFile::remove(m_ledgerPath);
+    QFile::remove(LedgerSummary::sidecarPath(m_ledgerPath));
+}
+
+void TestLedgerSummary::compute()
+{
+    TransactionManager manager;
+    fillLedger(&manager);
+    const LedgerSummary summary = summarize(manager);
+
+    QVERIFY(summary.isValid());
+    QCOMPARE(summary.rowCount(), 21);
+    QCOMPARE(summary.balance(), manager.calculateBalance());
+    const LedgerRollup& rollup = summary.rollup(false);
+    QCOMPARE(rollup.total.count, 21);
+    QCOMPARE(rollup.months.keys(), QStringList({QString(), "2024-02", "2024-03"}));
+    QCOMPARE(rollup.months.value(QString()).expense, 3.0);
+    QCOMPARE(rollup.days.value("2024-02-29").count, 1);
+    QCOMPARE(rollup.categories.value("交通").count + rollup.categories.value("餐饮").count, 21);
+}
+
+void TestLedgerSummary::roundTrip()
+{
+    TransactionManager manager;
+    fillLedger(&manager);
+    QVERIFY(manager.saveToFile(m_ledgerPath));
+    const LedgerSummary saved = summarize(manager);
+    QVERIFY(saved.save(m_ledgerPath));
+
+    const LedgerSummary loaded = LedgerSummary::load(m_ledgerPath);
+    QVERIFY(loaded.isValid());
+    QCOMPARE(loaded.rowCount(), saved.rowCount());
+    QCOMPARE(loaded.balance(), saved.balance());
+    QCOMPARE(loaded.transferPairs(), saved.transferPairs());
+    QCOMPARE(loaded.transferred(), saved.transferred());
+    for (bool excludeTransfers : {false, true}) {
+        const LedgerRollup& expected = saved.rollup(excludeTransfers);
+        const LedgerRollup& actual = loaded.rollup(excludeTransfers);
+        QCOMPARE(actual.total.count, expected.total.count);
+        compareCells(actual.months, expected.months);
+        compareCells(actual.days, expected.days);
+        compareCells(actual.categories, expected.categories);
+    }
+}
+
+void TestLedgerSummary::staleAfterLedgerChange()
+{
+    TransactionManager manager;
+    fillLedger(&manager);
+    QVERIFY(manager.saveToFile(m_ledgerPath));
+    QVERIFY(summarize(manager).save(m_ledgerPath));
+    QVERIFY(LedgerSummary::load(m_ledgerPath).isValid());
+
+    manager.addTransaction(Transaction(TransactionType::EXPENSE, 1.0, "我的账户", "商家", "餐饮", "现金"));
+    QVERIFY(manager.saveToFile(m_ledgerPath));
+    QVERIFY(!LedgerSummary::load(m_ledgerPath).isValid());
+
+    QVERIFY(QFile::remove(m_ledgerPath));
+    QVERIFY(!LedgerSummary::load(m_ledgerPath).isValid());
+}
+
+void TestLedgerSummary::rejectsDamagedSidecar()
+{
+    TransactionManager manager;
+    fillLedger(&manager);
+    QVERIFY(manager.saveToFile(m_ledgerPath));
+    QVERIFY(!LedgerSummary::load(m_ledgerPath).isValid()); // no sidecar yet
+    QVERIFY(summarize(manager).save(m_ledgerPath));
+
+    QFile sidecar(LedgerSummary::sidecarPath(m_ledgerPath));
+    QVERIFY(sidecar.resize(sidecar.size() - 4));
+    QVERIFY(!LedgerSummary::load(m_ledgerPath).isValid());
+    QVERIFY(!LedgerSummary().save(m_ledgerPath));
+}
+
+QTEST_GUILESS_MAIN(TestLedgerSummary)
+#include "tst_ledgersummary.moc"
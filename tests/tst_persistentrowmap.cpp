@@ -0,0 +1,208 @@
+#include "persistentrowmap.h"
+#include "transactionmanager.h"
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <algorithm>
+
+namespace {
+
+using IntMap = PersistentRowMap<int>;
+
+QList<quint32> keysOf(const IntMap& map)
+{
+    QList<quint32> keys;
+    map.forEach([&keys](quint32 key, int) {
+        keys.append(key);
+    });
+    return keys;
+}
+
+Transaction expenseAt(const QDateTime& timestamp, double amount)
+{
+    return Transaction(TransactionType::EXPENSE, amount, "我的账户", "便利店", "餐饮", "支付宝", timestamp);
+}
+
+// Resident rows only; a row of a cold month would be missed
+bool holds(const TransactionManager& manager, const Transaction& transaction)
+{
+    const QList<Transaction> rows = manager.getTransactions();
+    return std::any_of(rows.cbegin(), rows.cend(), [&transaction](const Transaction& row) {
+        return row.getUuid() == transaction.getUuid();
+    });
+}
+
+} // namespace
+
+class TestPersistentRowMap : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void insertAndRemoveKeepVersions();
+    void inPlaceEditsSpareSharedVersions();
+    void iteratesInKeyOrder();
+    void mergedPrefersOther();
+    void undoRedo();
+    void coldMonthKeepsHistory();
+};
+
+void TestPersistentRowMap::insertAndRemoveKeepVersions()
+{
+    IntMap empty;
+    IntMap full;
+    for (quint32 key = 0; key < 100; ++key) {
+        full = full.insert(key, int(key) * 2);
+    }
+    const IntMap removed = full.remove(50);
+    const IntMap replaced = removed.insert(10, -1);
+
+    QVERIFY(empty.isEmpty());
+    QCOMPARE(full.size(), 100);
+    QCOMPARE(removed.size(), 99);
+    QCOMPARE(replaced.size(), 99);
+    QVERIFY(full.contains(50));
+    QVERIFY(!removed.contains(50));
+    QCOMPARE(*full.find(10), 20);
+    QCOMPARE(*removed.find(10), 20);
+    QCOMPARE(*replaced.find(10), -1);
+    QCOMPARE(removed.remove(1000).size(), 99);
+}
+
+void TestPersistentRowMap::inPlaceEditsSpareSharedVersions()
+{
+    IntMap original;
+    for (quint32 key = 0; key < 64; ++key) {
+        original.set(key, int(key));
+    }
+    IntMap edited = original;
+    edited.set(3, 300);
+    edited.set(64, 64);
+    edited.erase(7);
+
+    QCOMPARE(original.size(), 64);
+    QCOMPARE(*original.find(3), 3);
+    QVERIFY(!original.contains(64));
+    QVERIFY(original.contains(7));
+    QCOMPARE(edited.size(), 64);
+    QCOMPARE(*edited.find(3), 300);
+    QVERIFY(edited.contains(64));
+    QVERIFY(!edited.contains(7));
+}
+
+void TestPersistentRowMap::iteratesInKeyOrder()
+{
+    const QList<quint32> keys{0xFFFFFFFFu, 1u << 25, 32, 31, 0, 1u << 30};
+    IntMap map;
+    for (quint32 key : keys) {
+        map.set(key, 1);
+    }
+    QList<quint32> sorted = keys;
+    std::sort(sorted.begin(), sorted.end());
+    QCOMPARE(keysOf(map), sorted);
+
+    for (quint32 key : keys) {
+        map.erase(key);
+    }
+    QVERIFY(map.isEmpty());
+    QCOMPARE(map.nodeBlocks(), qint64(0));
+}
+
+void TestPersistentRowMap::mergedPrefersOther()
+{
+    IntMap base;
+    base.set(1, 1);
+    base.set(2, 2);
+    base.set(3, 3);
+    IntMap layer;
+    layer.set(3, 30);
+    layer.set(4, 40);
+    layer.set(1u << 20, 50);
+
+    const IntMap merged = base.merged(layer);
+    QCOMPARE(merged.size(), 5);
+    QCOMPARE(keysOf(merged), QList<quint32>({1, 2, 3, 4, 1u << 20}));
+    QCOMPARE(*merged.find(3), 30);
+    QCOMPARE(*merged.find(1), 1);
+
+    QCOMPARE(base.size(), 3);
+    QCOMPARE(*base.find(3), 3);
+    QCOMPARE(layer.size(), 3);
+    QCOMPARE(IntMap().merged(layer).size(), 3);
+    QCOMPARE(base.merged(IntMap()).size(), 3);
+}
+
+void TestPersistentRowMap::undoRedo()
+{
+    TransactionManager manager;
+    const QDateTime now = QDateTime::currentDateTime();
+    const Transaction first = expenseAt(now, 10.0);
+    const Transaction second = expenseAt(now, 20.0);
+    QVERIFY(manager.addTransaction(first));
+    QVERIFY(manager.addTransaction(second));
+    QVERIFY(manager.deleteTransaction(first.getId()));
+    QCOMPARE(manager.getTransactionCount(), 1);
+
+    QVERIFY(manager.undo());
+    QCOMPARE(manager.getTransactionCount(), 2);
+    QVERIFY(holds(manager, first));
+    QVERIFY(manager.undo());
+    QVERIFY(manager.undo());
+    QCOMPARE(manager.getTransactionCount(), 0);
+    QVERIFY(!manager.canUndo());
+
+    QVERIFY(manager.redo());
+    QVERIFY(manager.redo());
+    QVERIFY(manager.redo());
+    QCOMPARE(manager.getTransactionCount(), 1);
+    QVERIFY(holds(manager, second));
+    QVERIFY(!holds(manager, first));
+    QVERIFY(!manager.canRedo());
+}
+
+// Deleting a row of a month that is still on disk loads that month under the
+// existing history; undoing past the delete must neither drop nor duplicate
+// the month's rows
+void TestPersistentRowMap::coldMonthKeepsHistory()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+
+    const QDateTime old(QDate(2020, 1, 15), QTime(12, 0));
+    const Transaction oldKept = expenseAt(old, 5.0);
+    const Transaction oldDeleted = expenseAt(old.addDays(1), 6.0);
+    {
+        TransactionManager writer;
+        QVERIFY(writer.addTransactions({oldKept, oldDeleted}));
+        QVERIFY(writer.savePartitionedLedger(directory.path()));
+    }
+
+    TransactionManager manager;
+    QVERIFY(manager.openPartitionedLedger(directory.path()));
+    QCOMPARE(manager.getTransactionCount(), 2);
+    QVERIFY(!manager.canUndo());
+
+    const Transaction recent = expenseAt(QDateTime::currentDateTime(), 7.0);
+    QVERIFY(manager.addTransaction(recent));
+    QVERIFY(manager.deleteTransaction(oldDeleted.getId()));
+    QCOMPARE(manager.getTransactionCount(), 2);
+
+    QVERIFY(manager.undo());
+    QCOMPARE(manager.getTransactionCount(), 3);
+    QVERIFY(manager.undo());
+    QVERIFY(!manager.canUndo());
+    QCOMPARE(manager.getTransactionCount(), 2);
+    QVERIFY(holds(manager, oldKept));
+    QVERIFY(holds(manager, oldDeleted));
+    QVERIFY(!holds(manager, recent));
+
+    QVERIFY(manager.redo());
+    QVERIFY(manager.redo());
+    QCOMPARE(manager.getTransactionCount(), 2);
+    QVERIFY(holds(manager, oldKept));
+    QVERIFY(!holds(manager, oldDeleted));
+    QVERIFY(holds(manager, recent));
+}
+
+QTEST_GUILESS_MAIN(TestPersistentRowMap)
+#include "tst_persistentrowmap.moc"
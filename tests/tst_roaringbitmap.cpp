@@ -0,0 +1,148 @@
+#include "roaringbitmap.h"
+#include <QRandomGenerator>
+#include <QSet>
+#include <QTest>
+
+#include <algorithm>
+
+namespace {
+
+RoaringBitmap bitmapOf(const QSet<quint32>& values)
+{
+    RoaringBitmap bitmap;
+    for (quint32 value : values) {
+        bitmap.add(value);
+    }
+    return bitmap;
+}
+
+QList<quint32> sorted(const QSet<quint32>& values)
+{
+    QList<quint32> list = values.values();
+    std::sort(list.begin(), list.end());
+    return list;
+}
+
+// Dense runs that become bitmap containers next to sparse array ones, in
+// some containers only one side has
+QSet<quint32> randomSet(quint32 seed, int dense, int sparse)
+{
+    QRandomGenerator random(seed);
+    QSet<quint32> values;
+    for (int i = 0; i < dense; ++i) {
+        values.insert(random.bounded(3u * 65536u));
+    }
+    for (int i = 0; i < sparse; ++i) {
+        values.insert(random.generate());
+    }
+    return values;
+}
+
+} // namespace
+
+class TestRoaringBitmap : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void addRemoveContains();
+    void containerConversion();
+    void setOperations_data();
+    void setOperations();
+};
+
+void TestRoaringBitmap::addRemoveContains()
+{
+    RoaringBitmap bitmap;
+    QVERIFY(bitmap.isEmpty());
+    for (quint32 value : {0u, 1u, 65535u, 65536u, 0xFFFFFFFFu, 1u}) {
+        bitmap.add(value);
+    }
+    QCOMPARE(bitmap.cardinality(), qint64(5));
+    QVERIFY(bitmap.contains(65536));
+    QVERIFY(!bitmap.contains(2));
+    QCOMPARE(bitmap.toList(), QList<quint32>({0u, 1u, 65535u, 65536u, 0xFFFFFFFFu}));
+
+    const RoaringBitmap copy = bitmap;
+    bitmap.remove(65536);
+    bitmap.remove(12345);
+    QCOMPARE(bitmap.cardinality(), qint64(4));
+    QVERIFY(!bitmap.contains(65536));
+    QVERIFY(copy.contains(65536));
+    QCOMPARE(copy.cardinality(), qint64(5));
+
+    bitmap.clear();
+    QVERIFY(bitmap.isEmpty());
+    QCOMPARE(bitmap.toList(), QList<quint32>());
+}
+
+// Crossing ArrayLimit either way must keep the values and their order
+void TestRoaringBitmap::containerConversion()
+{
+    RoaringBitmap bitmap;
+    for (quint32 value = 0; value <= quint32(RoaringBitmap::ArrayLimit) * 2; value += 2) {
+        bitmap.add(value);
+    }
+    QCOMPARE(bitmap.cardinality(), qint64(RoaringBitmap::ArrayLimit + 1));
+    QVERIFY(bitmap.contains(8192));
+    QVERIFY(!bitmap.contains(8191));
+
+    bitmap.remove(0);
+    bitmap.remove(2);
+    QCOMPARE(bitmap.cardinality(), qint64(RoaringBitmap::ArrayLimit - 1));
+    const QList<quint32> values = bitmap.toList();
+    QCOMPARE(int(values.size()), RoaringBitmap::ArrayLimit - 1);
+    QCOMPARE(values.constFirst(), 4u);
+    QCOMPARE(values.constLast(), 8192u);
+    QVERIFY(std::is_sorted(values.cbegin(), values.cend()));
+}
+
+void TestRoaringBitmap::setOperations_data()
+{
+    QTest::addColumn<quint32>("seed");
+    QTest::addColumn<int>("dense");
+    QTest::addColumn<int>("sparse");
+    QTest::newRow("arrays") << 1u << 300 << 50;
+    QTest::newRow("bitmaps") << 2u << 60000 << 50;
+    QTest::newRow("mixed") << 3u << 20000 << 2000;
+}
+
+void TestRoaringBitmap::setOperations()
+{
+    QFETCH(quint32, seed);
+    QFETCH(int, dense);
+    QFETCH(int, sparse);
+    const QSet<quint32> a = randomSet(seed, dense, sparse);
+    const QSet<quint32> b = randomSet(seed + 100, dense / 2, sparse * 2);
+    const RoaringBitmap left = bitmapOf(a);
+    const RoaringBitmap right = bitmapOf(b);
+
+    const QSet<quint32> both = QSet<quint32>(a).intersect(b);
+    const QSet<quint32> either = QSet<quint32>(a).unite(b);
+    const QSet<quint32> onlyLeft = QSet<quint32>(a).subtract(b);
+
+    QCOMPARE((left & right).toList(), sorted(both));
+    QCOMPARE((left | right).toList(), sorted(either));
+    QCOMPARE((left - right).toList(), sorted(onlyLeft));
+    QCOMPARE((left & right).cardinality(), qint64(both.size()));
+    QCOMPARE((left | right).cardinality(), qint64(either.size()));
+    QCOMPARE((left - right).cardinality(), qint64(onlyLeft.size()));
+
+    RoaringBitmap inPlace = left;
+    inPlace &= right;
+    QVERIFY(inPlace == (left & right));
+    inPlace = left;
+    inPlace |= right;
+    QVERIFY(inPlace == (left | right));
+    inPlace = left;
+    inPlace -= right;
+    QVERIFY(inPlace == (left - right));
+    QCOMPARE(left.toList(), sorted(a));
+
+    QVERIFY((left - left).isEmpty());
+    QVERIFY((left | RoaringBitmap()) == left);
+    QVERIFY((left & RoaringBitmap()).isEmpty());
+}
+
+QTEST_APPLESS_MAIN(TestRoaringBitmap)
+#include "tst_roaringbitmap.moc"
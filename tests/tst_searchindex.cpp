@@ -0,0 +1,201 @@
+#include "searchindex.h"
+#include "transactionmanager.h"
+#include <QTest>
+
+#include <algorithm>
+
+namespace {
+
+Transaction row(const QString& note, const QString& to = "商家")
+{
+    Transaction transaction(TransactionType::EXPENSE, 12.0, "我的账户", to, "餐饮", "支付宝",
+                            QDateTime(QDate(2024, 5, 1), QTime(12, 0)));
+    transaction.setNote(note);
+    return transaction;
+}
+
+// Notes that share a common gram ("午餐") and carry a unique number
+Transaction numbered(int i)
+{
+    return row(QString("午餐 %1号").arg(i));
+}
+
+QList<quint32> sequences(std::initializer_list<quint32> values)
+{
+    return QList<quint32>(values);
+}
+
+} // namespace
+
+class TestSearchIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void candidates();
+    void tombstones();
+    void compaction();
+    void restoreDuringCompaction();
+    void completeAccount();
+    void searchWithinDates();
+};
+
+void TestSearchIndex::candidates()
+{
+    SearchIndex index;
+    index.addTransaction(0, row("公司午餐"));
+    index.addTransaction(1, row("Coffee", "星巴克"));
+    index.addTransaction(2, row("晚餐", "食堂"));
+
+    QCOMPARE(index.candidates("午餐"), sequences({0}));
+    QCOMPARE(index.candidates("餐"), sequences({0, 1, 2})); // the category too
+    QCOMPARE(index.candidates("COFFEE"), sequences({1}));
+    QCOMPARE(index.candidates("星巴克"), sequences({1}));
+    QVERIFY(index.candidates("早餐").isEmpty());
+    QVERIFY(index.candidates("").isEmpty());
+
+    // No bigram spans two fields
+    QVERIFY(index.candidates("餐我").isEmpty());
+    QVERIFY(SearchIndex::matches(row("Coffee"), "cOFF"));
+    QVERIFY(!SearchIndex::matches(row("Coffee"), "tea"));
+}
+
+void TestSearchIndex::tombstones()
+{
+    SearchIndex index;
+    const Transaction first = numbered(1);
+    const Transaction second = numbered(2);
+    index.addTransaction(0, first);
+    index.addTransaction(1, second);
+
+    index.removeTransaction(0, first);
+    QCOMPARE(index.tombstoneCount(), 1);
+    QCOMPARE(index.candidates("午餐"), sequences({1}));
+    QVERIFY(!index.needsCompaction()); // fewer than MinimumTombstones
+
+    // Undo restores the same sequence: the tombstone is lifted and the
+    // postings that survived are used again
+    index.addTransaction(0, first);
+    QCOMPARE(index.tombstoneCount(), 0);
+    QCOMPARE(index.candidates("午餐"), sequences({0, 1}));
+    QCOMPARE(index.candidates("1号"), sequences({0}));
+}
+
+void TestSearchIndex::compaction()
+{
+    SearchIndex index;
+    const int rows = SearchIndex::MinimumTombstones * 4;
+    for (int i = 0; i < rows; ++i) {
+        index.addTransaction(quint32(i), numbered(i));
+    }
+    // Every other row of the first half: enough tombstones on both counts
+    for (int i = 0; i < rows / 2; i += 2) {
+        index.removeTransaction(quint32(i), numbered(i));
+    }
+    QCOMPARE(index.tombstoneCount(), rows / 4);
+    QVERIFY(index.needsCompaction());
+
+    // A bounded number of posting lists per call
+    int calls = 1;
+    while (index.compact(16)) {
+        ++calls;
+    }
+    QVERIFY(calls > 1);
+    QCOMPARE(index.tombstoneCount(), 0);
+    QVERIFY(!index.needsCompaction());
+    QVERIFY(!index.compact(16));
+
+    const QList<quint32> lunch = index.candidates("午餐");
+    QCOMPARE(int(lunch.size()), rows - rows / 4);
+    QVERIFY(!lunch.contains(0u));
+    QVERIFY(lunch.contains(1u));
+    QVERIFY(std::is_sorted(lunch.cbegin(), lunch.cend()));
+
+    // A purged row restored by undo is indexed afresh
+    index.addTransaction(0, numbered(0));
+    QCOMPARE(index.candidates("午餐 0号"), sequences({0}));
+    QCOMPARE(int(index.candidates("午餐").size()), rows - rows / 4 + 1);
+}
+
+void TestSearchIndex::restoreDuringCompaction()
+{
+    SearchIndex index;
+    const int rows = SearchIndex::MinimumTombstones * 2;
+    for (int i = 0; i < rows; ++i) {
+        index.addTransaction(quint32(i), numbered(i));
+    }
+    for (int i = 0; i < rows / 2; ++i) {
+        index.removeTransaction(quint32(i), numbered(i));
+    }
+    QVERIFY(index.needsCompaction());
+    QVERIFY(index.compact(1));
+
+    // Some of its posting lists are already purged, the rest still queued
+    index.addTransaction(7, numbered(7));
+    while (index.compact(8)) {
+    }
+    QCOMPARE(index.candidates("午餐 7号"), sequences({7}));
+    QCOMPARE(int(index.candidates("午餐").size()), rows / 2 + 1);
+    QCOMPARE(index.tombstoneCount(), 0);
+}
+
+void TestSearchIndex::completeAccount()
+{
+    SearchIndex index;
+    const Transaction coffee = row("", "Starbucks");
+    index.addTransaction(0, coffee);
+    index.addTransaction(1, row("", "Starbucks"));
+    index.addTransaction(2, row("", "Stationery"));
+
+    QCOMPARE(index.completeAccount("sta", 10), QStringList({"Starbucks", "Stationery"}));
+    QCOMPARE(index.completeAccount("sta", 1), QStringList({"Starbucks"}));
+
+    // Names stay while any row refers to them
+    index.removeTransaction(0, coffee);
+    QCOMPARE(index.completeAccount("star", 10), QStringList({"Starbucks"}));
+    index.removeTransaction(1, coffee);
+    QVERIFY(index.completeAccount("star", 10).isEmpty());
+}
+
+// Only matches inside the range are returned, edge days to the millisecond
+void TestSearchIndex::searchWithinDates()
+{
+    TransactionManager manager;
+    QList<Transaction> rows;
+    for (int day = 0; day < 10; ++day) {
+        for (int hour : {1, 23}) {
+            Transaction transaction = numbered((day + 1) * 100 + hour);
+            transaction.setTimestamp(QDateTime(QDate(2024, 5, 1 + day), QTime(hour, 0)));
+            rows.append(transaction);
+        }
+    }
+    rows.append(row("午餐 无日期"));
+    rows.last().setTimestampMSecs(Transaction::InvalidTimestamp);
+    QVERIFY(manager.addTransactions(rows));
+
+    auto days = [](const QList<Transaction>& found) {
+        QList<int> result;
+        for (const auto& transaction : found) {
+            const QDateTime timestamp = transaction.getTimestamp();
+            result.append(timestamp.date().day() * 100 + timestamp.time().hour());
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+
+    const QDateTime start(QDate(2024, 5, 3), QTime(12, 0));
+    const QDateTime end(QDate(2024, 5, 5), QTime(12, 0));
+    QCOMPARE(days(manager.search("午餐", start, end)), QList<int>({323, 401, 423, 501}));
+    QCOMPARE(days(manager.search("423号", start, end)), QList<int>({423}));
+    QVERIFY(manager.search("523号", start, end).isEmpty());
+
+    // Without dates the undated row is found too; with either end set it
+    // is not in the range
+    QCOMPARE(int(manager.search("午餐", QDateTime(), QDateTime()).size()), 21);
+    QCOMPARE(int(manager.search("午餐", start, QDateTime()).size()), 15);
+    QCOMPARE(days(manager.search("午餐", QDateTime(), QDateTime(QDate(2024, 5, 1), QTime(2, 0)))),
+             QList<int>({101}));
+}
+
+QTEST_GUILESS_MAIN(TestSearchIndex)
+#include "tst_searchindex.moc"
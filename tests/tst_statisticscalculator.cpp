@@ -0,0 +1,127 @@
+#include "statisticscalculator.h"
+#include "transactionmanager.h"
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <cstring>
+
+namespace {
+
+// Past ParallelThreshold and not a whole number of chunks, in date order
+// across 2024, with amounts of very different sizes so the order of the
+// additions shows in the low bits
+QList<Transaction> manyRows()
+{
+    const int count = StatisticsCalculator::ParallelThreshold + StatisticsCalculator::ChunkRows / 2 + 7;
+    const qint64 start = QDateTime(QDate(2024, 1, 1), QTime(0, 0)).toMSecsSinceEpoch();
+    const qint64 step = qint64(366) * 24 * 3600 * 1000 / count;
+    static const char* const categories[] = {"餐饮", "交通", "住房", "购物", "工资"};
+
+    QList<Transaction> rows;
+    rows.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const double amount = i % 997 == 0 ? 1.0e9 + i : 0.01 * (i % 1000) + 0.1;
+        Transaction transaction(i % 5 == 4 ? TransactionType::INCOME : TransactionType::EXPENSE, amount,
+                                "我的账户", "商家", categories[i % 5], "支付宝");
+        transaction.setTimestampMSecs(start + i * step);
+        rows.append(transaction);
+    }
+    return rows;
+}
+
+bool sameBits(double a, double b)
+{
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+} // namespace
+
+class TestStatisticsCalculator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void threadCountsAgree();
+    void archiveMatchesRows();
+
+private:
+    QList<Transaction> m_rows;
+};
+
+void TestStatisticsCalculator::initTestCase()
+{
+    m_rows = manyRows();
+    QVERIFY(m_rows.size() > StatisticsCalculator::ParallelThreshold);
+}
+
+// Chunks are cut and merged the same way whatever runs them
+void TestStatisticsCalculator::threadCountsAgree()
+{
+    StatisticsCalculator serial;
+    serial.setThreadCount(1);
+    StatisticsCalculator parallel;
+    parallel.setThreadCount(4);
+    QCOMPARE(parallel.threadCount(), 4);
+
+    QVERIFY(sameBits(serial.calculateTotalAmount(m_rows), parallel.calculateTotalAmount(m_rows)));
+
+    const MonthlyStats serialMonth = serial.calculateMonthlyStats(6, 2024, m_rows);
+    const MonthlyStats parallelMonth = parallel.calculateMonthlyStats(6, 2024, m_rows);
+    QVERIFY(serialMonth.totalExpense > 0.0);
+    QVERIFY(sameBits(serialMonth.totalIncome, parallelMonth.totalIncome));
+    QVERIFY(sameBits(serialMonth.totalExpense, parallelMonth.totalExpense));
+
+    const YearlyStats serialYear = serial.calculateYearlyStats(2024, m_rows);
+    const YearlyStats parallelYear = parallel.calculateYearlyStats(2024, m_rows);
+    QVERIFY(sameBits(serialYear.netAmount, parallelYear.netAmount));
+    for (int month = 1; month <= 12; ++month) {
+        QVERIFY2(sameBits(serialYear.monthlyData.value(month).netAmount,
+                          parallelYear.monthlyData.value(month).netAmount),
+                 qPrintable(QString::number(month)));
+    }
+
+    const QMap<QString, double> serialCategories = serial.calculateExpenseByCategory(m_rows);
+    const QMap<QString, double> parallelCategories = parallel.calculateExpenseByCategory(m_rows);
+    QCOMPARE(parallelCategories.keys(), serialCategories.keys());
+    for (auto it = serialCategories.cbegin(); it != serialCategories.cend(); ++it) {
+        QVERIFY2(sameBits(it.value(), parallelCategories.value(it.key())), qPrintable(it.key()));
+    }
+
+    const QDateTime from(QDate(2024, 3, 1), QTime(0, 0));
+    const QDateTime to(QDate(2024, 9, 30), QTime(23, 59));
+    const QMap<QDate, double> serialTrend = serial.calculateDailyTrend(from, to, m_rows);
+    const QMap<QDate, double> parallelTrend = parallel.calculateDailyTrend(from, to, m_rows);
+    QCOMPARE(parallelTrend.keys(), serialTrend.keys());
+    for (auto it = serialTrend.cbegin(); it != serialTrend.cend(); ++it) {
+        QVERIFY2(sameBits(it.value(), parallelTrend.value(it.key())), qPrintable(it.key().toString()));
+    }
+}
+
+// Whole blocks come from their header totals, the edge blocks row by row
+void TestStatisticsCalculator::archiveMatchesRows()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString path = directory.filePath("ledger.mtla");
+    TransactionManager manager;
+    QVERIFY(manager.addTransactions(m_rows));
+    QVERIFY(manager.saveToArchive(path));
+
+    StatisticsCalculator calculator;
+    for (int month : {1, 6, 12}) {
+        bool ok = false;
+        const MonthlyStats fromArchive = calculator.calculateMonthlyStatsFromArchive(month, 2024, path, &ok);
+        QVERIFY(ok);
+        const MonthlyStats fromRows = calculator.calculateMonthlyStats(month, 2024, m_rows);
+        QCOMPARE(fromArchive.totalIncome, fromRows.totalIncome);
+        QCOMPARE(fromArchive.totalExpense, fromRows.totalExpense);
+    }
+
+    bool ok = true;
+    calculator.calculateMonthlyStatsFromArchive(1, 2024, directory.filePath("missing.mtla"), &ok);
+    QVERIFY(!ok);
+}
+
+QTEST_GUILESS_MAIN(TestStatisticsCalculator)
+#include "tst_statisticscalculator.moc"
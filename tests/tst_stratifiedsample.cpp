@@ -0,0 +1,211 @@
+#include "stratifiedsample.h"
+#include "ledgerpartitions.h"
+#include <QSet>
+#include <QTest>
+
+namespace {
+
+const qint64 kDay = 24 * 3600 * 1000;
+const qint64 kStart = QDateTime(QDate(2024, 1, 1), QTime(12, 0)).toMSecsSinceEpoch();
+
+// Row i of month m, worth i + 1
+Transaction row(int month, int i)
+{
+    Transaction transaction(TransactionType::EXPENSE, i + 1, "我的账户", "商家", "餐饮", "支付宝");
+    transaction.setTimestampMSecs(QDateTime::fromMSecsSinceEpoch(kStart).addMonths(month).toMSecsSinceEpoch()
+                                  + (i % 28) * kDay);
+    return transaction;
+}
+
+QString monthOf(int month)
+{
+    return LedgerPartitions::monthKey(row(month, 0).getTimestampMSecs());
+}
+
+double amount(const SampledRow& sampled)
+{
+    return sampled.transaction.getAmount();
+}
+
+// The stored sample agrees with the counts reported for it
+void verifyConsistent(const StratifiedSample& sample)
+{
+    int rows = 0;
+    for (const auto& month : sample.months()) {
+        const QList<SampledRow> sampled = sample.rows(month);
+        QVERIFY(sampled.size() <= sample.population(month));
+        rows += int(sampled.size());
+    }
+    QCOMPARE(sample.sampleSize(), rows);
+}
+
+} // namespace
+
+class TestStratifiedSample : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void smallMonthsAreExact();
+    void reservoirIsBounded();
+    void uniformAfterEdits();
+    void remainder();
+    void copiesAreIndependent();
+};
+
+void TestStratifiedSample::smallMonthsAreExact()
+{
+    StratifiedSample sample(50);
+    double total = 0.0;
+    for (int i = 0; i < 40; ++i) {
+        sample.addTransaction(quint32(i), row(0, i));
+        total += i + 1;
+    }
+    Transaction undated = row(1, 0);
+    undated.setTimestampMSecs(Transaction::InvalidTimestamp);
+    sample.addTransaction(100, undated);
+
+    QCOMPARE(sample.population(), 41);
+    QCOMPARE(sample.sampleSize(), 41);
+    QVERIFY(sample.isComplete(monthOf(0)));
+    QCOMPARE(sample.population(LedgerPartitions::UndatedPartition), 1);
+
+    const SampleEstimate estimate = sample.estimateSum(amount, {monthOf(0)});
+    QVERIFY(estimate.exact);
+    QCOMPARE(estimate.value, total);
+    QCOMPARE(estimate.margin, 0.0);
+    QCOMPARE(sample.estimateSum(amount).value, total + 1.0);
+
+    // Emptied months go
+    sample.removeTransaction(100, undated);
+    QVERIFY(!sample.months().contains(LedgerPartitions::UndatedPartition));
+    QCOMPARE(sample.sampleSize(), 40);
+    verifyConsistent(sample);
+
+    sample.clear();
+    QCOMPARE(sample.population(), 0);
+    QVERIFY(sample.months().isEmpty());
+}
+
+void TestStratifiedSample::reservoirIsBounded()
+{
+    StratifiedSample sample(50);
+    const int count = 2000;
+    double total = 0.0;
+    for (int i = 0; i < count; ++i) {
+        sample.addTransaction(quint32(i), row(0, i));
+        total += i + 1;
+    }
+    QCOMPARE(sample.population(monthOf(0)), count);
+    QCOMPARE(sample.sampleSize(), 50);
+    QVERIFY(!sample.isComplete(monthOf(0)));
+
+    QSet<quint32> seen;
+    for (const auto& sampled : sample.rows(monthOf(0))) {
+        QVERIFY(sampled.sequence < quint32(count));
+        QCOMPARE(sampled.transaction.getAmount(), double(sampled.sequence + 1));
+        seen.insert(sampled.sequence);
+    }
+    QCOMPARE(int(seen.size()), 50);
+
+    // The margin covers 95%; four times it is a safe bound
+    const SampleEstimate estimate = sample.estimateSum(amount);
+    QVERIFY(!estimate.exact);
+    QVERIFY(estimate.margin > 0.0);
+    QVERIFY2(qAbs(estimate.value - total) < 4 * estimate.margin,
+             qPrintable(QString("%1 ± %2 for %3").arg(estimate.value).arg(estimate.margin).arg(total)));
+}
+
+// Over many months, rows that survive a round of deletes and the rows
+// added after them are sampled at the same rate
+void TestStratifiedSample::uniformAfterEdits()
+{
+    const int months = 400;
+    const int rowsPerMonth = 20;
+    const int capacity = 5;
+    StratifiedSample sample(capacity);
+    for (int m = 0; m < months; ++m) {
+        for (int i = 0; i < rowsPerMonth; ++i) {
+            sample.addTransaction(quint32(m * 100 + i), row(m, i));
+        }
+        for (int i = 0; i < rowsPerMonth / 2; ++i) {
+            sample.removeTransaction(quint32(m * 100 + i), row(m, i));
+        }
+        for (int i = rowsPerMonth; i < rowsPerMonth + rowsPerMonth / 2; ++i) {
+            sample.addTransaction(quint32(m * 100 + i), row(m, i));
+        }
+    }
+    QCOMPARE(sample.population(), months * rowsPerMonth);
+    verifyConsistent(sample);
+
+    int survivors = 0;
+    int added = 0;
+    for (const auto& month : sample.months()) {
+        QVERIFY(sample.rows(month).size() <= capacity);
+        for (const auto& sampled : sample.rows(month)) {
+            const int i = int(sampled.sequence % 100);
+            QVERIFY(i >= rowsPerMonth / 2);
+            if (i < rowsPerMonth) {
+                ++survivors;
+            } else {
+                ++added;
+            }
+        }
+    }
+
+    // The adds refill every reservoir, and each group expects
+    // months * 10 * 5 / 20 = 1000 of the sampled rows; allow about five
+    // standard deviations
+    QCOMPARE(survivors + added, months * capacity);
+    const int expected = months * (rowsPerMonth / 2) * capacity / rowsPerMonth;
+    QVERIFY2(qAbs(survivors - added) < expected / 5,
+             qPrintable(QString("%1 survivors, %2 added").arg(survivors).arg(added)));
+}
+
+// Only the unscanned part of each month is estimated
+void TestStratifiedSample::remainder()
+{
+    StratifiedSample sample(50);
+    double total = 0.0;
+    for (int i = 0; i < 1000; ++i) {
+        sample.addTransaction(quint32(i), row(0, i));
+        total += i + 1;
+    }
+    const QStringList months = {monthOf(0)};
+
+    const SampleEstimate none = sample.estimateRemainder(amount, months, {}, {});
+    const SampleEstimate half = sample.estimateRemainder(amount, months, {{monthOf(0), 500}},
+                                                         {{monthOf(0), 500.0 * 501 / 2}});
+    QVERIFY(half.margin < none.margin);
+
+    const SampleEstimate done = sample.estimateRemainder(amount, months, {{monthOf(0), 1000}},
+                                                         {{monthOf(0), total}});
+    QVERIFY(done.exact);
+    QCOMPARE(done.value, total);
+    QCOMPARE(done.margin, 0.0);
+
+    // Months outside the list, or never seen, add nothing
+    QCOMPARE(sample.estimateSum(amount, {monthOf(5)}).value, 0.0);
+}
+
+// Workers keep a copy while the ledger goes on changing
+void TestStratifiedSample::copiesAreIndependent()
+{
+    StratifiedSample sample(10);
+    for (int i = 0; i < 5; ++i) {
+        sample.addTransaction(quint32(i), row(0, i));
+    }
+    const StratifiedSample copy = sample;
+
+    sample.removeTransaction(0, row(0, 0));
+    sample.addTransaction(10, row(1, 0));
+    QCOMPARE(copy.population(), 5);
+    QCOMPARE(copy.sampleSize(), 5);
+    QCOMPARE(copy.months(), QStringList({monthOf(0)}));
+    QCOMPARE(sample.population(), 5);
+    QCOMPARE(sample.population(monthOf(0)), 4);
+    QVERIFY(sample.bytesUsed() > 0);
+}
+
+QTEST_APPLESS_MAIN(TestStratifiedSample)
+#include "tst_stratifiedsample.moc"
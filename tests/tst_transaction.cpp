@@ -0,0 +1,90 @@
+#include "transaction.h"
+#include <QJsonObject>
+#include <QTest>
+
+class TestTransaction : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void parseTags();
+    void normalizeTags();
+    void jsonRoundTrip();
+    void foreignIds();
+};
+
+void TestTransaction::parseTags()
+{
+    QCOMPARE(Transaction::parseTags("出差, 可报销"), QStringList({"出差", "可报销"}));
+    QCOMPARE(Transaction::parseTags(" b;a，c、a (d)（e）\t"), QStringList({"a", "b", "c", "d", "e"}));
+    QCOMPARE(Transaction::parseTags(" ,; "), QStringList());
+}
+
+void TestTransaction::normalizeTags()
+{
+    // Clean lists come back as they are
+    QCOMPARE(Transaction::normalizeTags({"a", "b"}), QStringList({"a", "b"}));
+    QCOMPARE(Transaction::normalizeTags({}), QStringList());
+
+    // Anything else goes through parseTags()
+    QCOMPARE(Transaction::normalizeTags({"b", "a", "a"}), QStringList({"a", "b"}));
+    QCOMPARE(Transaction::normalizeTags({"a b", "c"}), QStringList({"a", "b", "c"}));
+    QCOMPARE(Transaction::normalizeTags({"x（y）"}), QStringList({"x", "y"}));
+    QCOMPARE(Transaction::normalizeTags({"a　b"}), QStringList({"a", "b"}));
+    QCOMPARE(Transaction::normalizeTags({"", "a"}), QStringList({"a"}));
+
+    Transaction transaction;
+    transaction.setTags({"可报销", "出差", "出差"});
+    QCOMPARE(transaction.getTags(), QStringList({"出差", "可报销"}));
+    QVERIFY(transaction.hasTag("出差"));
+}
+
+void TestTransaction::jsonRoundTrip()
+{
+    Transaction transaction(TransactionType::INCOME, 1234.5, "公司", "我的账户", "工资", "银行转账",
+                            QDateTime(QDate(2024, 6, 30), QTime(18, 0, 5)));
+    transaction.setNote("六月\n工资");
+    transaction.setTags({"固定"});
+
+    const Transaction copy = Transaction::fromJson(transaction.toJson());
+    QCOMPARE(copy.getUuid(), transaction.getUuid());
+    QVERIFY(copy.getType() == TransactionType::INCOME);
+    QCOMPARE(copy.getAmount(), 1234.5);
+    QCOMPARE(copy.getFromAccount(), QString("公司"));
+    QCOMPARE(copy.getToAccount(), QString("我的账户"));
+    QCOMPARE(copy.getCategory(), QString("工资"));
+    QCOMPARE(copy.getMethod(), QString("银行转账"));
+    QCOMPARE(copy.getNote(), transaction.getNote());
+    QCOMPARE(copy.getTags(), QStringList({"固定"}));
+    QCOMPARE(copy.getTimestampMSecs(), transaction.getTimestampMSecs());
+
+    QJsonObject undated = transaction.toJson();
+    undated.remove("timestamp");
+    QCOMPARE(Transaction::fromJson(undated).getTimestampMSecs(), Transaction::InvalidTimestamp);
+}
+
+// Rows without a UUID get the same id each time they are read
+void TestTransaction::foreignIds()
+{
+    QJsonObject json = Transaction(TransactionType::EXPENSE, 8.0, "我的账户", "食堂", "餐饮", "现金",
+                                   QDateTime(QDate(2024, 1, 2), QTime(12, 0)))
+                           .toJson();
+    json["id"] = "20240102-0001";
+    const Transaction keyed = Transaction::fromJson(json);
+    QVERIFY(keyed.isValid());
+    QCOMPARE(keyed.getUuid(), Transaction::foreignId("20240102-0001"));
+    QCOMPARE(Transaction::fromJson(json).getUuid(), keyed.getUuid());
+
+    json.remove("id");
+    const Transaction content = Transaction::fromJson(json);
+    QVERIFY(content.isValid());
+    QCOMPARE(Transaction::fromJson(json).getUuid(), content.getUuid());
+    json["amount"] = 9.0;
+    QVERIFY(Transaction::fromJson(json).getUuid() != content.getUuid());
+
+    QVERIFY(Transaction::foreignId("a") != Transaction::foreignId("b"));
+    QVERIFY(!Transaction().isValid());
+}
+
+QTEST_APPLESS_MAIN(TestTransaction)
+#include "tst_transaction.moc"
@@ -0,0 +1,231 @@
+#include "transfermatcher.h"
+#include "transactionmanager.h"
+#include <QTest>
+
+namespace {
+
+const qint64 kHour = 3600 * 1000;
+const qint64 kStart = QDateTime(QDate(2024, 4, 1), QTime(9, 0)).toMSecsSinceEpoch();
+
+Transaction transfer(TransactionType type, qint64 timestamp, double amount = 500.0)
+{
+    Transaction transaction(type, amount, "我的账户", "储蓄卡", "转账", "银行卡");
+    transaction.setTimestampMSecs(timestamp);
+    return transaction;
+}
+
+Transaction expense(qint64 timestamp, double amount = 500.0)
+{
+    return transfer(TransactionType::EXPENSE, timestamp, amount);
+}
+
+Transaction income(qint64 timestamp, double amount = 500.0)
+{
+    return transfer(TransactionType::INCOME, timestamp, amount);
+}
+
+quint32 partner(const TransferMatcher& matcher, quint32 sequence)
+{
+    quint32 other = 0;
+    return matcher.partnerOf(sequence, &other) ? other : 0xffffffffu;
+}
+
+} // namespace
+
+class TestTransferMatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void pairsClosest();
+    void ignoresNonCandidates();
+    void rePairsAfterDeletingOneHalf();
+    void windowEdges_data();
+    void windowEdges();
+    void pairedRowsAreACopy();
+    void undoRedo();
+};
+
+void TestTransferMatcher::pairsClosest()
+{
+    TransferMatcher matcher;
+    matcher.addTransaction(1, expense(kStart));
+    matcher.addTransaction(2, income(kStart + 2 * kHour));
+    QCOMPARE(partner(matcher, 1), 2u);
+
+    // Already paired rows are not taken over by a closer one
+    matcher.addTransaction(3, income(kStart + kHour));
+    QCOMPARE(partner(matcher, 1), 2u);
+    QVERIFY(!matcher.isPaired(3));
+
+    // On a tie the lower sequence wins
+    matcher.addTransaction(10, income(kStart + 10 * kHour));
+    matcher.addTransaction(11, income(kStart + 12 * kHour));
+    matcher.addTransaction(12, expense(kStart + 11 * kHour));
+    QCOMPARE(partner(matcher, 12), 10u);
+    QCOMPARE(matcher.pairCount(), 2);
+
+    const QList<TransferPair> pairs = matcher.pairs();
+    QCOMPARE(int(pairs.size()), 2);
+    for (const auto& pair : pairs) {
+        QCOMPARE(partner(matcher, pair.expense), pair.income);
+        QCOMPARE(partner(matcher, pair.income), pair.expense);
+    }
+}
+
+void TestTransferMatcher::ignoresNonCandidates()
+{
+    TransferMatcher matcher;
+    Transaction undated = expense(kStart);
+    undated.setTimestampMSecs(Transaction::InvalidTimestamp);
+    matcher.addTransaction(1, undated);
+    Transaction sameAccount = expense(kStart);
+    sameAccount.setToAccount("我的账户");
+    matcher.addTransaction(2, sameAccount);
+    matcher.addTransaction(3, income(kStart, 499.99)); // another amount
+    matcher.addTransaction(4, income(kStart));
+    matcher.addTransaction(5, income(kStart));
+    QCOMPARE(matcher.pairCount(), 0);
+
+    matcher.addTransaction(6, expense(kStart));
+    QCOMPARE(partner(matcher, 6), 4u);
+    matcher.removeTransaction(1, undated); // never indexed
+    QCOMPARE(matcher.pairCount(), 1);
+}
+
+// The survivor of a pair goes back to the waiting rows and takes the best
+// one still there
+void TestTransferMatcher::rePairsAfterDeletingOneHalf()
+{
+    TransferMatcher matcher;
+    const Transaction first = expense(kStart);
+    const Transaction second = income(kStart + kHour);
+    const Transaction third = expense(kStart + 3 * kHour);
+    const Transaction fourth = expense(kStart + 2 * kHour);
+    matcher.addTransaction(1, first);
+    matcher.addTransaction(2, second);
+    matcher.addTransaction(3, third);
+    matcher.addTransaction(4, fourth);
+    QCOMPARE(partner(matcher, 2), 1u);
+
+    matcher.removeTransaction(1, first);
+    QCOMPARE(partner(matcher, 2), 4u);
+    QCOMPARE(partner(matcher, 4), 2u);
+    QVERIFY(!matcher.isPaired(3));
+    QCOMPARE(matcher.pairedRows().toList(), QList<quint32>({2u, 4u}));
+
+    // Removing the income leaves both expenses waiting
+    matcher.removeTransaction(2, second);
+    QCOMPARE(matcher.pairCount(), 0);
+    QVERIFY(matcher.pairedRows().isEmpty());
+
+    const Transaction fifth = income(kStart + 3 * kHour);
+    matcher.addTransaction(5, fifth);
+    QCOMPARE(partner(matcher, 5), 3u);
+
+    // A waiting row leaves without touching the pairs
+    matcher.removeTransaction(4, fourth);
+    QCOMPARE(partner(matcher, 5), 3u);
+    matcher.removeTransaction(3, third);
+    QVERIFY(!matcher.isPaired(5));
+    QCOMPARE(matcher.pairCount(), 0);
+
+    matcher.clear();
+    QVERIFY(matcher.pairs().isEmpty());
+}
+
+void TestTransferMatcher::windowEdges_data()
+{
+    QTest::addColumn<qint64>("expenseAt");
+    QTest::addColumn<qint64>("incomeAt");
+    QTest::addColumn<bool>("paired");
+    const qint64 window = TransferMatcher::DefaultWindowMSecs;
+    const qint64 boundary = (kStart / window + 1) * window; // a bucket edge
+    QTest::newRow("same time") << kStart << kStart << true;
+    QTest::newRow("one window") << kStart << kStart + window << true;
+    QTest::newRow("past the window") << kStart << kStart + window + 1 << false;
+    QTest::newRow("income first") << kStart + window << kStart << true;
+    QTest::newRow("across a bucket edge") << boundary - 1 << boundary << true;
+    QTest::newRow("window across a bucket edge") << boundary - 1 << boundary + window - 1 << true;
+    QTest::newRow("past the window across a bucket edge") << boundary - 1 << boundary + window << false;
+    QTest::newRow("before the epoch") << qint64(-10) << window - 10 << true;
+    QTest::newRow("before the epoch, past the window") << qint64(-10) << window - 9 << false;
+}
+
+void TestTransferMatcher::windowEdges()
+{
+    QFETCH(qint64, expenseAt);
+    QFETCH(qint64, incomeAt);
+    QFETCH(bool, paired);
+
+    TransferMatcher matcher;
+    matcher.addTransaction(1, expense(expenseAt));
+    matcher.addTransaction(2, income(incomeAt));
+    QCOMPARE(matcher.isPaired(1), paired);
+    QCOMPARE(matcher.isPaired(2), paired);
+
+    // A new window drops the rows; re-added, they pair under it
+    matcher.setWindow(qAbs(incomeAt - expenseAt));
+    QCOMPARE(matcher.pairCount(), 0);
+    matcher.addTransaction(2, income(incomeAt));
+    matcher.addTransaction(1, expense(expenseAt));
+    QVERIFY(matcher.isPaired(1));
+}
+
+// Workers hold a copy of pairedRows() while the matcher keeps changing
+void TestTransferMatcher::pairedRowsAreACopy()
+{
+    TransferMatcher matcher;
+    const Transaction first = expense(kStart);
+    matcher.addTransaction(1, first);
+    matcher.addTransaction(2, income(kStart));
+    const RoaringBitmap copy = matcher.pairedRows();
+
+    matcher.removeTransaction(1, first);
+    matcher.addTransaction(3, expense(kStart + kHour));
+    QCOMPARE(copy.toList(), QList<quint32>({1u, 2u}));
+    QCOMPARE(matcher.pairedRows().toList(), QList<quint32>({2u, 3u}));
+    QVERIFY(matcher.bytesUsed() > 0);
+}
+
+// Undo and redo swap whole versions; the rows they add and remove are
+// re-matched like any other
+void TestTransferMatcher::undoRedo()
+{
+    TransactionManager manager;
+    const Transaction out = expense(kStart);
+    const Transaction in = income(kStart + kHour);
+    QVERIFY(manager.addTransaction(out));
+    QVERIFY(manager.addTransaction(in));
+    QCOMPARE(manager.getTransferPairCount(), 1);
+    QVERIFY(manager.isPairedTransfer(out.getId()));
+    QVERIFY(manager.isPairedTransfer(in.getId()));
+    QCOMPARE(int(manager.getTransactionsExcludingTransfers().size()), 0);
+
+    QVERIFY(manager.deleteTransaction(out.getId()));
+    QCOMPARE(manager.getTransferPairCount(), 0);
+    QVERIFY(!manager.isPairedTransfer(in.getId()));
+
+    QVERIFY(manager.undo());
+    QCOMPARE(manager.getTransferPairCount(), 1);
+    QVERIFY(manager.isPairedTransfer(out.getId()));
+    QVERIFY(manager.isPairedTransfer(in.getId()));
+
+    QVERIFY(manager.redo());
+    QCOMPARE(manager.getTransferPairCount(), 0);
+    QVERIFY(manager.undo());
+    QVERIFY(manager.undo()); // the income's add
+    QCOMPARE(manager.getTransferPairCount(), 0);
+    QVERIFY(!manager.isPairedTransfer(out.getId()));
+    QVERIFY(manager.transferMatcher().pairedRows().isEmpty());
+
+    QVERIFY(manager.redo());
+    QCOMPARE(manager.getTransferPairCount(), 1);
+    const QList<QPair<Transaction, Transaction>> pairs = manager.getTransferPairs();
+    QCOMPARE(int(pairs.size()), 1);
+    QCOMPARE(pairs.constFirst().first.getUuid(), out.getUuid());
+    QCOMPARE(pairs.constFirst().second.getUuid(), in.getUuid());
+}
+
+QTEST_GUILESS_MAIN(TestTransferMatcher)
+#include "tst_transfermatcher.moc"
@@ -2,73 +2,149 @@
 #include <QUuid>
 #include <QJsonObject>
 #include <QJsonValue>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QRegularExpression>
+
+namespace {
+
+// Namespace of the ids derived by Transaction::foreignId()
+const QUuid kForeignIdNamespace(0x3b0f6c52, 0x8e1d, 0x4a7b, 0x9c2e, 0x51, 0xd4, 0x0a, 0x86, 0xf3, 0x2b, 0x7e, 0x19);
+
+qint64 toStoredTimestamp(const QDateTime& timestamp)
+{
+    return timestamp.isValid() ? timestamp.toMSecsSinceEpoch() : Transaction::InvalidTimestamp;
+}
+
+const QRegularExpression& tagSeparators()
+{
+    static const QRegularExpression separators("[\\s,;，；、()（）]+");
+    return separators;
+}
+
+// The characters tagSeparators() matches, checked without the regex engine
+bool hasTagSeparator(const QString& tag)
+{
+    static const QString punctuation = QStringLiteral(",;，；、()（）");
+    for (const QChar c : tag) {
+        if (c.isSpace() || punctuation.contains(c)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
 
 Transaction::Transaction()
-    : m_id(QUuid::createUuid().toString())
-    , m_type(TransactionType::EXPENSE)
+    : m_timestamp(InvalidTimestamp)
     , m_amount(0.0)
+    , m_type(TransactionType::EXPENSE)
 {
 }
 
 Transaction::Transaction(TransactionType type, double amount, const QString& fromAccount,
                          const QString& toAccount, const QString& category, const QString& method,
                          const QDateTime& timestamp)
-    : m_id(QUuid::createUuid().toString())
-    , m_type(type)
+    : m_id(QUuid::createUuid())
+    , m_timestamp(toStoredTimestamp(timestamp))
     , m_amount(amount)
     , m_fromAccount(fromAccount)
     , m_toAccount(toAccount)
     , m_category(category)
     , m_method(method)
-    , m_timestamp(timestamp)
+    , m_type(type)
 {
 }
 
-QString Transaction::getId() const { return m_id; }
+QString Transaction::getId() const { return m_id.toString(); }
+QUuid Transaction::getUuid() const { return m_id; }
 TransactionType Transaction::getType() const { return m_type; }
 double Transaction::getAmount() const { return m_amount; }
 QString Transaction::getFromAccount() const { return m_fromAccount; }
 QString Transaction::getToAccount() const { return m_toAccount; }
 QString Transaction::getCategory() const { return m_category; }
 QString Transaction::getMethod() const { return m_method; }
-QDateTime Transaction::getTimestamp() const { return m_timestamp; }
+QString Transaction::getNote() const { return m_note; }
+QStringList Transaction::getTags() const { return m_tags; }
+bool Transaction::hasTag(const QString& tag) const { return m_tags.contains(tag); }
+qint64 Transaction::getTimestampMSecs() const { return m_timestamp; }
 
+QDateTime Transaction::getTimestamp() const
+{
+    if (m_timestamp == InvalidTimestamp) {
+        return QDateTime();
+    }
+    return QDateTime::fromMSecsSinceEpoch(m_timestamp);
+}
+
+void Transaction::setId(const QUuid& id) { m_id = id; }
 void Transaction::setType(TransactionType type) { m_type = type; }
 void Transaction::setAmount(double amount) { m_amount = amount; }
 void Transaction::setFromAccount(const QString& fromAccount) { m_fromAccount = fromAccount; }
 void Transaction::setToAccount(const QString& toAccount) { m_toAccount = toAccount; }
 void Transaction::setCategory(const QString& category) { m_category = category; }
 void Transaction::setMethod(const QString& method) { m_method = method; }
-void Transaction::setTimestamp(const QDateTime& timestamp) { m_timestamp = timestamp; }
+void Transaction::setNote(const QString& note) { m_note = note; }
+void Transaction::setTags(const QStringList& tags) { m_tags = normalizeTags(tags); }
+void Transaction::setTimestamp(const QDateTime& timestamp) { m_timestamp = toStoredTimestamp(timestamp); }
+void Transaction::setTimestampMSecs(qint64 msecs) { m_timestamp = msecs; }
 
 QJsonObject Transaction::toJson() const
 {
     QJsonObject json;
-    json["id"] = m_id;
+    json["id"] = getId();
     json["type"] = static_cast<int>(m_type);
     json["amount"] = m_amount;
     json["fromAccount"] = m_fromAccount;
     json["toAccount"] = m_toAccount;
     json["category"] = m_category;
     json["method"] = m_method;
-    json["timestamp"] = m_timestamp.toString(Qt::ISODate);
+    if (!m_note.isEmpty()) {
+        json["note"] = m_note;
+    }
+    if (!m_tags.isEmpty()) {
+        json["tags"] = QJsonArray::fromStringList(m_tags);
+    }
+    json["timestamp"] = getTimestamp().toString(Qt::ISODate);
     return json;
 }
 
 Transaction Transaction::fromJson(const QJsonObject& json)
 {
     Transaction transaction;
-    transaction.m_id = json["id"].toString();
+    const QString id = json["id"].toString();
+    transaction.m_id = QUuid::fromString(id);
+    if (transaction.m_id.isNull()) {
+        // Rows written by other tools may carry no (or a non-UUID) id; one
+        // without any is keyed by its content (QJsonObject keeps keys sorted)
+        transaction.m_id = foreignId(id.isEmpty() ? QJsonDocument(json).toJson(QJsonDocument::Compact)
+                                                  : id.toUtf8());
+    }
     transaction.m_type = static_cast<TransactionType>(json["type"].toInt());
     transaction.m_amount = json["amount"].toDouble();
     transaction.m_fromAccount = json["fromAccount"].toString();
     transaction.m_toAccount = json["toAccount"].toString();
     transaction.m_category = json["category"].toString();
     transaction.m_method = json["method"].toString();
-    transaction.m_timestamp = QDateTime::fromString(json["timestamp"].toString(), Qt::ISODate);
+    transaction.m_note = json["note"].toString();
+    const QJsonArray tags = json["tags"].toArray();
+    if (!tags.isEmpty()) {
+        QStringList values;
+        for (const auto& tag : tags) {
+            values.append(tag.toString());
+        }
+        transaction.setTags(values);
+    }
+    transaction.setTimestamp(QDateTime::fromString(json["timestamp"].toString(), Qt::ISODate));
     return transaction;
 }
 
+bool Transaction::isValid() const
+{
+    return !m_id.isNull();
+}
+
 QString Transaction::getTypeString() const
 {
     return m_type == TransactionType::INCOME ? "收入" : "支出";
@@ -79,3 +155,28 @@ QString Transaction::getDisplayAmount() const
     QString sign = m_type == TransactionType::INCOME ? "+ " : "- ";
     return sign + QString("¥ %1").arg(m_amount, 0, 'f', 2);
 }
+
+QStringList Transaction::parseTags(const QString& text)
+{
+    QStringList tags = text.split(tagSeparators(), Qt::SkipEmptyParts);
+    tags.sort();
+    tags.removeDuplicates();
+    return tags;
+}
+
+QStringList Transaction::normalizeTags(const QStringList& tags)
+{
+    // The common case, rows read back from a file: already sorted and clean.
+    // Checked per character, as this runs for every tag of every loaded row.
+    bool clean = true;
+    for (int i = 0; i < tags.size() && clean; ++i) {
+        clean = !tags.at(i).isEmpty() && (i == 0 || tags.at(i - 1) < tags.at(i))
+                && !hasTagSeparator(tags.at(i));
+    }
+    return clean ? tags : parseTags(tags.join(' '));
+}
+
+QUuid Transaction::foreignId(const QByteArray& key)
+{
+    return QUuid::createUuidV5(kForeignIdNamespace, key);
+}
@@ -2,17 +2,32 @@
 #define TRANSACTION_H
 
 #include <QString>
+#include <QStringList>
 #include <QDateTime>
 #include <QJsonObject>
+#include <QUuid>
 
-enum class TransactionType {
+#include <limits>
+
+enum class TransactionType : quint8 {
     INCOME,
     EXPENSE
 };
 
+// A single ledger row.
+//
+// The layout is kept compact because a ledger may hold millions of rows:
+// the id is stored as a QUuid (16 bytes inline, no heap), the timestamp as
+// milliseconds since the epoch, and the four text fields are plain QStrings
+// that TransactionManager interns through its StringPool so that repeated
+// values (categories, methods, accounts) share one allocation. The optional
+// note is free text and is not interned. Tags are optional too; an untagged
+// row's list holds no allocation.
 class Transaction
 {
 public:
+    // A default-constructed transaction has a null id; it is used as the
+    // "not found" value and as the target of fromJson().
     Transaction();
     Transaction(TransactionType type, double amount, const QString& fromAccount,
                 const QString& toAccount, const QString& category, const QString& method,
@@ -20,40 +35,66 @@ public:
 
     // Getters
     QString getId() const;
+    QUuid getUuid() const;
     TransactionType getType() const;
     double getAmount() const;
     QString getFromAccount() const;
     QString getToAccount() const;
     QString getCategory() const;
     QString getMethod() const;
+    QString getNote() const;
+    QStringList getTags() const; // sorted, without duplicates
+    bool hasTag(const QString& tag) const;
     QDateTime getTimestamp() const;
+    qint64 getTimestampMSecs() const;
 
     // Setters
+    void setId(const QUuid& id);
     void setType(TransactionType type);
     void setAmount(double amount);
     void setFromAccount(const QString& fromAccount);
     void setToAccount(const QString& toAccount);
     void setCategory(const QString& category);
     void setMethod(const QString& method);
+    void setNote(const QString& note);
+    void setTags(const QStringList& tags);
     void setTimestamp(const QDateTime& timestamp);
+    void setTimestampMSecs(qint64 msecs);
 
     // Serialization
     QJsonObject toJson() const;
     static Transaction fromJson(const QJsonObject& json);
 
     // Utility
+    bool isValid() const;
     QString getTypeString() const;
     QString getDisplayAmount() const;
 
+    // Splits text into tags at whitespace, commas, semicolons and
+    // parentheses (which TagIndex expressions reserve), then sorts them and
+    // drops duplicates: "出差, 可报销" -> ["出差", "可报销"]
+    static QStringList parseTags(const QString& text);
+    static QStringList normalizeTags(const QStringList& tags);
+
+    // The id given to a row whose source has no UUID for it: a name-based
+    // (version 5) UUID of the source's own key, so reading the same file
+    // again yields the same ids
+    static QUuid foreignId(const QByteArray& key);
+
+    // Marks a timestamp that could not be parsed.
+    static constexpr qint64 InvalidTimestamp = std::numeric_limits<qint64>::min();
+
 private:
-    QString m_id;
-    TransactionType m_type;
+    QUuid m_id;
+    qint64 m_timestamp;
     double m_amount;
     QString m_fromAccount;
     QString m_toAccount;
     QString m_category;
     QString m_method;
-    QDateTime m_timestamp;
+    QString m_note;
+    QStringList m_tags;
+    TransactionType m_type;
 };
 
 #endif // TRANSACTION_H
@@ -1,44 +1,200 @@
 #include "transactionmanager.h"
+#include "ledgerarchive.h"
 #include <QFile>
+#include <QSaveFile>
+#include <QDir>
 #include <QJsonDocument>
 #include <QJsonArray>
-#include <QDebug>
+#include <QTimer>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
 
 TransactionManager::TransactionManager(QObject* parent)
     : QObject(parent)
+    , m_nextSequence(0)
+    , m_changeVersion(0)
+    , m_savedVersion(0)
+    , m_rowCacheValid(false)
+    , m_residentMonthLimit(24)
+    , m_budgets(new BudgetEngine(this))
+    , m_compactionScheduled(false)
+{
+}
+
+bool TransactionManager::addTransaction(const Transaction& transaction)
 {
+    if (isPartitioned()) {
+        const QString month = LedgerPartitions::monthKey(transaction.getTimestampMSecs());
+        if (!makeResident(month)) {
+            return false;
+        }
+        evictCleanMonths({month});
+    }
+
+    LedgerChange change;
+    change.before = m_rows;
+    change.added.append(appendRow(transaction));
+    change.after = m_rows;
+    commitChange(change);
+
+    emit transactionsChanged();
+    emit transactionAdded(change.added.constFirst().transaction);
+    return true;
 }
 
-void TransactionManager::addTransaction(const Transaction& transaction)
+bool TransactionManager::addTransactions(const QList<Transaction>& transactions)
 {
-    m_transactions.append(transaction);
+    if (transactions.isEmpty()) {
+        return true;
+    }
+
+    if (isPartitioned()) {
+        QSet<QString> months;
+        for (const auto& transaction : transactions) {
+            months.insert(LedgerPartitions::monthKey(transaction.getTimestampMSecs()));
+        }
+        for (const auto& month : std::as_const(months)) {
+            if (!makeResident(month)) {
+                return false;
+            }
+        }
+        evictCleanMonths(months);
+    }
+
+    LedgerChange change;
+    change.before = m_rows;
+    change.added.reserve(transactions.size());
+    m_idIndex.reserve(m_idIndex.size() + transactions.size());
+    for (const auto& transaction : transactions) {
+        change.added.append(appendRow(transaction));
+    }
+    change.after = m_rows;
+    commitChange(change);
+
     emit transactionsChanged();
-    emit transactionAdded(transaction);
+    return true;
+}
+
+QList<Transaction> TransactionManager::filterDuplicates(const QList<Transaction>& transactions,
+                                                       QList<Transaction>* duplicates)
+{
+    QList<Transaction> fresh;
+    fresh.reserve(transactions.size());
+
+    QHash<quint64, int> seen;
+    QHash<QString, FingerprintIndex> coldFingerprints; // cold months read for this batch
+    for (const auto& transaction : transactions) {
+        const quint64 fingerprint = transactionFingerprint(transaction);
+        int stored = m_fingerprints.count(fingerprint);
+
+        if (isPartitioned()) {
+            const QString month = LedgerPartitions::monthKey(transaction.getTimestampMSecs());
+            if (!m_residentMonths.contains(month) && m_partitions.contains(month)
+                && m_partitions.partition(month).fingerprints.mightContain(fingerprint)) {
+                auto cold = coldFingerprints.find(month);
+                if (cold == coldFingerprints.end()) {
+                    cold = coldFingerprints.insert(month, FingerprintIndex());
+                    for (const auto& row : m_partitions.cachedPartition(month)) {
+                        cold->add(transactionFingerprint(row));
+                    }
+                }
+                stored += cold->count(fingerprint);
+            }
+        }
+
+        if (++seen[fingerprint] <= stored) {
+            if (duplicates) {
+                duplicates->append(transaction);
+            }
+        } else {
+            fresh.append(transaction);
+        }
+    }
+    return fresh;
+}
+
+int TransactionManager::addNewTransactions(const QList<Transaction>& transactions,
+                                           QList<Transaction>* duplicates)
+{
+    const QList<Transaction> fresh = filterDuplicates(transactions, duplicates);
+    if (!addTransactions(fresh)) {
+        return -1;
+    }
+    return int(fresh.size());
 }
 
 bool TransactionManager::deleteTransaction(const QString& id)
 {
-    for (int i = 0; i < m_transactions.size(); ++i) {
-        if (m_transactions[i].getId() == id) {
-            m_transactions.removeAt(i);
-            emit transactionsChanged();
-            emit transactionDeleted(id);
-            return true;
+    return deleteTransactions({id}) == 1;
+}
+
+// Each row is found through the id index and erased from the row map in
+// O(log n); the search index only records a tombstone (see SearchIndex)
+int TransactionManager::deleteTransactions(const QStringList& ids)
+{
+    QList<QUuid> uuids;
+    uuids.reserve(ids.size());
+    for (const auto& id : ids) {
+        uuids.append(QUuid::fromString(id));
+    }
+    makeRowsResident(uuids);
+
+    LedgerChange change;
+    change.before = m_rows;
+    QStringList deleted;
+    for (int i = 0; i < uuids.size(); ++i) {
+        auto it = m_idIndex.constFind(uuids.at(i));
+        if (it == m_idIndex.constEnd()) {
+            continue;
         }
+        const StoredRow row{it.value(), *m_rows.find(it.value())};
+        m_rows.erase(row.sequence);
+        unindexRow(row);
+        change.removed.append(row);
+        deleted.append(ids.at(i));
+    }
+    if (change.removed.isEmpty()) {
+        return 0;
+    }
+    change.after = m_rows;
+    commitChange(change);
+    scheduleCompaction();
+
+    emit transactionsChanged();
+    for (const auto& id : std::as_const(deleted)) {
+        emit transactionDeleted(id);
     }
-    return false;
+    return int(deleted.size());
 }
 
 QList<Transaction> TransactionManager::getTransactions() const
 {
-    return m_transactions;
+    if (!m_rowCacheValid) {
+        m_rowCache = snapshot().toList();
+        m_rowCacheValid = true;
+    }
+    return m_rowCache;
 }
 
 Transaction TransactionManager::getTransactionById(const QString& id) const
 {
-    for (const auto& transaction : m_transactions) {
-        if (transaction.getId() == id) {
-            return transaction;
+    const QUuid uuid = QUuid::fromString(id);
+    auto it = m_idIndex.constFind(uuid);
+    if (it != m_idIndex.constEnd()) {
+        return *m_rows.find(it.value());
+    }
+
+    if (isPartitioned()) {
+        QString month = m_partitions.findCachedMonth(uuid);
+        if (!month.isEmpty()) {
+            const QList<Transaction> rows = m_partitions.cachedPartition(month);
+            for (const auto& transaction : rows) {
+                if (transaction.getUuid() == uuid) {
+                    return transaction;
+                }
+            }
         }
     }
     return Transaction();
@@ -47,11 +203,21 @@ Transaction TransactionManager::getTransactionById(const QString& id) const
 QList<Transaction> TransactionManager::filterByDate(const QDateTime& startDate, const QDateTime& endDate) const
 {
     QList<Transaction> result;
-    for (const auto& transaction : m_transactions) {
-        QDateTime timestamp = transaction.getTimestamp();
-        if (timestamp >= startDate && timestamp <= endDate) {
+    const qint64 start = startDate.toMSecsSinceEpoch();
+    const qint64 end = endDate.toMSecsSinceEpoch();
+    auto matches = [start, end](const Transaction& transaction) {
+        qint64 timestamp = transaction.getTimestampMSecs();
+        return timestamp != Transaction::InvalidTimestamp && timestamp >= start && timestamp <= end;
+    };
+
+    m_rows.forEach([&](quint32, const Transaction& transaction) {
+        if (matches(transaction)) {
             result.append(transaction);
         }
+    });
+
+    if (isPartitioned()) {
+        appendColdMatches(m_partitions.monthsBetween(start, end), matches, &result);
     }
     return result;
 }
@@ -59,11 +225,19 @@ QList<Transaction> TransactionManager::filterByDate(const QDateTime& startDate,
 QList<Transaction> TransactionManager::filterByAmount(double minAmount, double maxAmount) const
 {
     QList<Transaction> result;
-    for (const auto& transaction : m_transactions) {
+    auto matches = [minAmount, maxAmount](const Transaction& transaction) {
         double amount = transaction.getAmount();
-        if (amount >= minAmount && amount <= maxAmount) {
+        return amount >= minAmount && amount <= maxAmount;
+    };
+
+    m_rows.forEach([&](quint32, const Transaction& transaction) {
+        if (matches(transaction)) {
             result.append(transaction);
         }
+    });
+
+    if (isPartitioned()) {
+        appendColdMatches(coldMonths(), matches, &result);
     }
     return result;
 }
@@ -71,19 +245,158 @@ QList<Transaction> TransactionManager::filterByAmount(double minAmount, double m
 QList<Transaction> TransactionManager::filterByCategory(const QString& category) const
 {
     QList<Transaction> result;
-    for (const auto& transaction : m_transactions) {
-        if (transaction.getCategory() == category) {
+    auto matches = [&category](const Transaction& transaction) {
+        return transaction.getCategory() == category;
+    };
+
+    m_rows.forEach([&](quint32, const Transaction& transaction) {
+        if (matches(transaction)) {
             result.append(transaction);
         }
+    });
+
+    if (isPartitioned()) {
+        appendColdMatches(coldMonths(), matches, &result);
+    }
+    return result;
+}
+
+QList<Transaction> TransactionManager::search(const QString& query, int limit) const
+{
+    QList<Transaction> result;
+    const QList<quint32> candidates = m_searchIndex.candidates(query);
+    for (auto it = candidates.crbegin(); it != candidates.crend() && (limit < 0 || result.size() < limit); ++it) {
+        const Transaction* transaction = m_rows.find(*it);
+        if (transaction && SearchIndex::matches(*transaction, query)) {
+            result.append(*transaction);
+        }
+    }
+    return result;
+}
+
+QList<Transaction> TransactionManager::search(const QString& query, const QDateTime& startDate,
+                                              const QDateTime& endDate) const
+{
+    QList<Transaction> result;
+    RoaringBitmap inRange = m_tagIndex.allRows();
+    clipToDates(startDate, endDate, &inRange);
+    auto take = [&](quint32 sequence) {
+        const Transaction* transaction = m_rows.find(sequence);
+        if (transaction && SearchIndex::matches(*transaction, query)) {
+            result.append(*transaction);
+        }
+    };
+
+    // Walk the smaller side and probe the other
+    const QList<quint32> candidates = m_searchIndex.candidates(query);
+    if (inRange.cardinality() < candidates.size()) {
+        inRange.forEach([&](quint32 sequence) {
+            if (std::binary_search(candidates.cbegin(), candidates.cend(), sequence)) {
+                take(sequence);
+            }
+        });
+    } else {
+        for (quint32 sequence : candidates) {
+            if (inRange.contains(sequence)) {
+                take(sequence);
+            }
+        }
+    }
+
+    if (isPartitioned()) {
+        const qint64 start = startDate.isValid() ? startDate.toMSecsSinceEpoch() : std::numeric_limits<qint64>::min();
+        const qint64 end = endDate.isValid() ? endDate.toMSecsSinceEpoch() : std::numeric_limits<qint64>::max();
+        appendColdMatches(m_partitions.monthsBetween(start, end), [&](const Transaction& transaction) {
+            const qint64 timestamp = transaction.getTimestampMSecs();
+            return timestamp != Transaction::InvalidTimestamp && timestamp >= start && timestamp <= end
+                    && SearchIndex::matches(transaction, query);
+        }, &result);
     }
     return result;
 }
 
+QStringList TransactionManager::completeAccount(const QString& prefix, int limit) const
+{
+    return m_searchIndex.completeAccount(prefix, limit);
+}
+
+bool TransactionManager::setTransactionTags(const QString& id, const QStringList& tags)
+{
+    if (!getTransactionById(id).isValid()) {
+        return false;
+    }
+    retagRows({id}, [&tags](const QStringList&) {
+        return tags;
+    });
+    return true;
+}
+
+int TransactionManager::tagTransactions(const QStringList& ids, const QStringList& added,
+                                        const QStringList& removed)
+{
+    const QStringList adding = Transaction::normalizeTags(added);
+    const QStringList removing = Transaction::normalizeTags(removed);
+    return retagRows(ids, [&adding, &removing](const QStringList& current) {
+        QStringList tags = current + adding;
+        for (const auto& tag : removing) {
+            tags.removeAll(tag);
+        }
+        return tags;
+    });
+}
+
+QStringList TransactionManager::getTags() const
+{
+    return m_tagIndex.tags();
+}
+
+int TransactionManager::getTagCount(const QString& tag) const
+{
+    return m_tagIndex.rowCount(tag);
+}
+
+QList<Transaction> TransactionManager::filterByTags(const QString& expression, const QDateTime& startDate,
+                                                    const QDateTime& endDate, const QString& category,
+                                                    QString* error) const
+{
+    QList<Transaction> result;
+    RoaringBitmap rows;
+    if (!selectTagged(expression, startDate, endDate, category, &rows, error)) {
+        return result;
+    }
+    result.reserve(rows.cardinality());
+    rows.forEach([this, &result](quint32 sequence) {
+        result.append(*m_rows.find(sequence));
+    });
+    return result;
+}
+
+int TransactionManager::countByTags(const QString& expression, const QDateTime& startDate,
+                                    const QDateTime& endDate, const QString& category, QString* error) const
+{
+    RoaringBitmap rows;
+    if (!selectTagged(expression, startDate, endDate, category, &rows, error)) {
+        return -1;
+    }
+    return int(rows.cardinality());
+}
+
+const TagIndex& TransactionManager::tagIndex() const
+{
+    return m_tagIndex;
+}
+
 double TransactionManager::calculateTotalAmount() const
 {
     double total = 0.0;
-    for (const auto& transaction : m_transactions) {
+    m_rows.forEach([&total](quint32, const Transaction& transaction) {
         total += transaction.getAmount();
+    });
+
+    // Cold partitions are answered from the manifest without loading them
+    for (const auto& month : coldMonths()) {
+        PartitionInfo info = m_partitions.partition(month);
+        total += info.totalIncome + info.totalExpense;
     }
     return total;
 }
@@ -91,36 +404,192 @@ double TransactionManager::calculateTotalAmount() const
 double TransactionManager::calculateBalance() const
 {
     double balance = 0.0;
-    for (const auto& transaction : m_transactions) {
+    m_rows.forEach([&balance](quint32, const Transaction& transaction) {
         if (transaction.getType() == TransactionType::INCOME) {
             balance += transaction.getAmount();
         } else {
             balance -= transaction.getAmount();
         }
+    });
+
+    for (const auto& month : coldMonths()) {
+        PartitionInfo info = m_partitions.partition(month);
+        balance += info.totalIncome - info.totalExpense;
     }
     return balance;
 }
 
-bool TransactionManager::saveToFile(const QString& filename)
+void TransactionManager::calculateTotals(double* income, double* expense, bool excludeTransfers) const
 {
-    QJsonArray jsonArray;
-    for (const auto& transaction : m_transactions) {
-        jsonArray.append(transaction.toJson());
+    *income = 0.0;
+    *expense = 0.0;
+    const bool skipPaired = excludeTransfers && m_transfers.pairCount() > 0;
+    m_rows.forEach([&](quint32 sequence, const Transaction& transaction) {
+        if (skipPaired && m_transfers.isPaired(sequence)) {
+            return;
+        }
+        if (transaction.getType() == TransactionType::INCOME) {
+            *income += transaction.getAmount();
+        } else {
+            *expense += transaction.getAmount();
+        }
+    });
+
+    for (const auto& month : coldMonths()) {
+        PartitionInfo info = m_partitions.partition(month);
+        *income += info.totalIncome;
+        *expense += info.totalExpense;
     }
+}
 
-    QJsonDocument doc(jsonArray);
-    QFile file(filename);
-    if (!file.open(QIODevice::WriteOnly)) {
+int TransactionManager::coldMonthCount() const
+{
+    return int(coldMonths().size());
+}
+
+bool TransactionManager::isPairedTransfer(const QString& id) const
+{
+    auto it = m_idIndex.constFind(QUuid::fromString(id));
+    return it != m_idIndex.constEnd() && m_transfers.isPaired(it.value());
+}
+
+int TransactionManager::getTransferPairCount() const
+{
+    return m_transfers.pairCount();
+}
+
+QList<QPair<Transaction, Transaction>> TransactionManager::getTransferPairs() const
+{
+    QList<QPair<Transaction, Transaction>> result;
+    const QList<TransferPair> pairs = m_transfers.pairs();
+    result.reserve(pairs.size());
+    for (const auto& pair : pairs) {
+        result.append(qMakePair(*m_rows.find(pair.expense), *m_rows.find(pair.income)));
+    }
+    return result;
+}
+
+QList<Transaction> TransactionManager::getTransactionsExcludingTransfers() const
+{
+    if (m_transfers.pairCount() == 0) {
+        return getTransactions();
+    }
+
+    QList<Transaction> rows;
+    rows.reserve(m_rows.size() - 2 * m_transfers.pairCount());
+    m_rows.forEach([this, &rows](quint32 sequence, const Transaction& transaction) {
+        if (!m_transfers.isPaired(sequence)) {
+            rows.append(transaction);
+        }
+    });
+    return rows;
+}
+
+const TransferMatcher& TransactionManager::transferMatcher() const
+{
+    return m_transfers;
+}
+
+AnomalyDetector::Anomaly TransactionManager::anomalyOf(const Transaction& transaction) const
+{
+    auto it = m_idIndex.constFind(transaction.getUuid());
+    if (it == m_idIndex.constEnd() || m_transfers.isPaired(it.value())) {
+        return AnomalyDetector::Anomaly();
+    }
+    return m_anomalies.anomaly(it.value());
+}
+
+int TransactionManager::getAnomalyCount() const
+{
+    int count = 0;
+    const QList<quint32> flagged = m_anomalies.flaggedRows();
+    for (quint32 sequence : flagged) {
+        count += m_transfers.isPaired(sequence) ? 0 : 1;
+    }
+    return count;
+}
+
+QList<Transaction> TransactionManager::getAnomalies() const
+{
+    QList<Transaction> rows;
+    const QList<quint32> flagged = m_anomalies.flaggedRows();
+    for (quint32 sequence : flagged) {
+        if (!m_transfers.isPaired(sequence)) {
+            rows.append(*m_rows.find(sequence));
+        }
+    }
+    return rows;
+}
+
+const StratifiedSample& TransactionManager::statisticsSample() const
+{
+    return m_sample;
+}
+
+QStringList TransactionManager::getAccounts() const
+{
+    return m_accountIndex.accounts();
+}
+
+double TransactionManager::getAccountBalance(const QString& account, const QDateTime& at) const
+{
+    return m_accountIndex.balanceAt(account, at.toMSecsSinceEpoch());
+}
+
+QList<TransactionManager::AccountStatementLine> TransactionManager::getAccountStatement(
+    const QString& account, const QDateTime& startDate, const QDateTime& endDate) const
+{
+    QList<AccountStatementLine> lines;
+    const QList<AccountPosting> postings = m_accountIndex.statement(
+        account, startDate.toMSecsSinceEpoch(), endDate.toMSecsSinceEpoch());
+    lines.reserve(postings.size());
+    for (const auto& posting : postings) {
+        lines.append(AccountStatementLine{*m_rows.find(posting.sequence), posting.amount, posting.balance});
+    }
+    return lines;
+}
+
+bool TransactionManager::saveToFile(const QString& filename)
+{
+    if (!writeLedger(filename, LedgerExporter::Json)) {
         return false;
     }
+    markSaved(m_changeVersion);
+    return true;
+}
 
-    file.write(doc.toJson());
-    file.close();
+bool TransactionManager::saveToArchive(const QString& filename)
+{
+    if (!writeLedger(filename, LedgerExporter::Archive)) {
+        return false;
+    }
+    markSaved(m_changeVersion);
     return true;
 }
 
+bool TransactionManager::exportToCsv(const QString& filename)
+{
+    return writeLedger(filename, LedgerExporter::Csv);
+}
+
 bool TransactionManager::loadFromFile(const QString& filename)
 {
+    if (LedgerArchive::isArchiveFile(filename)) {
+        QList<Transaction> transactions;
+        if (!LedgerArchive::load(filename, &transactions)) {
+            return false;
+        }
+
+        resetStorage();
+        for (const auto& transaction : std::as_const(transactions)) {
+            appendRow(transaction);
+        }
+        markClean();
+
+        emit transactionsChanged();
+        return true;
+    }
+
     QFile file(filename);
     if (!file.open(QIODevice::ReadOnly)) {
         return false;
@@ -134,26 +603,806 @@ bool TransactionManager::loadFromFile(const QString& filename)
         return false;
     }
 
-    m_transactions.clear();
+    resetStorage();
     QJsonArray jsonArray = doc.array();
+    m_idIndex.reserve(jsonArray.size());
+    m_fingerprints.reserve(jsonArray.size());
+    m_transfers.reserve(jsonArray.size());
     for (const auto& value : jsonArray) {
         if (value.isObject()) {
-            Transaction transaction = Transaction::fromJson(value.toObject());
-            m_transactions.append(transaction);
+            appendRow(Transaction::fromJson(value.toObject()));
+        }
+    }
+    markClean();
+
+    emit transactionsChanged();
+    return true;
+}
+
+void TransactionManager::takeLedger(TransactionManager* other)
+{
+    Q_ASSERT(!other->isPartitioned());
+    resetStorage();
+
+    std::swap(m_rows, other->m_rows);
+    std::swap(m_nextSequence, other->m_nextSequence);
+    std::swap(m_idIndex, other->m_idIndex);
+    std::swap(m_accountIndex, other->m_accountIndex);
+    std::swap(m_searchIndex, other->m_searchIndex);
+    std::swap(m_tagIndex, other->m_tagIndex);
+    std::swap(m_fingerprints, other->m_fingerprints);
+    std::swap(m_transfers, other->m_transfers);
+    std::swap(m_sample, other->m_sample);
+    std::swap(m_anomalies, other->m_anomalies);
+    std::swap(m_stringPool, other->m_stringPool);
+    std::swap(m_undoStack, other->m_undoStack);
+    std::swap(m_redoStack, other->m_redoStack);
+    std::swap(m_historyRows, other->m_historyRows);
+    invalidateRowCache();
+    other->invalidateRowCache();
+    rebuildBudgetState();
+    markClean();
+
+    emit historyChanged();
+    emit transactionsChanged();
+}
+
+bool TransactionManager::openPartitionedLedger(const QString& directory)
+{
+    resetStorage();
+    if (!m_partitions.open(directory)) {
+        return false;
+    }
+
+    // Hot set: every month touched by the default 30-day bills range, which
+    // includes the current month
+    QDateTime now = QDateTime::currentDateTime();
+    const QStringList hotMonths = m_partitions.monthsBetween(now.addDays(-30).toMSecsSinceEpoch(),
+                                                             now.toMSecsSinceEpoch());
+    for (const auto& month : hotMonths) {
+        makeResident(month);
+    }
+    if (m_partitions.contains(LedgerPartitions::UndatedPartition)) {
+        makeResident(LedgerPartitions::UndatedPartition);
+    }
+    clearHistory();
+    markClean();
+
+    emit transactionsChanged();
+    return true;
+}
+
+bool TransactionManager::savePartitionedLedger(const QString& directory)
+{
+    if (!isPartitioned() || QDir(directory).absolutePath() != m_partitions.directory()) {
+        // Converting (or relocating) the ledger: every month becomes resident
+        // and is written out, and stale partitions in the target are removed
+        QList<Transaction> rows = allTransactions();
+        resetStorage();
+        if (!m_partitions.open(directory)) {
+            return false;
+        }
+
+        for (const auto& info : m_partitions.partitions()) {
+            m_residentMonths.insert(info.month);
+            m_dirtyMonths.insert(info.month);
+        }
+        for (const auto& transaction : std::as_const(rows)) {
+            QString month = LedgerPartitions::monthKey(transaction.getTimestampMSecs());
+            m_residentMonths.insert(month);
+            m_dirtyMonths.insert(month);
+            appendRow(transaction);
         }
+        emit transactionsChanged();
+    }
+
+    QHash<QString, QList<Transaction>> byMonth;
+    m_rows.forEach([&](quint32, const Transaction& transaction) {
+        QString month = LedgerPartitions::monthKey(transaction.getTimestampMSecs());
+        if (m_dirtyMonths.contains(month)) {
+            byMonth[month].append(transaction);
+        }
+    });
+
+    bool success = true;
+    for (const auto& month : std::as_const(m_dirtyMonths)) {
+        success = m_partitions.writePartition(month, byMonth.value(month)) && success;
+    }
+    if (success) {
+        m_dirtyMonths.clear();
+        markSaved(m_changeVersion);
+    }
+    return m_partitions.saveManifest() && success;
+}
+
+bool TransactionManager::isPartitioned() const
+{
+    return m_partitions.isOpen();
+}
+
+void TransactionManager::setPartitionCacheLimit(int rows)
+{
+    m_partitions.setCacheLimit(rows);
+}
+
+void TransactionManager::setResidentMonthLimit(int months)
+{
+    m_residentMonthLimit = qMax(1, months);
+}
+
+int TransactionManager::residentMonthLimit() const
+{
+    return m_residentMonthLimit;
+}
+
+QString TransactionManager::errorString() const
+{
+    return m_errorString;
+}
+
+bool TransactionManager::canUndo() const
+{
+    return !m_undoStack.isEmpty();
+}
+
+bool TransactionManager::canRedo() const
+{
+    return !m_redoStack.isEmpty();
+}
+
+bool TransactionManager::undo()
+{
+    if (m_undoStack.isEmpty()) {
+        return false;
+    }
+
+    LedgerChange change = m_undoStack.takeLast();
+    m_rows = change.before;
+    for (const auto& row : std::as_const(change.added)) {
+        unindexRow(row);
+    }
+    for (const auto& row : std::as_const(change.removed)) {
+        indexRow(row);
     }
+    m_redoStack.append(change);
+    ++m_changeVersion;
+    invalidateRowCache();
+    scheduleCompaction();
 
+    emit historyChanged();
+    m_budgets->flush();
     emit transactionsChanged();
     return true;
 }
 
-void TransactionManager::clearAll()
+bool TransactionManager::redo()
+{
+    if (m_redoStack.isEmpty()) {
+        return false;
+    }
+
+    LedgerChange change = m_redoStack.takeLast();
+    m_rows = change.after;
+    for (const auto& row : std::as_const(change.removed)) {
+        unindexRow(row);
+    }
+    for (const auto& row : std::as_const(change.added)) {
+        indexRow(row);
+    }
+    m_undoStack.append(change);
+    ++m_changeVersion;
+    invalidateRowCache();
+    scheduleCompaction();
+
+    emit historyChanged();
+    m_budgets->flush();
+    emit transactionsChanged();
+    return true;
+}
+
+void TransactionManager::clearHistory()
+{
+    if (m_undoStack.isEmpty() && m_redoStack.isEmpty()) {
+        return;
+    }
+    m_undoStack.clear();
+    m_redoStack.clear();
+    m_historyRows.clear();
+    emit historyChanged();
+}
+
+LedgerSnapshot TransactionManager::snapshot() const
+{
+    return LedgerSnapshot(m_rows);
+}
+
+quint64 TransactionManager::changeVersion() const
+{
+    return m_changeVersion;
+}
+
+bool TransactionManager::isDirty() const
+{
+    return m_changeVersion != m_savedVersion;
+}
+
+void TransactionManager::markSaved(quint64 version)
+{
+    m_savedVersion = version;
+}
+
+void TransactionManager::setBudgetRules(const QList<BudgetRule>& rules)
+{
+    m_budgets->setRules(rules);
+    rebuildBudgetState();
+}
+
+QList<BudgetRule> TransactionManager::budgetRules() const
+{
+    return m_budgets->rules();
+}
+
+BudgetEngine* TransactionManager::budgetEngine() const
+{
+    return m_budgets;
+}
+
+LedgerMemoryReport TransactionManager::memoryReport() const
+{
+    LedgerMemoryReport report;
+    report.rows = m_rows.size();
+    report.rowBytes = m_rows.bytesUsed();
+    report.rowBlocks = m_rows.nodeBlocks();
+
+    StringCensus strings;
+    m_rows.forEach([&strings](quint32, const Transaction& transaction) {
+        strings.addTransaction(transaction);
+    });
+    report.stringBytes = strings.bytes();
+    report.unsharedStringBytes = strings.unsharedBytes();
+    report.stringFields = strings.fields();
+    report.distinctStrings = strings.distinct();
+    report.stringPoolBytes = m_stringPool.tableBytes();
+    report.internRequests = m_stringPool.requestCount();
+
+    report.idIndexBytes = m_idIndex.capacity() * qint64(sizeof(QUuid) + sizeof(quint32) + 1);
+    report.accountIndexBytes = m_accountIndex.bytesUsed();
+    report.rollupBytes = m_accountIndex.rollupBytes();
+    report.searchIndexBytes = m_searchIndex.bytesUsed();
+    report.fingerprintBytes = m_fingerprints.bytesUsed();
+    report.transferBytes = m_transfers.bytesUsed();
+    report.sampleBytes = m_sample.bytesUsed();
+    report.anomalyBytes = m_anomalies.bytesUsed();
+    report.tagIndexBytes = m_tagIndex.bytesUsed();
+
+    if (m_rowCacheValid) {
+        report.rowCacheBytes = m_rowCache.capacity() * qint64(sizeof(Transaction));
+    }
+    report.partitionCacheBytes = m_partitions.cacheBytes();
+    report.partitionCacheRows = m_partitions.cachedRowCount();
+
+    for (const QList<LedgerChange>* stack : {&m_undoStack, &m_redoStack}) {
+        for (const auto& change : *stack) {
+            report.historyBytes += qint64(sizeof(LedgerChange))
+                    + (change.added.capacity() + change.removed.capacity()) * qint64(sizeof(StoredRow));
+        }
+    }
+    return report;
+}
+
+bool TransactionManager::clearAll()
 {
-    m_transactions.clear();
+    // In partitioned mode every month is brought in first so that the clear
+    // can be undone and the emptied partitions are removed on the next save.
+    // A month that cannot be read would stay on disk and keep counting, so
+    // the clear is refused instead.
+    for (const auto& month : coldMonths()) {
+        if (!makeResident(month)) {
+            return false;
+        }
+    }
+
+    LedgerChange change;
+    change.before = m_rows;
+    m_rows.forEach([&change](quint32 sequence, const Transaction& transaction) {
+        change.removed.append(StoredRow{sequence, transaction});
+    });
+    m_rows = PersistentRowMap<Transaction>();
+    for (const auto& row : std::as_const(change.removed)) {
+        unindexRow(row);
+    }
+    change.after = m_rows;
+    commitChange(change);
+    scheduleCompaction();
+
     emit transactionsChanged();
+    return true;
 }
 
 int TransactionManager::getTransactionCount() const
 {
-    return m_transactions.size();
+    int count = m_rows.size();
+    for (const auto& month : coldMonths()) {
+        count += m_partitions.partition(month).rowCount;
+    }
+    return count;
+}
+
+Transaction TransactionManager::internStrings(const Transaction& transaction)
+{
+    Transaction interned = transaction;
+    interned.setFromAccount(m_stringPool.intern(transaction.getFromAccount()));
+    interned.setToAccount(m_stringPool.intern(transaction.getToAccount()));
+    interned.setCategory(m_stringPool.intern(transaction.getCategory()));
+    interned.setMethod(m_stringPool.intern(transaction.getMethod()));
+    QStringList tags = transaction.getTags();
+    if (!tags.isEmpty()) {
+        for (auto& tag : tags) {
+            tag = m_stringPool.intern(tag);
+        }
+        interned.setTags(tags);
+    }
+    return interned;
+}
+
+TransactionManager::StoredRow TransactionManager::appendRow(const Transaction& transaction)
+{
+    StoredRow row{m_nextSequence++, internStrings(transaction)};
+    // The id index needs unique ids. A row arriving with one the ledger
+    // already holds (an import reusing a bank's ids, a hand-edited file) is
+    // kept under a fresh id rather than replacing the other in the index.
+    if (m_idIndex.contains(row.transaction.getUuid())) {
+        row.transaction.setId(QUuid::createUuid());
+    }
+    m_rows.set(row.sequence, row.transaction);
+    indexRow(row);
+    return row;
+}
+
+void TransactionManager::commitChange(const LedgerChange& change)
+{
+    for (const auto& dropped : std::as_const(m_redoStack)) {
+        countHistoryRows(dropped, -1);
+    }
+    countHistoryRows(change, 1);
+    m_undoStack.append(change);
+    m_redoStack.clear();
+    ++m_changeVersion;
+    invalidateRowCache();
+    emit historyChanged();
+    m_budgets->flush();
+}
+
+// Keeps m_historyRows in step as changes enter and leave the stacks, so
+// eviction can tell which months the history touches without walking it.
+// Undo and redo only move changes between the stacks. Months only matter
+// in partitioned mode, and entering or leaving it clears the history.
+void TransactionManager::countHistoryRows(const LedgerChange& change, int delta)
+{
+    if (!isPartitioned()) {
+        return;
+    }
+    for (const QList<StoredRow>* rows : {&change.added, &change.removed}) {
+        for (const auto& row : *rows) {
+            const QString month = LedgerPartitions::monthKey(row.transaction.getTimestampMSecs());
+            auto it = m_historyRows.find(month);
+            if (it == m_historyRows.end()) {
+                it = m_historyRows.insert(month, 0);
+            }
+            *it += delta;
+            if (*it <= 0) {
+                m_historyRows.erase(it);
+            }
+        }
+    }
+}
+
+// Every row entering or leaving the current version passes through
+// indexRow()/unindexRow(), including undo and redo.
+void TransactionManager::indexRow(const StoredRow& row)
+{
+    m_idIndex.insert(row.transaction.getUuid(), row.sequence);
+    m_accountIndex.addTransaction(row.sequence, row.transaction);
+    m_searchIndex.addTransaction(row.sequence, row.transaction);
+    m_tagIndex.addTransaction(row.sequence, row.transaction);
+    m_fingerprints.add(transactionFingerprint(row.transaction));
+    m_transfers.addTransaction(row.sequence, row.transaction);
+    m_sample.addTransaction(row.sequence, row.transaction);
+    m_anomalies.addTransaction(row.sequence, row.transaction);
+    m_budgets->addTransaction(row.transaction);
+    invalidateRowCache();
+
+    if (isPartitioned()) {
+        QString month = LedgerPartitions::monthKey(row.transaction.getTimestampMSecs());
+        if (m_residentMonths.contains(month)) {
+            m_dirtyMonths.insert(month);
+        }
+    }
+}
+
+void TransactionManager::unindexRow(const StoredRow& row)
+{
+    auto it = m_idIndex.find(row.transaction.getUuid());
+    if (it != m_idIndex.end() && it.value() == row.sequence) {
+        m_idIndex.erase(it);
+    }
+    m_accountIndex.removeTransaction(row.sequence, row.transaction);
+    m_searchIndex.removeTransaction(row.sequence, row.transaction);
+    m_tagIndex.removeTransaction(row.sequence, row.transaction);
+    m_fingerprints.remove(transactionFingerprint(row.transaction));
+    m_transfers.removeTransaction(row.sequence, row.transaction);
+    m_sample.removeTransaction(row.sequence, row.transaction);
+    m_anomalies.removeTransaction(row.sequence, row.transaction);
+    m_budgets->removeTransaction(row.transaction);
+    invalidateRowCache();
+
+    if (isPartitioned()) {
+        QString month = LedgerPartitions::monthKey(row.transaction.getTimestampMSecs());
+        if (m_residentMonths.contains(month)) {
+            m_dirtyMonths.insert(month);
+        }
+    }
+}
+
+void TransactionManager::invalidateRowCache()
+{
+    if (m_rowCacheValid) {
+        m_rowCache.clear();
+        m_rowCacheValid = false;
+    }
+}
+
+void TransactionManager::resetStorage()
+{
+    m_rows = PersistentRowMap<Transaction>();
+    m_nextSequence = 0;
+    m_idIndex.clear();
+    m_accountIndex.clear();
+    m_searchIndex.clear();
+    m_tagIndex.clear();
+    m_fingerprints.clear();
+    m_transfers.clear();
+    m_sample.clear();
+    m_anomalies.clear();
+    m_stringPool.clear();
+    m_partitions.close();
+    m_residentMonths.clear();
+    m_dirtyMonths.clear();
+    m_residentOrder.clear();
+    m_budgets->clearState();
+    invalidateRowCache();
+    clearHistory();
+    markClean();
+}
+
+// Streams the resident rows and then the cold partitions one at a time, so
+// at most one partition is materialized while writing
+bool TransactionManager::writeLedger(const QString& filename, LedgerExporter::Format format)
+{
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    LedgerExporter exporter(&file, format);
+    bool ok = exporter.begin();
+    m_rows.forEach([&ok, &exporter](quint32, const Transaction& transaction) {
+        ok = ok && exporter.write(transaction);
+    });
+    for (const auto& month : coldMonths()) {
+        const QList<Transaction> rows = m_partitions.cachedPartition(month);
+        for (const auto& transaction : rows) {
+            ok = ok && exporter.write(transaction);
+        }
+    }
+    return ok && exporter.finish() && file.commit();
+}
+
+// The in-memory rows match what is on disk
+void TransactionManager::markClean()
+{
+    ++m_changeVersion;
+    markSaved(m_changeVersion);
+    // A freshly loaded ledger is not news
+    m_budgets->discardPending();
+}
+
+// Tombstones are purged a slice at a time from the event loop, so a large
+// compaction never stalls the caller
+void TransactionManager::scheduleCompaction()
+{
+    if (m_compactionScheduled || !m_searchIndex.needsCompaction()) {
+        return;
+    }
+    m_compactionScheduled = true;
+    QTimer::singleShot(0, this, &TransactionManager::compactIndexes);
+}
+
+void TransactionManager::compactIndexes()
+{
+    const int gramsPerSlice = 4096;
+    if (m_searchIndex.compact(gramsPerSlice)) {
+        QTimer::singleShot(0, this, &TransactionManager::compactIndexes);
+        return;
+    }
+    m_compactionScheduled = false;
+    scheduleCompaction();
+}
+
+// Rows listed by a query over cold months live in the partition cache;
+// bring their month in before editing it. Done before the edit, so the
+// month's rows are part of the versions the edit's change records. Rows
+// whose month fails to load stay cold, so the edit skips them.
+bool TransactionManager::makeRowsResident(const QList<QUuid>& ids)
+{
+    if (!isPartitioned()) {
+        return true;
+    }
+    bool ok = true;
+    QSet<QString> months;
+    for (const auto& uuid : ids) {
+        auto it = m_idIndex.constFind(uuid);
+        if (it != m_idIndex.constEnd()) {
+            months.insert(LedgerPartitions::monthKey(m_rows.find(it.value())->getTimestampMSecs()));
+            continue;
+        }
+        QString month = m_partitions.findCachedMonth(uuid);
+        if (!month.isEmpty()) {
+            months.insert(month);
+            ok = makeResident(month) && ok;
+        }
+    }
+    evictCleanMonths(months);
+    return ok;
+}
+
+// Replaces each listed row whose tags retag() changes with a retagged copy
+// under a new sequence number, so every index sees a plain delete and add
+template <typename Retag>
+int TransactionManager::retagRows(const QStringList& ids, Retag retag)
+{
+    QList<QUuid> uuids;
+    uuids.reserve(ids.size());
+    for (const auto& id : ids) {
+        uuids.append(QUuid::fromString(id));
+    }
+    makeRowsResident(uuids);
+
+    LedgerChange change;
+    change.before = m_rows;
+    for (const auto& uuid : std::as_const(uuids)) {
+        auto it = m_idIndex.constFind(uuid);
+        if (it == m_idIndex.constEnd()) {
+            continue;
+        }
+        const StoredRow row{it.value(), *m_rows.find(it.value())};
+        Transaction tagged = row.transaction;
+        tagged.setTags(retag(row.transaction.getTags()));
+        if (tagged.getTags() == row.transaction.getTags()) {
+            continue;
+        }
+        m_rows.erase(row.sequence);
+        unindexRow(row);
+        change.removed.append(row);
+        change.added.append(appendRow(tagged));
+    }
+    if (change.removed.isEmpty()) {
+        return 0;
+    }
+    change.after = m_rows;
+    commitChange(change);
+    scheduleCompaction();
+
+    emit transactionsChanged();
+    return int(change.removed.size());
+}
+
+// Whole days come from the day and month bitmaps; only the rows on the
+// first and last day are checked against the exact times
+bool TransactionManager::selectTagged(const QString& expression, const QDateTime& startDate,
+                                      const QDateTime& endDate, const QString& category,
+                                      RoaringBitmap* rows, QString* error) const
+{
+    if (!m_tagIndex.evaluate(expression, rows, error)) {
+        return false;
+    }
+    if (!category.isEmpty()) {
+        *rows &= m_tagIndex.rowsInCategory(category);
+    }
+    clipToDates(startDate, endDate, rows);
+    return true;
+}
+
+// Keeps the rows dated startDate through endDate; an invalid date leaves
+// that end open. Whole days come from the day and month bitmaps, so only
+// the rows of the two edge days are read.
+void TransactionManager::clipToDates(const QDateTime& startDate, const QDateTime& endDate,
+                                     RoaringBitmap* rows) const
+{
+    if (!startDate.isValid() && !endDate.isValid()) {
+        return;
+    }
+
+    const QDate first = startDate.isValid() ? startDate.toLocalTime().date() : QDate();
+    const QDate last = endDate.isValid() ? endDate.toLocalTime().date() : QDate();
+    *rows &= m_tagIndex.rowsBetween(first, last);
+
+    const qint64 start = startDate.isValid() ? startDate.toMSecsSinceEpoch() : std::numeric_limits<qint64>::min();
+    const qint64 end = endDate.isValid() ? endDate.toMSecsSinceEpoch() : std::numeric_limits<qint64>::max();
+    QList<QDate> edges;
+    if (first.isValid()) {
+        edges.append(first);
+    }
+    if (last.isValid() && last != first) {
+        edges.append(last);
+    }
+    for (const auto& day : std::as_const(edges)) {
+        const RoaringBitmap edge = *rows & m_tagIndex.rowsOn(day);
+        edge.forEach([this, rows, start, end](quint32 sequence) {
+            const qint64 timestamp = m_rows.find(sequence)->getTimestampMSecs();
+            if (timestamp < start || timestamp > end) {
+                rows->remove(sequence);
+            }
+        });
+    }
+}
+
+// Feeds the current rows to the budget engine without raising alerts
+void TransactionManager::rebuildBudgetState()
+{
+    m_budgets->clearState();
+    m_rows.forEach([this](quint32, const Transaction& transaction) {
+        m_budgets->addTransaction(transaction);
+    });
+    m_budgets->discardPending();
+}
+
+// Applies edit to the current version and to every version the history holds
+template <typename Edit>
+void TransactionManager::forEachVersion(Edit edit)
+{
+    edit(m_rows);
+    for (QList<LedgerChange>* stack : {&m_undoStack, &m_redoStack}) {
+        for (auto& change : *stack) {
+            edit(change.before);
+            edit(change.after);
+        }
+    }
+}
+
+bool TransactionManager::makeResident(const QString& month)
+{
+    if (!isPartitioned()) {
+        return true;
+    }
+    if (m_residentMonths.contains(month)) {
+        m_residentOrder.removeOne(month);
+        m_residentOrder.append(month);
+        return true;
+    }
+
+    bool ok = false;
+    const QList<Transaction> rows = m_partitions.loadPartition(month, &ok);
+    if (!ok) {
+        // Leave the month cold so a later save cannot overwrite it
+        m_errorString = QString("无法读取账本分区 %1").arg(month);
+        return false;
+    }
+
+    // The rows are a base layer under the history rather than an edit:
+    // undo and redo swap in whole versions, so every version the stacks hold
+    // gets them too, sharing one copy of the layer
+    PersistentRowMap<Transaction> layer;
+    for (const auto& transaction : rows) {
+        StoredRow row{m_nextSequence++, internStrings(transaction)};
+        layer.set(row.sequence, row.transaction);
+        indexRow(row);
+    }
+    forEachVersion([&layer](PersistentRowMap<Transaction>& version) {
+        version = version.merged(layer);
+    });
+    m_residentMonths.insert(month);
+    m_residentOrder.append(month);
+    m_budgets->discardPending();
+    return true;
+}
+
+// Sends the least recently edited resident months, other than keep, back to
+// their partitions until at most m_residentMonthLimit stay. Only months saved
+// since their last edit go, so nothing is lost; reads fetch them through the
+// partition cache and the next edit loads them again.
+void TransactionManager::evictCleanMonths(const QSet<QString>& keep)
+{
+    if (m_residentMonths.size() <= m_residentMonthLimit) {
+        return;
+    }
+
+    // Months made resident other than through makeResident() (a converted
+    // ledger) count as the least recently edited
+    QStringList candidates;
+    for (const auto& month : std::as_const(m_residentMonths)) {
+        if (!m_residentOrder.contains(month)) {
+            candidates.append(month);
+        }
+    }
+    candidates.sort();
+    candidates.append(m_residentOrder);
+
+    QSet<QString> evicted;
+    for (const auto& month : std::as_const(candidates)) {
+        if (m_residentMonths.size() - evicted.size() <= m_residentMonthLimit) {
+            break;
+        }
+        // A month with rows in the history stays: undoing or redoing would
+        // index them again without their month
+        if (!keep.contains(month) && !m_historyRows.contains(month) && !m_dirtyMonths.contains(month)
+            && m_partitions.contains(month)) {
+            evicted.insert(month);
+        }
+    }
+    if (evicted.isEmpty()) {
+        return;
+    }
+
+    for (const auto& month : std::as_const(evicted)) {
+        m_residentMonths.remove(month);
+        m_residentOrder.removeOne(month);
+    }
+    QList<StoredRow> rows;
+    m_rows.forEach([&](quint32 sequence, const Transaction& transaction) {
+        if (evicted.contains(LedgerPartitions::monthKey(transaction.getTimestampMSecs()))) {
+            rows.append(StoredRow{sequence, transaction});
+        }
+    });
+    // Taken out of every version, as makeResident() put them into every one
+    forEachVersion([&rows](PersistentRowMap<Transaction>& version) {
+        for (const auto& row : std::as_const(rows)) {
+            version.erase(row.sequence);
+        }
+    });
+    for (const auto& row : std::as_const(rows)) {
+        unindexRow(row);
+    }
+    m_budgets->discardPending();
+    scheduleCompaction();
+}
+
+QList<Transaction> TransactionManager::allTransactions() const
+{
+    QList<Transaction> rows = getTransactions();
+    for (const auto& month : coldMonths()) {
+        rows.append(m_partitions.cachedPartition(month));
+    }
+    return rows;
+}
+
+template <typename Predicate>
+void TransactionManager::appendColdMatches(const QStringList& months, Predicate predicate,
+                                           QList<Transaction>* result) const
+{
+    for (const auto& month : months) {
+        if (m_residentMonths.contains(month)) {
+            continue;
+        }
+        const QList<Transaction> rows = m_partitions.cachedPartition(month);
+        for (const auto& transaction : rows) {
+            if (predicate(transaction)) {
+                result->append(transaction);
+            }
+        }
+    }
+}
+
+QStringList TransactionManager::coldMonths() const
+{
+    QStringList months;
+    if (!isPartitioned()) {
+        return months;
+    }
+    for (const auto& info : m_partitions.partitions()) {
+        if (!m_residentMonths.contains(info.month)) {
+            months.append(info.month);
+        }
+    }
+    return months;
 }
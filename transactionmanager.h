@@ -2,10 +2,40 @@
 #define TRANSACTIONMANAGER_H
 
 #include "transaction.h"
+#include "stringpool.h"
+#include "ledgerpartitions.h"
+#include "accountindex.h"
+#include "searchindex.h"
+#include "tagindex.h"
+#include "fingerprintindex.h"
+#include "transfermatcher.h"
+#include "stratifiedsample.h"
+#include "anomalydetector.h"
+#include "ledgersnapshot.h"
+#include "ledgerexporter.h"
+#include "ledgermemoryreport.h"
+#include "budgetengine.h"
+#include "persistentrowmap.h"
 #include <QObject>
 #include <QList>
 #include <QDateTime>
+#include <QHash>
+#include <QPair>
+#include <QSet>
 
+// Owns the ledger rows.
+//
+// Rows live in a PersistentRowMap keyed by an insertion sequence number, so
+// every edit produces a new version in O(log n) while older versions stay
+// intact. Those versions back undo/redo (a version swap) and snapshot().
+//
+// A ledger is either loaded whole (loadFromFile) or opened as a
+// month-partitioned directory (openPartitionedLedger). In partitioned mode
+// only the hot months are resident at startup: getTransactions() returns the
+// resident rows, filters pull the cold months they touch through the
+// partition cache, and totals and counts cover the whole ledger. Months an
+// edit touches become resident; once more than residentMonthLimit() are, the
+// least recently edited clean ones go cold again.
 class TransactionManager : public QObject
 {
     Q_OBJECT
@@ -13,36 +43,242 @@ class TransactionManager : public QObject
 public:
     explicit TransactionManager(QObject* parent = nullptr);
 
-    // Core operations
-    void addTransaction(const Transaction& transaction);
+    // Core operations. A row whose id the ledger already holds is added
+    // under a fresh id. In partitioned mode an add fails, leaving the ledger
+    // unchanged, when the month it falls in cannot be loaded; errorString()
+    // then says which.
+    bool addTransaction(const Transaction& transaction);
+    bool addTransactions(const QList<Transaction>& transactions); // one undo step, one signal
     bool deleteTransaction(const QString& id);
+    int deleteTransactions(const QStringList& ids); // one undo step, one signal; returns the rows deleted
     QList<Transaction> getTransactions() const;
     Transaction getTransactionById(const QString& id) const;
 
+    // Duplicate detection by content (see transactionFingerprint()).
+    // filterDuplicates() returns the rows of transactions the ledger does not
+    // hold yet. A row is a duplicate while the ledger holds at least as many
+    // rows with its content as the batch has passed so far, so re-importing
+    // an overlapping export adds only the new rows and keeps genuinely
+    // repeated ones. Cold partitions are asked through their Bloom filters
+    // and only read when the filter reports a possible match.
+    QList<Transaction> filterDuplicates(const QList<Transaction>& transactions,
+                                        QList<Transaction>* duplicates = nullptr);
+    int addNewTransactions(const QList<Transaction>& transactions,
+                           QList<Transaction>* duplicates = nullptr); // returns the rows added, -1 on failure
+
     // Filtering operations
     QList<Transaction> filterByDate(const QDateTime& startDate, const QDateTime& endDate) const;
     QList<Transaction> filterByAmount(double minAmount, double maxAmount) const;
     QList<Transaction> filterByCategory(const QString& category) const;
 
+    // Indexed substring search over notes, accounts and categories of the
+    // resident rows, newest first. A negative limit returns every match.
+    QList<Transaction> search(const QString& query, int limit = 500) const;
+    // Matches dated startDate through endDate, in no particular order. The
+    // candidates are intersected with the tag index's date bitmaps before any
+    // row is read, so the cost follows the range rather than every match.
+    // Cold months the range touches are read through the partition cache.
+    QList<Transaction> search(const QString& query, const QDateTime& startDate, const QDateTime& endDate) const;
+    QStringList completeAccount(const QString& prefix, int limit = 10) const;
+
+    // Tags, indexed as bitmaps (see TagIndex). filterByTags() and
+    // countByTags() evaluate a tag expression and intersect it with the
+    // optional date range and category without visiting non-matching rows;
+    // rows come back in insertion order. Like search(), they cover the
+    // resident rows. Retagging replaces the rows, one undo step per call.
+    bool setTransactionTags(const QString& id, const QStringList& tags);
+    int tagTransactions(const QStringList& ids, const QStringList& added,
+                        const QStringList& removed = QStringList()); // returns the rows changed
+    QStringList getTags() const;
+    int getTagCount(const QString& tag) const;
+    QList<Transaction> filterByTags(const QString& expression, const QDateTime& startDate = QDateTime(),
+                                    const QDateTime& endDate = QDateTime(), const QString& category = QString(),
+                                    QString* error = nullptr) const;
+    int countByTags(const QString& expression, const QDateTime& startDate = QDateTime(),
+                    const QDateTime& endDate = QDateTime(), const QString& category = QString(),
+                    QString* error = nullptr) const; // -1 when the expression does not parse
+    const TagIndex& tagIndex() const;
+
     // Statistics
     double calculateTotalAmount() const;
     double calculateBalance() const;
 
+    // Income and expense over the whole ledger. Paired transfers can only be
+    // left out of the resident rows; cold months count from their manifest
+    // totals, which include them.
+    void calculateTotals(double* income, double* expense, bool excludeTransfers = false) const;
+    int coldMonthCount() const; // partitions not loaded; 0 for a whole-file ledger
+
+    // Transfers between our own accounts, paired as they are indexed (see
+    // TransferMatcher). A paired expense and income cancel out, so
+    // statistics can leave both halves out instead of counting the money
+    // twice. Covers the resident rows.
+    bool isPairedTransfer(const QString& id) const;
+    int getTransferPairCount() const;
+    QList<QPair<Transaction, Transaction>> getTransferPairs() const; // (expense, income)
+    QList<Transaction> getTransactionsExcludingTransfers() const;
+    const TransferMatcher& transferMatcher() const;
+
+    // Unusual expenses, scored in O(1) as each row is indexed (see
+    // AnomalyDetector), so adding, importing and loading all flag them.
+    // Paired transfers are never reported. Covers the resident rows.
+    AnomalyDetector::Anomaly anomalyOf(const Transaction& transaction) const;
+    int getAnomalyCount() const;
+    QList<Transaction> getAnomalies() const; // in insertion order
+
+    // Per-month random sample of the resident rows, kept current on every
+    // edit; see ProgressiveStatistics
+    const StratifiedSample& statisticsSample() const;
+
+    // Per-account ledger over the resident rows: every transaction moves its
+    // amount out of getFromAccount() and into getToAccount()
+    struct AccountStatementLine {
+        Transaction transaction;
+        double amount;   // signed, from the account's point of view
+        double balance;  // running balance after this line
+    };
+    QStringList getAccounts() const;
+    double getAccountBalance(const QString& account, const QDateTime& at) const;
+    QList<AccountStatementLine> getAccountStatement(const QString& account, const QDateTime& startDate,
+                                                    const QDateTime& endDate) const;
+
     // Data persistence
     bool saveToFile(const QString& filename);
-    bool loadFromFile(const QString& filename);
+    bool saveToArchive(const QString& filename);
+    bool loadFromFile(const QString& filename); // JSON or LedgerArchive, detected by content
+    bool exportToCsv(const QString& filename);
+
+    // Replaces this ledger with other's rows, indexes and history in O(1),
+    // leaving other empty. Lets a whole-file ledger be loaded and indexed on
+    // a worker thread and installed on the GUI thread in one step.
+    void takeLedger(TransactionManager* other);
+
+    // Month-partitioned persistence
+    bool openPartitionedLedger(const QString& directory);
+    bool savePartitionedLedger(const QString& directory);
+    bool isPartitioned() const;
+    void setPartitionCacheLimit(int rows);
+    void setResidentMonthLimit(int months);
+    int residentMonthLimit() const;
+
+    // Why the last failed operation failed
+    QString errorString() const;
+
+    // Undo / redo of addTransaction, deleteTransaction and clearAll.
+    // Loading a ledger starts a new history. A cold month made resident joins
+    // every version in it, so undo and redo never drop or revive its rows.
+    bool canUndo() const;
+    bool canRedo() const;
+    bool undo();
+    bool redo();
+    void clearHistory();
+
+    // Consistent view of the current (resident) rows
+    LedgerSnapshot snapshot() const;
+
+    // Dirty tracking for background persistence. changeVersion() advances on
+    // every edit, undo and redo; markSaved() records the version that reached
+    // disk.
+    quint64 changeVersion() const;
+    bool isDirty() const;
+    void markSaved(quint64 version);
+
+    // Budget rules, evaluated incrementally as rows are added and removed.
+    // The engine emits alerts after edits, undo and redo but not for loads;
+    // in partitioned mode it covers the resident months.
+    void setBudgetRules(const QList<BudgetRule>& rules);
+    QList<BudgetRule> budgetRules() const;
+    BudgetEngine* budgetEngine() const;
+
+    // Estimated memory use by component; walks the resident rows once
+    LedgerMemoryReport memoryReport() const;
 
     // Utility
-    void clearAll();
+    bool clearAll(); // false, with nothing cleared, when a cold month cannot be read
     int getTransactionCount() const;
 
 signals:
     void transactionsChanged();
     void transactionAdded(const Transaction& transaction);
     void transactionDeleted(const QString& id);
+    void historyChanged();
 
 private:
-    QList<Transaction> m_transactions;
+    struct StoredRow {
+        quint32 sequence;
+        Transaction transaction;
+    };
+
+    struct LedgerChange {
+        PersistentRowMap<Transaction> before;
+        PersistentRowMap<Transaction> after;
+        QList<StoredRow> added;
+        QList<StoredRow> removed;
+    };
+
+    Transaction internStrings(const Transaction& transaction);
+    StoredRow appendRow(const Transaction& transaction);
+    void commitChange(const LedgerChange& change);
+    void countHistoryRows(const LedgerChange& change, int delta);
+    void indexRow(const StoredRow& row);
+    void unindexRow(const StoredRow& row);
+    void invalidateRowCache();
+    void resetStorage();
+    void markClean();
+    void rebuildBudgetState();
+    bool makeRowsResident(const QList<QUuid>& ids);
+    template <typename Retag>
+    int retagRows(const QStringList& ids, Retag retag);
+    bool selectTagged(const QString& expression, const QDateTime& startDate, const QDateTime& endDate,
+                      const QString& category, RoaringBitmap* rows, QString* error) const;
+    void clipToDates(const QDateTime& startDate, const QDateTime& endDate, RoaringBitmap* rows) const;
+    void scheduleCompaction();
+    void compactIndexes();
+    bool writeLedger(const QString& filename, LedgerExporter::Format format);
+    bool makeResident(const QString& month);
+    template <typename Edit>
+    void forEachVersion(Edit edit);
+    void evictCleanMonths(const QSet<QString>& keep);
+    QList<Transaction> allTransactions() const;
+    template <typename Predicate>
+    void appendColdMatches(const QStringList& months, Predicate predicate,
+                           QList<Transaction>* result) const;
+    QStringList coldMonths() const;
+
+    PersistentRowMap<Transaction> m_rows;
+    quint32 m_nextSequence;
+    QHash<QUuid, quint32> m_idIndex;
+    AccountIndex m_accountIndex;
+    SearchIndex m_searchIndex;
+    TagIndex m_tagIndex;
+    FingerprintIndex m_fingerprints;
+    TransferMatcher m_transfers;
+    StratifiedSample m_sample;
+    AnomalyDetector m_anomalies;
+    StringPool m_stringPool;
+
+    QList<LedgerChange> m_undoStack;
+    QList<LedgerChange> m_redoStack;
+
+    quint64 m_changeVersion;
+    quint64 m_savedVersion;
+
+    // getTransactions() materializes the current version once per change
+    mutable QList<Transaction> m_rowCache;
+    mutable bool m_rowCacheValid;
+
+    // Partitioned mode; the cache inside m_partitions fills during const reads
+    mutable LedgerPartitions m_partitions;
+    QSet<QString> m_residentMonths;
+    QSet<QString> m_dirtyMonths;
+    QStringList m_residentOrder; // least recently edited first
+    QHash<QString, int> m_historyRows; // rows per month in the undo and redo stacks
+    int m_residentMonthLimit;
+
+    QString m_errorString;
+
+    BudgetEngine* m_budgets;
+    bool m_compactionScheduled;
 };
 
 #endif // TRANSACTIONMANAGER_H
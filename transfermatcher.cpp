@@ -0,0 +1,235 @@
+#include "transfermatcher.h"
+
+#include <utility>
+
+namespace {
+
+quint64 mix(quint64 value)
+{
+    // splitmix64 finalizer
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+// Rounded down, also for timestamps before the epoch
+qint64 floorDivide(qint64 value, qint64 divisor)
+{
+    qint64 quotient = value / divisor;
+    if (value % divisor != 0 && value < 0) {
+        --quotient;
+    }
+    return quotient;
+}
+
+} // namespace
+
+TransferMatcher::TransferMatcher()
+    : m_window(DefaultWindowMSecs)
+{
+}
+
+void TransferMatcher::setWindow(qint64 msecs)
+{
+    m_window = qMax<qint64>(1, msecs);
+    clear();
+}
+
+qint64 TransferMatcher::window() const
+{
+    return m_window;
+}
+
+bool TransferMatcher::isCandidate(const Transaction& transaction)
+{
+    return transaction.getTimestampMSecs() != Transaction::InvalidTimestamp
+            && transaction.getAmount() > 0.0
+            && !transaction.getFromAccount().isEmpty()
+            && !transaction.getToAccount().isEmpty()
+            && transaction.getFromAccount() != transaction.getToAccount();
+}
+
+qint64 TransferMatcher::bucketOf(qint64 timestamp) const
+{
+    return floorDivide(timestamp, m_window);
+}
+
+quint64 TransferMatcher::joinKey(const Entry& entry, qint64 bucket)
+{
+    quint64 key = mix(quint64(entry.cents));
+    key = mix(key ^ qHash(entry.from));
+    key = mix(key ^ (quint64(qHash(entry.to)) << 1));
+    return mix(key ^ quint64(bucket));
+}
+
+void TransferMatcher::addTransaction(quint32 sequence, const Transaction& transaction)
+{
+    if (!isCandidate(transaction)) {
+        return;
+    }
+
+    Entry entry;
+    entry.timestamp = transaction.getTimestampMSecs();
+    entry.cents = qRound64(transaction.getAmount() * 100);
+    entry.from = transaction.getFromAccount();
+    entry.to = transaction.getToAccount();
+    entry.income = transaction.getType() == TransactionType::INCOME;
+    match(sequence, entry);
+}
+
+void TransferMatcher::removeTransaction(quint32 sequence, const Transaction& transaction)
+{
+    auto waiting = m_unpaired.find(sequence);
+    if (waiting != m_unpaired.end()) {
+        unlinkWaiting(sequence, waiting.value());
+        m_unpaired.erase(waiting);
+        return;
+    }
+
+    auto link = m_links.find(sequence);
+    if (link == m_links.end()) {
+        return;
+    }
+    const quint32 partner = link->partner;
+    m_links.erase(link);
+    const Link other = m_links.take(partner);
+    m_paired.remove(sequence);
+    m_paired.remove(partner);
+
+    // The partner was matched on this row's amount and accounts
+    Entry entry;
+    entry.timestamp = other.timestamp;
+    entry.cents = qRound64(transaction.getAmount() * 100);
+    entry.from = transaction.getFromAccount();
+    entry.to = transaction.getToAccount();
+    entry.income = other.income;
+    match(partner, entry);
+}
+
+void TransferMatcher::match(quint32 sequence, const Entry& entry)
+{
+    const int otherSide = entry.income ? 0 : 1;
+    const qint64 bucket = bucketOf(entry.timestamp);
+
+    // The window is one bucket wide, so any row within it sits in this
+    // bucket or a neighbour
+    qint64 bestDistance = 0;
+    auto best = m_unpaired.end();
+    for (qint64 probe = bucket - 1; probe <= bucket + 1; ++probe) {
+        auto waiting = m_waiting[otherSide].constFind(joinKey(entry, probe));
+        if (waiting == m_waiting[otherSide].constEnd()) {
+            continue;
+        }
+        for (quint32 waitingSequence : waiting.value()) {
+            auto candidate = m_unpaired.find(waitingSequence);
+            if (candidate->cents != entry.cents || candidate->from != entry.from || candidate->to != entry.to) {
+                continue;  // a hash collision
+            }
+            const qint64 distance = qAbs(candidate->timestamp - entry.timestamp);
+            if (distance > m_window) {
+                continue;
+            }
+            if (best == m_unpaired.end() || distance < bestDistance
+                || (distance == bestDistance && waitingSequence < best.key())) {
+                bestDistance = distance;
+                best = candidate;
+            }
+        }
+    }
+
+    if (best == m_unpaired.end()) {
+        m_unpaired.insert(sequence, entry);
+        m_waiting[entry.income ? 1 : 0][joinKey(entry, bucket)].append(sequence);
+        return;
+    }
+
+    const quint32 partner = best.key();
+    unlinkWaiting(partner, best.value());
+    m_links.insert(sequence, Link{entry.timestamp, partner, entry.income});
+    m_links.insert(partner, Link{best->timestamp, sequence, best->income});
+    m_unpaired.erase(best);
+    m_paired.add(sequence);
+    m_paired.add(partner);
+}
+
+void TransferMatcher::unlinkWaiting(quint32 sequence, const Entry& entry)
+{
+    QHash<quint64, QList<quint32>>& waiting = m_waiting[entry.income ? 1 : 0];
+    auto it = waiting.find(joinKey(entry, bucketOf(entry.timestamp)));
+    if (it == waiting.end()) {
+        return;
+    }
+    it->removeOne(sequence);
+    if (it->isEmpty()) {
+        waiting.erase(it);
+    }
+}
+
+void TransferMatcher::clear()
+{
+    m_unpaired.clear();
+    m_links.clear();
+    m_waiting[0].clear();
+    m_waiting[1].clear();
+    m_paired.clear();
+}
+
+void TransferMatcher::reserve(int rows)
+{
+    m_unpaired.reserve(rows);
+}
+
+bool TransferMatcher::isPaired(quint32 sequence) const
+{
+    return m_links.contains(sequence);
+}
+
+bool TransferMatcher::partnerOf(quint32 sequence, quint32* partner) const
+{
+    auto it = m_links.constFind(sequence);
+    if (it == m_links.constEnd()) {
+        return false;
+    }
+    *partner = it->partner;
+    return true;
+}
+
+int TransferMatcher::pairCount() const
+{
+    return int(m_links.size() / 2);
+}
+
+QList<TransferPair> TransferMatcher::pairs() const
+{
+    QList<TransferPair> result;
+    result.reserve(pairCount());
+    for (auto it = m_links.cbegin(); it != m_links.cend(); ++it) {
+        if (!it->income) {
+            result.append(TransferPair{it.key(), it->partner});
+        }
+    }
+    return result;
+}
+
+const RoaringBitmap& TransferMatcher::pairedRows() const
+{
+    return m_paired;
+}
+
+qint64 TransferMatcher::bytesUsed() const
+{
+    // The account names are pooled by TransactionManager and counted there
+    qint64 bytes = m_unpaired.capacity() * qint64(sizeof(quint32) + sizeof(Entry) + 1)
+                   + m_links.capacity() * qint64(sizeof(quint32) + sizeof(Link) + 1)
+                   + m_paired.bytesUsed();
+    for (const auto& waiting : m_waiting) {
+        bytes += waiting.capacity() * qint64(sizeof(quint64) + sizeof(QList<quint32>) + 1);
+        for (auto it = waiting.cbegin(); it != waiting.cend(); ++it) {
+            bytes += it->capacity() * qint64(sizeof(quint32));
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,90 @@
+#ifndef TRANSFERMATCHER_H
+#define TRANSFERMATCHER_H
+
+#include "transaction.h"
+#include "roaringbitmap.h"
+#include <QHash>
+#include <QList>
+
+struct TransferPair {
+    quint32 expense;  // sequence numbers in TransactionManager's store
+    quint32 income;
+};
+
+// Pairs the two halves of a transfer between our own accounts.
+//
+// A transfer is recorded as an EXPENSE row and an INCOME row with the same
+// amount and the same from/to accounts, a little apart in time. Rows are
+// hash-joined on (amount in cents, from, to, time bucket) where a bucket is
+// one window wide, so a row only probes its own bucket and the two around it
+// for an unpaired row of the other type. Each insert or delete is O(1)
+// expected; removing one half of a pair re-matches the other half against
+// the rows still waiting.
+//
+// A row pairs with the closest unpaired candidate within the window (the
+// lower sequence on a tie). Pairing is greedy in insertion order, so rows
+// already paired are never taken over by a later, closer one.
+//
+// Only rows still waiting keep their join fields. A paired row keeps a link
+// to its partner and its own timestamp; the partner shares the amount and
+// accounts of the half being removed, so that is enough to re-match it.
+// The paired sequences also live in a RoaringBitmap. pairedRows() copies
+// share its containers, so a worker thread can keep one while edits go on,
+// and the next edit detaches only the container it touches.
+class TransferMatcher
+{
+public:
+    static constexpr qint64 DefaultWindowMSecs = 24 * 3600 * 1000;
+
+    TransferMatcher();
+
+    // Changing the window drops every row; re-add them afterwards
+    void setWindow(qint64 msecs);
+    qint64 window() const;
+
+    // removeTransaction() needs the row as it was added
+    void addTransaction(quint32 sequence, const Transaction& transaction);
+    void removeTransaction(quint32 sequence, const Transaction& transaction);
+    void clear();
+    void reserve(int rows);
+
+    bool isPaired(quint32 sequence) const;
+    bool partnerOf(quint32 sequence, quint32* partner) const;
+    int pairCount() const;
+    QList<TransferPair> pairs() const;
+    const RoaringBitmap& pairedRows() const; // both halves of every pair
+
+    // Estimated heap bytes of the unpaired rows, the links and the buckets
+    qint64 bytesUsed() const;
+
+private:
+    struct Entry {
+        qint64 timestamp;
+        qint64 cents;
+        QString from;
+        QString to;
+        bool income;
+    };
+
+    struct Link {
+        qint64 timestamp;
+        quint32 partner;
+        bool income;
+    };
+
+    static bool isCandidate(const Transaction& transaction);
+    qint64 bucketOf(qint64 timestamp) const;
+    static quint64 joinKey(const Entry& entry, qint64 bucket);
+    void match(quint32 sequence, const Entry& entry);
+    void unlinkWaiting(quint32 sequence, const Entry& entry);
+
+    qint64 m_window;
+    QHash<quint32, Entry> m_unpaired;
+    QHash<quint32, Link> m_links; // paired rows
+    // Unpaired rows by join key, per type: [0] expenses, [1] incomes. Keys
+    // are hashes, so candidates are checked against their entries.
+    QHash<quint64, QList<quint32>> m_waiting[2];
+    RoaringBitmap m_paired;
+};
+
+#endif // TRANSFERMATCHER_H
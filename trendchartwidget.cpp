@@ -0,0 +1,241 @@
+#include "trendchartwidget.h"
+#include <QMouseEvent>
+#include <QPainter>
+#include <QWheelEvent>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+
+const double kMinVisibleDays = 14.0;
+
+struct Column {
+    double min = std::numeric_limits<double>::max();
+    double max = std::numeric_limits<double>::lowest();
+    double sum = 0.0;
+    int days = 0;
+};
+
+const char *levelName(TrendPyramid::Level level)
+{
+    switch (level) {
+    case TrendPyramid::Week:  return "按周";
+    case TrendPyramid::Month: return "按月";
+    default:                  return "按日";
+    }
+}
+
+} // namespace
+
+TrendChartWidget::TrendChartWidget(QWidget *parent)
+    : QWidget(parent)
+    , m_viewFirst(0.0)
+    , m_viewLast(0.0)
+    , m_dragging(false)
+    , m_dragOriginX(0.0)
+    , m_dragViewFirst(0.0)
+{
+    setMinimumHeight(220);
+    setToolTip("滚轮缩放，拖动平移，双击复位");
+}
+
+void TrendChartWidget::setTrend(const QMap<QDate, double> &dailyTrend)
+{
+    const bool hadData = !m_pyramid.isEmpty();
+    if (hadData) {
+        // Usually a refresh after an edit: only the days it changed are redone
+        m_pyramid.update(dailyTrend);
+    } else {
+        m_pyramid = TrendPyramid(dailyTrend);
+    }
+
+    // Keep the user's pan and zoom across data refreshes
+    if (hadData) {
+        clampView();
+    } else {
+        resetView();
+    }
+    update();
+}
+
+void TrendChartWidget::resetView()
+{
+    m_viewFirst = double(m_pyramid.firstDay());
+    m_viewLast = qMax(double(m_pyramid.lastDay()), m_viewFirst + kMinVisibleDays);
+    update();
+}
+
+QRectF TrendChartWidget::plotRect() const
+{
+    return QRectF(rect()).adjusted(70, 24, -12, -28);
+}
+
+double TrendChartWidget::daysPerPixel() const
+{
+    return (m_viewLast - m_viewFirst + 1.0) / qMax(1.0, plotRect().width());
+}
+
+void TrendChartWidget::clampView()
+{
+    const double first = double(m_pyramid.firstDay());
+    const double last = qMax(double(m_pyramid.lastDay()), first + kMinVisibleDays);
+    const double span = qBound(kMinVisibleDays, m_viewLast - m_viewFirst, last - first);
+
+    m_viewFirst = qBound(first, m_viewFirst, last - span);
+    m_viewLast = m_viewFirst + span;
+}
+
+void TrendChartWidget::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::white);
+
+    if (m_pyramid.isEmpty()) {
+        painter.setPen(QColor(127, 140, 141));
+        painter.drawText(rect(), Qt::AlignCenter, "暂无数据");
+        return;
+    }
+
+    const QRectF plot = plotRect();
+    const int width = int(plot.width());
+    if (width <= 0 || plot.height() <= 0) {
+        return;
+    }
+
+    // Fold the visible buckets into pixel columns
+    const double scale = daysPerPixel();
+    const TrendPyramid::Level level = TrendPyramid::levelFor(scale);
+    const std::vector<TrendBucket> &buckets = m_pyramid.buckets(level);
+    std::vector<Column> columns(width);
+
+    for (int i = m_pyramid.firstBucketFrom(level, qint64(std::floor(m_viewFirst)));
+         i < int(buckets.size()) && buckets[i].firstDay <= m_viewLast; ++i) {
+        const TrendBucket &bucket = buckets[i];
+        const double middle = (bucket.firstDay + bucket.lastDay) / 2.0;
+        const int x = qBound(0, int((middle - m_viewFirst) / scale), width - 1);
+        Column &column = columns[x];
+        column.min = qMin(column.min, bucket.min);
+        column.max = qMax(column.max, bucket.max);
+        column.sum += bucket.sum;
+        column.days += bucket.days;
+    }
+
+    // Vertical range over what is visible, always including zero
+    double yMin = 0.0;
+    double yMax = 0.0;
+    for (const Column &column : columns) {
+        if (column.days > 0) {
+            yMin = qMin(yMin, column.min);
+            yMax = qMax(yMax, column.max);
+        }
+    }
+    if (yMax - yMin < 1.0) {
+        yMax += 1.0;
+    }
+    auto yFor = [&](double value) {
+        return plot.bottom() - (value - yMin) / (yMax - yMin) * plot.height();
+    };
+
+    // Grid: zero line and frame
+    painter.setPen(QColor(225, 229, 233));
+    painter.drawRect(plot);
+    painter.setPen(QPen(QColor(194, 199, 203), 1, Qt::DashLine));
+    painter.drawLine(QPointF(plot.left(), yFor(0.0)), QPointF(plot.right(), yFor(0.0)));
+
+    // Daily min/max envelope, one stroke per column
+    painter.setPen(QColor(102, 126, 234, 80));
+    for (int x = 0; x < width; ++x) {
+        const Column &column = columns[x];
+        if (column.days > 0) {
+            const double px = plot.left() + x + 0.5;
+            painter.drawLine(QPointF(px, yFor(column.min)), QPointF(px, yFor(column.max)));
+        }
+    }
+
+    // Mean daily net amount, one vertex per column
+    QPolygonF line;
+    line.reserve(width);
+    for (int x = 0; x < width; ++x) {
+        const Column &column = columns[x];
+        if (column.days > 0) {
+            line << QPointF(plot.left() + x + 0.5, yFor(column.sum / column.days));
+        }
+    }
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(QPen(QColor(102, 126, 234), 1.5));
+    painter.drawPolyline(line);
+    painter.setRenderHint(QPainter::Antialiasing, false);
+
+    // Labels
+    painter.setPen(QColor(51, 51, 51));
+    const QRectF yLabels(0, plot.top() - 8, plot.left() - 6, plot.height() + 16);
+    painter.drawText(yLabels, Qt::AlignRight | Qt::AlignTop, QString::number(yMax, 'f', 0));
+    painter.drawText(yLabels, Qt::AlignRight | Qt::AlignBottom, QString::number(yMin, 'f', 0));
+
+    const QRectF xLabels(plot.left(), plot.bottom() + 4, plot.width(), 20);
+    const QDate first = QDate::fromJulianDay(qint64(std::floor(m_viewFirst)));
+    const QDate last = QDate::fromJulianDay(qint64(std::floor(m_viewLast)));
+    painter.drawText(xLabels, Qt::AlignLeft | Qt::AlignTop, first.toString("yyyy-MM-dd"));
+    painter.drawText(xLabels, Qt::AlignRight | Qt::AlignTop, last.toString("yyyy-MM-dd"));
+
+    painter.setPen(QColor(127, 140, 141));
+    painter.drawText(QRectF(plot.left(), 2, plot.width(), 20), Qt::AlignRight | Qt::AlignVCenter,
+                     QString("每日净额 · %1").arg(levelName(level)));
+}
+
+void TrendChartWidget::wheelEvent(QWheelEvent *event)
+{
+    if (m_pyramid.isEmpty()) {
+        return;
+    }
+
+    // Zoom around the day under the cursor
+    const QRectF plot = plotRect();
+    const double anchor = m_viewFirst + (event->position().x() - plot.left()) * daysPerPixel();
+    const double factor = std::pow(0.8, event->angleDelta().y() / 120.0);
+    m_viewFirst = anchor - (anchor - m_viewFirst) * factor;
+    m_viewLast = anchor + (m_viewLast - anchor) * factor;
+    clampView();
+    update();
+    event->accept();
+}
+
+void TrendChartWidget::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton) {
+        m_dragging = true;
+        m_dragOriginX = event->position().x();
+        m_dragViewFirst = m_viewFirst;
+        setCursor(Qt::ClosedHandCursor);
+    }
+}
+
+void TrendChartWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!m_dragging) {
+        return;
+    }
+    const double span = m_viewLast - m_viewFirst;
+    m_viewFirst = m_dragViewFirst - (event->position().x() - m_dragOriginX) * daysPerPixel();
+    m_viewLast = m_viewFirst + span;
+    clampView();
+    update();
+}
+
+void TrendChartWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton) {
+        m_dragging = false;
+        unsetCursor();
+    }
+}
+
+void TrendChartWidget::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    Q_UNUSED(event);
+    resetView();
+}
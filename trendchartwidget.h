@@ -0,0 +1,47 @@
+#ifndef TRENDCHARTWIDGET_H
+#define TRENDCHARTWIDGET_H
+
+#include "trendpyramid.h"
+#include <QWidget>
+
+// Daily net amount chart with wheel zoom, drag pan and double-click reset.
+//
+// Each frame reads the TrendPyramid level whose buckets are no wider than a
+// pixel column and folds them into per-column min/max/mean, then draws one
+// envelope stroke and one polyline vertex per column. The work per frame is
+// bounded by the widget width however many years of history are loaded.
+class TrendChartWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit TrendChartWidget(QWidget *parent = nullptr);
+
+    void setTrend(const QMap<QDate, double> &dailyTrend);
+    void resetView();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+    QRectF plotRect() const;
+    double daysPerPixel() const;
+    void clampView();
+
+    TrendPyramid m_pyramid;
+
+    // Visible range in Julian days; fractional while zooming
+    double m_viewFirst;
+    double m_viewLast;
+
+    bool m_dragging;
+    double m_dragOriginX;
+    double m_dragViewFirst;
+};
+
+#endif // TRENDCHARTWIDGET_H
@@ -0,0 +1,183 @@
+#include "trendpyramid.h"
+#include <QList>
+#include <QPair>
+
+#include <algorithm>
+
+namespace {
+
+void addDay(std::vector<TrendBucket>* level, qint64 bucketStart, qint64 bucketEnd, double value)
+{
+    if (level->empty() || level->back().firstDay != bucketStart) {
+        level->push_back(TrendBucket{bucketStart, bucketEnd, value, value, value, 1});
+        return;
+    }
+    TrendBucket& bucket = level->back();
+    bucket.sum += value;
+    bucket.min = qMin(bucket.min, value);
+    bucket.max = qMax(bucket.max, value);
+    ++bucket.days;
+}
+
+} // namespace
+
+TrendPyramid::TrendPyramid(const QMap<QDate, double>& dailyTrend)
+{
+    m_levels[Day].reserve(dailyTrend.size());
+
+    // QMap iterates in date order, so every level is built by appending
+    for (auto it = dailyTrend.constBegin(); it != dailyTrend.constEnd(); ++it) {
+        const QDate date = it.key();
+        const qint64 day = date.toJulianDay();
+        const double value = it.value();
+
+        m_levels[Day].push_back(TrendBucket{day, day, value, value, value, 1});
+
+        const qint64 weekStart = day - (date.dayOfWeek() - 1);
+        addDay(&m_levels[Week], weekStart, weekStart + 6, value);
+
+        const QDate monthStart(date.year(), date.month(), 1);
+        addDay(&m_levels[Month], monthStart.toJulianDay(),
+               monthStart.toJulianDay() + monthStart.daysInMonth() - 1, value);
+    }
+}
+
+void TrendPyramid::update(const QMap<QDate, double>& dailyTrend)
+{
+    // Both sides are sorted by day, so one merge pass finds the differences
+    const std::vector<TrendBucket>& days = m_levels[Day];
+    QList<QDate> removed;
+    QList<QPair<QDate, double>> changed;
+    size_t i = 0;
+    auto it = dailyTrend.constBegin();
+    while (i < days.size() || it != dailyTrend.constEnd()) {
+        const qint64 day = it != dailyTrend.constEnd() ? it.key().toJulianDay() : 0;
+        if (it == dailyTrend.constEnd() || (i < days.size() && days[i].firstDay < day)) {
+            removed.append(QDate::fromJulianDay(days[i].firstDay));
+            ++i;
+        } else if (i == days.size() || day < days[i].firstDay) {
+            changed.append(qMakePair(it.key(), it.value()));
+            ++it;
+        } else {
+            if (days[i].sum != it.value()) {
+                changed.append(qMakePair(it.key(), it.value()));
+            }
+            ++i;
+            ++it;
+        }
+    }
+
+    // Each change may shift the levels, so past a few a rebuild is cheaper
+    if ((removed.size() + changed.size()) * 8 > qsizetype(days.size())) {
+        *this = TrendPyramid(dailyTrend);
+        return;
+    }
+    for (const auto& date : std::as_const(removed)) {
+        removeDay(date);
+    }
+    for (const auto& change : std::as_const(changed)) {
+        setDay(change.first, change.second);
+    }
+}
+
+void TrendPyramid::setDay(const QDate& date, double value)
+{
+    const qint64 day = date.toJulianDay();
+    std::vector<TrendBucket>& days = m_levels[Day];
+    auto it = days.begin() + firstBucketFrom(Day, day);
+    const TrendBucket leaf{day, day, value, value, value, 1};
+    if (it != days.end() && it->firstDay == day) {
+        *it = leaf;
+    } else {
+        days.insert(it, leaf);
+    }
+    refreshAncestors(date);
+}
+
+void TrendPyramid::removeDay(const QDate& date)
+{
+    const qint64 day = date.toJulianDay();
+    std::vector<TrendBucket>& days = m_levels[Day];
+    auto it = days.begin() + firstBucketFrom(Day, day);
+    if (it == days.end() || it->firstDay != day) {
+        return;
+    }
+    days.erase(it);
+    refreshAncestors(date);
+}
+
+void TrendPyramid::refreshAncestors(const QDate& date)
+{
+    const qint64 day = date.toJulianDay();
+    const qint64 weekStart = day - (date.dayOfWeek() - 1);
+    refreshBucket(Week, weekStart, weekStart + 6);
+
+    const QDate monthStart(date.year(), date.month(), 1);
+    refreshBucket(Month, monthStart.toJulianDay(), monthStart.toJulianDay() + monthStart.daysInMonth() - 1);
+}
+
+// Folds the days in [first, last] again into the level's bucket for that
+// span, adding or dropping the bucket as the days require
+void TrendPyramid::refreshBucket(Level level, qint64 first, qint64 last)
+{
+    const std::vector<TrendBucket>& days = m_levels[Day];
+    std::vector<TrendBucket> folded;
+    for (size_t i = firstBucketFrom(Day, first); i < days.size() && days[i].firstDay <= last; ++i) {
+        addDay(&folded, first, last, days[i].sum);
+    }
+
+    std::vector<TrendBucket>& buckets = m_levels[level];
+    auto it = buckets.begin() + firstBucketFrom(level, first);
+    const bool present = it != buckets.end() && it->firstDay == first;
+    if (folded.empty()) {
+        if (present) {
+            buckets.erase(it);
+        }
+    } else if (present) {
+        *it = folded.front();
+    } else {
+        buckets.insert(it, folded.front());
+    }
+}
+
+bool TrendPyramid::isEmpty() const
+{
+    return m_levels[Day].empty();
+}
+
+qint64 TrendPyramid::firstDay() const
+{
+    return isEmpty() ? 0 : m_levels[Day].front().firstDay;
+}
+
+qint64 TrendPyramid::lastDay() const
+{
+    return isEmpty() ? 0 : m_levels[Day].back().lastDay;
+}
+
+const std::vector<TrendBucket>& TrendPyramid::buckets(Level level) const
+{
+    return m_levels[level];
+}
+
+int TrendPyramid::firstBucketFrom(Level level, qint64 day) const
+{
+    const std::vector<TrendBucket>& buckets = m_levels[level];
+    auto it = std::lower_bound(buckets.begin(), buckets.end(), day,
+                               [](const TrendBucket& bucket, qint64 value) {
+                                   return bucket.lastDay < value;
+                               });
+    return int(it - buckets.begin());
+}
+
+// Coarsest level whose nominal bucket width still fits in one pixel column
+TrendPyramid::Level TrendPyramid::levelFor(double daysPerPixel)
+{
+    if (daysPerPixel >= 31.0) {
+        return Month;
+    }
+    if (daysPerPixel >= 7.0) {
+        return Week;
+    }
+    return Day;
+}
@@ -0,0 +1,66 @@
+#ifndef TRENDPYRAMID_H
+#define TRENDPYRAMID_H
+
+#include <QDate>
+#include <QMap>
+
+#include <vector>
+
+// Aggregated span of a daily trend. Values are daily net amounts, so a
+// bucket's min/max is the range of its days and sum / days their mean.
+struct TrendBucket {
+    qint64 firstDay;    // Julian day of the first day covered
+    qint64 lastDay;     // Julian day of the last day covered
+    double sum;
+    double min;
+    double max;
+    int days;           // days with data
+};
+
+// Multi-resolution view of StatisticsCalculator::calculateDailyTrend().
+//
+// Holds the daily values plus per-week (Monday based) and per-month
+// buckets, each level sorted by day. A chart picks the coarsest level whose
+// buckets are no wider than one pixel column, so the number of buckets it
+// touches per frame depends on its width, not on the length of history.
+//
+// A refresh after an edit changes a few days: update() and setDay() redo
+// only those days' leaves and the week and month buckets above them.
+class TrendPyramid
+{
+public:
+    enum Level {
+        Day,
+        Week,
+        Month,
+        LevelCount
+    };
+
+    TrendPyramid() = default;
+    explicit TrendPyramid(const QMap<QDate, double>& dailyTrend);
+
+    // Brings the pyramid to dailyTrend, touching only the days that differ
+    // (or rebuilding, when most of them do)
+    void update(const QMap<QDate, double>& dailyTrend);
+    void setDay(const QDate& date, double value);
+    void removeDay(const QDate& date);
+
+    bool isEmpty() const;
+    qint64 firstDay() const;
+    qint64 lastDay() const;
+
+    const std::vector<TrendBucket>& buckets(Level level) const;
+
+    // Index of the first bucket at level that ends on or after day
+    int firstBucketFrom(Level level, qint64 day) const;
+
+    static Level levelFor(double daysPerPixel);
+
+private:
+    void refreshAncestors(const QDate& date);
+    void refreshBucket(Level level, qint64 first, qint64 last);
+
+    std::vector<TrendBucket> m_levels[LevelCount];
+};
+
+#endif // TRENDPYRAMID_H